@@ -0,0 +1,9 @@
+#!/bin/bash
+
+# Full cmake rebuild of the native Linux host target (pico_dash_host). No Pico SDK or cross compiler required.
+
+cd ./build/host
+
+rm -rf *
+
+cmake -DPICO_DASH_HOST=ON -DCMAKE_BUILD_TYPE=RelWithDebInfo ../../src/
@@ -0,0 +1,44 @@
+#ifndef HARDWARE_ADC_H
+#define HARDWARE_ADC_H
+
+// Host (Linux) stand-in for hardware/adc.h.
+// The ADC converts at the rate set by its clock divider against the virtual clock, round robin over the selected inputs.
+// Input levels come from hostAdcSetInput. Samples go through a 4 deep FIFO which DMA can drain with DREQ_ADC.
+
+#include "pico.h"
+
+#define NUM_ADC_CHANNELS 5
+
+/** Stand in ADC register block. Only the address of fifo is used, as a DMA read address. */
+typedef struct
+{
+	volatile uint32_t fifo;
+} adc_hw_t;
+
+extern adc_hw_t _hostAdcHw;
+
+#define adc_hw (&_hostAdcHw)
+
+void adc_init();
+
+static inline void adc_gpio_init(uint gpio)
+{
+	(void)gpio;
+}
+
+static inline void adc_set_temp_sensor_enabled(bool enable)
+{
+	(void)enable;
+}
+
+void adc_select_input(uint input);
+void adc_set_round_robin(uint input_mask);
+
+/** Only the FIFO enable and DREQ enable are modelled. Samples are always 12 bit with no error flag. */
+void adc_fifo_setup(bool en, bool dreq_en, uint16_t dreq_thresh, bool err_in_fifo, bool byte_shift);
+
+void adc_set_clkdiv(float clkdiv);
+void adc_run(bool run);
+void adc_fifo_drain();
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef HARDWARE_DMA_H
+#define HARDWARE_DMA_H
+
+// Host (Linux) stand-in for hardware/dma.h.
+// Channels paced by the spi0 DREQs move bytes between memory and the shim's spi0 FIFO model as the master shifts data.
+// Channels paced by DREQ_ADC move 16 bit samples out of the shim's ADC FIFO as the virtual clock advances.
+// Completion triggers any chained channel and raises DMA_IRQ_0/DMA_IRQ_1, if enabled for the channel, on whichever core
+// set the IRQ's handler. As on the real thing the transfer count reloads each time a channel is triggered.
+
+#include "pico.h"
+#include "hardware/irq.h"
+#include "hardware/regs/dreq.h"
+
+#define NUM_DMA_CHANNELS 12
+
+enum dma_channel_transfer_size
+{
+	DMA_SIZE_8 = 0,
+	DMA_SIZE_16 = 1,
+	DMA_SIZE_32 = 2
+};
+
+typedef struct
+{
+	enum dma_channel_transfer_size size;
+	bool readIncrement;
+	bool writeIncrement;
+	uint dreq;
+
+	/** Channel to trigger on completion. The channel itself for none. */
+	uint chainTo;
+} dma_channel_config;
+
+int dma_claim_unused_channel(bool required);
+void dma_channel_unclaim(uint channel);
+
+dma_channel_config dma_channel_get_default_config(uint channel);
+
+static inline void channel_config_set_transfer_data_size(dma_channel_config* config, enum dma_channel_transfer_size size)
+{
+	config -> size = size;
+}
+
+static inline void channel_config_set_read_increment(dma_channel_config* config, bool incr)
+{
+	config -> readIncrement = incr;
+}
+
+static inline void channel_config_set_write_increment(dma_channel_config* config, bool incr)
+{
+	config -> writeIncrement = incr;
+}
+
+static inline void channel_config_set_dreq(dma_channel_config* config, uint dreq)
+{
+	config -> dreq = dreq;
+}
+
+static inline void channel_config_set_chain_to(dma_channel_config* config, uint chain_to)
+{
+	config -> chainTo = chain_to;
+}
+
+void dma_channel_configure(uint channel, const dma_channel_config* config, volatile void* write_addr,
+	const volatile void* read_addr, uint transfer_count, bool trigger);
+
+void dma_channel_set_read_addr(uint channel, const volatile void* read_addr, bool trigger);
+void dma_channel_set_write_addr(uint channel, volatile void* write_addr, bool trigger);
+void dma_channel_set_trans_count(uint channel, uint32_t trans_count, bool trigger);
+void dma_channel_start(uint channel);
+void dma_channel_abort(uint channel);
+bool dma_channel_is_busy(uint channel);
+
+void dma_channel_set_irq0_enabled(uint channel, bool enabled);
+bool dma_channel_get_irq0_status(uint channel);
+void dma_channel_acknowledge_irq0(uint channel);
+
+void dma_channel_set_irq1_enabled(uint channel, bool enabled);
+bool dma_channel_get_irq1_status(uint channel);
+void dma_channel_acknowledge_irq1(uint channel);
+
+#endif
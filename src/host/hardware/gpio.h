@@ -0,0 +1,57 @@
+#ifndef HARDWARE_GPIO_H
+#define HARDWARE_GPIO_H
+
+// Host (Linux) stand-in for hardware/gpio.h.
+// Pin levels are held in memory. The host simulation drives input pins via hostGpioDrive (see pico_dash_host_shim.h),
+// which delivers edge interrupts to the registered callback.
+
+#include "pico.h"
+#include "hardware/irq.h"
+
+#define NUM_BANK0_GPIOS 30
+
+#define GPIO_IN false
+#define GPIO_OUT true
+
+enum gpio_function
+{
+	GPIO_FUNC_XIP = 0,
+	GPIO_FUNC_SPI = 1,
+	GPIO_FUNC_UART = 2,
+	GPIO_FUNC_I2C = 3,
+	GPIO_FUNC_PWM = 4,
+	GPIO_FUNC_SIO = 5,
+	GPIO_FUNC_PIO0 = 6,
+	GPIO_FUNC_PIO1 = 7,
+	GPIO_FUNC_GPCK = 8,
+	GPIO_FUNC_USB = 9,
+	GPIO_FUNC_NULL = 0x1f
+};
+
+enum gpio_irq_level
+{
+	GPIO_IRQ_LEVEL_LOW = 0x1u,
+	GPIO_IRQ_LEVEL_HIGH = 0x2u,
+	GPIO_IRQ_EDGE_FALL = 0x4u,
+	GPIO_IRQ_EDGE_RISE = 0x8u
+};
+
+typedef void (*gpio_irq_callback_t)(uint gpio, uint32_t event_mask);
+
+void gpio_init(uint gpio);
+void gpio_set_function(uint gpio, enum gpio_function fn);
+void gpio_set_dir(uint gpio, bool out);
+void gpio_pull_up(uint gpio);
+void gpio_pull_down(uint gpio);
+bool gpio_get(uint gpio);
+void gpio_put(uint gpio, bool value);
+void gpio_put_masked(uint32_t mask, uint32_t value);
+uint32_t gpio_get_all();
+
+/** Set the GPIO IRQ callback for the calling core. */
+void gpio_set_irq_callback(gpio_irq_callback_t callback);
+
+/** Enable or disable edge/level events for a pin. Events are routed to the calling core. */
+void gpio_set_irq_enabled(uint gpio, uint32_t event_mask, bool enabled);
+
+#endif
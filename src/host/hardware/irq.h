@@ -0,0 +1,24 @@
+#ifndef HARDWARE_IRQ_H
+#define HARDWARE_IRQ_H
+
+// Host (Linux) stand-in for hardware/irq.h.
+
+#include "pico.h"
+#include "hardware/regs/intctrl.h"
+
+/** NVIC enables are not modelled. Simulated GPIO interrupts are always delivered. */
+static inline void irq_set_enabled(uint num, bool enabled)
+{
+	(void)num;
+	(void)enabled;
+}
+
+typedef void (*irq_handler_t)(void);
+
+/**
+ * Set the handler for an interrupt. The handler is run as the core that set it.
+ * Only DMA_IRQ_0 and DMA_IRQ_1 are ever raised by the shim.
+ */
+void irq_set_exclusive_handler(uint num, irq_handler_t handler);
+
+#endif
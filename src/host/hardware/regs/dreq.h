@@ -0,0 +1,13 @@
+#ifndef HARDWARE_REGS_DREQ_H
+#define HARDWARE_REGS_DREQ_H
+
+// Host (Linux) stand-in for hardware/regs/dreq.h.
+
+#define DREQ_SPI0_TX 16
+#define DREQ_SPI0_RX 17
+#define DREQ_SPI1_TX 18
+#define DREQ_SPI1_RX 19
+#define DREQ_ADC 36
+#define DREQ_FORCE 63
+
+#endif
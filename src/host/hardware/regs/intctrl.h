@@ -0,0 +1,16 @@
+#ifndef HARDWARE_REGS_INTCTRL_H
+#define HARDWARE_REGS_INTCTRL_H
+
+// Host (Linux) stand-in for hardware/regs/intctrl.h.
+
+#define TIMER_IRQ_0 0
+#define TIMER_IRQ_1 1
+#define TIMER_IRQ_2 2
+#define TIMER_IRQ_3 3
+#define DMA_IRQ_0 11
+#define DMA_IRQ_1 12
+#define IO_IRQ_BANK0 13
+#define SIO_IRQ_PROC0 15
+#define SIO_IRQ_PROC1 16
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef HARDWARE_SPI_H
+#define HARDWARE_SPI_H
+
+// Host (Linux) stand-in for hardware/spi.h.
+// spi0 is modelled as a pair of 8 entry FIFOs. Firmware accesses them through pico_dash_spi_hw.h and the host
+// simulation plays the master through hostSpiMasterTransfer/hostSpiMasterCommand (see pico_dash_host_shim.h).
+
+#include "pico.h"
+#include "hardware/regs/dreq.h"
+
+#define SPI_SSPSR_TFE_BITS 0x00000001
+#define SPI_SSPSR_TNF_BITS 0x00000002
+#define SPI_SSPSR_RNE_BITS 0x00000004
+#define SPI_SSPSR_RFF_BITS 0x00000008
+#define SPI_SSPSR_BSY_BITS 0x00000010
+
+/** Depth of each of the SPI FIFOs. */
+#define SPI_FIFO_DEPTH 8
+
+typedef struct spi_inst spi_inst_t;
+
+/** Register block layout. Only the address of dr means anything, as a DMA read or write address for spi0. */
+typedef struct
+{
+	uint32_t cr0;
+	uint32_t cr1;
+	uint32_t dr;
+	uint32_t sr;
+	uint32_t cpsr;
+	uint32_t imsc;
+	uint32_t ris;
+	uint32_t mis;
+	uint32_t icr;
+	uint32_t dmacr;
+} spi_hw_t;
+
+spi_hw_t* spi_get_hw(spi_inst_t* spi);
+
+#define spi0 ((spi_inst_t*)0x4003c000)
+#define spi1 ((spi_inst_t*)0x40040000)
+
+typedef enum
+{
+	SPI_CPHA_0 = 0,
+	SPI_CPHA_1 = 1
+} spi_cpha_t;
+
+typedef enum
+{
+	SPI_CPOL_0 = 0,
+	SPI_CPOL_1 = 1
+} spi_cpol_t;
+
+typedef enum
+{
+	SPI_LSB_FIRST = 0,
+	SPI_MSB_FIRST = 1
+} spi_order_t;
+
+static inline uint spi_init(spi_inst_t* spi, uint baudrate)
+{
+	(void)spi;
+	return baudrate;
+}
+
+static inline void spi_set_slave(spi_inst_t* spi, bool slave)
+{
+	(void)spi;
+	(void)slave;
+}
+
+static inline void spi_set_format(spi_inst_t* spi, uint data_bits, spi_cpol_t cpol, spi_cpha_t cpha, spi_order_t order)
+{
+	(void)spi;
+	(void)data_bits;
+	(void)cpol;
+	(void)cpha;
+	(void)order;
+}
+
+static inline uint spi_get_dreq(spi_inst_t* spi, bool is_tx)
+{
+	(void)spi;
+	return is_tx ? DREQ_SPI0_TX : DREQ_SPI0_RX;
+}
+
+#endif
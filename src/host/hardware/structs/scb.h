@@ -0,0 +1,20 @@
+#ifndef HARDWARE_STRUCTS_SCB_H
+#define HARDWARE_STRUCTS_SCB_H
+
+// Host (Linux) stand-in for hardware/structs/scb.h.
+// Writes are accepted and ignored. The shim always wakes WFE when an interrupt is delivered, as if SEVONPEND were set.
+
+#include "pico.h"
+
+#define M0PLUS_SCR_SEVONPEND_BITS 0x00000010
+
+typedef struct
+{
+	volatile uint32_t scr;
+} armv6m_scb_hw_t;
+
+static armv6m_scb_hw_t _hostScbHw;
+
+#define scb_hw (&_hostScbHw)
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef HARDWARE_SYNC_H
+#define HARDWARE_SYNC_H
+
+// Host (Linux) stand-in for hardware/sync.h.
+
+#include "pico.h"
+
+/** Wait for event. Returns once an event has been signalled to the calling core since its last __wfe. */
+void __wfe();
+
+/** Signal an event to both cores. */
+void __sev();
+
+/**
+ * Note that the calling core is polling for something to change. A core that keeps polling with nothing changing is put
+ * to sleep until something does. Implemented by the host shim.
+ */
+void hostPoll();
+
+/**
+ * Only ever used to pad busy waits, so on the host it is a poll. This also acts as a barrier so that polling loops
+ * re-read shared state as they must on target.
+ */
+static inline void __nop()
+{
+	hostPoll();
+}
+
+/**
+ * Mask interrupts on the calling core. On the host this holds off delivery of every simulated interrupt, on either core,
+ * until restore_interrupts. Nests, so it may be called from an interrupt handler.
+ * @returns State to pass to restore_interrupts.
+ */
+uint32_t save_and_disable_interrupts();
+
+/** Undo save_and_disable_interrupts. */
+void restore_interrupts(uint32_t status);
+
+static inline void __dmb()
+{
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+static inline void __mem_fence_acquire()
+{
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+}
+
+static inline void __mem_fence_release()
+{
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+#endif
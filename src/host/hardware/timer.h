@@ -0,0 +1,46 @@
+#ifndef HARDWARE_TIMER_H
+#define HARDWARE_TIMER_H
+
+// Host (Linux) stand-in for hardware/timer.h.
+// Runs off the virtual clock. Alarms fire when the host simulation advances the clock past their target.
+
+#include "pico.h"
+#include "pico/time.h"
+
+/** Number of hardware alarms. */
+#define NUM_TIMERS 4
+
+static inline uint64_t time_us_64()
+{
+	return get_absolute_time();
+}
+
+static inline uint32_t time_us_32()
+{
+	return (uint32_t)get_absolute_time();
+}
+
+typedef void (*hardware_alarm_callback_t)(uint alarm_num);
+
+/**
+ * Claim a free alarm.
+ * @returns Alarm number, or -1 if none are free and required is false.
+ */
+int hardware_alarm_claim_unused(bool required);
+
+void hardware_alarm_unclaim(uint alarm_num);
+
+/**
+ * Set the callback for an alarm. As on target, the callback is run as the core that set it.
+ */
+void hardware_alarm_set_callback(uint alarm_num, hardware_alarm_callback_t callback);
+
+/**
+ * Arm an alarm to fire at the given time.
+ * @returns True if the target time has already passed, in which case the alarm is not armed.
+ */
+bool hardware_alarm_set_target(uint alarm_num, absolute_time_t t);
+
+void hardware_alarm_cancel(uint alarm_num);
+
+#endif
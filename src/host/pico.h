@@ -0,0 +1,26 @@
+#ifndef PICO_H
+#define PICO_H
+
+// Host (Linux) stand-in for the Pico SDK's top level header.
+// Only what the pico_dash sources actually use is provided.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef unsigned int uint;
+
+/** Everything runs from "RAM" on the host. */
+#define __not_in_flash_func(func_name) func_name
+#define __not_in_flash(group)
+#define __scratch_x(group)
+#define __scratch_y(group)
+#define __time_critical_func(func_name) func_name
+
+/**
+ * Get the number of the "core" the caller is running on.
+ * Core 0 is the thread that calls main, core 1 is the thread started by multicore_launch_core1.
+ */
+uint get_core_num();
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef PICO_MULTICORE_H
+#define PICO_MULTICORE_H
+
+// Host (Linux) stand-in for pico/multicore.h.
+// Core 1 is a pthread.
+
+#include "pico.h"
+
+/** Size of core 1's stack, at the top of scratch X, in bytes. */
+#ifndef PICO_CORE1_STACK_SIZE
+#define PICO_CORE1_STACK_SIZE 0x800
+#endif
+
+/** Start core 1 running the given entry function. */
+void multicore_launch_core1(void (*entry)(void));
+
+#endif
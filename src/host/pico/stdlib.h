@@ -0,0 +1,16 @@
+#ifndef PICO_STDLIB_H
+#define PICO_STDLIB_H
+
+// Host (Linux) stand-in for pico/stdlib.h.
+
+#include "pico.h"
+#include "pico/time.h"
+#include "hardware/gpio.h"
+
+/** Stdio is the host process' stdio. Nothing to do. */
+static inline bool stdio_init_all()
+{
+	return true;
+}
+
+#endif
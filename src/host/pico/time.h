@@ -0,0 +1,71 @@
+#ifndef PICO_TIME_H
+#define PICO_TIME_H
+
+// Host (Linux) stand-in for pico/time.h.
+// Time is virtual. It only moves forward when the host simulation advances it (see pico_dash_host_shim.h), which makes
+// runs repeatable and lets hours of simulated time pass in seconds.
+
+#include "pico.h"
+
+/** Microseconds since boot. Matches the SDK's non-opaque representation. */
+typedef uint64_t absolute_time_t;
+
+/** Get the current virtual time. */
+absolute_time_t get_absolute_time();
+
+static inline uint64_t to_us_since_boot(absolute_time_t t)
+{
+	return t;
+}
+
+static inline uint32_t to_ms_since_boot(absolute_time_t t)
+{
+	return (uint32_t)(t / 1000);
+}
+
+/** Difference, in microseconds, of "to" minus "from". */
+static inline int64_t absolute_time_diff_us(absolute_time_t from, absolute_time_t to)
+{
+	return (int64_t)(to - from);
+}
+
+static inline absolute_time_t delayed_by_us(const absolute_time_t t, uint64_t us)
+{
+	return t + us;
+}
+
+static inline absolute_time_t delayed_by_ms(const absolute_time_t t, uint32_t ms)
+{
+	return t + (uint64_t)ms * 1000;
+}
+
+static inline absolute_time_t make_timeout_time_us(uint64_t us)
+{
+	return delayed_by_us(get_absolute_time(), us);
+}
+
+static inline absolute_time_t make_timeout_time_ms(uint32_t ms)
+{
+	return delayed_by_ms(get_absolute_time(), ms);
+}
+
+/** Block until the virtual clock has been advanced past the given time. */
+void sleep_until(absolute_time_t target);
+
+static inline void sleep_us(uint64_t us)
+{
+	sleep_until(make_timeout_time_us(us));
+}
+
+static inline void sleep_ms(uint32_t ms)
+{
+	sleep_until(make_timeout_time_ms(ms));
+}
+
+/**
+ * Wait for an event or for the given time to pass, whichever is first.
+ * @returns True if the time has passed.
+ */
+bool best_effort_wfe_or_timeout(absolute_time_t timeout_timestamp);
+
+#endif
@@ -0,0 +1,92 @@
+#include <string.h>
+
+#include "pico_dash_config.h"
+#include "pico_dash_host_shim.h"
+
+// Host stand in for the config flash sectors. Erasing and programming behave as on the flash chip, and power can be lost
+// part way through either.
+
+#define HOST_CONFIG_FLASH_SIZE (CONFIG_FLASH_SECTORS * CONFIG_FLASH_SECTOR_SIZE)
+
+/** Contents of the config sectors. As a new chip, erased. */
+static uint8_t _hostConfigFlash[HOST_CONFIG_FLASH_SIZE] = {[0 ... HOST_CONFIG_FLASH_SIZE - 1] = 0xFF};
+
+/** Number of times each config sector has been erased. */
+static uint32_t _hostConfigFlashErases[CONFIG_FLASH_SECTORS];
+
+/** Bytes left before power is lost. -1 for never. */
+static int _hostConfigFlashPowerLeft = -1;
+
+/**
+ * Use up power for bytes of an erase or program.
+ * @returns Number of the bytes written before power was lost.
+ */
+static uint32_t _hostConfigFlashPower(uint32_t size)
+{
+	uint32_t retVal = size;
+
+	if(_hostConfigFlashPowerLeft >= 0)
+	{
+		if((uint32_t)_hostConfigFlashPowerLeft < size) retVal = _hostConfigFlashPowerLeft;
+
+		_hostConfigFlashPowerLeft -= retVal;
+	}
+
+	return retVal;
+}
+
+const uint8_t* configFlashContents()
+{
+	return _hostConfigFlash;
+}
+
+bool configFlashErase(uint32_t offset)
+{
+	_hostConfigFlashErases[offset / CONFIG_FLASH_SECTOR_SIZE]++;
+
+	uint32_t erased = _hostConfigFlashPower(CONFIG_FLASH_SECTOR_SIZE);
+
+	memset(_hostConfigFlash + offset, 0xFF, erased);
+
+	return erased == CONFIG_FLASH_SECTOR_SIZE;
+}
+
+bool configFlashProgram(uint32_t offset, const uint8_t* data, uint32_t size)
+{
+	uint32_t programmed = _hostConfigFlashPower(size);
+
+	// Programming can only clear bits.
+	for(uint32_t posn = 0; posn < programmed; posn++)
+	{
+		_hostConfigFlash[offset + posn] &= data[posn];
+	}
+
+	return programmed == size;
+}
+
+void configFlashCoreInit()
+{
+}
+
+void hostConfigFlashWipe()
+{
+	memset(_hostConfigFlash, 0xFF, HOST_CONFIG_FLASH_SIZE);
+	memset(_hostConfigFlashErases, 0, sizeof(_hostConfigFlashErases));
+
+	_hostConfigFlashPowerLeft = -1;
+}
+
+uint32_t hostConfigFlashErases(int sector)
+{
+	return _hostConfigFlashErases[sector];
+}
+
+void hostConfigFlashPowerLoss(int bytes)
+{
+	_hostConfigFlashPowerLeft = bytes;
+}
+
+void hostConfigFlashCorrupt(uint32_t offset, uint8_t bits)
+{
+	_hostConfigFlash[offset] ^= bits;
+}
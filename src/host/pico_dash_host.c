@@ -0,0 +1,3252 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "hardware/sync.h"
+#include "pico/multicore.h"
+#include "pico/time.h"
+
+#include "pico_dash_adc.h"
+#include "pico_dash_calibration_tables.h"
+#include "pico_dash_config.h"
+#include "pico_dash_filter.h"
+#include "pico_dash_gauge.h"
+#include "pico_dash_gauge_profile.h"
+#include "pico_dash_gpio.h"
+#include "pico_dash_history.h"
+#include "pico_dash_host_shim.h"
+#include "pico_dash_latch.h"
+#include "pico_dash_microstep_tables.h"
+#include "pico_dash_sched.h"
+#include "pico_dash_spi_latch.h"
+#include "pico_dash_trace.h"
+
+bool debugMsgActive = false;
+
+extern bool _exitSensorProcLoop;
+
+extern int _latchedData[MAX_LATCHED_INDEXES];
+
+extern struct Sensor _sensors[MAX_LATCHED_INDEXES];
+
+extern bool _sensorConfigByCore1;
+
+extern struct SensorConfig _sensorConfig;
+
+void _publishLatchedData(absolute_time_t captureTime);
+
+void _applySensorConfig();
+
+/**
+ * Native Linux build of the latcher and SPI latch protocol.
+ * Core 0 runs the same SPI service loop as the firmware, core 1 runs the latcher and a third thread plays the Pi master,
+ * driving a simulated car through the sensor test pulse generator or, with -l, synthetic edge streams fed through pulse
+ * capture. Core 0 also steps a tachometer gauge from the latched RPM. Time is virtual so long drives run quickly and the
+ * whole thing can be profiled with perf.
+ */
+
+/** Simulated drive length, in virtual seconds. */
+static int _simSeconds = 600;
+
+/** Virtual time between master polls, in milliseconds. */
+static int _pollIntervalMs = 50;
+
+/** Virtual clock step, in microseconds. Smaller steps keep core 1 closer to real strobe timing but run slower. */
+static int _clockStepUs = 250;
+
+/**
+ * Whether the sensors are fed synthetic edge streams through pulse capture rather than using the test pulse generator.
+ */
+static bool _liveEdges = false;
+
+/** Mean pulse period, in microseconds, above which the pulse sensors resolve from the pulse period. 0 for never. */
+static int _pulsePeriodThreshold = 0;
+
+/** Pulse capture inputs used for live edges. */
+#define RPM_PULSE_GPIO 2
+#define SPEED_PULSE_GPIO 3
+
+/** ADC input the engine temperature sender is on. */
+#define TEMP_ADC_INPUT 0
+
+/** Peak noise on the engine temperature sender, in ADC counts. */
+#define TEMP_ADC_NOISE 20
+
+/** Whether a dashboard refresh uses a single GET_LATCHED_DATA_MULTI rather than a GET_LATCHED_DATA per channel. */
+static bool _refreshMulti = false;
+
+/**
+ * Whether the dashboard is pushed changes, through the data ready GPIO and GET_CHANGED, rather than polling for every
+ * value.
+ */
+static bool _refreshPush = false;
+
+/** Number of GET_CHANGED command cycles and the changes they got. */
+static int _pushCommands = 0;
+static int _pushChanges = 0;
+
+/** Number of commands to run through each protocol version when measuring throughput. 0 to run the simulated drive. */
+static int _throughputCommands = 0;
+
+/** Rounds of sensor config uploads to compare SET_SENSOR_DATA with SET_SENSOR_CONFIG over. 0 not to compare them. */
+static int _configUploads = 0;
+
+/** Whether the master logs every latched value with GET_HISTORY as it drives. */
+static bool _historyLog = false;
+
+/** Commands per pipelined command cycle when measuring throughput. */
+#define THROUGHPUT_PIPELINE_DEPTH 16
+
+/** Number of commands to run through each protocol version for the load benchmark. 0 not to run it. */
+static int _loadCommands = 0;
+
+/** Commands the load benchmark can mix. */
+enum LoadCommand
+{
+	LOAD_GET_LATCHED_DATA,
+	LOAD_SET_SENSOR_DATA,
+	LOAD_GET_LATCHED_DATA_INDEX,
+	MAX_LOAD_COMMANDS
+};
+
+/** Relative weight of each load benchmark command, by enum LoadCommand. Set with -w. */
+static int _loadMix[MAX_LOAD_COMMANDS] = {8, 1, 1};
+
+/** Number of dashboard refreshes and the command cycle handshakes they took. */
+static int _refreshes = 0;
+static uint64_t _refreshHandshakes = 0;
+
+/** Set once the master has finished so core 0 can exit. */
+static bool _simDone = false;
+
+/** Command cycles that failed to complete. */
+static int _failedCommands = 0;
+
+/** Sum of absolute differences between the simulated and latched values, and the number of samples summed. */
+static int64_t _rpmErrorSum = 0;
+static int64_t _speedErrorSum = 0;
+static int64_t _tempErrorSum = 0;
+static int _errorSamples = 0;
+
+/** Virtual time the tachometer finished homing, in milliseconds. 0 until it has. */
+static uint64_t _tachoHomedMs = 0;
+
+/** Sum and maximum of the distance, in steps, between the tachometer needle and the latched RPM it is showing. */
+static int64_t _tachoLagSum = 0;
+static int _tachoMaxLag = 0;
+static int _tachoLagSamples = 0;
+
+#if PICO_DASH_STATS
+
+/** Event counters got with GET_STATS at the end of the drive. */
+static uint32_t _driveStatsCounters[MAX_STATS_COUNTERS];
+
+/** SPI timing histograms got with GET_STATS at the end of the drive, by histogram id. */
+static struct StatsHistogram _driveStatsHistograms[STATS_STROBE_LATENESS];
+
+/** Strobe lateness histograms got with GET_STATS at the end of the drive, by latched data index. */
+static struct StatsHistogram _driveStrobeLateness[MAX_LATCHED_INDEXES];
+
+#endif
+
+/** Run a single command through the SPI master emulator. */
+static bool _command(const uint8_t* command, uint8_t* response)
+{
+	bool retVal = hostSpiMasterCommand(command, SPI_COMMAND_RESPONSE_FRAME_SIZE, response,
+		SPI_COMMAND_RESPONSE_FRAME_SIZE);
+
+	if(!retVal || response[0] != command[0]) _failedCommands++;
+
+	return retVal;
+}
+
+static void _setSensorData(int latchedDataIndex, SensorData sensorVar, int value)
+{
+	uint8_t command[SPI_COMMAND_RESPONSE_FRAME_SIZE] = {SET_SENSOR_DATA, latchedDataIndex, sensorVar,
+		value & 0xFF, (value >> 8) & 0xFF, (value >> 16) & 0xFF, (value >> 24) & 0xFF, 0};
+
+	uint8_t response[SPI_COMMAND_RESPONSE_FRAME_SIZE];
+
+	if(_command(command, response) && response[1] != 0) _failedCommands++;
+}
+
+static int _getLatchedData(int latchedDataIndex)
+{
+	uint8_t command[SPI_COMMAND_RESPONSE_FRAME_SIZE] = {GET_LATCHED_DATA, latchedDataIndex};
+	uint8_t response[SPI_COMMAND_RESPONSE_FRAME_SIZE];
+
+	_command(command, response);
+
+	return response[1] | response[2] << 8 | response[3] << 16 | response[4] << 24;
+}
+
+/**
+ * Refresh the whole dashboard, ie every latched data index.
+ * @param latchedData Returns the latched data, by latched data index.
+ */
+static void _refreshDashboard(int* latchedData)
+{
+	uint64_t startHandshakes = hostSpiHandshakeCount();
+
+	if(_refreshMulti)
+	{
+		uint8_t command[SPI_COMMAND_RESPONSE_FRAME_SIZE] = {GET_LATCHED_DATA_MULTI};
+		uint8_t response[SPI_MAX_RESPONSE_SIZE];
+
+		for(int index = 1; index < MAX_LATCHED_INDEXES; index++) command[1 + index / 8] |= 1 << (index % 8);
+
+		// Command byte then four bytes per index.
+		int responseSize = (1 + 4 * (MAX_LATCHED_INDEXES - 1) + SPI_COMMAND_RESPONSE_FRAME_SIZE - 1)
+			/ SPI_COMMAND_RESPONSE_FRAME_SIZE * SPI_COMMAND_RESPONSE_FRAME_SIZE;
+
+		if(!hostSpiMasterCommand(command, SPI_COMMAND_RESPONSE_FRAME_SIZE, response, responseSize) ||
+			response[0] != command[0])
+		{
+			_failedCommands++;
+		}
+
+		for(int index = 1; index < MAX_LATCHED_INDEXES; index++)
+		{
+			uint8_t* value = response + 1 + 4 * (index - 1);
+			latchedData[index] = value[0] | value[1] << 8 | value[2] << 16 | value[3] << 24;
+		}
+	}
+	else
+	{
+		for(int index = 1; index < MAX_LATCHED_INDEXES; index++) latchedData[index] = _getLatchedData(index);
+	}
+
+	_refreshHandshakes += hostSpiHandshakeCount() - startHandshakes;
+	_refreshes++;
+}
+
+/**
+ * Get whatever latched data has changed, if the data ready GPIO says there is any.
+ * @param latchedData Latched data, by latched data index. Changed values are updated.
+ */
+static void _getChanged(int* latchedData)
+{
+	if(gpio_get(SPI_LATCH_DATA_READY_GPIO_PIN))
+	{
+		uint8_t command[SPI_COMMAND_RESPONSE_FRAME_SIZE] = {GET_CHANGED, MAX_LATCHED_INDEXES - 1};
+		uint8_t response[SPI_MAX_RESPONSE_SIZE];
+
+		if(!hostSpiMasterCommand(command, SPI_COMMAND_RESPONSE_FRAME_SIZE, response,
+			SPI_GET_CHANGED_RESPONSE_SIZE(MAX_LATCHED_INDEXES - 1)) || response[0] != command[0])
+		{
+			_failedCommands++;
+		}
+		else
+		{
+			for(int change = 0; change < response[1]; change++)
+			{
+				uint8_t* value = response + 2 + 5 * change;
+				latchedData[value[0]] = value[1] | value[2] << 8 | value[3] << 16 | value[4] << 24;
+			}
+
+			_pushChanges += response[1];
+		}
+
+		_pushCommands++;
+	}
+}
+
+static int _getLatchedDataIndex(const char* name)
+{
+	uint8_t command[SPI_COMMAND_RESPONSE_FRAME_SIZE] = {GET_LATCHED_DATA_INDEX, name[0], name[1], name[2]};
+	uint8_t response[SPI_COMMAND_RESPONSE_FRAME_SIZE];
+
+	_command(command, response);
+
+	return (int8_t)response[1];
+}
+
+#if PICO_DASH_STATS || PICO_DASH_HISTORY
+
+/** Get a little endian 32 bit integer out of a response. */
+static uint32_t _responseUint32(const uint8_t* value)
+{
+	return value[0] | value[1] << 8 | value[2] << 16 | (uint32_t)value[3] << 24;
+}
+
+#endif
+
+/** Add a sensor variable to a sensor config to set with _setSensorConfig. */
+static void _sensorConfigPut(uint32_t* setMask, int32_t* values, SensorData sensorVar, int value)
+{
+	*setMask |= 1u << sensorVar;
+	values[sensorVar] = value;
+}
+
+/**
+ * Build a SET_SENSOR_CONFIG command.
+ * @param values Value of each sensor variable in setMask, by sensor data id.
+ * @param command Returns the command, up to SPI_MAX_COMMAND_SIZE bytes.
+ * @returns Size of the command.
+ */
+static int _sensorConfigCommand(int latchedDataIndex, uint32_t setMask, const int32_t* values, uint8_t* command)
+{
+	int retVal = 0;
+
+	command[retVal++] = SET_SENSOR_CONFIG;
+	command[retVal++] = latchedDataIndex;
+
+	for(int sensorVar = -1; sensorVar < MAX_SENSOR_DATA; sensorVar++)
+	{
+		// The mask, then the values in ascending id order.
+		if(sensorVar < 0 || setMask & (1u << sensorVar))
+		{
+			uint32_t value = sensorVar < 0 ? setMask : (uint32_t)values[sensorVar];
+
+			for(int byte = 0; byte < 4; byte++) command[retVal++] = (value >> (8 * byte)) & 0xFF;
+		}
+	}
+
+	while(retVal % SPI_COMMAND_RESPONSE_FRAME_SIZE) command[retVal++] = 0;
+
+	return retVal;
+}
+
+/** Set any number of a sensor's variables in one command cycle, with SET_SENSOR_CONFIG. */
+static void _setSensorConfig(int latchedDataIndex, uint32_t setMask, const int32_t* values)
+{
+	uint8_t command[SPI_MAX_COMMAND_SIZE];
+	uint8_t response[SPI_COMMAND_RESPONSE_FRAME_SIZE];
+
+	int commandSize = _sensorConfigCommand(latchedDataIndex, setMask, values, command);
+
+	if(!hostSpiMasterCommand(command, commandSize, response, SPI_COMMAND_RESPONSE_FRAME_SIZE) ||
+		response[0] != SET_SENSOR_CONFIG || response[1] != 0)
+	{
+		_failedCommands++;
+	}
+}
+
+/**
+ * Check a sensor's variables read back with GET_SENSOR_CONFIG as they were set. As every variable asked for has been
+ * set, the response must be the SET_SENSOR_CONFIG command for them but for its first byte.
+ */
+static bool _sensorConfigReadsBack(int latchedDataIndex, uint32_t setMask, const int32_t* values)
+{
+	uint8_t command[SPI_COMMAND_RESPONSE_FRAME_SIZE] = {GET_SENSOR_CONFIG, latchedDataIndex,
+		setMask & 0xFF, (setMask >> 8) & 0xFF, (setMask >> 16) & 0xFF, (setMask >> 24) & 0xFF};
+
+	uint8_t expected[SPI_MAX_COMMAND_SIZE];
+	uint8_t response[SPI_MAX_RESPONSE_SIZE];
+
+	int responseSize = _sensorConfigCommand(latchedDataIndex, setMask, values, expected);
+	expected[0] = GET_SENSOR_CONFIG;
+
+	return hostSpiMasterCommand(command, sizeof(command), response, responseSize) &&
+		memcmp(response, expected, responseSize) == 0;
+}
+
+#if PICO_DASH_STATS
+
+/**
+ * Get the event counters with GET_STATS.
+ * @param counters Returns the counters, by counter id.
+ * @param reset Whether to reset every stat once they have been read.
+ */
+static void _getStatsCounters(uint32_t* counters, bool reset)
+{
+	uint8_t command[SPI_COMMAND_RESPONSE_FRAME_SIZE] = {GET_STATS, SPI_GET_STATS_COUNTERS, 0,
+		reset ? SPI_GET_STATS_RESET : 0};
+	uint8_t response[SPI_MAX_RESPONSE_SIZE];
+
+	if(!hostSpiMasterCommand(command, SPI_COMMAND_RESPONSE_FRAME_SIZE, response, SPI_GET_STATS_COUNTERS_RESPONSE_SIZE)
+		|| response[0] != command[0] || response[1] != SPI_GET_STATS_COUNTERS)
+	{
+		_failedCommands++;
+	}
+
+	for(int counter = 0; counter < MAX_STATS_COUNTERS; counter++) counters[counter] = _responseUint32(response + 2 + 4 * counter);
+}
+
+/**
+ * Get a timing histogram with GET_STATS.
+ * @param histogramId Histogram.
+ * @param index Latched data index, for STATS_STROBE_LATENESS. 0 otherwise.
+ * @param histogram Returns the histogram.
+ */
+static void _getStatsHistogram(enum StatsHistogramId histogramId, int index, struct StatsHistogram* histogram)
+{
+	uint8_t command[SPI_COMMAND_RESPONSE_FRAME_SIZE] = {GET_STATS, histogramId, index};
+	uint8_t response[SPI_MAX_RESPONSE_SIZE];
+
+	if(!hostSpiMasterCommand(command, SPI_COMMAND_RESPONSE_FRAME_SIZE, response, SPI_GET_STATS_HISTOGRAM_RESPONSE_SIZE)
+		|| response[0] != command[0] || response[1] != histogramId || response[2] != index)
+	{
+		_failedCommands++;
+	}
+
+	histogram -> count = _responseUint32(response + 3);
+	histogram -> max = _responseUint32(response + 7);
+	histogram -> sum = _responseUint32(response + 11) | (uint64_t)_responseUint32(response + 15) << 32;
+
+	for(int bucket = 0; bucket < STATS_HISTOGRAM_BUCKETS; bucket++)
+	{
+		histogram -> buckets[bucket] = _responseUint32(response + 19 + 4 * bucket);
+	}
+}
+
+/**
+ * Get every stat at the end of the drive, then reset them and check that the reset took.
+ */
+static void _getDriveStats()
+{
+	_getStatsCounters(_driveStatsCounters, false);
+
+	for(int histogramId = 0; histogramId < STATS_STROBE_LATENESS; histogramId++)
+	{
+		_getStatsHistogram(histogramId, 0, &_driveStatsHistograms[histogramId]);
+	}
+
+	for(int index = NO_LATCHED_INDEX + 1; index < MAX_LATCHED_INDEXES; index++)
+	{
+		_getStatsHistogram(STATS_STROBE_LATENESS, index, &_driveStrobeLateness[index]);
+	}
+
+	// The shim's master moves the clock on while it waits for the slave to be ready, so at least some of these take
+	// time. Without DMA the slave writes its response without waiting on the master, so the service time can be 0.
+	if((SPI_LATCH_DMA && !_driveStatsHistograms[STATS_COMMAND_SERVICE_TIME].sum) ||
+		!_driveStatsHistograms[STATS_READY_LATENCY].sum)
+	{
+		printf("Command service time or ready latency never took any time.\n");
+
+		_failedCommands++;
+	}
+
+	uint32_t counters[MAX_STATS_COUNTERS];
+
+	_getStatsCounters(counters, true);
+	_getStatsCounters(counters, false);
+
+	// Only the command cycle that read them since the reset.
+	if(counters[STATS_COMMAND_CYCLES] != 1 || counters[STATS_COMMANDS] != 1)
+	{
+		printf("Stats reset left %u command cycles and %u commands.\n", counters[STATS_COMMAND_CYCLES],
+			counters[STATS_COMMANDS]);
+
+		_failedCommands++;
+	}
+}
+
+/**
+ * Print a timing histogram's count, mean, maximum and the bucket bound that 99% of times are under.
+ */
+static void _printStatsHistogram(const char* name, const struct StatsHistogram* histogram)
+{
+	uint64_t cumulative = 0;
+	int bucket = 0;
+
+	while(bucket < STATS_HISTOGRAM_BUCKETS - 1 && (cumulative += histogram -> buckets[bucket]) * 100 <
+		(uint64_t)histogram -> count * 99)
+	{
+		bucket++;
+	}
+
+	printf("%s: %u recorded, mean %.1f us, max %u us, 99%% under %u us.\n", name, histogram -> count,
+		histogram -> count ? (double)histogram -> sum / histogram -> count : 0.0, histogram -> max, 1u << bucket);
+}
+
+#endif
+
+#if PICO_DASH_HISTORY
+
+/** How often the master logs the history, in milliseconds. */
+#define HISTORY_LOG_INTERVAL_MS 5000
+
+/** Sequence number of the next sample for the master to log, by latched data index. */
+static uint32_t _historyLogged[MAX_LATCHED_INDEXES];
+
+/** Time of the last sample logged, low 32 bits, by latched data index. */
+static uint32_t _historyLastTime[MAX_LATCHED_INDEXES];
+
+/** Value of the last sample logged, by latched data index. */
+static int32_t _historyLastValue[MAX_LATCHED_INDEXES];
+
+/** GET_HISTORY command cycles. */
+static int _historyCommands = 0;
+
+/** Number of samples the history holds up to the last logged, and the time they span in microseconds. */
+static uint32_t _historyHeld[MAX_LATCHED_INDEXES];
+static uint32_t _historyHeldUs[MAX_LATCHED_INDEXES];
+
+/** Samples dropped before they were logged, logged out of time order, and logs whose last sample wasn't latched. */
+static int _historyLost = 0;
+static int _historyOutOfOrder = 0;
+static int _historyNotLatched = 0;
+
+/**
+ * Get samples from a latched data index's history with GET_HISTORY.
+ * @param sequence Sequence number of the first sample wanted.
+ * @param maxSamples Most samples to get.
+ * @param response Returns the response.
+ * @returns Number of samples got, or -1 if the command failed.
+ */
+static int _getHistory(int latchedDataIndex, uint32_t sequence, int maxSamples, uint8_t* response)
+{
+	uint8_t command[SPI_COMMAND_RESPONSE_FRAME_SIZE] = {GET_HISTORY, latchedDataIndex, sequence & 0xFF,
+		(sequence >> 8) & 0xFF, (sequence >> 16) & 0xFF, (sequence >> 24) & 0xFF, maxSamples};
+
+	int retVal = -1;
+
+	if(hostSpiMasterCommand(command, SPI_COMMAND_RESPONSE_FRAME_SIZE, response,
+		SPI_GET_HISTORY_RESPONSE_SIZE(maxSamples)) && response[0] == command[0] && response[1] == latchedDataIndex &&
+		response[2] <= maxSamples)
+	{
+		retVal = response[2];
+	}
+	else
+	{
+		_failedCommands++;
+	}
+
+	_historyCommands++;
+
+	return retVal;
+}
+
+/**
+ * Log every sample of a latched data index since it was last logged, checking that none were lost, that they are in
+ * time order and that the last is the value latched now.
+ */
+static void _logHistory(int latchedDataIndex)
+{
+	uint8_t response[SPI_MAX_RESPONSE_SIZE];
+
+	int samples;
+
+	do
+	{
+		samples = _getHistory(latchedDataIndex, _historyLogged[latchedDataIndex], SPI_HISTORY_MAX_SAMPLES, response);
+
+		if(samples >= 0)
+		{
+			uint32_t sequence = _responseUint32(response + 3);
+
+			_historyLost += sequence - _historyLogged[latchedDataIndex];
+
+			for(int sample = 0; sample < samples; sample++)
+			{
+				uint32_t time = _responseUint32(response + 11 + 8 * sample);
+
+				if(sequence + sample > 0 && (int32_t)(time - _historyLastTime[latchedDataIndex]) <= 0)
+				{
+					_historyOutOfOrder++;
+				}
+
+				_historyLastTime[latchedDataIndex] = time;
+				_historyLastValue[latchedDataIndex] = _responseUint32(response + 15 + 8 * sample);
+			}
+
+			_historyLogged[latchedDataIndex] = sequence + samples;
+		}
+	}
+	while(samples > 0 && _historyLogged[latchedDataIndex] != _responseUint32(response + 7));
+
+	if(_historyLogged[latchedDataIndex] && _historyLastValue[latchedDataIndex] != getLatchedData(latchedDataIndex))
+	{
+		_historyNotLatched++;
+	}
+}
+
+/**
+ * Get how much of a latched data index's history is still held, from its oldest sample to the last logged.
+ */
+static void _getHistoryHeld(int latchedDataIndex)
+{
+	uint8_t response[SPI_MAX_RESPONSE_SIZE];
+
+	if(_getHistory(latchedDataIndex, 0, 1, response) == 1)
+	{
+		_historyHeld[latchedDataIndex] = _historyLogged[latchedDataIndex] - _responseUint32(response + 3);
+		_historyHeldUs[latchedDataIndex] = _historyLastTime[latchedDataIndex] - _responseUint32(response + 11);
+	}
+}
+
+/**
+ * Print what the master logged of a latched data index and how much of it the history still holds.
+ */
+static void _printHistoryLog(const char* name, int latchedDataIndex)
+{
+	printf("%s history: %u samples logged, the last %u over %.1f s still held.\n", name,
+		_historyLogged[latchedDataIndex], _historyHeld[latchedDataIndex], _historyHeldUs[latchedDataIndex] / 1e6);
+}
+
+#endif
+
+/**
+ * Simulated drive. Repeatedly accelerates through the gears to 110 km/h and back down to idle.
+ * @param timeMs Virtual time since start of drive.
+ * @param rpm Returns engine RPM.
+ * @param speed Returns speed in km/h.
+ */
+static void _driveProfile(uint64_t timeMs, int* rpm, int* speed)
+{
+	// One minute per cycle. 40 seconds accelerating, 20 seconds braking.
+	int cycleMs = timeMs % 60000;
+
+	*speed = cycleMs < 40000 ? cycleMs * 110 / 40000 : (60000 - cycleMs) * 110 / 20000;
+
+	// Five gears, each covering 22 km/h, between 1500 and 6000 RPM.
+	int gearSpeed = *speed % 22;
+
+	*rpm = *speed == 0 ? 800 : 1500 + gearSpeed * 4500 / 22;
+}
+
+static void _configurePulseSensor(int index, int strobeInterval, int accumInterval, int preScale, int testDuration,
+	int gpio)
+{
+	uint32_t setMask = 0;
+	int32_t values[MAX_SENSOR_DATA];
+
+	_sensorConfigPut(&setMask, values, SENSOR_TYPE, PULSE_SENSOR);
+	_sensorConfigPut(&setMask, values, PULSE_GPIO, _liveEdges ? gpio : -1);
+	_sensorConfigPut(&setMask, values, STROBE_INTERVAL, strobeInterval);
+	_sensorConfigPut(&setMask, values, PULSE_ACCUMULATION_INTERVAL, accumInterval);
+	_sensorConfigPut(&setMask, values, PULSE_PRE_SCALE, preScale);
+	_sensorConfigPut(&setMask, values, PULSE_POST_SCALE, 1);
+	_sensorConfigPut(&setMask, values, PULSE_TEST_DURATION_START, testDuration);
+	_sensorConfigPut(&setMask, values, PULSE_PERIOD_THRESHOLD, _pulsePeriodThreshold);
+	_sensorConfigPut(&setMask, values, ACTIVE, 1);
+
+	// The whole sensor in one command cycle.
+	_setSensorConfig(index, setMask, values);
+}
+
+/**
+ * Piecewise linear interpolation of a sensor curve.
+ * @param inputs Input at each point, ascending.
+ * @param outputs Output at each point.
+ * @param pointCount Number of points.
+ * @param input Input to interpolate at. Clamped to the ends of the curve.
+ */
+static double _interpolate(const int32_t* inputs, const int32_t* outputs, int pointCount, double input)
+{
+	if(input <= inputs[0]) return outputs[0];
+
+	for(int point = 1; point < pointCount; point++)
+	{
+		if(input <= inputs[point])
+		{
+			return outputs[point - 1] + (double)(outputs[point] - outputs[point - 1]) * (input - inputs[point - 1])
+				/ (inputs[point] - inputs[point - 1]);
+		}
+	}
+
+	return outputs[pointCount - 1];
+}
+
+/**
+ * ADC level, in 12 bit counts, that a sensor produces for a given output, going backwards through its curve.
+ * @param curve Sensor curve. The outputs must be descending, as for an NTC sender.
+ * @param output Output in latched data units.
+ */
+static int _curveAdcLevel(const struct CalibrationCurve* curve, int output)
+{
+	int32_t fixedOutput = output << CALIBRATION_FRACTION_BITS;
+
+	if(fixedOutput >= curve -> outputs[0]) return curve -> inputs[0] >> (ADC_DECIMATED_BITS - ADC_SAMPLE_BITS);
+
+	for(int point = 1; point < curve -> pointCount; point++)
+	{
+		if(fixedOutput >= curve -> outputs[point])
+		{
+			double input = curve -> inputs[point - 1] + (double)(curve -> inputs[point] - curve -> inputs[point - 1])
+				* (fixedOutput - curve -> outputs[point - 1]) / (curve -> outputs[point] - curve -> outputs[point - 1]);
+
+			return (int)(input / (1 << (ADC_DECIMATED_BITS - ADC_SAMPLE_BITS)) + 0.5);
+		}
+	}
+
+	return curve -> inputs[curve -> pointCount - 1] >> (ADC_DECIMATED_BITS - ADC_SAMPLE_BITS);
+}
+
+/**
+ * Simulated engine temperature. Warms up from 20 to 90 degrees over the first five minutes.
+ * @returns Temperature in tenths of a degree.
+ */
+static int _engineTemp(uint64_t timeMs)
+{
+	return timeMs < 300000 ? 200 + (int)(timeMs * 700 / 300000) : 900;
+}
+
+static void _configureVoltageSensor(int index, int strobeInterval, int adcInput, CalibrationTableId calibrationTable)
+{
+	uint32_t setMask = 0;
+	int32_t values[MAX_SENSOR_DATA];
+
+	_sensorConfigPut(&setMask, values, SENSOR_TYPE, SCALED_VOLTAGE_SENSOR);
+	_sensorConfigPut(&setMask, values, STROBE_INTERVAL, strobeInterval);
+	_sensorConfigPut(&setMask, values, ADC_CHANNEL, adcInput);
+	_sensorConfigPut(&setMask, values, VOLTAGE_CALIBRATION_TABLE, calibrationTable);
+	_sensorConfigPut(&setMask, values, ACTIVE, 1);
+
+	_setSensorConfig(index, setMask, values);
+}
+
+/**
+ * Stamp the edges of a steady pulse train up to the current virtual time.
+ * @param gpio Pulse capture input.
+ * @param periodUs Pulse period in microseconds. 0 or less for no pulses.
+ * @param nextEdge Time of the next edge, 0 if the pulse train is stopped. Updated.
+ */
+static void _driveEdges(uint gpio, int periodUs, absolute_time_t* nextEdge)
+{
+	absolute_time_t now = get_absolute_time();
+
+	if(periodUs <= 0)
+	{
+		*nextEdge = 0;
+	}
+	else
+	{
+		if(*nextEdge == 0) *nextEdge = now;
+
+		for(; *nextEdge <= now; *nextEdge += periodUs) hostPulseCaptureEdge(gpio, *nextEdge);
+	}
+}
+
+static double _realTimeSeconds()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Print the throughput of a protocol run.
+ * @param commands Number of commands run.
+ * @param startTime Real time the run started.
+ * @param startBytes Bytes shifted before the run started.
+ * @param startHandshakes Handshakes done before the run started.
+ */
+static void _printThroughput(const char* protocol, int commands, double startTime, uint64_t startBytes,
+	uint64_t startHandshakes)
+{
+	double realTime = _realTimeSeconds() - startTime;
+	uint64_t bytes = hostSpiByteCount() - startBytes;
+
+	// Bus time at the highest baud the slave allows, ignoring the master's gaps between bytes.
+	double busTimeUs = bytes * 8 * 1e6 / SPI_BAUD;
+
+	printf("%s: %i commands in %.3f s, %.0f commands per second. %.1f bytes, %.2f handshakes and %.1f us of bus time"
+		" per command.\n", protocol, commands, realTime, commands / realTime, (double)bytes / commands,
+		(double)(hostSpiHandshakeCount() - startHandshakes) / commands, busTimeUs / commands);
+}
+
+/**
+ * Run the throughput commands pipelined, then check a multi-frame response in the middle of a pipeline. Leaves the
+ * protocol at SPI_PROTOCOL_HALF_DUPLEX.
+ * @returns Number of wrong responses.
+ */
+static int _throughputPipelined()
+{
+	uint8_t response[SPI_COMMAND_RESPONSE_FRAME_SIZE];
+
+	uint8_t setVersion[SPI_COMMAND_RESPONSE_FRAME_SIZE] = {SET_PROTOCOL_VERSION, SPI_PROTOCOL_PIPELINED};
+
+	if(!_command(setVersion, response) || response[1] != SPI_PROTOCOL_PIPELINED)
+	{
+		printf("Pipelined protocol not negotiated.\n");
+		return 1;
+	}
+
+	uint8_t commands[THROUGHPUT_PIPELINE_DEPTH][SPI_COMMAND_RESPONSE_FRAME_SIZE] = {{0}};
+	uint8_t responses[THROUGHPUT_PIPELINE_DEPTH][SPI_COMMAND_RESPONSE_FRAME_SIZE];
+	int responseSizes[THROUGHPUT_PIPELINE_DEPTH];
+
+	int wrongResponses = 0;
+
+	double startTime = _realTimeSeconds();
+	uint64_t startBytes = hostSpiByteCount();
+	uint64_t startHandshakes = hostSpiHandshakeCount();
+
+	for(int index = 0; index < _throughputCommands; index += THROUGHPUT_PIPELINE_DEPTH)
+	{
+		int count = _throughputCommands - index < THROUGHPUT_PIPELINE_DEPTH ? _throughputCommands - index
+			: THROUGHPUT_PIPELINE_DEPTH;
+
+		for(int pipe = 0; pipe < count; pipe++)
+		{
+			commands[pipe][0] = GET_LATCHED_DATA;
+			commands[pipe][1] = 1 + (index + pipe) % (MAX_LATCHED_INDEXES - 1);
+			responseSizes[pipe] = SPI_COMMAND_RESPONSE_FRAME_SIZE;
+		}
+
+		if(!hostSpiMasterPipelinedCommands(commands[0], count, responses[0], responseSizes)) _failedCommands++;
+
+		for(int pipe = 0; pipe < count; pipe++)
+		{
+			if(responses[pipe][0] != GET_LATCHED_DATA) wrongResponses++;
+		}
+	}
+
+	_printThroughput("Pipelined", _throughputCommands, startTime, startBytes, startHandshakes);
+
+	// A multi-frame response in the middle of a pipeline, then back to half duplex. The protocol only changes once this
+	// cycle is done.
+	uint8_t lastCommands[3][SPI_COMMAND_RESPONSE_FRAME_SIZE] = {
+		{GET_LATCHED_DATA_MULTI},
+		{GET_LATCHED_DATA_INDEX, 'S', 'K', 'H'},
+		{SET_PROTOCOL_VERSION, SPI_PROTOCOL_HALF_DUPLEX}
+	};
+
+	for(int index = 1; index < MAX_LATCHED_INDEXES; index++) lastCommands[0][1 + index / 8] |= 1 << (index % 8);
+
+	int lastResponseSizes[3] = {SPI_WHOLE_FRAMES_SIZE(1 + 4 * (MAX_LATCHED_INDEXES - 1)),
+		SPI_COMMAND_RESPONSE_FRAME_SIZE, SPI_COMMAND_RESPONSE_FRAME_SIZE};
+
+	uint8_t lastResponses[SPI_MAX_RESPONSE_SIZE + 2 * SPI_COMMAND_RESPONSE_FRAME_SIZE];
+	uint8_t* indexResponse = lastResponses + lastResponseSizes[0];
+
+	if(!hostSpiMasterPipelinedCommands(lastCommands[0], 3, lastResponses, lastResponseSizes) ||
+		lastResponses[0] != GET_LATCHED_DATA_MULTI || indexResponse[0] != GET_LATCHED_DATA_INDEX ||
+		indexResponse[1] != SPEED_KMH || indexResponse[SPI_COMMAND_RESPONSE_FRAME_SIZE + 1] != SPI_PROTOCOL_HALF_DUPLEX)
+	{
+		wrongResponses++;
+	}
+
+	return wrongResponses;
+}
+
+/**
+ * Agree length-prefixed frames from the capabilities, then run the throughput commands as single value reads and as
+ * bulk reads of every value. Leaves the protocol at SPI_PROTOCOL_HALF_DUPLEX.
+ * @returns Number of wrong responses.
+ */
+static int _throughputFramed()
+{
+	uint8_t response[SPI_MAX_FRAME_PAYLOAD_SIZE];
+
+	uint8_t getCapabilities[SPI_COMMAND_RESPONSE_FRAME_SIZE] = {GET_CAPABILITIES};
+
+	if(!_command(getCapabilities, response) || response[1] < SPI_PROTOCOL_FRAMED)
+	{
+		printf("Length-prefixed frames not supported.\n");
+		return 1;
+	}
+
+	int maxPayloadSize = response[2] | response[3] << 8;
+
+	uint8_t setVersion[SPI_COMMAND_RESPONSE_FRAME_SIZE] = {SET_PROTOCOL_VERSION, SPI_PROTOCOL_FRAMED,
+		maxPayloadSize & 0xFF, (maxPayloadSize >> 8) & 0xFF};
+
+	if(!_command(setVersion, response) || response[1] != SPI_PROTOCOL_FRAMED ||
+		(response[2] | response[3] << 8) != maxPayloadSize)
+	{
+		printf("Length-prefixed frames not negotiated.\n");
+		return 1;
+	}
+
+	int wrongResponses = 0;
+
+	double startTime = _realTimeSeconds();
+	uint64_t startBytes = hostSpiByteCount();
+	uint64_t startHandshakes = hostSpiHandshakeCount();
+
+	for(int index = 0; index < _throughputCommands; index++)
+	{
+		uint8_t command[2] = {GET_LATCHED_DATA, 1 + index % (MAX_LATCHED_INDEXES - 1)};
+
+		if(hostSpiMasterFramedCommand(command, sizeof(command), response, sizeof(response)) != 5 ||
+			response[0] != GET_LATCHED_DATA)
+		{
+			wrongResponses++;
+		}
+	}
+
+	_printThroughput("Length-prefixed", _throughputCommands, startTime, startBytes, startHandshakes);
+
+	// Every value in one frame. Trailing zero mask bytes are left off.
+	uint8_t bulkCommand[SPI_COMMAND_RESPONSE_FRAME_SIZE] = {GET_LATCHED_DATA_MULTI};
+
+	for(int index = 1; index < MAX_LATCHED_INDEXES; index++) bulkCommand[1 + index / 8] |= 1 << (index % 8);
+
+	int bulkCommandSize = 1 + (MAX_LATCHED_INDEXES - 1) / 8 + 1;
+	int bulkResponseSize = 1 + 4 * (MAX_LATCHED_INDEXES - 1);
+	int bulkCommands = _throughputCommands / (MAX_LATCHED_INDEXES - 1);
+
+	startTime = _realTimeSeconds();
+	startBytes = hostSpiByteCount();
+	startHandshakes = hostSpiHandshakeCount();
+
+	for(int index = 0; index < bulkCommands; index++)
+	{
+		if(hostSpiMasterFramedCommand(bulkCommand, bulkCommandSize, response, sizeof(response)) != bulkResponseSize ||
+			response[0] != GET_LATCHED_DATA_MULTI)
+		{
+			wrongResponses++;
+		}
+	}
+
+	_printThroughput("Length-prefixed bulk (per value)", bulkCommands * (MAX_LATCHED_INDEXES - 1), startTime, startBytes,
+		startHandshakes);
+
+	// A command payload much longer than the FIFOs.
+	uint8_t longCommand[SPI_MAX_FRAME_PAYLOAD_SIZE] = {GET_LATCHED_DATA_INDEX, 'E', 'R', 'M'};
+
+	if(hostSpiMasterFramedCommand(longCommand, maxPayloadSize, response, sizeof(response)) != 2 ||
+		response[1] != ENGINE_RPM)
+	{
+		wrongResponses++;
+	}
+
+	uint8_t halfDuplex[2] = {SET_PROTOCOL_VERSION, SPI_PROTOCOL_HALF_DUPLEX};
+
+	if(hostSpiMasterFramedCommand(halfDuplex, sizeof(halfDuplex), response, sizeof(response)) != 2 ||
+		response[1] != SPI_PROTOCOL_HALF_DUPLEX)
+	{
+		wrongResponses++;
+	}
+
+	return wrongResponses;
+}
+
+/**
+ * Run the same GET_LATCHED_DATA commands through each protocol version, checking the responses, and compare their
+ * throughput.
+ */
+static void* _throughputMasterEntry(void* arg)
+{
+	(void)arg;
+
+	// Half duplex, the protocol every master starts with.
+	double startTime = _realTimeSeconds();
+	uint64_t startBytes = hostSpiByteCount();
+	uint64_t startHandshakes = hostSpiHandshakeCount();
+
+	for(int index = 0; index < _throughputCommands; index++)
+	{
+		_getLatchedData(1 + index % (MAX_LATCHED_INDEXES - 1));
+	}
+
+	_printThroughput("Half duplex", _throughputCommands, startTime, startBytes, startHandshakes);
+
+	int wrongResponses = _throughputPipelined();
+	wrongResponses += _throughputFramed();
+
+	// Check a half duplex command still works.
+	uint8_t command[SPI_COMMAND_RESPONSE_FRAME_SIZE] = {GET_LATCHED_DATA_INDEX, 'E', 'T', 'C'};
+	uint8_t response[SPI_COMMAND_RESPONSE_FRAME_SIZE];
+
+	if(!_command(command, response) || response[1] != ENGINE_TEMP_C) wrongResponses++;
+
+	if(wrongResponses) printf("%i wrong responses.\n", wrongResponses);
+
+	_failedCommands += wrongResponses;
+
+	__atomic_store_n(&_simDone, true, __ATOMIC_RELEASE);
+	__sev();
+
+	return 0;
+}
+
+/** Number of sensors each sensor config upload round sets up. */
+#define UPLOAD_SENSORS 3
+
+/**
+ * Make up the config of one of the upload sensors, as the drive sets them up but varied by round.
+ * @param sensor Upload sensor, 0 to UPLOAD_SENSORS - 1.
+ * @param setMask Returns the sensor variables set.
+ * @param values Returns the values, by sensor data id.
+ * @returns Latched data index of the sensor.
+ */
+static int _uploadSensorConfig(int round, int sensor, uint32_t* setMask, int32_t* values)
+{
+	static const int indexes[UPLOAD_SENSORS] = {ENGINE_RPM, SPEED_KMH, ENGINE_TEMP_C};
+
+	*setMask = 0;
+
+	_sensorConfigPut(setMask, values, SENSOR_TYPE, sensor < 2 ? PULSE_SENSOR : SCALED_VOLTAGE_SENSOR);
+	_sensorConfigPut(setMask, values, STROBE_INTERVAL, 1000 + round % 1000);
+	_sensorConfigPut(setMask, values, CHANGE_DEADBAND, round % 50);
+	_sensorConfigPut(setMask, values, FILTER_TYPE, round % 2 ? FILTER_MEDIAN : FILTER_NONE);
+	_sensorConfigPut(setMask, values, FILTER_LENGTH, 1 + round % 5);
+
+	if(sensor < 2)
+	{
+		_sensorConfigPut(setMask, values, PULSE_GPIO, -1);
+		_sensorConfigPut(setMask, values, PULSE_ACCUMULATION_INTERVAL, 100000 + round);
+		_sensorConfigPut(setMask, values, PULSE_PRE_SCALE, sensor ? 3600000 : 60000000);
+		_sensorConfigPut(setMask, values, PULSE_POST_SCALE, 1);
+		_sensorConfigPut(setMask, values, PULSE_TEST_DURATION_START, 10000 + round);
+		_sensorConfigPut(setMask, values, PULSE_TEST_DURATION_END, 20000);
+		_sensorConfigPut(setMask, values, PULSE_TEST_DURATION_STEP, 100);
+		_sensorConfigPut(setMask, values, PULSE_TEST_STEP_TIME_INTERVAL, 50000);
+	}
+	else
+	{
+		_sensorConfigPut(setMask, values, ADC_CHANNEL, TEMP_ADC_INPUT);
+		_sensorConfigPut(setMask, values, VOLTAGE_PRE_SCALE, 1 + round % 7);
+		_sensorConfigPut(setMask, values, VOLTAGE_POST_SCALE, 1);
+		_sensorConfigPut(setMask, values, VOLTAGE_CALIBRATION_TABLE, ENGINE_TEMP_NTC_CALIBRATION);
+	}
+
+	_sensorConfigPut(setMask, values, ACTIVE, 1);
+
+	return indexes[sensor];
+}
+
+/**
+ * Check every upload sensor reads back with GET_SENSOR_CONFIG as it was last set.
+ * @returns Number of sensors that read back wrong.
+ */
+static int _uploadReadBack(int round)
+{
+	int retVal = 0;
+
+	uint32_t setMask;
+	int32_t values[MAX_SENSOR_DATA];
+
+	for(int sensor = 0; sensor < UPLOAD_SENSORS; sensor++)
+	{
+		int index = _uploadSensorConfig(round, sensor, &setMask, values);
+
+		if(!_sensorConfigReadsBack(index, setMask, values)) retVal++;
+	}
+
+	return retVal;
+}
+
+/**
+ * Print the cost of a run of sensor config uploads.
+ * @param uploads Number of sensors set up.
+ * @param startTime Real time the run started.
+ * @param startBytes Bytes shifted before the run started.
+ * @param startHandshakes Handshakes done before the run started.
+ */
+static void _printUploads(const char* method, int uploads, double startTime, uint64_t startBytes,
+	uint64_t startHandshakes)
+{
+	double realTime = _realTimeSeconds() - startTime;
+	uint64_t bytes = hostSpiByteCount() - startBytes;
+
+	printf("%s: %i sensors set up in %.3f s. %.2f handshakes, %.1f bytes and %.1f us of bus time per sensor.\n", method,
+		uploads, realTime, (double)(hostSpiHandshakeCount() - startHandshakes) / uploads, (double)bytes / uploads,
+		bytes * 8 * 1e6 / SPI_BAUD / uploads);
+}
+
+/**
+ * Set the same sensors up with a SET_SENSOR_DATA per variable, then with a SET_SENSOR_CONFIG per sensor, half duplex
+ * and length-prefixed, comparing the cost and checking each reads back. Then check a SET_SENSOR_CONFIG that fails
+ * changes nothing, inside a batch fails the batch, and pipelined needs the whole command in its transfer.
+ */
+static void* _uploadMasterEntry(void* arg)
+{
+	(void)arg;
+
+	uint32_t setMask;
+	int32_t values[MAX_SENSOR_DATA];
+
+	int wrongResponses = 0;
+	int uploads = _configUploads * UPLOAD_SENSORS;
+
+	double startTime = _realTimeSeconds();
+	uint64_t startBytes = hostSpiByteCount();
+	uint64_t startHandshakes = hostSpiHandshakeCount();
+
+	for(int round = 0; round < _configUploads; round++)
+	{
+		for(int sensor = 0; sensor < UPLOAD_SENSORS; sensor++)
+		{
+			int index = _uploadSensorConfig(round, sensor, &setMask, values);
+
+			for(SensorData sensorVar = sensorConfigNextVar(0); sensorVar < MAX_SENSOR_DATA;
+				sensorVar = sensorConfigNextVar(sensorVar))
+			{
+				if(setMask & (1u << sensorVar)) _setSensorData(index, sensorVar, values[sensorVar]);
+			}
+		}
+	}
+
+	_printUploads("SET_SENSOR_DATA per variable", uploads, startTime, startBytes, startHandshakes);
+
+	wrongResponses += _uploadReadBack(_configUploads - 1);
+
+	startTime = _realTimeSeconds();
+	startBytes = hostSpiByteCount();
+	startHandshakes = hostSpiHandshakeCount();
+
+	for(int round = 0; round < _configUploads; round++)
+	{
+		for(int sensor = 0; sensor < UPLOAD_SENSORS; sensor++)
+		{
+			int index = _uploadSensorConfig(round, sensor, &setMask, values);
+
+			_setSensorConfig(index, setMask, values);
+		}
+	}
+
+	_printUploads("SET_SENSOR_CONFIG half duplex", uploads, startTime, startBytes, startHandshakes);
+
+	wrongResponses += _uploadReadBack(_configUploads - 1);
+
+	// Length-prefixed, leaving off the padding.
+	uint8_t command[SPI_MAX_COMMAND_SIZE];
+	uint8_t response[SPI_MAX_FRAME_PAYLOAD_SIZE];
+
+	uint8_t setVersion[SPI_COMMAND_RESPONSE_FRAME_SIZE] = {SET_PROTOCOL_VERSION, SPI_PROTOCOL_FRAMED,
+		SPI_MAX_FRAME_PAYLOAD_SIZE & 0xFF, (SPI_MAX_FRAME_PAYLOAD_SIZE >> 8) & 0xFF};
+
+	if(!_command(setVersion, response) || response[1] != SPI_PROTOCOL_FRAMED) wrongResponses++;
+
+	startTime = _realTimeSeconds();
+	startBytes = hostSpiByteCount();
+	startHandshakes = hostSpiHandshakeCount();
+
+	for(int round = 0; round < _configUploads; round++)
+	{
+		for(int sensor = 0; sensor < UPLOAD_SENSORS; sensor++)
+		{
+			int index = _uploadSensorConfig(round, sensor, &setMask, values);
+			int commandSize = 6 + 4 * __builtin_popcount(setMask);
+
+			_sensorConfigCommand(index, setMask, values, command);
+
+			if(hostSpiMasterFramedCommand(command, commandSize, response, sizeof(response)) != 2 ||
+				response[0] != SET_SENSOR_CONFIG || response[1] != 0)
+			{
+				wrongResponses++;
+			}
+		}
+	}
+
+	_printUploads("SET_SENSOR_CONFIG length-prefixed", uploads, startTime, startBytes, startHandshakes);
+
+	// A payload shorter than its mask says is a bad command, rather than read with the missing values as 0.
+	int shortIndex = _uploadSensorConfig(_configUploads, 0, &setMask, values);
+
+	_sensorConfigCommand(shortIndex, setMask, values, command);
+
+	if(hostSpiMasterFramedCommand(command, 2 + 4 * __builtin_popcount(setMask), response, sizeof(response)) !=
+		SPI_COMMAND_RESPONSE_FRAME_SIZE || response[0] != 0xFF)
+	{
+		wrongResponses++;
+	}
+
+	uint8_t halfDuplex[2] = {SET_PROTOCOL_VERSION, SPI_PROTOCOL_HALF_DUPLEX};
+
+	if(hostSpiMasterFramedCommand(halfDuplex, sizeof(halfDuplex), response, sizeof(response)) != 2) wrongResponses++;
+
+	wrongResponses += _uploadReadBack(_configUploads - 1);
+
+	// A value out of bounds part way through changes nothing.
+	int index = _uploadSensorConfig(_configUploads, 0, &setMask, values);
+	values[FILTER_LENGTH] = 0;
+
+	int commandSize = _sensorConfigCommand(index, setMask, values, command);
+
+	if(!hostSpiMasterCommand(command, commandSize, response, SPI_COMMAND_RESPONSE_FRAME_SIZE) || response[1] != 1)
+	{
+		wrongResponses++;
+	}
+
+	wrongResponses += _uploadReadBack(_configUploads - 1);
+
+	// Inside a batch, the good sensor is held back with the bad one.
+	uint8_t beginBatch[SPI_COMMAND_RESPONSE_FRAME_SIZE] = {BEGIN_SENSOR_DATA_BATCH};
+	uint8_t commitBatch[SPI_COMMAND_RESPONSE_FRAME_SIZE] = {COMMIT_SENSOR_DATA_BATCH};
+
+	_command(beginBatch, response);
+
+	int goodIndex = _uploadSensorConfig(_configUploads, 1, &setMask, values);
+	_setSensorConfig(goodIndex, setMask, values);
+
+	if(!hostSpiMasterCommand(command, commandSize, response, SPI_COMMAND_RESPONSE_FRAME_SIZE) || response[1] != 1)
+	{
+		wrongResponses++;
+	}
+
+	if(!_command(commitBatch, response) || response[1] != 1) wrongResponses++;
+
+	wrongResponses += _uploadReadBack(_configUploads - 1);
+
+	// A pulse post-scale of 0 is out of bounds too, as every value of the sensor is divided by it.
+	int zeroScaleIndex = _uploadSensorConfig(_configUploads, 1, &setMask, values);
+	values[PULSE_POST_SCALE] = 0;
+
+	int zeroScaleSize = _sensorConfigCommand(zeroScaleIndex, setMask, values, command);
+
+	if(!hostSpiMasterCommand(command, zeroScaleSize, response, SPI_COMMAND_RESPONSE_FRAME_SIZE) || response[1] != 1)
+	{
+		wrongResponses++;
+	}
+
+	wrongResponses += _uploadReadBack(_configUploads - 1);
+
+	// A variable of the other sensor type is turned away, on its own or in a descriptor, as it would corrupt the sensor.
+	uint8_t wrongType[SPI_COMMAND_RESPONSE_FRAME_SIZE] = {SET_SENSOR_DATA, ENGINE_TEMP_C, PULSE_ACCUMULATION_INTERVAL,
+		0x00, 0xE1, 0xF5, 0x05};
+
+	if(!_command(wrongType, response) || response[1] != 1) wrongResponses++;
+
+	int wrongTypeIndex = _uploadSensorConfig(_configUploads, 2, &setMask, values);
+	_sensorConfigPut(&setMask, values, PULSE_ACCUMULATION_INTERVAL, 100000000);
+
+	int wrongTypeSize = _sensorConfigCommand(wrongTypeIndex, setMask, values, command);
+
+	if(!hostSpiMasterCommand(command, wrongTypeSize, response, SPI_COMMAND_RESPONSE_FRAME_SIZE) || response[1] != 1)
+	{
+		wrongResponses++;
+	}
+
+	wrongResponses += _uploadReadBack(_configUploads - 1);
+
+	// A mask with bit 0, or a bit for an id that doesn't exist, is a bad command rather than having values read for it.
+	uint8_t badMasks[2][SPI_COMMAND_RESPONSE_FRAME_SIZE] = {
+		{SET_SENSOR_CONFIG, ENGINE_TEMP_C, 0x01, 0x00, 0x00, 0x00},
+		{SET_SENSOR_CONFIG, ENGINE_TEMP_C, 0x00, 0x00, 0x00, 0x80}
+	};
+
+	for(int badMask = 0; badMask < 2; badMask++)
+	{
+		if(!hostSpiMasterCommand(badMasks[badMask], SPI_COMMAND_RESPONSE_FRAME_SIZE, response,
+			SPI_COMMAND_RESPONSE_FRAME_SIZE) || response[0] != 0xFF)
+		{
+			wrongResponses++;
+		}
+	}
+
+	// A zero frame is only a NO_COMMAND when pipelined. Otherwise it is a bad command, as a line stuck low would send.
+	uint8_t zeroFrame[SPI_COMMAND_RESPONSE_FRAME_SIZE] = {NO_COMMAND};
+
+	if(!hostSpiMasterCommand(zeroFrame, SPI_COMMAND_RESPONSE_FRAME_SIZE, response, SPI_COMMAND_RESPONSE_FRAME_SIZE) ||
+		response[0] != 0xFF)
+	{
+		wrongResponses++;
+	}
+
+	// Pipelined, only the first frame is shifted in with the first transfer. An odd number of commands, so ready for
+	// command is low once the pipeline ends.
+	uint8_t pipelined[4][SPI_COMMAND_RESPONSE_FRAME_SIZE] = {
+		{SET_PROTOCOL_VERSION, SPI_PROTOCOL_PIPELINED},
+		{SET_SENSOR_CONFIG, index, 1 << STROBE_INTERVAL},
+		{GET_LATCHED_DATA_INDEX, 'E', 'T', 'C'},
+		{SET_PROTOCOL_VERSION, SPI_PROTOCOL_HALF_DUPLEX}
+	};
+
+	int pipelinedResponseSizes[3] = {SPI_COMMAND_RESPONSE_FRAME_SIZE, SPI_COMMAND_RESPONSE_FRAME_SIZE,
+		SPI_COMMAND_RESPONSE_FRAME_SIZE};
+
+	if(!_command(pipelined[0], response) ||
+		!hostSpiMasterPipelinedCommands(pipelined[1], 3, response, pipelinedResponseSizes) || response[0] != 0xFF ||
+		response[SPI_COMMAND_RESPONSE_FRAME_SIZE + 1] != ENGINE_TEMP_C ||
+		response[2 * SPI_COMMAND_RESPONSE_FRAME_SIZE + 1] != SPI_PROTOCOL_HALF_DUPLEX)
+	{
+		wrongResponses++;
+	}
+
+	wrongResponses += _uploadReadBack(_configUploads - 1);
+
+	if(wrongResponses) printf("%i wrong responses.\n", wrongResponses);
+
+	_failedCommands += wrongResponses;
+
+	__atomic_store_n(&_simDone, true, __ATOMIC_RELEASE);
+	__sev();
+
+	return 0;
+}
+
+/**
+ * Build the command frame for a load benchmark command. Cycles through the latched data indexes.
+ * @param loadCommand Command (enum LoadCommand).
+ * @param sequence Command number, to pick the index by.
+ * @param command Returns the command frame.
+ */
+static void _loadCommandFrame(int loadCommand, int sequence, uint8_t* command)
+{
+	static const char* names[] = {"ERM", "SKH", "ETC"};
+
+	int index = 1 + sequence % (MAX_LATCHED_INDEXES - 1);
+
+	for(int byte = 0; byte < SPI_COMMAND_RESPONSE_FRAME_SIZE; byte++) command[byte] = 0;
+
+	switch(loadCommand)
+	{
+		case LOAD_GET_LATCHED_DATA:
+
+			command[0] = GET_LATCHED_DATA;
+			command[1] = index;
+			break;
+
+		case LOAD_SET_SENSOR_DATA:
+
+			// Doesn't change what any sensor does. Deadbands are off until set.
+			command[0] = SET_SENSOR_DATA;
+			command[1] = index;
+			command[2] = CHANGE_DEADBAND;
+			command[3] = command[4] = command[5] = command[6] = 0xFF;
+			break;
+
+		case LOAD_GET_LATCHED_DATA_INDEX:
+
+			command[0] = GET_LATCHED_DATA_INDEX;
+			memcpy(command + 1, names[sequence % 3], MAX_LATCH_DATA_INDEX_NAME_SIZE);
+			break;
+	}
+}
+
+/**
+ * Whether a response to a load benchmark command is right.
+ */
+static bool _loadResponseRight(const uint8_t* command, const uint8_t* response)
+{
+	bool retVal = response[0] == command[0];
+
+	if(command[0] == SET_SENSOR_DATA) retVal = retVal && response[1] == 0;
+
+	if(command[0] == GET_LATCHED_DATA_INDEX)
+	{
+		retVal = retVal && response[1] == getLatchedDataIndex((const char*)command + 1);
+	}
+
+	return retVal;
+}
+
+static int _compareUint32(const void* a, const void* b)
+{
+	uint32_t valueA = *(const uint32_t*)a;
+	uint32_t valueB = *(const uint32_t*)b;
+
+	return valueA < valueB ? -1 : valueA > valueB;
+}
+
+/**
+ * Print the JSON object for one protocol's load benchmark run.
+ * @param protocol Protocol name.
+ * @param commands Number of commands run.
+ * @param latenciesNs Master side latency of each command, in nanoseconds. Sorted in place.
+ * @param startTime Real time the run started.
+ * @param startBytes Bytes shifted before the run started.
+ * @param startHandshakes Handshakes done before the run started.
+ * @param wrongResponses Number of wrong responses.
+ * @param last Whether this is the last protocol, so no comma follows.
+ */
+static void _printLoadJson(const char* protocol, int commands, uint32_t* latenciesNs, double startTime,
+	uint64_t startBytes, uint64_t startHandshakes, int wrongResponses, bool last)
+{
+	double realTime = _realTimeSeconds() - startTime;
+
+	qsort(latenciesNs, commands, sizeof(uint32_t), _compareUint32);
+
+	// Nearest rank percentiles.
+	double percentiles[] = {50, 99, 99.9};
+	double latenciesUs[3];
+
+	for(int percentile = 0; percentile < 3; percentile++)
+	{
+		int rank = (int)ceil(percentiles[percentile] / 100 * commands);
+
+		latenciesUs[percentile] = latenciesNs[rank > 0 ? rank - 1 : 0] / 1e3;
+	}
+
+	printf("\t\t{\n");
+	printf("\t\t\t\"protocol\": \"%s\",\n", protocol);
+	printf("\t\t\t\"commands\": %i,\n", commands);
+	printf("\t\t\t\"seconds\": %.6f,\n", realTime);
+	printf("\t\t\t\"commands_per_second\": %.0f,\n", commands / realTime);
+	printf("\t\t\t\"bytes_per_command\": %.2f,\n", (double)(hostSpiByteCount() - startBytes) / commands);
+	printf("\t\t\t\"handshakes_per_command\": %.3f,\n", (double)(hostSpiHandshakeCount() - startHandshakes) / commands);
+	printf("\t\t\t\"wrong_responses\": %i,\n", wrongResponses);
+	printf("\t\t\t\"latency_us\": {\"p50\": %.3f, \"p99\": %.3f, \"p999\": %.3f, \"max\": %.3f}\n", latenciesUs[0],
+		latenciesUs[1], latenciesUs[2], latenciesNs[commands - 1] / 1e3);
+	printf("\t\t}%s\n", last ? "" : ",");
+}
+
+/**
+ * Load benchmark. Runs the same weighted random mix of GET_LATCHED_DATA, SET_SENSOR_DATA and GET_LATCHED_DATA_INDEX
+ * commands through each protocol version, timing every command from the master's side, and prints the throughput and
+ * latency percentiles as JSON on stdout.
+ * Latency is real time, from the master raising command active to it having the whole response. A pipelined command's
+ * latency is that of the whole command cycle it was in, since that is when the master has its response.
+ */
+static void* _loadMasterEntry(void* arg)
+{
+	(void)arg;
+
+	int mixTotal = 0;
+
+	for(int loadCommand = 0; loadCommand < MAX_LOAD_COMMANDS; loadCommand++) mixTotal += _loadMix[loadCommand];
+
+	uint8_t (*commands)[SPI_COMMAND_RESPONSE_FRAME_SIZE] = malloc(_loadCommands * SPI_COMMAND_RESPONSE_FRAME_SIZE);
+	uint32_t* latenciesNs = malloc(_loadCommands * sizeof(uint32_t));
+
+	// The same mix, in the same order, for every protocol.
+	srand(3);
+
+	for(int index = 0; index < _loadCommands; index++)
+	{
+		int pick = rand() % mixTotal;
+		int loadCommand = 0;
+
+		while(pick >= _loadMix[loadCommand]) pick -= _loadMix[loadCommand++];
+
+		_loadCommandFrame(loadCommand, index, commands[index]);
+	}
+
+	printf("{\n");
+	printf("\t\"benchmark\": \"spi_load\",\n");
+	printf("\t\"spi_dma\": %s,\n", SPI_LATCH_DMA ? "true" : "false");
+	printf("\t\"mix\": {\"GET_LATCHED_DATA\": %i, \"SET_SENSOR_DATA\": %i, \"GET_LATCHED_DATA_INDEX\": %i},\n",
+		_loadMix[LOAD_GET_LATCHED_DATA], _loadMix[LOAD_SET_SENSOR_DATA], _loadMix[LOAD_GET_LATCHED_DATA_INDEX]);
+	printf("\t\"protocols\": [\n");
+
+	uint8_t response[SPI_MAX_FRAME_PAYLOAD_SIZE];
+	int wrongResponses = 0;
+
+	// Half duplex, the protocol every master starts with.
+	double startTime = _realTimeSeconds();
+	uint64_t startBytes = hostSpiByteCount();
+	uint64_t startHandshakes = hostSpiHandshakeCount();
+
+	for(int index = 0; index < _loadCommands; index++)
+	{
+		double commandStart = _realTimeSeconds();
+
+		bool done = hostSpiMasterCommand(commands[index], SPI_COMMAND_RESPONSE_FRAME_SIZE, response,
+			SPI_COMMAND_RESPONSE_FRAME_SIZE);
+
+		latenciesNs[index] = (_realTimeSeconds() - commandStart) * 1e9;
+
+		if(!done || !_loadResponseRight(commands[index], response)) wrongResponses++;
+	}
+
+	_printLoadJson("half_duplex", _loadCommands, latenciesNs, startTime, startBytes, startHandshakes, wrongResponses,
+		false);
+
+	_failedCommands += wrongResponses;
+	wrongResponses = 0;
+
+	// Pipelined, THROUGHPUT_PIPELINE_DEPTH commands a command cycle.
+	uint8_t setVersion[SPI_COMMAND_RESPONSE_FRAME_SIZE] = {SET_PROTOCOL_VERSION, SPI_PROTOCOL_PIPELINED};
+
+	if(!_command(setVersion, response) || response[1] != SPI_PROTOCOL_PIPELINED) _failedCommands++;
+
+	uint8_t responses[THROUGHPUT_PIPELINE_DEPTH][SPI_COMMAND_RESPONSE_FRAME_SIZE];
+	int responseSizes[THROUGHPUT_PIPELINE_DEPTH];
+
+	for(int pipe = 0; pipe < THROUGHPUT_PIPELINE_DEPTH; pipe++) responseSizes[pipe] = SPI_COMMAND_RESPONSE_FRAME_SIZE;
+
+	startTime = _realTimeSeconds();
+	startBytes = hostSpiByteCount();
+	startHandshakes = hostSpiHandshakeCount();
+
+	for(int index = 0; index < _loadCommands; index += THROUGHPUT_PIPELINE_DEPTH)
+	{
+		int count = _loadCommands - index < THROUGHPUT_PIPELINE_DEPTH ? _loadCommands - index : THROUGHPUT_PIPELINE_DEPTH;
+
+		double cycleStart = _realTimeSeconds();
+
+		bool done = hostSpiMasterPipelinedCommands(commands[index], count, responses[0], responseSizes);
+
+		uint32_t cycleNs = (_realTimeSeconds() - cycleStart) * 1e9;
+
+		for(int pipe = 0; pipe < count; pipe++)
+		{
+			latenciesNs[index + pipe] = cycleNs;
+
+			if(!done || !_loadResponseRight(commands[index + pipe], responses[pipe])) wrongResponses++;
+		}
+	}
+
+	_printLoadJson("pipelined", _loadCommands, latenciesNs, startTime, startBytes, startHandshakes, wrongResponses,
+		false);
+
+	_failedCommands += wrongResponses;
+	wrongResponses = 0;
+
+	uint8_t halfDuplex[SPI_COMMAND_RESPONSE_FRAME_SIZE] = {SET_PROTOCOL_VERSION, SPI_PROTOCOL_HALF_DUPLEX};
+	int halfDuplexSize = SPI_COMMAND_RESPONSE_FRAME_SIZE;
+
+	if(!hostSpiMasterPipelinedCommands(halfDuplex, 1, response, &halfDuplexSize) ||
+		response[1] != SPI_PROTOCOL_HALF_DUPLEX)
+	{
+		_failedCommands++;
+	}
+
+	// Length-prefixed, each command without its trailing padding.
+	setVersion[1] = SPI_PROTOCOL_FRAMED;
+	setVersion[2] = SPI_MAX_FRAME_PAYLOAD_SIZE & 0xFF;
+	setVersion[3] = (SPI_MAX_FRAME_PAYLOAD_SIZE >> 8) & 0xFF;
+
+	if(!_command(setVersion, response) || response[1] != SPI_PROTOCOL_FRAMED) _failedCommands++;
+
+	startTime = _realTimeSeconds();
+	startBytes = hostSpiByteCount();
+	startHandshakes = hostSpiHandshakeCount();
+
+	for(int index = 0; index < _loadCommands; index++)
+	{
+		int commandSize = SPI_COMMAND_RESPONSE_FRAME_SIZE;
+
+		while(commandSize > 1 && commands[index][commandSize - 1] == 0) commandSize--;
+
+		double commandStart = _realTimeSeconds();
+
+		int responseSize = hostSpiMasterFramedCommand(commands[index], commandSize, response, sizeof(response));
+
+		latenciesNs[index] = (_realTimeSeconds() - commandStart) * 1e9;
+
+		if(responseSize < 2 || !_loadResponseRight(commands[index], response)) wrongResponses++;
+	}
+
+	_printLoadJson("length_prefixed", _loadCommands, latenciesNs, startTime, startBytes, startHandshakes,
+		wrongResponses, true);
+
+	_failedCommands += wrongResponses;
+
+	if(hostSpiMasterFramedCommand(halfDuplex, 2, response, sizeof(response)) != 2 ||
+		response[1] != SPI_PROTOCOL_HALF_DUPLEX)
+	{
+		_failedCommands++;
+	}
+
+	printf("\t],\n");
+	printf("\t\"failed_commands\": %i\n", _failedCommands);
+	printf("}\n");
+
+	free(commands);
+	free(latenciesNs);
+
+	__atomic_store_n(&_simDone, true, __ATOMIC_RELEASE);
+	__sev();
+
+	return 0;
+}
+
+static void* _masterEntry(void* arg)
+{
+	(void)arg;
+
+	int rpmIndex = _getLatchedDataIndex("ERM");
+	int speedIndex = _getLatchedDataIndex("SKH");
+	int tempIndex = _getLatchedDataIndex("ETC");
+
+	// One pulse per engine revolution and one pulse per metre travelled.
+	_configurePulseSensor(rpmIndex, 1000, 100000, 60000000, 60000000 / 800, RPM_PULSE_GPIO);
+	_configurePulseSensor(speedIndex, 1000, 250000, 3600000, 0, SPEED_PULSE_GPIO);
+
+	// NTC sender through its calibration table.
+	const struct CalibrationCurve* tempCurve = calibrationCurves + ENGINE_TEMP_NTC_CALIBRATION;
+
+	hostAdcSetInput(TEMP_ADC_INPUT, _curveAdcLevel(tempCurve, _engineTemp(0)), TEMP_ADC_NOISE);
+	_configureVoltageSensor(tempIndex, 100000, TEMP_ADC_INPUT, ENGINE_TEMP_NTC_CALIBRATION);
+
+	uint64_t endTimeMs = (uint64_t)_simSeconds * 1000;
+	uint64_t timeMs = 0;
+
+	int rpm = 0;
+	int speed = 0;
+
+	absolute_time_t nextRpmEdge = 0;
+	absolute_time_t nextSpeedEdge = 0;
+
+	// Latched data as the dashboard has it.
+	int latchedData[MAX_LATCHED_INDEXES] = {0};
+
+	if(_refreshPush)
+	{
+		// Roughly what a needle can show.
+		_setSensorData(rpmIndex, CHANGE_DEADBAND, 25);
+		_setSensorData(speedIndex, CHANGE_DEADBAND, 0);
+		_setSensorData(tempIndex, CHANGE_DEADBAND, 2);
+	}
+
+	while(timeMs < endTimeMs)
+	{
+		// Let the latcher run up to the next poll.
+		for(int elapsedUs = 0; elapsedUs < _pollIntervalMs * 1000; elapsedUs += _clockStepUs)
+		{
+			hostClockAdvance(_clockStepUs);
+
+			if(_liveEdges)
+			{
+				_driveEdges(RPM_PULSE_GPIO, rpm ? 60000000 / rpm : 0, &nextRpmEdge);
+				_driveEdges(SPEED_PULSE_GPIO, speed ? 3600000 / speed : 0, &nextSpeedEdge);
+			}
+
+			hostClockSync();
+
+			// Changes are got as soon as they are flagged rather than at the next poll.
+			if(_refreshPush) _getChanged(latchedData);
+		}
+
+		timeMs += _pollIntervalMs;
+
+		if(!_refreshPush) _refreshDashboard(latchedData);
+
+		int latchedRpm = latchedData[rpmIndex];
+		int latchedSpeed = latchedData[speedIndex];
+		int latchedTemp = latchedData[tempIndex];
+
+		// Latched values lag by up to an accumulation interval so this is a measure of lag as much as accuracy.
+		if(timeMs > 1000)
+		{
+			_rpmErrorSum += abs(latchedRpm - rpm);
+			_speedErrorSum += abs(latchedSpeed - speed);
+			_tempErrorSum += abs(latchedTemp - _engineTemp(timeMs));
+			_errorSamples++;
+		}
+
+		if(isGaugeHomed(0))
+		{
+			if(!_tachoHomedMs) _tachoHomedMs = timeMs;
+
+			int lag = abs(getGaugePosition(0) - getGaugeTargetPosition(0, getLatchedData(ENGINE_RPM)));
+
+			_tachoLagSum += lag;
+			_tachoLagSamples++;
+
+			if(lag > _tachoMaxLag) _tachoMaxLag = lag;
+		}
+
+		if(debugMsgActive && timeMs % 1000 == 0)
+		{
+			printf("t=%lus rpm=%i/%i speed=%i/%i temp=%i/%i\n", timeMs / 1000, latchedRpm, rpm, latchedSpeed, speed,
+				latchedTemp, _engineTemp(timeMs));
+		}
+
+		// Move the car on.
+		int newRpm, newSpeed;
+		_driveProfile(timeMs, &newRpm, &newSpeed);
+
+		if(newRpm != rpm) _setSensorData(rpmIndex, PULSE_TEST_DURATION_START, 60000000 / newRpm);
+		if(newSpeed != speed) _setSensorData(speedIndex, PULSE_TEST_DURATION_START, newSpeed ? 3600000 / newSpeed : 0);
+
+		rpm = newRpm;
+		speed = newSpeed;
+
+		hostAdcSetInput(TEMP_ADC_INPUT, _curveAdcLevel(tempCurve, _engineTemp(timeMs)), TEMP_ADC_NOISE);
+
+#if PICO_DASH_HISTORY
+
+		if(_historyLog && (timeMs % HISTORY_LOG_INTERVAL_MS == 0 || timeMs >= endTimeMs))
+		{
+			_logHistory(rpmIndex);
+			_logHistory(speedIndex);
+			_logHistory(tempIndex);
+		}
+
+#endif
+	}
+
+#if PICO_DASH_HISTORY
+
+	if(_historyLog)
+	{
+		_getHistoryHeld(rpmIndex);
+		_getHistoryHeld(speedIndex);
+		_getHistoryHeld(tempIndex);
+	}
+
+#endif
+
+#if PICO_DASH_STATS
+	_getDriveStats();
+#endif
+
+	__atomic_store_n(&_simDone, true, __ATOMIC_RELEASE);
+	__sev();
+
+	return 0;
+}
+
+
+/**
+ * Time command frame decode and response build on its own, with no SPI transfer or handshake.
+ * @param iterations Number of frames to process.
+ */
+static void _benchmarkFrameDecode(int iterations)
+{
+	// Each of the commands in turn. The latcher isn't running so the values don't matter.
+	const uint8_t commands[][SPI_COMMAND_RESPONSE_FRAME_SIZE] = {
+		{GET_LATCHED_DATA_INDEX, 'E', 'R', 'M'},
+		{GET_LATCHED_DATA_RESOLUTION, ENGINE_TEMP_C},
+		{GET_LATCHED_DATA, ENGINE_RPM},
+		{SET_SENSOR_DATA, SPEED_KMH, STROBE_INTERVAL, 0xE8, 0x03, 0, 0}
+	};
+
+	const int numCommands = sizeof(commands) / sizeof(commands[0]);
+
+	uint8_t response[SPI_COMMAND_RESPONSE_FRAME_SIZE];
+
+	initLatcher();
+
+	double startTime = _realTimeSeconds();
+
+	for(int iteration = 0; iteration < iterations; iteration++)
+	{
+		processSpiCommandFrame(commands[iteration % numCommands], response);
+	}
+
+	double realTime = _realTimeSeconds() - startTime;
+
+	printf("Processed %i command frames in %.3f s, %.1f ns per frame.\n", iterations, realTime,
+		realTime * 1e9 / iterations);
+}
+
+/**
+ * Run a full schedule queue of items with assorted intervals through the same fixed rate rescheduling as the latcher,
+ * checking that items always come off in deadline order and each is due exactly as often as its interval says.
+ * @param strobes Number of strobes to run.
+ * @returns True if the schedule was always correct.
+ */
+static bool _benchmarkSchedule(int strobes)
+{
+	static struct SchedQueue queue;
+
+	int intervals[MAX_SCHED_ITEMS];
+	int strobeCounts[MAX_SCHED_ITEMS] = {0};
+
+	schedQueueInit(&queue);
+
+	for(int id = 0; id < MAX_SCHED_ITEMS; id++)
+	{
+		// Spread of intervals from 1ms to about 100ms, with plenty of coinciding deadlines.
+		intervals[id] = 1000 * (1 + (id * 37) % 100);
+		schedQueueSet(&queue, id, intervals[id]);
+	}
+
+	int outOfOrder = 0;
+	absolute_time_t lastDeadline = 0;
+
+	double startTime = _realTimeSeconds();
+
+	for(int strobe = 0; strobe < strobes; strobe++)
+	{
+		const struct SchedEntry* next = schedQueuePeek(&queue);
+
+		int id = next -> id;
+		absolute_time_t deadline = next -> deadline;
+
+		if(deadline < lastDeadline) outOfOrder++;
+
+		lastDeadline = deadline;
+		strobeCounts[id]++;
+
+		schedQueueSet(&queue, id, deadline + intervals[id]);
+	}
+
+	double realTime = _realTimeSeconds() - startTime;
+
+	// Every item must have been strobed once per interval up to the last deadline, give or take the one in progress.
+	int wrongCounts = 0;
+
+	for(int id = 0; id < MAX_SCHED_ITEMS; id++)
+	{
+		int expected = lastDeadline / intervals[id];
+
+		if(strobeCounts[id] < expected - 1 || strobeCounts[id] > expected + 1) wrongCounts++;
+	}
+
+	printf("Scheduled %i strobes of %i sensors in %.3f s, %.1f ns per strobe. %i out of order, %i wrong counts.\n",
+		strobes, MAX_SCHED_ITEMS, realTime, realTime * 1e9 / strobes, outOfOrder, wrongCounts);
+
+	return outOfOrder == 0 && wrongCounts == 0;
+}
+
+/**
+ * Check the decimation kernel against a plain per channel sum for every round robin width, then time it on full width
+ * buffers.
+ * @param buffers Number of buffers to time.
+ * @returns True if the kernel's sums were always right.
+ */
+static bool _benchmarkDecimation(int buffers)
+{
+	const int samplesPerChannel = 1 << ADC_DECIMATION_LOG2;
+
+	static uint16_t samples[MAX_ADC_INPUTS << ADC_DECIMATION_LOG2];
+
+	uint32_t seed = 1;
+
+	for(int sample = 0; sample < (MAX_ADC_INPUTS << ADC_DECIMATION_LOG2); sample++)
+	{
+		seed = seed * 1664525 + 1013904223;
+		samples[sample] = (seed >> 16) & 0xFFF;
+	}
+
+	int wrongSums = 0;
+
+	for(int channelCount = 1; channelCount <= MAX_ADC_INPUTS; channelCount++)
+	{
+		uint32_t sums[MAX_ADC_INPUTS];
+		decimateInterleaved(samples, channelCount, samplesPerChannel, sums);
+
+		for(int channel = 0; channel < channelCount; channel++)
+		{
+			uint32_t expected = 0;
+
+			for(int sample = 0; sample < samplesPerChannel; sample++) expected += samples[sample * channelCount + channel];
+
+			if(sums[channel] != expected) wrongSums++;
+		}
+	}
+
+	// Full scale in must be full scale out.
+	for(int sample = 0; sample < samplesPerChannel; sample++) samples[sample] = 0xFFF;
+
+	uint32_t fullScaleSum;
+	decimateInterleaved(samples, 1, samplesPerChannel, &fullScaleSum);
+
+	if(decimatedValue(fullScaleSum, ADC_DECIMATION_LOG2) != 0xFFF << (ADC_DECIMATED_BITS - ADC_SAMPLE_BITS)) wrongSums++;
+
+	double startTime = _realTimeSeconds();
+
+	uint32_t checksum = 0;
+
+	for(int buffer = 0; buffer < buffers; buffer++)
+	{
+		uint32_t sums[MAX_ADC_INPUTS];
+
+		// Alternate widths so both the unrolled and the general loop are timed.
+		int channelCount = buffer & 1 ? MAX_ADC_INPUTS : 2;
+
+		decimateInterleaved(samples, channelCount, samplesPerChannel, sums);
+
+		checksum += sums[0];
+	}
+
+	double realTime = _realTimeSeconds() - startTime;
+
+	int samplesTimed = buffers / 2 * (MAX_ADC_INPUTS + 2) * samplesPerChannel;
+
+	printf("Decimated %i buffers in %.3f s, %.2f ns per sample (checksum %u). %i wrong sums.\n", buffers, realTime,
+		realTime * 1e9 / samplesTimed, checksum, wrongSums);
+
+	return wrongSums == 0;
+}
+
+/** Read the CPU cycle counter, where there is one to read. Always 0 otherwise. */
+static uint64_t _cycleCount()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __builtin_ia32_rdtsc();
+#else
+	return 0;
+#endif
+}
+
+/**
+ * Filter of a whole window of values, worked out from scratch.
+ * @param window Values in the window, oldest first.
+ * @param count Number of values in the window.
+ */
+static int _referenceFilter(int type, const int* window, int count)
+{
+	int sorted[FILTER_MAX_LENGTH];
+	int64_t sum = 0;
+
+	for(int index = 0; index < count; index++)
+	{
+		sum += window[index];
+
+		int posn = index;
+
+		for(; posn > 0 && sorted[posn - 1] > window[index]; posn--) sorted[posn] = sorted[posn - 1];
+
+		sorted[posn] = window[index];
+	}
+
+	return type == FILTER_MOVING_AVERAGE ? sum / count
+		: count & 1 ? sorted[count / 2] : ((int64_t)sorted[count / 2 - 1] + sorted[count / 2]) / 2;
+}
+
+/**
+ * Check the moving average and median filters against filtering each window from scratch, at every length, and the
+ * exponential moving average against floating point. Then time updates of each filter at the longest length.
+ * @param updates Number of updates to time per filter.
+ * @returns True if every filtered value is right.
+ */
+static bool _benchmarkFilters(int updates)
+{
+	// Noisy values with the odd spike, as a sensor might give.
+	const int valueCount = 4096;
+
+	static int values[4096];
+
+	uint32_t seed = 1;
+
+	for(int index = 0; index < valueCount; index++)
+	{
+		seed = seed * 1664525 + 1013904223;
+
+		values[index] = 3000 + (int)(seed >> 24) - 128 + (seed % 61 == 0 ? 20000 : 0) - (index & 256 ? 1000 : 0);
+	}
+
+	int wrongValues = 0;
+	double maxEmaError = 0;
+
+	for(int type = FILTER_EMA; type < MAX_FILTER_TYPES; type++)
+	{
+		for(int length = 1; length <= FILTER_MAX_LENGTH; length++)
+		{
+			struct Filter filter;
+			configureFilter(&filter, type, length);
+
+			double ema = values[0];
+
+			for(int index = 0; index < valueCount; index++)
+			{
+				int filtered = filterUpdate(&filter, values[index]);
+
+				if(type == FILTER_EMA)
+				{
+					if(index > 0) ema += (values[index] - ema) / (1 << length);
+
+					// Fixed point truncation accumulates as a small bias.
+					double error = fabs(filtered - ema);
+					if(error > maxEmaError) maxEmaError = error;
+				}
+				else
+				{
+					int count = index + 1 < length ? index + 1 : length;
+
+					if(filtered != _referenceFilter(type, values + index + 1 - count, count)) wrongValues++;
+				}
+			}
+		}
+	}
+
+	// Within a unit either side of the exact average, plus rounding.
+	if(maxEmaError > 2) wrongValues++;
+
+	printf("Filters checked at lengths 1 to %i: %i wrong values, max EMA error %.2f.\n", FILTER_MAX_LENGTH, wrongValues,
+		maxEmaError);
+
+	const char* names[MAX_FILTER_TYPES] = {"none", "ema", "moving_average", "median"};
+
+	for(int type = FILTER_NONE; type < MAX_FILTER_TYPES; type++)
+	{
+		struct Filter filter;
+		configureFilter(&filter, type, type == FILTER_EMA ? 4 : type == FILTER_NONE ? 1 : FILTER_MAX_LENGTH);
+
+		int64_t checksum = 0;
+
+		double startTime = _realTimeSeconds();
+		uint64_t startCycles = _cycleCount();
+
+		for(int update = 0; update < updates; update++)
+		{
+			checksum += filterUpdate(&filter, values[update & (valueCount - 1)]);
+		}
+
+		uint64_t cycles = _cycleCount() - startCycles;
+		double realTime = _realTimeSeconds() - startTime;
+
+		printf("Filter %s length %i: %.2f ns, %.1f cycles per update (checksum %li).\n", names[type], filter.length,
+			realTime * 1e9 / updates, (double)cycles / updates, checksum);
+	}
+
+	return wrongValues == 0;
+}
+
+/**
+ * Check every calibration table against the sensor curve it was generated from at every ADC value within the curve,
+ * then time table lookups.
+ * @param lookups Number of lookups to time.
+ * @returns True if no table is out by more than a latched data unit anywhere.
+ */
+static bool _benchmarkCalibration(int lookups)
+{
+	bool retVal = true;
+
+	for(int tableId = NO_CALIBRATION + 1; tableId < MAX_CALIBRATION_TABLES; tableId++)
+	{
+		const struct CalibrationCurve* curve = calibrationCurves + tableId;
+
+		double maxError = 0;
+		double sumError = 0;
+		int maxErrorInput = 0;
+
+		int firstInput = curve -> inputs[0];
+		int lastInput = curve -> inputs[curve -> pointCount - 1];
+
+		for(int input = firstInput; input <= lastInput; input++)
+		{
+			double reference = _interpolate(curve -> inputs, curve -> outputs, curve -> pointCount, input)
+				/ (1 << CALIBRATION_FRACTION_BITS);
+
+			double error = fabs(calibrate(calibrationTables[tableId], input) - reference);
+
+			sumError += error;
+
+			if(error > maxError)
+			{
+				maxError = error;
+				maxErrorInput = input;
+			}
+		}
+
+		printf("%s: max error %.2f units at ADC %i, mean error %.3f units.\n", curve -> name, maxError, maxErrorInput,
+			sumError / (lastInput - firstInput + 1));
+
+		if(maxError > 1) retVal = false;
+	}
+
+	if(MAX_CALIBRATION_TABLES > NO_CALIBRATION + 1)
+	{
+		const struct CalibrationTable* table = calibrationTables[NO_CALIBRATION + 1];
+
+		// Volatile input so the lookups can't be hoisted out of the loop.
+		volatile uint32_t input = 0;
+		int checksum = 0;
+
+		double startTime = _realTimeSeconds();
+
+		for(int lookup = 0; lookup < lookups; lookup++)
+		{
+			checksum += calibrate(table, input);
+			input = (input + 40503) & 0xFFFF;
+		}
+
+		double realTime = _realTimeSeconds() - startTime;
+
+		printf("%i lookups in %.3f s, %.2f ns per lookup (checksum %i).\n", lookups, realTime, realTime * 1e9 / lookups,
+			checksum);
+	}
+
+	return retVal;
+}
+
+/** Sweep of the simulated tachometer, in steps. */
+#define TACHO_SWEEP_STEPS 945
+
+/** Latched RPM at full sweep of the simulated tachometer. */
+#define TACHO_MAX_RPM 8000
+
+/** The simulated tachometer. Same as the firmware's. */
+static const struct GaugeConfig _tachoGauge =
+{
+	.coilGpios = {6, 7, 8, 9},
+	.enableGpio = 10,
+	.microsteps = 16,
+	.index = ENGINE_RPM,
+	.minValue = 0,
+	.maxValue = TACHO_MAX_RPM,
+	.sweepSteps = TACHO_SWEEP_STEPS,
+	.maxStepRate = 1600,
+	.acceleration = 5000
+};
+
+/**
+ * Run the tachometer's motion profile through random moves, some of them retargeted part way through, checking that the
+ * speed never changes by more than one speed index a step, never goes over the limit, only reverses from rest and always
+ * stops exactly on the target. Then time a full sweep against the blocking X27_stepperTest loop and time profile steps.
+ * @param moves Number of moves.
+ * @returns True if the profile always behaved.
+ */
+static bool _benchmarkGaugeProfile(int moves)
+{
+	struct GaugeProfileTable table;
+	struct GaugeProfile profile;
+
+	bool retVal = gaugeProfileInitTable(&table, _tachoGauge.maxStepRate, _tachoGauge.acceleration);
+
+	gaugeProfileInit(&profile, &table, 0);
+
+	int faults = 0;
+	int reversals = 0;
+	uint64_t steps = 0;
+	double maxRate = 0;
+	double maxAcceleration = 0;
+
+	srand(1);
+
+	for(int move = 0; move < moves; move++)
+	{
+		profile.target = rand() % (TACHO_SWEEP_STEPS + 1);
+
+		// A quarter of the moves are retargeted part way, often to behind the needle.
+		int retargetStep = rand() % 4 == 0 ? rand() % 200 : -1;
+
+		int moveSteps = 0;
+
+		while(true)
+		{
+			int speed = profile.speed;
+			int direction = profile.direction;
+			double lastInterval = gaugeProfileInterval(&profile);
+
+			int stepDirection = gaugeProfileStep(&profile);
+
+			if(!stepDirection) break;
+
+			if(speed == 0)
+			{
+				if(stepDirection != direction) reversals++;
+			}
+			else if(stepDirection != direction)
+			{
+				faults++;
+			}
+
+			if(abs(profile.speed - speed) > 1 || profile.speed > profile.speedLimit) faults++;
+
+			if(profile.speed > 0)
+			{
+				// Mean rates over the intervals either side of the step, and the acceleration between them.
+				double interval = gaugeProfileInterval(&profile);
+
+				if(1e6 / interval > maxRate) maxRate = 1e6 / interval;
+
+				if(speed > 0)
+				{
+					double acceleration = fabs(1e6 / interval - 1e6 / lastInterval) / ((interval + lastInterval) / 2e6);
+
+					if(acceleration > maxAcceleration) maxAcceleration = acceleration;
+				}
+			}
+
+			if(++moveSteps == retargetStep) profile.target = rand() % (TACHO_SWEEP_STEPS + 1);
+
+			steps++;
+		}
+
+		if(profile.position != profile.target || profile.speed != 0) faults++;
+	}
+
+	// Intervals are whole microseconds, so at speed the acceleration between neighbouring steps wobbles around the profile's.
+	printf("%i moves, %lu steps, %i reversals, %i faults. Max %.0f steps/s, max step to step acceleration %.0f steps/s/s"
+		" (profile %i).\n", moves, steps, reversals, faults, maxRate, maxAcceleration, _tachoGauge.acceleration);
+
+	// A full sweep, timed as the interrupt would step it.
+	gaugeProfileInit(&profile, &table, 0);
+	profile.target = TACHO_SWEEP_STEPS;
+
+	uint64_t sweepUs = 0;
+
+	while(gaugeProfileStep(&profile))
+	{
+		if(profile.speed > 0) sweepUs += gaugeProfileInterval(&profile);
+	}
+
+	printf("Full sweep of %i steps in %.3f s, against %.3f s at the blocking loop's 100 steps/s.\n", TACHO_SWEEP_STEPS,
+		sweepUs / 1e6, TACHO_SWEEP_STEPS / 100.0);
+
+	// Back and forth across the sweep, so every step is a real one.
+	gaugeProfileInit(&profile, &table, 0);
+
+	int timedSteps = moves * 100;
+
+	double startTime = _realTimeSeconds();
+
+	for(int step = 0; step < timedSteps; step++)
+	{
+		if(!gaugeProfileStep(&profile)) profile.target = profile.position ? 0 : TACHO_SWEEP_STEPS;
+	}
+
+	double realTime = _realTimeSeconds() - startTime;
+
+	printf("%i profile steps in %.3f s, %.2f ns per step (position %i).\n", timedSteps, realTime,
+		realTime * 1e9 / timedSteps, profile.position);
+
+	return retVal && faults == 0;
+}
+
+/** Length of the gauge timing simulation, in virtual seconds. */
+#define GAUGE_TIMING_SECONDS 20
+
+/** Coil sequence, as X27_stepperTest has it. Bit n is L293D input n + 1. */
+static const uint8_t _x27CoilStates[6] = {0x5, 0x1, 0x8, 0xA, 0x2, 0x4};
+
+/**
+ * Drive several tachometer-like gauges from latched data that jumps about, a microsecond of virtual time at a time, and
+ * check after every microsecond that each gauge's coils are at the state for its position, that no gauge moved more
+ * than a step and that no gauge stepped faster than its profile allows. Then report the step interrupt load.
+ * Each gauge has its own four coil pins. The host has 32 so eight gauges fit, more than an RP2040 has free.
+ * @param gaugeCount Number of gauges.
+ * @returns True if the gauges always behaved.
+ */
+static bool _simulateGauges(int gaugeCount)
+{
+	// Full sweep value of each latched data index the gauges show.
+	static const int fullScale[MAX_LATCHED_INDEXES] = {[ENGINE_RPM] = 8000, [SPEED_KMH] = 200, [ENGINE_TEMP_C] = 1300};
+
+	struct GaugeProfileTable table;
+	gaugeProfileInitTable(&table, _tachoGauge.maxStepRate, _tachoGauge.acceleration);
+
+	// Steps may come up to the coalesce interval early.
+	int minInterval = table.intervals[table.maxSpeed - 1] - GAUGE_STEP_COALESCE_INTERVAL;
+
+	int homePosition = _tachoGauge.sweepSteps + GAUGE_HOMING_MARGIN_STEPS;
+
+	initLatcher();
+
+	for(int gauge = 0; gauge < gaugeCount; gauge++)
+	{
+		struct GaugeConfig config = _tachoGauge;
+
+		for(int coil = 0; coil < GAUGE_COIL_GPIO_COUNT; coil++) config.coilGpios[coil] = gauge * 4 + coil;
+
+		config.enableGpio = -1;
+		config.index = NO_LATCHED_INDEX + 1 + gauge % (MAX_LATCHED_INDEXES - 1);
+		// Gauges sharing latched data get different scales so they don't step in lock step.
+		config.maxValue = fullScale[config.index] * (8 + gauge) / 8;
+
+		addGauge(&config);
+	}
+
+	startGauges();
+
+	int lastPositions[MAX_GAUGES];
+	uint64_t lastStepTimes[MAX_GAUGES];
+	int minIntervals[MAX_GAUGES];
+
+	for(int gauge = 0; gauge < gaugeCount; gauge++)
+	{
+		lastPositions[gauge] = homePosition;
+		lastStepTimes[gauge] = 0;
+		minIntervals[gauge] = INT32_MAX;
+	}
+
+	uint64_t nextChangeUs[MAX_LATCHED_INDEXES] = {0};
+
+	int coilFaults = 0;
+	int stepFaults = 0;
+	int speedFaults = 0;
+
+	srand(2);
+
+	double startTime = _realTimeSeconds();
+
+	for(uint64_t timeUs = 1; timeUs <= GAUGE_TIMING_SECONDS * 1000000ull; timeUs++)
+	{
+		// Each latched value jumps somewhere new every so often, often before the needles have got there.
+		bool changed = false;
+
+		for(int index = NO_LATCHED_INDEX + 1; index < MAX_LATCHED_INDEXES; index++)
+		{
+			if(timeUs >= nextChangeUs[index])
+			{
+				_latchedData[index] = rand() % (fullScale[index] + 1);
+				nextChangeUs[index] = timeUs + 100000 + rand() % 1400000;
+				changed = true;
+			}
+		}
+
+		if(changed) _publishLatchedData(get_absolute_time());
+
+		hostClockAdvance(1);
+
+		uint32_t levels = gpio_get_all();
+
+		for(int gauge = 0; gauge < gaugeCount; gauge++)
+		{
+			int position = getGaugePosition(gauge);
+			int coilState = ((position - homePosition) % 6 + 6) % 6;
+
+			if(((levels >> (gauge * 4)) & 0xF) != _x27CoilStates[coilState]) coilFaults++;
+
+			if(position != lastPositions[gauge])
+			{
+				if(abs(position - lastPositions[gauge]) > 1) stepFaults++;
+
+				// Only moving steps count. Coming back from rest waits at least as long as any step.
+				int interval = timeUs - lastStepTimes[gauge];
+
+				if(lastStepTimes[gauge] && interval < minIntervals[gauge]) minIntervals[gauge] = interval;
+				if(interval < minInterval) speedFaults++;
+
+				lastPositions[gauge] = position;
+				lastStepTimes[gauge] = timeUs;
+			}
+		}
+	}
+
+	double realTime = _realTimeSeconds() - startTime;
+
+	struct GaugeTimingStats stats;
+	getGaugeTimingStats(&stats);
+
+	int fastestInterval = INT32_MAX;
+	int homed = 0;
+
+	for(int gauge = 0; gauge < gaugeCount; gauge++)
+	{
+		if(minIntervals[gauge] < fastestInterval) fastestInterval = minIntervals[gauge];
+		if(isGaugeHomed(gauge)) homed++;
+	}
+
+	printf("%i gauges for %i s (%.2f s real time), %i homed. %u steps, fastest %.0f steps/s.\n", gaugeCount,
+		GAUGE_TIMING_SECONDS, realTime, homed, stats.steps, 1e6 / fastestInterval);
+
+	printf("%u step interrupts, %.0f per second, %.2f steps per interrupt. Latest step %u us after it was due.\n",
+		stats.interrupts, (double)stats.interrupts / GAUGE_TIMING_SECONDS, (double)stats.steps / stats.interrupts,
+		stats.maxLateness);
+
+	printf("Coil faults %i, step faults %i, speed faults %i.\n", coilFaults, stepFaults, speedFaults);
+
+	return homed == gaugeCount && coilFaults == 0 && stepFaults == 0 && speedFaults == 0;
+}
+
+/** L293D input levels of a coil current, as the microstep tables give them. Both low when the coil is off. */
+static uint32_t _microstepCoilInputs(double current, int level)
+{
+	return level == 0 ? 0 : current > 0 ? 0x1 : 0x2;
+}
+
+/**
+ * Check the generated microstep tables against sine/cosine coil currents: every level within rounding of the current it
+ * stands for, the L293D inputs matching each current's sign, every whole step matching the 6 state coil sequence and the
+ * reverse tables exactly mirroring the forward ones.
+ * @returns True if every table checks out.
+ */
+static bool _checkMicrostepTables()
+{
+	bool retVal = true;
+
+	for(int tableNum = 0; tableNum < MICROSTEP_TABLE_COUNT; tableNum++)
+	{
+		const struct MicrostepTable* table = &microstepTables[tableNum];
+
+		int cycle = table -> microsteps * MICROSTEP_STEPS_PER_CYCLE;
+
+		int faults = 0;
+		double maxError = 0;
+		int maxChange = 0;
+
+		for(int microstep = 0; microstep <= cycle; microstep++)
+		{
+			uint32_t word = table -> forward[microstep];
+
+			uint32_t inputs = word >> 1 & 0xF;
+			int levelA = word >> MICROSTEP_WORD_LEVELS_SHIFT & 0xFFFF;
+			int levelB = word >> (MICROSTEP_WORD_LEVELS_SHIFT + 16);
+
+			double angle = 2 * M_PI * microstep / cycle;
+			double currentA = cos(angle - M_PI / 6);
+			double currentB = cos(angle + M_PI / 6);
+
+			double errorA = fabs(levelA - fabs(currentA) * MICROSTEP_PWM_TOP);
+			double errorB = fabs(levelB - fabs(currentB) * MICROSTEP_PWM_TOP);
+
+			if(errorA > maxError) maxError = errorA;
+			if(errorB > maxError) maxError = errorB;
+
+			// Bit 0 tells the state machine it is a microstep rather than a period.
+			if(word & 1 || levelA > MICROSTEP_PWM_TOP || levelB > MICROSTEP_PWM_TOP || errorA > 1 || errorB > 1) faults++;
+
+			if(inputs != (_microstepCoilInputs(currentA, levelA) | _microstepCoilInputs(currentB, levelB) << 2)) faults++;
+
+			if(microstep % table -> microsteps == 0 &&
+				inputs != _x27CoilStates[microstep / table -> microsteps % MICROSTEP_STEPS_PER_CYCLE])
+			{
+				faults++;
+			}
+
+			if(table -> reverse[microstep] != table -> forward[(cycle - microstep) % cycle]) faults++;
+
+			if(microstep > 0)
+			{
+				uint32_t lastWord = table -> forward[microstep - 1];
+
+				int changeA = abs(levelA - (int)(lastWord >> MICROSTEP_WORD_LEVELS_SHIFT & 0xFFFF));
+				int changeB = abs(levelB - (int)(lastWord >> (MICROSTEP_WORD_LEVELS_SHIFT + 16)));
+
+				if(changeA > maxChange) maxChange = changeA;
+				if(changeB > maxChange) maxChange = changeB;
+			}
+		}
+
+		printf("%i microsteps per step: %i entries a table, max level error %.2f of %i, max level change %i per"
+			" microstep. %i faults.\n", table -> microsteps, cycle + 1, maxError, MICROSTEP_PWM_TOP, maxChange, faults);
+
+		if(faults) retVal = false;
+	}
+
+	return retVal;
+}
+
+/** Number of snapshots for the snapshot stress writer to publish. */
+static int _stressSnapshotCount = 0;
+
+/**
+ * Snapshot stress writer. Runs as core 1 in place of the sensor loop and publishes snapshots in which every value, and
+ * the capture time, equals the sequence number.
+ */
+static void _snapshotStressWriter()
+{
+	for(int pass = 1; pass <= _stressSnapshotCount; pass++)
+	{
+		for(int index = 0; index < MAX_LATCHED_INDEXES; index++) _latchedData[index] = pass;
+
+		_publishLatchedData(pass);
+	}
+}
+
+/**
+ * Hammer the latched data snapshots from both cores and check that core 0 never sees a torn one.
+ * @returns True if no torn snapshots were seen.
+ */
+static bool _stressSnapshots()
+{
+	initLatcher();
+	multicore_launch_core1(_snapshotStressWriter);
+
+	int reads = 0;
+	int torn = 0;
+	int outOfOrder = 0;
+	uint32_t lastSequence = 0;
+
+	struct LatchedDataSnapshot snapshot;
+
+	do
+	{
+		getLatchedDataSnapshot(&snapshot);
+		reads++;
+
+		bool consistent = snapshot.captureTime == snapshot.sequence;
+
+		for(int index = 0; index < MAX_LATCHED_INDEXES; index++)
+		{
+			consistent = consistent && snapshot.values[index] == (int)snapshot.sequence;
+		}
+
+		if(!consistent) torn++;
+		if(snapshot.sequence < lastSequence) outOfOrder++;
+
+		lastSequence = snapshot.sequence;
+	}
+	while(snapshot.sequence < (uint32_t)_stressSnapshotCount);
+
+	hostJoinCore1();
+
+	printf("Read %i snapshots while %i were published. %i torn, %i out of order.\n", reads, _stressSnapshotCount, torn,
+		outOfOrder);
+
+	return torn == 0 && outOfOrder == 0;
+}
+
+/** Number of samples for the history stress writer to record. */
+static int _stressHistorySamples = 0;
+
+#if PICO_DASH_HISTORY
+
+/**
+ * Time of a history stress sample. Irregular, and now and then too long after the last to delta encode.
+ */
+static absolute_time_t _stressHistoryTime(uint32_t sequence)
+{
+	return sequence * 1000ull + sequence % 7 * 13 + sequence / 5000 * 3000000000ull;
+}
+
+/**
+ * Value of a history stress sample. Mostly small steps, now and then a jump as big as a value can make.
+ */
+static int32_t _stressHistoryValue(uint32_t sequence)
+{
+	return sequence % 100 == 99 ? (int32_t)(sequence * 2654435761u) : (int32_t)(sequence / 3) - 500;
+}
+
+/**
+ * History stress writer. Runs as core 1 in place of the sensor loop and records samples whose time and value follow
+ * from their sequence number.
+ */
+static void _historyStressWriter()
+{
+	for(uint32_t sequence = 0; sequence < (uint32_t)_stressHistorySamples; sequence++)
+	{
+		historyRecord(ENGINE_RPM, _stressHistoryTime(sequence), _stressHistoryValue(sequence));
+	}
+}
+
+/**
+ * Read the history from core 0 while core 1 records it and check that every sample read is the one recorded. Every so
+ * often the read is from the oldest sample, which core 1 is about to drop.
+ * @returns True if every sample read was right and none were read out of order.
+ */
+static bool _stressHistory()
+{
+	initLatcher();
+	multicore_launch_core1(_historyStressWriter);
+
+	struct HistorySample samples[SPI_HISTORY_MAX_SAMPLES];
+
+	int reads = 0;
+	int samplesRead = 0;
+	int wrong = 0;
+	int outOfOrder = 0;
+	uint32_t wanted = 0;
+	uint32_t lost = 0;
+	uint32_t recorded;
+
+	do
+	{
+		bool fromOldest = reads % 16 == 15;
+
+		uint32_t sequence = fromOldest ? 0 : wanted;
+
+		int got = getHistory(ENGINE_RPM, &sequence, samples, SPI_HISTORY_MAX_SAMPLES, &recorded);
+
+		for(int sample = 0; sample < got; sample++)
+		{
+			if(samples[sample].time != _stressHistoryTime(sequence + sample) ||
+				samples[sample].value != _stressHistoryValue(sequence + sample))
+			{
+				wrong++;
+			}
+		}
+
+		if(!fromOldest)
+		{
+			// Core 1 can get a whole ring ahead, but a read never goes back.
+			if(sequence < wanted) outOfOrder++;
+
+			lost += sequence - wanted;
+			wanted = sequence + got;
+		}
+
+		reads++;
+		samplesRead += got;
+	}
+	while(recorded < (uint32_t)_stressHistorySamples || wanted < recorded);
+
+	hostJoinCore1();
+
+	printf("Read %i history samples in %i reads while %i were recorded. %u dropped before they were read, %i wrong, "
+		"%i out of order.\n", samplesRead, reads, _stressHistorySamples, lost, wrong, outOfOrder);
+
+	return wrong == 0 && outOfOrder == 0;
+}
+
+#endif
+
+/** Number of sensor config batches for the sensor config stress test to commit. */
+static int _stressConfigBatches = 0;
+
+/** Set once the last batch has been committed. */
+static bool _stressConfigDone = false;
+
+/** Pulse sensors whose config every stress batch changes. */
+static const LatchedDataIndex _stressConfigSensors[] = {ENGINE_RPM, SPEED_KMH};
+
+/** Variables every stress batch sets, on each of the sensors, to the batch number. */
+static const SensorData _stressConfigVars[] =
+{
+	PULSE_ACCUMULATION_INTERVAL, PULSE_PRE_SCALE, PULSE_TEST_DURATION_END, PULSE_PERIOD_THRESHOLD
+};
+
+#define STRESS_CONFIG_SENSORS (int)(sizeof(_stressConfigSensors) / sizeof(_stressConfigSensors[0]))
+#define STRESS_CONFIG_VARS (int)(sizeof(_stressConfigVars) / sizeof(_stressConfigVars[0]))
+
+/** Results of the sensor config stress applier. Only written by core 1. */
+static int _stressConfigPasses = 0;
+static int _stressConfigTorn = 0;
+static int _stressConfigOutOfOrder = 0;
+
+/** Get one of the stress batch variables of a sensor. */
+static int _stressConfigValue(LatchedDataIndex index, SensorData sensorVar)
+{
+	switch(sensorVar)
+	{
+		case PULSE_ACCUMULATION_INTERVAL: return _sensors[index].pulseAccumulationInterval;
+		case PULSE_PRE_SCALE: return _sensors[index].pulsePreScale;
+		case PULSE_TEST_DURATION_END: return _sensors[index].pulseTestDurationEnd;
+		case PULSE_PERIOD_THRESHOLD: return _sensors[index].pulsePeriodThreshold;
+		default: return -1;
+	}
+}
+
+/**
+ * Sensor config stress applier. Runs as core 1 in place of the sensor loop, applying the committed config each time it is
+ * woken and checking, where a strobe would run, that every variable of every batch sensor comes from the same batch and
+ * that batches are never applied out of order. The temperature sensor's deadband, set outside the batches, must only
+ * ever go up.
+ */
+static void _sensorConfigStressApplier()
+{
+	int lastBatch = 0;
+	int lastDeadband = -1;
+
+	bool done;
+
+	do
+	{
+		// Read before applying, so the last pass sees everything committed.
+		done = __atomic_load_n(&_stressConfigDone, __ATOMIC_ACQUIRE);
+
+		_applySensorConfig();
+
+		int batch = _stressConfigValue(_stressConfigSensors[0], _stressConfigVars[0]);
+
+		for(int sensor = 0; sensor < STRESS_CONFIG_SENSORS; sensor++)
+		{
+			for(int var = 0; var < STRESS_CONFIG_VARS; var++)
+			{
+				if(_stressConfigValue(_stressConfigSensors[sensor], _stressConfigVars[var]) != batch)
+				{
+					_stressConfigTorn++;
+				}
+			}
+		}
+
+		int deadband = _sensors[ENGINE_TEMP_C].changeDeadband;
+
+		if(batch < lastBatch || deadband < lastDeadband) _stressConfigOutOfOrder++;
+
+		lastBatch = batch;
+		lastDeadband = deadband;
+
+		_stressConfigPasses++;
+
+		// Sleep until core 0 commits more, as the sensor loop does.
+		if(!done) __wfe();
+	}
+	while(!done);
+}
+
+/**
+ * Hammer the sensor config queue with batches from core 0 while core 1 applies them, and check that core 1 never sees
+ * part of a batch, never sees batches out of order and ends up with the last batch committed.
+ * @returns True if the config core 1 saw was always consistent.
+ */
+static bool _stressSensorConfig()
+{
+	initLatcher();
+
+	for(int sensor = 0; sensor < STRESS_CONFIG_SENSORS; sensor++)
+	{
+		for(int var = 0; var < STRESS_CONFIG_VARS; var++)
+		{
+			setSensorData(_stressConfigSensors[sensor], _stressConfigVars[var], 0);
+		}
+	}
+
+	_sensorConfigByCore1 = true;
+	multicore_launch_core1(_sensorConfigStressApplier);
+
+	int committed = 0;
+	int lastCommitted = 0;
+	int lastDeadband = -1;
+
+	for(int batch = 1; batch <= _stressConfigBatches; batch++)
+	{
+		beginSensorDataBatch();
+
+		for(int sensor = 0; sensor < STRESS_CONFIG_SENSORS; sensor++)
+		{
+			for(int var = 0; var < STRESS_CONFIG_VARS; var++)
+			{
+				setSensorData(_stressConfigSensors[sensor], _stressConfigVars[var], batch);
+			}
+		}
+
+		// Core 1 is often behind, so some batches are turned away with the queue full. None of those may show.
+		if(commitSensorDataBatch())
+		{
+			committed++;
+			lastCommitted = batch;
+		}
+
+		// A change on its own between the batches.
+		if(setSensorData(ENGINE_TEMP_C, CHANGE_DEADBAND, batch)) lastDeadband = batch;
+	}
+
+	__atomic_store_n(&_stressConfigDone, true, __ATOMIC_RELEASE);
+
+	hostJoinCore1();
+
+	bool lastApplied = _sensors[ENGINE_TEMP_C].changeDeadband == lastDeadband;
+
+	for(int sensor = 0; sensor < STRESS_CONFIG_SENSORS; sensor++)
+	{
+		for(int var = 0; var < STRESS_CONFIG_VARS; var++)
+		{
+			lastApplied = lastApplied &&
+				_stressConfigValue(_stressConfigSensors[sensor], _stressConfigVars[var]) == lastCommitted;
+		}
+	}
+
+	printf("Committed %i of %i sensor config batches while core 1 made %i passes. %i torn, %i out of order, last batch"
+		" %s.\n", committed, _stressConfigBatches, _stressConfigPasses, _stressConfigTorn, _stressConfigOutOfOrder,
+		lastApplied ? "applied" : "not applied");
+
+	return _stressConfigTorn == 0 && _stressConfigOutOfOrder == 0 && lastApplied;
+}
+
+/** Make up a sensor config with a random set of variables, and values of every size. */
+static void _randomSensorConfig(struct SensorConfig* config)
+{
+	memset(config, 0, sizeof(*config));
+
+	for(int index = 1; index < MAX_LATCHED_INDEXES; index++)
+	{
+		for(int sensorVar = ACTIVE; sensorVar < MAX_SENSOR_DATA; sensorVar++)
+		{
+			if(rand() % 3)
+			{
+				// Mostly small values, either sign, as real configs are, with the odd one of up to 32 bits.
+				int bits = rand() % 4 ? rand() % 12 : rand() % 33;
+				int value = (int)(((uint32_t)rand() << 16 ^ (uint32_t)rand()) & (bits < 32 ? (1u << bits) - 1 : ~0u));
+
+				config -> setMask[index] |= 1u << sensorVar;
+				config -> values[index][sensorVar] = rand() % 2 ? -value : value;
+			}
+		}
+	}
+}
+
+/** Whether two sensor configs set the same variables to the same values. */
+static bool _sensorConfigsEqual(const struct SensorConfig* a, const struct SensorConfig* b)
+{
+	bool retVal = true;
+
+	for(int index = 1; index < MAX_LATCHED_INDEXES; index++)
+	{
+		retVal = retVal && a -> setMask[index] == b -> setMask[index];
+
+		for(int sensorVar = ACTIVE; sensorVar < MAX_SENSOR_DATA; sensorVar++)
+		{
+			retVal = retVal && (!(a -> setMask[index] & (1u << sensorVar)) ||
+				a -> values[index][sensorVar] == b -> values[index][sensorVar]);
+		}
+	}
+
+	return retVal;
+}
+
+/** Run a single command frame, with core 1 not running. @returns The response's error code byte. */
+static int _configCommand(uint8_t command)
+{
+	uint8_t frame[SPI_COMMAND_RESPONSE_FRAME_SIZE] = {command};
+	uint8_t response[SPI_MAX_RESPONSE_SIZE];
+
+	processSpiCommandFrame(frame, response);
+
+	return response[0] == command ? response[1] : 0xFF;
+}
+
+/**
+ * Check the persistent sensor config: the slot format round trips and catches corruption, saves are spread over the
+ * slots, power lost part way through a save never loses the config before it, and a saved config is restored by
+ * initLatcher and LOAD_CONFIG.
+ * @param saves Number of configs to round trip and save.
+ * @returns True if everything checked out.
+ */
+static bool _checkSensorConfig(int saves)
+{
+	static uint8_t slot[CONFIG_SLOT_SIZE];
+
+	struct SensorConfig config;
+	struct SensorConfig loaded;
+	struct SensorConfig last;
+
+	srand(4);
+
+	int wrongRoundTrips = 0;
+	int undetectedCorruptions = 0;
+	int longest = 0;
+
+	for(int save = 1; save <= saves; save++)
+	{
+		_randomSensorConfig(&config);
+
+		int size = sensorConfigSerialise(&config, save, slot);
+		uint32_t sequence = 0;
+
+		if(size > longest) longest = size;
+
+		if(!sensorConfigDeserialise(slot, &loaded, &sequence) || !_sensorConfigsEqual(&config, &loaded) ||
+			sequence != (uint32_t)save)
+		{
+			wrongRoundTrips++;
+		}
+
+		// CRC-32 catches any single bit flip.
+		int bit = rand() % (size * 8);
+		slot[bit / 8] ^= 1 << (bit % 8);
+
+		if(sensorConfigDeserialise(slot, &loaded, 0)) undetectedCorruptions++;
+	}
+
+	printf("Round tripped %i sensor configs through the slot format, longest %i of %i bytes. %i wrong, %i corruptions"
+		" undetected.\n", saves, longest, CONFIG_SLOT_SIZE, wrongRoundTrips, undetectedCorruptions);
+
+	// Saves one after another.
+	hostConfigFlashWipe();
+
+	int wrongLoads = 0;
+
+	for(int save = 0; save < saves; save++)
+	{
+		_randomSensorConfig(&config);
+
+		if(!sensorConfigSave(&config) || !sensorConfigLoad(&loaded) || !_sensorConfigsEqual(&config, &loaded))
+		{
+			wrongLoads++;
+		}
+	}
+
+	uint32_t erases = 0;
+	uint32_t mostErases = 0;
+
+	for(int sector = 0; sector < CONFIG_FLASH_SECTORS; sector++)
+	{
+		erases += hostConfigFlashErases(sector);
+		if(hostConfigFlashErases(sector) > mostErases) mostErases = hostConfigFlashErases(sector);
+	}
+
+	// Every slot is used before a block is erased again, and the blocks take turns.
+	bool levelled = erases == (uint32_t)(saves + CONFIG_SLOTS_PER_BLOCK - 1) / CONFIG_SLOTS_PER_BLOCK *
+		(CONFIG_FLASH_SECTORS / CONFIG_FLASH_BLOCKS) &&
+		mostErases <= (erases + CONFIG_FLASH_SECTORS - 1) / CONFIG_FLASH_SECTORS;
+
+	printf("Saved %i sensor configs with %u sector erases, at most %u of one sector. %i wrong loads.\n", saves, erases,
+		mostErases, wrongLoads);
+
+	// Power lost part way through saves.
+	hostConfigFlashWipe();
+
+	_randomSensorConfig(&last);
+	sensorConfigSave(&last);
+
+	int lostConfigs = 0;
+	int lostSaves = 0;
+
+	for(int save = 0; save < saves; save++)
+	{
+		_randomSensorConfig(&config);
+
+		// Anywhere from before the erase to after the slot is written.
+		hostConfigFlashPowerLoss(rand() % (CONFIG_BLOCK_SIZE + CONFIG_SLOT_SIZE * 2));
+
+		bool saved = sensorConfigSave(&config);
+
+		hostConfigFlashPowerLoss(-1);
+
+		if(!saved) lostSaves++;
+
+		// A save that didn't finish may still have got the whole config in before the power went.
+		if(!sensorConfigLoad(&loaded) || !(_sensorConfigsEqual(&loaded, &config) ||
+			(!saved && _sensorConfigsEqual(&loaded, &last))))
+		{
+			lostConfigs++;
+		}
+		else
+		{
+			last = loaded;
+		}
+	}
+
+	printf("Lost power during %i of %i saves. %i configs lost.\n", lostSaves, saves, lostConfigs);
+
+	// Restore at start up, and through SPI.
+	hostConfigFlashWipe();
+
+	initLatcher();
+	setTestMode(true);
+
+	// With nothing saved, every channel starts on its registry defaults.
+	bool defaulted = true;
+
+#define CHECK_CHANNEL_DEFAULTS(channel, channelName, resolution, type, defaultStrobeInterval, defaultPreScale, \
+	defaultPostScale) \
+	defaulted = defaulted && _sensors[channel].strobeInterval == (defaultStrobeInterval) && \
+		(type != PULSE_SENSOR || (_sensors[channel].pulsePreScale == (defaultPreScale) && \
+		_sensors[channel].pulsePostScale == (defaultPostScale))) && \
+		(type != SCALED_VOLTAGE_SENSOR || (_sensors[channel].voltagePreScale == (defaultPreScale) && \
+		_sensors[channel].voltagePostScale == (defaultPostScale)));
+	LATCHED_DATA_CHANNELS(CHECK_CHANNEL_DEFAULTS)
+#undef CHECK_CHANNEL_DEFAULTS
+
+	printf("Sensors %s on their channel defaults with no config saved.\n", defaulted ? "started" : "did not start");
+
+	setSensorData(ENGINE_RPM, SENSOR_TYPE, PULSE_SENSOR);
+	setSensorData(ENGINE_RPM, PULSE_GPIO, -1);
+	setSensorData(ENGINE_RPM, STROBE_INTERVAL, 1000);
+	setSensorData(ENGINE_RPM, PULSE_ACCUMULATION_INTERVAL, 100000);
+	setSensorData(ENGINE_RPM, PULSE_PRE_SCALE, 60000000);
+	setSensorData(ENGINE_RPM, PULSE_POST_SCALE, 1);
+	setSensorData(ENGINE_RPM, PULSE_TEST_DURATION_START, 10000);
+	setSensorData(ENGINE_RPM, ACTIVE, 1);
+	setSensorData(ENGINE_RPM, FILTER_TYPE, FILTER_MEDIAN);
+	setSensorData(ENGINE_RPM, FILTER_LENGTH, 5);
+	setSensorData(ENGINE_RPM, CHANGE_DEADBAND, 25);
+	setSensorData(ENGINE_TEMP_C, SENSOR_TYPE, SCALED_VOLTAGE_SENSOR);
+	setSensorData(ENGINE_TEMP_C, STROBE_INTERVAL, 10000);
+	setSensorData(ENGINE_TEMP_C, ADC_CHANNEL, 2);
+	setSensorData(ENGINE_TEMP_C, VOLTAGE_PRE_SCALE, 3300);
+	setSensorData(ENGINE_TEMP_C, VOLTAGE_POST_SCALE, 4096);
+
+	struct SensorConfig saved = _sensorConfig;
+	struct Sensor savedSensors[MAX_LATCHED_INDEXES];
+	memcpy(savedSensors, _sensors, sizeof(savedSensors));
+
+	bool restored = _configCommand(SAVE_CONFIG) == 0;
+
+	// Stop the captures so the restore can start them again.
+	setSensorData(ENGINE_RPM, ACTIVE, 0);
+	setSensorData(ENGINE_RPM, PULSE_PRE_SCALE, 7);
+
+	double startTime = _realTimeSeconds();
+
+	initLatcher();
+
+	double restoreTime = _realTimeSeconds() - startTime;
+
+	restored = restored && _sensorConfigsEqual(&_sensorConfig, &saved);
+
+	for(int index = 1; index < MAX_LATCHED_INDEXES; index++)
+	{
+		const struct Sensor* sensor = _sensors + index;
+		const struct Sensor* savedSensor = savedSensors + index;
+
+		restored = restored && sensor -> type == savedSensor -> type && sensor -> active == savedSensor -> active &&
+			sensor -> strobeInterval == savedSensor -> strobeInterval &&
+			sensor -> changeDeadband == savedSensor -> changeDeadband &&
+			sensor -> filterType == savedSensor -> filterType && sensor -> filterLength == savedSensor -> filterLength;
+
+		if(sensor -> type == PULSE_SENSOR)
+		{
+			restored = restored && sensor -> pulseAccumulationInterval == savedSensor -> pulseAccumulationInterval &&
+				sensor -> pulsePreScale == savedSensor -> pulsePreScale &&
+				sensor -> pulsePostScale == savedSensor -> pulsePostScale &&
+				sensor -> pulseTestCurDuration == savedSensor -> pulseTestCurDuration;
+		}
+		else
+		{
+			restored = restored && sensor -> adcChannel == savedSensor -> adcChannel &&
+				sensor -> voltagePreScale == savedSensor -> voltagePreScale &&
+				sensor -> voltagePostScale == savedSensor -> voltagePostScale &&
+				sensor -> voltageCalibrationTable == savedSensor -> voltageCalibrationTable;
+		}
+	}
+
+	setSensorData(ENGINE_TEMP_C, VOLTAGE_PRE_SCALE, 1);
+
+	restored = restored && _configCommand(LOAD_CONFIG) == 0 && _sensors[ENGINE_TEMP_C].voltagePreScale == 3300;
+
+	printf("Sensor config %s restored by initLatcher in %.1f us, and by LOAD_CONFIG.\n",
+		restored ? "was" : "was not", restoreTime * 1e6);
+
+	return wrongRoundTrips == 0 && undetectedCorruptions == 0 && wrongLoads == 0 && levelled && lostConfigs == 0 &&
+		defaulted && restored;
+}
+
+int main(int argc, char** argv)
+{
+	int opt;
+
+	int benchmarkIterations = 0;
+	int scheduleStrobes = 0;
+	int decimationBuffers = 0;
+	int filterUpdates = 0;
+	int calibrationLookups = 0;
+	int gaugeProfileMoves = 0;
+	int gaugeCount = 0;
+	int configSaves = 0;
+	bool checkMicrostepTables = false;
+
+	while((opt = getopt(argc, argv, "s:p:t:a:b:c:d:f:g:i:j:k:n:q:r:w:x:y:z:elmouv")) != -1)
+	{
+		switch(opt)
+		{
+			case 'c':
+
+				calibrationLookups = atoi(optarg);
+				break;
+
+			case 'd':
+
+				decimationBuffers = atoi(optarg);
+				break;
+
+			case 'f':
+
+				filterUpdates = atoi(optarg);
+				break;
+
+			case 'g':
+
+				gaugeProfileMoves = atoi(optarg);
+				break;
+
+			case 'i':
+
+				_configUploads = atoi(optarg);
+				break;
+
+			case 'j':
+
+				_loadCommands = atoi(optarg);
+				break;
+
+			case 'k':
+
+				gaugeCount = atoi(optarg);
+				break;
+
+			case 'n':
+
+				configSaves = atoi(optarg);
+				break;
+
+			case 'q':
+
+				scheduleStrobes = atoi(optarg);
+				break;
+
+			case 'w':
+
+				if(sscanf(optarg, "%i:%i:%i", &_loadMix[LOAD_GET_LATCHED_DATA], &_loadMix[LOAD_SET_SENSOR_DATA],
+					&_loadMix[LOAD_GET_LATCHED_DATA_INDEX]) != 3)
+				{
+					fprintf(stderr, "Load mix must be GET_LATCHED_DATA:SET_SENSOR_DATA:GET_LATCHED_DATA_INDEX weights.\n");
+					return 1;
+				}
+
+				break;
+
+			case 'x':
+
+				_stressSnapshotCount = atoi(optarg);
+				break;
+
+			case 'a':
+
+				_stressHistorySamples = atoi(optarg);
+				break;
+
+			case 'y':
+
+				_throughputCommands = atoi(optarg);
+				break;
+
+			case 'z':
+
+				_stressConfigBatches = atoi(optarg);
+				break;
+
+			case 'e':
+
+				checkMicrostepTables = true;
+				break;
+
+			case 'l':
+
+				_liveEdges = true;
+				break;
+
+			case 'r':
+
+				_pulsePeriodThreshold = atoi(optarg);
+				break;
+
+			case 'm':
+
+				_refreshMulti = true;
+				break;
+
+			case 'o':
+
+				_historyLog = true;
+				break;
+
+			case 'u':
+
+				_refreshPush = true;
+				break;
+
+			case 'b':
+
+				benchmarkIterations = atoi(optarg);
+				break;
+
+			case 's':
+
+				_simSeconds = atoi(optarg);
+				break;
+
+			case 'p':
+
+				_pollIntervalMs = atoi(optarg);
+				break;
+
+			case 't':
+
+				_clockStepUs = atoi(optarg);
+				break;
+
+			case 'v':
+
+				debugMsgActive = true;
+				break;
+
+			default:
+
+				fprintf(stderr, "Usage: %s [-s simulated seconds] [-p poll interval ms] [-t clock step us]"
+					" [-a history stress samples] [-b frame decode benchmark iterations]"
+					" [-c calibration benchmark lookups]"
+					" [-d decimation benchmark buffers] [-f filter benchmark updates] [-g gauge profile benchmark moves]"
+					" [-i sensor config upload rounds] [-j load benchmark commands] [-w load mix get:set:index]"
+					" [-k gauge timing simulation gauges] [-n sensor config saves]"
+					" [-q schedule benchmark strobes]"
+					" [-r pulse period threshold us] [-x snapshot stress count] [-y protocol throughput commands]"
+					" [-z sensor config stress batches]"
+					" [-e] [-l] [-m] [-o] [-u] [-v]\n", argv[0]);
+				return 1;
+		}
+	}
+
+	if(_simSeconds <= 0 || _pollIntervalMs <= 0 || _clockStepUs <= 0)
+	{
+		fprintf(stderr, "Simulated seconds, poll interval and clock step must all be positive.\n");
+		return 1;
+	}
+
+	if(_loadMix[LOAD_GET_LATCHED_DATA] < 0 || _loadMix[LOAD_SET_SENSOR_DATA] < 0 ||
+		_loadMix[LOAD_GET_LATCHED_DATA_INDEX] < 0 ||
+		_loadMix[LOAD_GET_LATCHED_DATA] + _loadMix[LOAD_SET_SENSOR_DATA] + _loadMix[LOAD_GET_LATCHED_DATA_INDEX] <= 0)
+	{
+		fprintf(stderr, "Load mix weights must not be negative and must not all be 0.\n");
+		return 1;
+	}
+
+	if(benchmarkIterations > 0)
+	{
+		_benchmarkFrameDecode(benchmarkIterations);
+		return 0;
+	}
+
+	if(calibrationLookups > 0) return _benchmarkCalibration(calibrationLookups) ? 0 : 1;
+
+	if(decimationBuffers > 0) return _benchmarkDecimation(decimationBuffers) ? 0 : 1;
+
+	if(filterUpdates > 0) return _benchmarkFilters(filterUpdates) ? 0 : 1;
+
+	if(gaugeProfileMoves > 0) return _benchmarkGaugeProfile(gaugeProfileMoves) ? 0 : 1;
+
+	if(checkMicrostepTables) return _checkMicrostepTables() ? 0 : 1;
+
+	if(gaugeCount > 0)
+	{
+		if(gaugeCount > MAX_GAUGES)
+		{
+			fprintf(stderr, "At most %i gauges.\n", MAX_GAUGES);
+			return 1;
+		}
+
+		return _simulateGauges(gaugeCount) ? 0 : 1;
+	}
+
+	if(scheduleStrobes > 0) return _benchmarkSchedule(scheduleStrobes) ? 0 : 1;
+
+	if(_stressSnapshotCount > 0) return _stressSnapshots() ? 0 : 1;
+
+#if PICO_DASH_HISTORY
+	if(_stressHistorySamples > 0) return _stressHistory() ? 0 : 1;
+#endif
+
+	if(_stressConfigBatches > 0) return _stressSensorConfig() ? 0 : 1;
+
+	if(configSaves > 0) return _checkSensorConfig(configSaves) ? 0 : 1;
+
+	double startTime = _realTimeSeconds();
+
+	// Same start up order as the firmware.
+	initLatcher();
+	setTestMode(!_liveEdges);
+	startLatcher();
+	initGpioIrqSubsystem();
+	spiLatchStartSubsystem();
+	addGauge(&_tachoGauge);
+	startGauges();
+
+	pthread_t masterThread;
+	pthread_create(&masterThread, 0, _loadCommands > 0 ? _loadMasterEntry
+		: _throughputCommands > 0 ? _throughputMasterEntry : _configUploads > 0 ? _uploadMasterEntry : _masterEntry, 0);
+
+	// Core 0 main processing loop.
+	while(!__atomic_load_n(&_simDone, __ATOMIC_ACQUIRE))
+	{
+		spiLatchProcess();
+
+		bool traceRecordsPending = !spiLatchProcReq() && traceDrain();
+
+		if(!spiLatchProcReq() && !traceRecordsPending) __wfe();
+	}
+
+	pthread_join(masterThread, 0);
+
+	_exitSensorProcLoop = true;
+	hostJoinCore1();
+
+	while(traceDrain());
+
+	if(_loadCommands > 0 || _throughputCommands > 0 || _configUploads > 0) return _failedCommands ? 1 : 0;
+
+	double realTime = _realTimeSeconds() - startTime;
+
+	printf("Simulated %i s in %.2f s real time. %lu command cycles, %i failed.\n", _simSeconds, realTime,
+		hostSpiHandshakeCount(), _failedCommands);
+
+	if(_refreshes)
+	{
+		printf("%.2f command cycle handshakes per dashboard refresh (%s).\n", (double)_refreshHandshakes / _refreshes,
+			_refreshMulti ? "GET_LATCHED_DATA_MULTI" : "GET_LATCHED_DATA");
+	}
+
+	if(_pushCommands)
+	{
+		printf("%i GET_CHANGED command cycles got %i changes, %.2f per second.\n", _pushCommands, _pushChanges,
+			(double)_pushCommands / _simSeconds);
+	}
+
+	if(_errorSamples)
+	{
+		printf("Mean RPM error %li, mean speed error %li km/h, mean temperature error %.1f C.\n",
+			_rpmErrorSum / _errorSamples, _speedErrorSum / _errorSamples, _tempErrorSum / 10.0 / _errorSamples);
+	}
+
+	if(_tachoLagSamples)
+	{
+		printf("Tachometer homed after %.2f s. Needle lag behind latched RPM mean %.1f steps, max %i steps.\n",
+			_tachoHomedMs / 1000.0, (double)_tachoLagSum / _tachoLagSamples, _tachoMaxLag);
+	}
+
+#if PICO_DASH_HISTORY
+
+	if(_historyLog)
+	{
+		printf("%i GET_HISTORY command cycles, one round every %i s. %i samples lost, %i out of order, %i logs not up "
+			"to the latched value.\n", _historyCommands, HISTORY_LOG_INTERVAL_MS / 1000, _historyLost,
+			_historyOutOfOrder, _historyNotLatched);
+
+		_printHistoryLog("RPM", ENGINE_RPM);
+		_printHistoryLog("Speed", SPEED_KMH);
+		_printHistoryLog("Temperature", ENGINE_TEMP_C);
+	}
+
+#endif
+
+	printf("Strobe deadlines missed: RPM %u, speed %u. ADC buffer overruns %u.\n", getSensorDeadlineMisses(ENGINE_RPM),
+		getSensorDeadlineMisses(SPEED_KMH), getAdcCaptureOverruns());
+
+#if PICO_DASH_STATS
+
+	printf("Stats: %u command cycles, %u commands, %u bad. Timeouts: %u receive, %u send. Tx FIFO not empty %u.\n",
+		_driveStatsCounters[STATS_COMMAND_CYCLES], _driveStatsCounters[STATS_COMMANDS],
+		_driveStatsCounters[STATS_BAD_COMMANDS], _driveStatsCounters[STATS_RECEIVE_TIMEOUTS],
+		_driveStatsCounters[STATS_SEND_TIMEOUTS], _driveStatsCounters[STATS_TX_FIFO_NOT_EMPTY]);
+
+	_printStatsHistogram("Command service time", &_driveStatsHistograms[STATS_COMMAND_SERVICE_TIME]);
+	_printStatsHistogram("Ready for command latency", &_driveStatsHistograms[STATS_READY_LATENCY]);
+	_printStatsHistogram("RPM strobe lateness", &_driveStrobeLateness[ENGINE_RPM]);
+	_printStatsHistogram("Speed strobe lateness", &_driveStrobeLateness[SPEED_KMH]);
+	_printStatsHistogram("Temperature strobe lateness", &_driveStrobeLateness[ENGINE_TEMP_C]);
+
+#endif
+
+#if PICO_DASH_HISTORY
+	if(_historyLost || _historyOutOfOrder || _historyNotLatched) return 1;
+#endif
+
+	return _failedCommands ? 1 : 0;
+}
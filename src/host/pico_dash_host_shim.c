@@ -0,0 +1,1346 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "hardware/adc.h"
+#include "hardware/dma.h"
+#include "hardware/gpio.h"
+#include "hardware/spi.h"
+#include "hardware/sync.h"
+#include "hardware/timer.h"
+#include "pico/multicore.h"
+#include "pico/time.h"
+
+#include "pico_dash_host_shim.h"
+#include "pico_dash_spi_latch.h"
+
+/** Real time, in microseconds, to wait for the firmware before giving up on a handshake or clock sync. */
+#define HOST_REAL_TIME_WAIT_US 100000
+
+/** Real time, in microseconds, that an idle core sleeps for before polling again regardless. */
+#define HOST_IDLE_WAIT_US 1000
+
+/**
+ * Number of consecutive polls that see nothing change before a core is considered idle and put to sleep.
+ * Must comfortably exceed the number of clock reads core 1 makes in a single pass of its sensor loop.
+ */
+#define HOST_IDLE_POLLS 64
+
+/**
+ * Virtual time, in microseconds, between the SPI master's polls of a handshake pin, and the most polls it advances the
+ * clock for in one wait. Time moving on while the master waits on the firmware is what the GET_STATS command service
+ * time and ready latency measure. The cap keeps a wait that is slow in real time from running the clock away.
+ */
+#define HOST_MASTER_POLL_US 1
+#define HOST_MASTER_MAX_POLLS 100
+
+// Everything the firmware can observe changing (virtual time, pins, FIFOs, events) bumps a single "world" generation
+// counter. A core that keeps polling without the generation changing is waiting on the outside world, so instead of
+// spinning it sleeps until the world changes. That keeps the simulation fast on a single CPU host and lets the
+// simulation know when core 1 has finished with the current instant.
+
+/** Protects all shared shim state below. */
+static pthread_mutex_t _hostMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/** Signalled whenever the world changes or a core goes idle. */
+static pthread_cond_t _hostCond = PTHREAD_COND_INITIALIZER;
+
+/** World generation. */
+static uint64_t _hostGen = 0;
+
+/** Core that the calling thread represents. */
+static _Thread_local uint _hostCoreNum = 0;
+
+/** World generation seen by the calling thread's last poll. */
+static _Thread_local uint64_t _hostPollGen = 0;
+
+/** Number of consecutive polls by the calling thread that saw no change. */
+static _Thread_local int _hostUnchangedPolls = 0;
+
+/** Whether each core is asleep waiting for the world to change. */
+static bool _hostCoreIdle[2];
+
+/** World generation at which each core went idle. */
+static uint64_t _hostCoreIdleGen[2];
+
+/** Current virtual time, in microseconds since boot. */
+static uint64_t _hostClock = 0;
+
+/** Whether core 1 has been launched and not yet returned. */
+static bool _hostCore1Running = false;
+
+static pthread_t _hostCore1Thread;
+
+static void (*_hostCore1Entry)(void) = 0;
+
+/** Pin levels. One bit per pin. */
+static uint32_t _hostGpioLevels = 0;
+
+/** Enabled GPIO IRQ events per pin. */
+static uint32_t _hostGpioIrqEvents[NUM_BANK0_GPIOS];
+
+/** Core each pin's IRQ is routed to. */
+static uint _hostGpioIrqCore[NUM_BANK0_GPIOS];
+
+/** GPIO IRQ callback per core. */
+static gpio_irq_callback_t _hostGpioIrqCallbacks[2];
+
+/**
+ * Serialises delivery of interrupts, and is held to mask them. Separate from _hostMutex because handlers call back into
+ * the shim.
+ */
+static pthread_mutex_t _hostIrqMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/** Number of nested save_and_disable_interrupts by the calling thread. It holds _hostIrqMutex while above zero. */
+static _Thread_local int _hostIrqMaskDepth = 0;
+
+/** Event flag per core, as used by WFE/SEV. */
+static bool _hostEvent[2];
+
+/** A SPI FIFO. */
+struct HostFifo
+{
+	uint8_t data[SPI_FIFO_DEPTH];
+	int readPosn;
+	int count;
+};
+
+/** Slave receive FIFO. Master writes, firmware reads. */
+static struct HostFifo _hostSpiRxFifo;
+
+/** Slave transmit FIFO. Firmware writes, master reads. */
+static struct HostFifo _hostSpiTxFifo;
+
+static uint64_t _hostHandshakeCount = 0;
+
+/** Number of bytes the master has shifted. */
+static uint64_t _hostByteCount = 0;
+
+/** Stand in spi0 register block. Only the address of dr is used, to recognise DMA to/from the spi0 FIFOs. */
+static spi_hw_t _hostSpi0Hw;
+
+/** A DMA channel. */
+struct HostDmaChannel
+{
+	bool claimed;
+	dma_channel_config config;
+	volatile uint8_t* writeAddr;
+	const volatile uint8_t* readAddr;
+	uint32_t transCount;
+
+	/** Transfer count copied into transCount each time the channel is triggered. */
+	uint32_t transCountReload;
+
+	bool busy;
+	bool irq0Enabled;
+	bool irq0Status;
+	bool irq1Enabled;
+	bool irq1Status;
+};
+
+static struct HostDmaChannel _hostDmaChannels[NUM_DMA_CHANNELS];
+
+/** Interrupt handlers, by IRQ number. */
+static irq_handler_t _hostIrqHandlers[32];
+
+/** Core that set each interrupt's handler, and so takes the interrupt. */
+static uint _hostIrqCore[32];
+
+/** Set when a DMA channel has raised DMA_IRQ_0 or DMA_IRQ_1 but the handler hasn't been run yet. */
+static bool _hostDmaIrqPending[2];
+
+/** Depth of the ADC FIFO. */
+#define HOST_ADC_FIFO_DEPTH 4
+
+/** ADC clock cycles per microsecond. */
+#define HOST_ADC_CLOCK_MHZ 48
+
+/** Minimum ADC clock cycles per conversion. */
+#define HOST_ADC_MIN_CONVERSION_CYCLES 96
+
+adc_hw_t _hostAdcHw;
+
+/** ADC model. */
+static struct
+{
+	bool running;
+	bool fifoEnabled;
+	bool dreqEnabled;
+	uint input;
+	uint roundRobinMask;
+
+	/** ADC clock cycles per conversion. */
+	uint64_t conversionCycles;
+
+	/** ADC clock cycle, counted from boot, at which the next conversion completes. */
+	uint64_t nextConversionCycle;
+
+	/** Input levels and peak noise, set by hostAdcSetInput. */
+	int levels[NUM_ADC_CHANNELS];
+	int noise[NUM_ADC_CHANNELS];
+
+	/** Noise generator state. */
+	uint32_t noiseSeed;
+
+	uint16_t fifo[HOST_ADC_FIFO_DEPTH];
+	int fifoReadPosn;
+	int fifoCount;
+} _hostAdc = {.conversionCycles = HOST_ADC_MIN_CONVERSION_CYCLES, .noiseSeed = 1};
+
+/** A hardware alarm. */
+struct HostAlarm
+{
+	bool claimed;
+	hardware_alarm_callback_t callback;
+
+	/** Core the callback runs as. */
+	uint core;
+
+	bool armed;
+	absolute_time_t target;
+};
+
+static struct HostAlarm _hostAlarms[NUM_TIMERS];
+
+/** Real monotonic time in microseconds. */
+static uint64_t _hostRealTimeUs()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/** Wait on the shim condition, with _hostMutex held, for at most the given real time. */
+static void _hostCondWait(uint64_t us)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+
+	ts.tv_sec += us / 1000000;
+	ts.tv_nsec += (us % 1000000) * 1000;
+
+	if(ts.tv_nsec >= 1000000000)
+	{
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000;
+	}
+
+	pthread_cond_timedwait(&_hostCond, &_hostMutex, &ts);
+}
+
+/** Record a change to the world, with _hostMutex held. */
+static void _hostWorldChangedLocked()
+{
+	_hostGen++;
+	pthread_cond_broadcast(&_hostCond);
+}
+
+static void _hostWorldChanged()
+{
+	pthread_mutex_lock(&_hostMutex);
+	_hostWorldChangedLocked();
+	pthread_mutex_unlock(&_hostMutex);
+}
+
+/** Go idle, with _hostMutex held, until the world changes or the idle wait expires. */
+static void _hostIdleLocked()
+{
+	uint core = _hostCoreNum;
+
+	_hostCoreIdle[core] = true;
+	_hostCoreIdleGen[core] = _hostGen;
+	pthread_cond_broadcast(&_hostCond);
+
+	uint64_t idleGen = _hostGen;
+	_hostCondWait(HOST_IDLE_WAIT_US);
+
+	// Spurious and timed out wakeups are fine, the caller just polls again.
+	_hostCoreIdle[core] = false;
+	_hostUnchangedPolls = _hostGen == idleGen ? HOST_IDLE_POLLS / 2 : 0;
+	_hostPollGen = _hostGen;
+}
+
+void hostPoll()
+{
+	uint64_t gen = __atomic_load_n(&_hostGen, __ATOMIC_ACQUIRE);
+
+	if(gen != _hostPollGen)
+	{
+		_hostPollGen = gen;
+		_hostUnchangedPolls = 0;
+	}
+	else if(++_hostUnchangedPolls >= HOST_IDLE_POLLS)
+	{
+		pthread_mutex_lock(&_hostMutex);
+
+		if(_hostGen == _hostPollGen) _hostIdleLocked();
+
+		pthread_mutex_unlock(&_hostMutex);
+	}
+}
+
+static bool _hostFifoPush(struct HostFifo* fifo, uint8_t value)
+{
+	if(fifo -> count == SPI_FIFO_DEPTH) return false;
+
+	fifo -> data[(fifo -> readPosn + fifo -> count++) % SPI_FIFO_DEPTH] = value;
+
+	return true;
+}
+
+static uint8_t _hostFifoPop(struct HostFifo* fifo)
+{
+	if(fifo -> count == 0) return 0;
+
+	uint8_t value = fifo -> data[fifo -> readPosn];
+
+	fifo -> readPosn = (fifo -> readPosn + 1) % SPI_FIFO_DEPTH;
+	fifo -> count--;
+
+	return value;
+}
+
+/** Trigger a DMA channel, with _hostMutex held. */
+static void _hostDmaTriggerLocked(uint channel)
+{
+	_hostDmaChannels[channel].transCount = _hostDmaChannels[channel].transCountReload;
+	_hostDmaChannels[channel].busy = true;
+}
+
+/** Move whatever data the DREQ paced DMA channels can move, with _hostMutex held. */
+static void _hostDmaServiceLocked()
+{
+	// Keep going while channels complete, since a chained channel may be able to move data straight away.
+	bool completed = true;
+
+	while(completed)
+	{
+		completed = false;
+
+		for(uint channel = 0; channel < NUM_DMA_CHANNELS; channel++)
+		{
+			struct HostDmaChannel* dma = _hostDmaChannels + channel;
+
+			if(!dma -> busy) continue;
+
+			if(dma -> config.dreq == DREQ_SPI0_RX)
+			{
+				while(dma -> transCount > 0 && _hostSpiRxFifo.count > 0)
+				{
+					*dma -> writeAddr = _hostFifoPop(&_hostSpiRxFifo);
+
+					if(dma -> config.writeIncrement) dma -> writeAddr++;
+					dma -> transCount--;
+				}
+			}
+			else if(dma -> config.dreq == DREQ_SPI0_TX)
+			{
+				while(dma -> transCount > 0 && _hostSpiTxFifo.count < SPI_FIFO_DEPTH)
+				{
+					_hostFifoPush(&_hostSpiTxFifo, *dma -> readAddr);
+
+					if(dma -> config.readIncrement) dma -> readAddr++;
+					dma -> transCount--;
+				}
+			}
+			else if(dma -> config.dreq == DREQ_ADC)
+			{
+				while(dma -> transCount > 0 && _hostAdc.dreqEnabled && _hostAdc.fifoCount > 0)
+				{
+					*(volatile uint16_t*)dma -> writeAddr = _hostAdc.fifo[_hostAdc.fifoReadPosn];
+
+					_hostAdc.fifoReadPosn = (_hostAdc.fifoReadPosn + 1) % HOST_ADC_FIFO_DEPTH;
+					_hostAdc.fifoCount--;
+
+					if(dma -> config.writeIncrement) dma -> writeAddr += sizeof(uint16_t);
+					dma -> transCount--;
+				}
+			}
+
+			if(dma -> transCount == 0)
+			{
+				dma -> busy = false;
+				completed = true;
+
+				if(dma -> irq0Enabled)
+				{
+					dma -> irq0Status = true;
+					_hostDmaIrqPending[0] = true;
+				}
+
+				if(dma -> irq1Enabled)
+				{
+					dma -> irq1Status = true;
+					_hostDmaIrqPending[1] = true;
+				}
+
+				if(dma -> config.chainTo != channel) _hostDmaTriggerLocked(dma -> config.chainTo);
+			}
+		}
+	}
+}
+
+/**
+ * Run the DMA_IRQ_0 and DMA_IRQ_1 handlers, as the cores that set them, if a channel has raised them.
+ * Must be called without _hostMutex held.
+ */
+static void _hostDmaDeliverIrq()
+{
+	for(int line = 0; line < 2; line++)
+	{
+		uint irq = line ? DMA_IRQ_1 : DMA_IRQ_0;
+
+		pthread_mutex_lock(&_hostMutex);
+		bool pending = _hostDmaIrqPending[line];
+		_hostDmaIrqPending[line] = false;
+		pthread_mutex_unlock(&_hostMutex);
+
+		if(pending && _hostIrqHandlers[irq])
+		{
+			uint32_t interrupts = save_and_disable_interrupts();
+
+			uint savedCoreNum = _hostCoreNum;
+			_hostCoreNum = _hostIrqCore[irq];
+
+			_hostIrqHandlers[irq]();
+
+			_hostCoreNum = savedCoreNum;
+
+			restore_interrupts(interrupts);
+
+			__sev();
+		}
+	}
+}
+
+/** Run the ADC up to the current virtual time, with _hostMutex held. */
+static void _hostAdcAdvanceLocked()
+{
+	uint64_t clockCycles = _hostClock * HOST_ADC_CLOCK_MHZ;
+
+	if(!_hostAdc.running)
+	{
+		_hostAdc.nextConversionCycle = clockCycles + _hostAdc.conversionCycles;
+		return;
+	}
+
+	while(_hostAdc.nextConversionCycle <= clockCycles)
+	{
+		uint input = _hostAdc.input;
+
+		// Uniform noise of up to the set peak either side of the level.
+		_hostAdc.noiseSeed = _hostAdc.noiseSeed * 1664525 + 1013904223;
+
+		int noise = _hostAdc.noise[input];
+		int sample = _hostAdc.levels[input] + (noise ? (int)(_hostAdc.noiseSeed >> 8) % (2 * noise + 1) - noise : 0);
+
+		sample = sample < 0 ? 0 : sample > 4095 ? 4095 : sample;
+
+		// A full FIFO drops the sample, as if it had overflowed.
+		if(_hostAdc.fifoEnabled && _hostAdc.fifoCount < HOST_ADC_FIFO_DEPTH)
+		{
+			_hostAdc.fifo[(_hostAdc.fifoReadPosn + _hostAdc.fifoCount++) % HOST_ADC_FIFO_DEPTH] = sample;
+		}
+
+		_hostDmaServiceLocked();
+
+		// Round robin moves on to the next higher input in the mask, wrapping round.
+		if(_hostAdc.roundRobinMask)
+		{
+			do
+			{
+				input = (input + 1) % NUM_ADC_CHANNELS;
+			}
+			while(!(_hostAdc.roundRobinMask & (1 << input)));
+
+			_hostAdc.input = input;
+		}
+
+		_hostAdc.nextConversionCycle += _hostAdc.conversionCycles;
+	}
+}
+
+void adc_init()
+{
+	pthread_mutex_lock(&_hostMutex);
+
+	_hostAdc.running = false;
+	_hostAdc.fifoEnabled = false;
+	_hostAdc.dreqEnabled = false;
+	_hostAdc.input = 0;
+	_hostAdc.roundRobinMask = 0;
+	_hostAdc.fifoCount = 0;
+
+	pthread_mutex_unlock(&_hostMutex);
+}
+
+void adc_select_input(uint input)
+{
+	pthread_mutex_lock(&_hostMutex);
+	_hostAdc.input = input;
+	pthread_mutex_unlock(&_hostMutex);
+}
+
+void adc_set_round_robin(uint input_mask)
+{
+	pthread_mutex_lock(&_hostMutex);
+	_hostAdc.roundRobinMask = input_mask;
+	pthread_mutex_unlock(&_hostMutex);
+}
+
+void adc_fifo_setup(bool en, bool dreq_en, uint16_t dreq_thresh, bool err_in_fifo, bool byte_shift)
+{
+	(void)dreq_thresh;
+	(void)err_in_fifo;
+	(void)byte_shift;
+
+	pthread_mutex_lock(&_hostMutex);
+	_hostAdc.fifoEnabled = en;
+	_hostAdc.dreqEnabled = dreq_en;
+	pthread_mutex_unlock(&_hostMutex);
+}
+
+void adc_set_clkdiv(float clkdiv)
+{
+	pthread_mutex_lock(&_hostMutex);
+
+	uint64_t cycles = (uint64_t)clkdiv + 1;
+	_hostAdc.conversionCycles = cycles < HOST_ADC_MIN_CONVERSION_CYCLES ? HOST_ADC_MIN_CONVERSION_CYCLES : cycles;
+
+	pthread_mutex_unlock(&_hostMutex);
+}
+
+void adc_run(bool run)
+{
+	pthread_mutex_lock(&_hostMutex);
+
+	// The first conversion completes a conversion time after starting.
+	if(run && !_hostAdc.running)
+	{
+		_hostAdc.nextConversionCycle = _hostClock * HOST_ADC_CLOCK_MHZ + _hostAdc.conversionCycles;
+	}
+
+	_hostAdc.running = run;
+
+	pthread_mutex_unlock(&_hostMutex);
+}
+
+void adc_fifo_drain()
+{
+	pthread_mutex_lock(&_hostMutex);
+	_hostAdc.fifoCount = 0;
+	pthread_mutex_unlock(&_hostMutex);
+}
+
+void hostAdcSetInput(uint input, int level, int noise)
+{
+	pthread_mutex_lock(&_hostMutex);
+
+	_hostAdc.levels[input] = level;
+	_hostAdc.noise[input] = noise;
+
+	pthread_mutex_unlock(&_hostMutex);
+}
+
+/** Run the callbacks of armed alarms whose target has passed. Must be called without _hostMutex held. */
+static void _hostAlarmDeliver()
+{
+	for(uint alarm = 0; alarm < NUM_TIMERS; alarm++)
+	{
+		pthread_mutex_lock(&_hostMutex);
+
+		bool fire = _hostAlarms[alarm].armed && _hostAlarms[alarm].target <= _hostClock;
+		hardware_alarm_callback_t callback = _hostAlarms[alarm].callback;
+		uint core = _hostAlarms[alarm].core;
+
+		if(fire) _hostAlarms[alarm].armed = false;
+
+		pthread_mutex_unlock(&_hostMutex);
+
+		if(fire && callback)
+		{
+			uint32_t interrupts = save_and_disable_interrupts();
+
+			uint savedCoreNum = _hostCoreNum;
+			_hostCoreNum = core;
+
+			callback(alarm);
+
+			_hostCoreNum = savedCoreNum;
+
+			restore_interrupts(interrupts);
+		}
+
+		// Taking the interrupt wakes the core from WFE.
+		if(fire) __sev();
+	}
+}
+
+int hardware_alarm_claim_unused(bool required)
+{
+	int retVal = -1;
+
+	pthread_mutex_lock(&_hostMutex);
+
+	for(int alarm = 0; alarm < NUM_TIMERS && retVal < 0; alarm++)
+	{
+		if(!_hostAlarms[alarm].claimed)
+		{
+			_hostAlarms[alarm].claimed = true;
+			retVal = alarm;
+		}
+	}
+
+	pthread_mutex_unlock(&_hostMutex);
+
+	if(retVal < 0 && required) abort();
+
+	return retVal;
+}
+
+void hardware_alarm_unclaim(uint alarm_num)
+{
+	pthread_mutex_lock(&_hostMutex);
+
+	_hostAlarms[alarm_num].claimed = false;
+	_hostAlarms[alarm_num].armed = false;
+
+	pthread_mutex_unlock(&_hostMutex);
+}
+
+void hardware_alarm_set_callback(uint alarm_num, hardware_alarm_callback_t callback)
+{
+	pthread_mutex_lock(&_hostMutex);
+
+	_hostAlarms[alarm_num].callback = callback;
+	_hostAlarms[alarm_num].core = _hostCoreNum;
+
+	pthread_mutex_unlock(&_hostMutex);
+}
+
+bool hardware_alarm_set_target(uint alarm_num, absolute_time_t t)
+{
+	pthread_mutex_lock(&_hostMutex);
+
+	bool missed = t <= _hostClock;
+
+	_hostAlarms[alarm_num].armed = !missed;
+	_hostAlarms[alarm_num].target = t;
+
+	pthread_mutex_unlock(&_hostMutex);
+
+	return missed;
+}
+
+void hardware_alarm_cancel(uint alarm_num)
+{
+	pthread_mutex_lock(&_hostMutex);
+
+	_hostAlarms[alarm_num].armed = false;
+
+	pthread_mutex_unlock(&_hostMutex);
+}
+
+uint32_t save_and_disable_interrupts()
+{
+	if(_hostIrqMaskDepth++ == 0) pthread_mutex_lock(&_hostIrqMutex);
+
+	return 0;
+}
+
+void restore_interrupts(uint32_t status)
+{
+	(void)status;
+
+	if(--_hostIrqMaskDepth == 0) pthread_mutex_unlock(&_hostIrqMutex);
+}
+
+uint get_core_num()
+{
+	return _hostCoreNum;
+}
+
+absolute_time_t get_absolute_time()
+{
+	hostPoll();
+
+	return __atomic_load_n(&_hostClock, __ATOMIC_ACQUIRE);
+}
+
+void sleep_until(absolute_time_t target)
+{
+	while(get_absolute_time() < target);
+}
+
+bool best_effort_wfe_or_timeout(absolute_time_t timeout_timestamp)
+{
+	if(get_absolute_time() >= timeout_timestamp) return true;
+
+	__wfe();
+
+	return get_absolute_time() >= timeout_timestamp;
+}
+
+void hostClockAdvance(uint64_t us)
+{
+	pthread_mutex_lock(&_hostMutex);
+
+	__atomic_add_fetch(&_hostClock, us, __ATOMIC_RELEASE);
+	_hostAdcAdvanceLocked();
+	_hostWorldChangedLocked();
+
+	pthread_mutex_unlock(&_hostMutex);
+
+	_hostDmaDeliverIrq();
+	_hostAlarmDeliver();
+}
+
+void hostClockSync()
+{
+	uint64_t giveUpTime = _hostRealTimeUs() + HOST_REAL_TIME_WAIT_US / 10;
+
+	pthread_mutex_lock(&_hostMutex);
+
+	// Core 1 is done with the current instant once it has gone idle having seen the latest change.
+	while(__atomic_load_n(&_hostCore1Running, __ATOMIC_ACQUIRE) &&
+		!(_hostCoreIdle[1] && _hostCoreIdleGen[1] == _hostGen) && _hostRealTimeUs() < giveUpTime)
+	{
+		_hostCondWait(HOST_IDLE_WAIT_US);
+	}
+
+	pthread_mutex_unlock(&_hostMutex);
+}
+
+static void* _hostCore1ThreadEntry(void* arg)
+{
+	(void)arg;
+
+	_hostCoreNum = 1;
+
+	_hostCore1Entry();
+
+	__atomic_store_n(&_hostCore1Running, false, __ATOMIC_RELEASE);
+	_hostWorldChanged();
+
+	return 0;
+}
+
+void multicore_launch_core1(void (*entry)(void))
+{
+	_hostCore1Entry = entry;
+
+	__atomic_store_n(&_hostCore1Running, true, __ATOMIC_RELEASE);
+
+	pthread_create(&_hostCore1Thread, 0, _hostCore1ThreadEntry, 0);
+}
+
+void hostJoinCore1()
+{
+	if(_hostCore1Entry)
+	{
+		// Make sure core 1 notices whatever told it to stop.
+		_hostWorldChanged();
+		__sev();
+
+		pthread_join(_hostCore1Thread, 0);
+		_hostCore1Entry = 0;
+	}
+}
+
+void __wfe()
+{
+	uint core = _hostCoreNum;
+
+	pthread_mutex_lock(&_hostMutex);
+
+	// WFE is allowed to wake spuriously so the idle wait expiring is fine.
+	if(!_hostEvent[core]) _hostIdleLocked();
+
+	_hostEvent[core] = false;
+
+	pthread_mutex_unlock(&_hostMutex);
+}
+
+void __sev()
+{
+	pthread_mutex_lock(&_hostMutex);
+
+	_hostEvent[0] = true;
+	_hostEvent[1] = true;
+
+	_hostWorldChangedLocked();
+
+	pthread_mutex_unlock(&_hostMutex);
+}
+
+void gpio_init(uint gpio)
+{
+	gpio_put(gpio, false);
+}
+
+void gpio_set_function(uint gpio, enum gpio_function fn)
+{
+	(void)gpio;
+	(void)fn;
+}
+
+void gpio_set_dir(uint gpio, bool out)
+{
+	(void)gpio;
+	(void)out;
+}
+
+void gpio_pull_up(uint gpio)
+{
+	gpio_put(gpio, true);
+}
+
+void gpio_pull_down(uint gpio)
+{
+	gpio_put(gpio, false);
+}
+
+bool gpio_get(uint gpio)
+{
+	return (__atomic_load_n(&_hostGpioLevels, __ATOMIC_ACQUIRE) >> gpio) & 1;
+}
+
+void gpio_put_masked(uint32_t mask, uint32_t value)
+{
+	pthread_mutex_lock(&_hostMutex);
+
+	uint32_t levels = __atomic_load_n(&_hostGpioLevels, __ATOMIC_RELAXED);
+	uint32_t newLevels = (levels & ~mask) | (value & mask);
+
+	if(newLevels != levels)
+	{
+		__atomic_store_n(&_hostGpioLevels, newLevels, __ATOMIC_RELEASE);
+		_hostWorldChangedLocked();
+	}
+
+	pthread_mutex_unlock(&_hostMutex);
+}
+
+void gpio_put(uint gpio, bool value)
+{
+	gpio_put_masked(1u << gpio, value ? 1u << gpio : 0);
+}
+
+uint32_t gpio_get_all()
+{
+	return __atomic_load_n(&_hostGpioLevels, __ATOMIC_ACQUIRE);
+}
+
+void gpio_set_irq_callback(gpio_irq_callback_t callback)
+{
+	_hostGpioIrqCallbacks[_hostCoreNum] = callback;
+}
+
+void gpio_set_irq_enabled(uint gpio, uint32_t event_mask, bool enabled)
+{
+	pthread_mutex_lock(&_hostIrqMutex);
+
+	if(enabled)
+	{
+		_hostGpioIrqEvents[gpio] |= event_mask;
+	}
+	else
+	{
+		_hostGpioIrqEvents[gpio] &= ~event_mask;
+	}
+
+	_hostGpioIrqCore[gpio] = _hostCoreNum;
+
+	pthread_mutex_unlock(&_hostIrqMutex);
+}
+
+void hostGpioDrive(uint gpio, bool value)
+{
+	bool oldValue = gpio_get(gpio);
+
+	gpio_put(gpio, value);
+
+	if(oldValue != value)
+	{
+		uint32_t interrupts = save_and_disable_interrupts();
+
+		uint32_t events = _hostGpioIrqEvents[gpio] & (value ? GPIO_IRQ_EDGE_RISE : GPIO_IRQ_EDGE_FALL);
+		uint core = _hostGpioIrqCore[gpio];
+
+		if(events && _hostGpioIrqCallbacks[core])
+		{
+			// Run the handler as the core it was routed to.
+			uint savedCoreNum = _hostCoreNum;
+			_hostCoreNum = core;
+
+			_hostGpioIrqCallbacks[core](gpio, events);
+
+			_hostCoreNum = savedCoreNum;
+		}
+
+		restore_interrupts(interrupts);
+	}
+
+	// A pending interrupt wakes WFE (SEVONPEND).
+	__sev();
+}
+
+bool hostSpiRxReadable()
+{
+	pthread_mutex_lock(&_hostMutex);
+	bool retVal = _hostSpiRxFifo.count > 0;
+	pthread_mutex_unlock(&_hostMutex);
+
+	if(!retVal) hostPoll();
+
+	return retVal;
+}
+
+bool hostSpiTxWritable()
+{
+	pthread_mutex_lock(&_hostMutex);
+	bool retVal = _hostSpiTxFifo.count < SPI_FIFO_DEPTH;
+	pthread_mutex_unlock(&_hostMutex);
+
+	if(!retVal) hostPoll();
+
+	return retVal;
+}
+
+bool hostSpiTxEmpty()
+{
+	pthread_mutex_lock(&_hostMutex);
+	bool retVal = _hostSpiTxFifo.count == 0;
+	pthread_mutex_unlock(&_hostMutex);
+
+	return retVal;
+}
+
+uint8_t hostSpiRead()
+{
+	pthread_mutex_lock(&_hostMutex);
+
+	// Wake a master waiting for room to write.
+	if(_hostSpiRxFifo.count == SPI_FIFO_DEPTH) pthread_cond_broadcast(&_hostCond);
+
+	uint8_t retVal = _hostFifoPop(&_hostSpiRxFifo);
+	pthread_mutex_unlock(&_hostMutex);
+
+	return retVal;
+}
+
+void hostSpiWrite(uint8_t value)
+{
+	pthread_mutex_lock(&_hostMutex);
+	_hostFifoPush(&_hostSpiTxFifo, value);
+	_hostWorldChangedLocked();
+	pthread_mutex_unlock(&_hostMutex);
+}
+
+void hostSpiMasterTransfer(const uint8_t* tx, uint8_t* rx, int len)
+{
+	__atomic_add_fetch(&_hostByteCount, len, __ATOMIC_RELAXED);
+
+	pthread_mutex_lock(&_hostMutex);
+
+	for(int index = 0; index < len; index++)
+	{
+		_hostFifoPush(&_hostSpiRxFifo, tx ? tx[index] : 0);
+
+		uint8_t value = _hostFifoPop(&_hostSpiTxFifo);
+		if(rx) rx[index] = value;
+
+		_hostDmaServiceLocked();
+	}
+
+	_hostWorldChangedLocked();
+
+	pthread_mutex_unlock(&_hostMutex);
+
+	_hostDmaDeliverIrq();
+}
+
+/** Wait, in real time, for a pin to reach the given level. */
+static bool _hostWaitForPin(uint gpio, bool value)
+{
+	uint64_t giveUpTime = _hostRealTimeUs() + HOST_REAL_TIME_WAIT_US;
+
+	bool retVal = true;
+
+	int polls = 0;
+
+	pthread_mutex_lock(&_hostMutex);
+
+	while(gpio_get(gpio) != value && retVal)
+	{
+		if(polls++ < HOST_MASTER_MAX_POLLS)
+		{
+			pthread_mutex_unlock(&_hostMutex);
+
+			hostClockAdvance(HOST_MASTER_POLL_US);
+
+			pthread_mutex_lock(&_hostMutex);
+		}
+
+		if(gpio_get(gpio) != value) _hostCondWait(HOST_IDLE_WAIT_US);
+
+		retVal = _hostRealTimeUs() < giveUpTime;
+	}
+
+	pthread_mutex_unlock(&_hostMutex);
+
+	return retVal;
+}
+
+/**
+ * Write bytes to the slave, waiting in real time for room in the slave rx FIFO before each one. ie The firmware is
+ * assumed to keep up with a long write, as it would at SPI_BAUD.
+ */
+static bool _hostSpiMasterWrite(const uint8_t* tx, int size)
+{
+	uint64_t giveUpTime = _hostRealTimeUs() + HOST_REAL_TIME_WAIT_US;
+
+	bool retVal = true;
+
+	for(int index = 0; index < size && retVal; index++)
+	{
+		pthread_mutex_lock(&_hostMutex);
+
+		while(_hostSpiRxFifo.count == SPI_FIFO_DEPTH && retVal)
+		{
+			_hostCondWait(HOST_IDLE_WAIT_US);
+
+			retVal = _hostRealTimeUs() < giveUpTime;
+		}
+
+		pthread_mutex_unlock(&_hostMutex);
+
+		hostSpiMasterTransfer(tx + index, 0, 1);
+	}
+
+	return retVal;
+}
+
+/**
+ * Shift bytes through the slave, waiting in real time for each byte to be queued in the slave tx FIFO.
+ * @param tx Bytes to send. Zeros are sent after the first txSize bytes.
+ * @param txSize Number of bytes to send from tx.
+ * @param rx Buffer to receive into. May be null to discard.
+ * @param size Number of bytes to shift.
+ */
+static bool _hostSpiMasterShift(const uint8_t* tx, int txSize, uint8_t* rx, int size)
+{
+	uint64_t giveUpTime = _hostRealTimeUs() + HOST_REAL_TIME_WAIT_US;
+
+	bool retVal = true;
+
+	for(int index = 0; index < size; index++)
+	{
+		pthread_mutex_lock(&_hostMutex);
+
+		while(_hostSpiTxFifo.count == 0 && retVal)
+		{
+			_hostCondWait(HOST_IDLE_WAIT_US);
+
+			retVal = _hostRealTimeUs() < giveUpTime;
+		}
+
+		pthread_mutex_unlock(&_hostMutex);
+
+		hostSpiMasterTransfer(index < txSize ? tx + index : 0, rx ? rx + index : 0, 1);
+	}
+
+	return retVal;
+}
+
+bool hostSpiMasterCommand(const uint8_t* command, int commandSize, uint8_t* response, int responseSize)
+{
+	__atomic_add_fetch(&_hostHandshakeCount, 1, __ATOMIC_RELAXED);
+
+	hostGpioDrive(SPI_LATCH_COMMAND_ACTIVE_GPIO_PIN, true);
+
+	bool retVal = _hostWaitForPin(SPI_LATCH_READY_FOR_COMMAND_GPIO_PIN, true);
+
+	if(retVal)
+	{
+		// A frame fits in the rx FIFO. The rest of a longer command goes as fast as the slave takes it.
+		if(commandSize > SPI_COMMAND_RESPONSE_FRAME_SIZE)
+		{
+			retVal = _hostSpiMasterWrite(command, commandSize);
+		}
+		else
+		{
+			hostSpiMasterTransfer(command, 0, commandSize);
+		}
+
+		retVal = retVal && _hostWaitForPin(SPI_LATCH_READY_FOR_COMMAND_GPIO_PIN, false);
+	}
+
+	// The master pads with zeros while reading the response.
+	if(retVal) retVal = _hostSpiMasterShift(0, 0, response, responseSize);
+
+	hostGpioDrive(SPI_LATCH_COMMAND_ACTIVE_GPIO_PIN, false);
+
+	return retVal;
+}
+
+bool hostSpiMasterPipelinedCommands(const uint8_t* commands, int commandCount, uint8_t* responses,
+	const int* responseSizes)
+{
+	static const uint8_t noCommand[SPI_COMMAND_RESPONSE_FRAME_SIZE] = {NO_COMMAND};
+
+	__atomic_add_fetch(&_hostHandshakeCount, 1, __ATOMIC_RELAXED);
+
+	hostGpioDrive(SPI_LATCH_COMMAND_ACTIVE_GPIO_PIN, true);
+
+	bool retVal = true;
+	bool readyForCommand = true;
+
+	// The first transfer carries no response.
+	uint8_t* response = 0;
+	int responseSize = SPI_COMMAND_RESPONSE_FRAME_SIZE;
+
+	for(int index = 0; index <= commandCount && retVal; index++)
+	{
+		retVal = _hostWaitForPin(SPI_LATCH_READY_FOR_COMMAND_GPIO_PIN, readyForCommand);
+		readyForCommand = !readyForCommand;
+
+		const uint8_t* command = index < commandCount ? commands + index * SPI_COMMAND_RESPONSE_FRAME_SIZE : noCommand;
+
+		if(retVal) retVal = _hostSpiMasterShift(command, SPI_COMMAND_RESPONSE_FRAME_SIZE, response, responseSize);
+
+		if(index < commandCount)
+		{
+			response = response ? response + responseSize : responses;
+			responseSize = responseSizes[index];
+		}
+	}
+
+	hostGpioDrive(SPI_LATCH_COMMAND_ACTIVE_GPIO_PIN, false);
+
+	return retVal;
+}
+
+int hostSpiMasterFramedCommand(const uint8_t* command, int commandSize, uint8_t* response, int maxResponseSize)
+{
+	__atomic_add_fetch(&_hostHandshakeCount, 1, __ATOMIC_RELAXED);
+
+	hostGpioDrive(SPI_LATCH_COMMAND_ACTIVE_GPIO_PIN, true);
+
+	bool retVal = _hostWaitForPin(SPI_LATCH_READY_FOR_COMMAND_GPIO_PIN, true);
+
+	uint8_t header[SPI_FRAME_HEADER_SIZE] = {commandSize & 0xFF, (commandSize >> 8) & 0xFF};
+	int responseSize = -1;
+
+	if(retVal)
+	{
+		_hostSpiMasterWrite(header, SPI_FRAME_HEADER_SIZE);
+		_hostSpiMasterWrite(command, commandSize);
+
+		retVal = _hostWaitForPin(SPI_LATCH_READY_FOR_COMMAND_GPIO_PIN, false);
+	}
+
+	if(retVal) retVal = _hostSpiMasterShift(0, 0, header, SPI_FRAME_HEADER_SIZE);
+
+	if(retVal)
+	{
+		responseSize = header[0] | header[1] << 8;
+
+		if(responseSize > maxResponseSize || !_hostSpiMasterShift(0, 0, response, responseSize)) responseSize = -1;
+	}
+
+	hostGpioDrive(SPI_LATCH_COMMAND_ACTIVE_GPIO_PIN, false);
+
+	return responseSize;
+}
+
+uint64_t hostSpiByteCount()
+{
+	return __atomic_load_n(&_hostByteCount, __ATOMIC_RELAXED);
+}
+
+uint64_t hostSpiHandshakeCount()
+{
+	return __atomic_load_n(&_hostHandshakeCount, __ATOMIC_RELAXED);
+}
+
+spi_hw_t* spi_get_hw(spi_inst_t* spi)
+{
+	(void)spi;
+	return &_hostSpi0Hw;
+}
+
+void irq_set_exclusive_handler(uint num, irq_handler_t handler)
+{
+	_hostIrqHandlers[num] = handler;
+	_hostIrqCore[num] = _hostCoreNum;
+}
+
+int dma_claim_unused_channel(bool required)
+{
+	int retVal = -1;
+
+	pthread_mutex_lock(&_hostMutex);
+
+	for(int channel = 0; channel < NUM_DMA_CHANNELS && retVal < 0; channel++)
+	{
+		if(!_hostDmaChannels[channel].claimed)
+		{
+			_hostDmaChannels[channel].claimed = true;
+			retVal = channel;
+		}
+	}
+
+	pthread_mutex_unlock(&_hostMutex);
+
+	if(retVal < 0 && required) abort();
+
+	return retVal;
+}
+
+void dma_channel_unclaim(uint channel)
+{
+	_hostDmaChannels[channel].claimed = false;
+}
+
+dma_channel_config dma_channel_get_default_config(uint channel)
+{
+	(void)channel;
+
+	dma_channel_config config = {DMA_SIZE_32, true, false, DREQ_FORCE, channel};
+
+	return config;
+}
+
+/** Start a channel and move whatever it can immediately, with _hostMutex held. */
+static void _hostDmaStartLocked(uint channel)
+{
+	_hostDmaTriggerLocked(channel);
+	_hostDmaServiceLocked();
+	_hostWorldChangedLocked();
+}
+
+/** Common tail of the DMA setters. Starts the channel if triggered and delivers any resulting IRQ. */
+static void _hostDmaSetterDone(uint channel, bool trigger)
+{
+	if(trigger) _hostDmaStartLocked(channel);
+
+	pthread_mutex_unlock(&_hostMutex);
+
+	if(trigger) _hostDmaDeliverIrq();
+}
+
+void dma_channel_configure(uint channel, const dma_channel_config* config, volatile void* write_addr,
+	const volatile void* read_addr, uint transfer_count, bool trigger)
+{
+	bool spi = config -> size == DMA_SIZE_8 && (config -> dreq == DREQ_SPI0_RX || config -> dreq == DREQ_SPI0_TX);
+	bool adc = config -> size == DMA_SIZE_16 && config -> dreq == DREQ_ADC;
+
+	if(!spi && !adc) abort();
+
+	pthread_mutex_lock(&_hostMutex);
+
+	_hostDmaChannels[channel].config = *config;
+	_hostDmaChannels[channel].writeAddr = write_addr;
+	_hostDmaChannels[channel].readAddr = read_addr;
+	_hostDmaChannels[channel].transCountReload = transfer_count;
+
+	_hostDmaSetterDone(channel, trigger);
+}
+
+void dma_channel_set_read_addr(uint channel, const volatile void* read_addr, bool trigger)
+{
+	pthread_mutex_lock(&_hostMutex);
+
+	_hostDmaChannels[channel].readAddr = read_addr;
+
+	_hostDmaSetterDone(channel, trigger);
+}
+
+void dma_channel_set_write_addr(uint channel, volatile void* write_addr, bool trigger)
+{
+	pthread_mutex_lock(&_hostMutex);
+
+	_hostDmaChannels[channel].writeAddr = write_addr;
+
+	_hostDmaSetterDone(channel, trigger);
+}
+
+void dma_channel_set_trans_count(uint channel, uint32_t trans_count, bool trigger)
+{
+	pthread_mutex_lock(&_hostMutex);
+
+	_hostDmaChannels[channel].transCountReload = trans_count;
+
+	_hostDmaSetterDone(channel, trigger);
+}
+
+void dma_channel_start(uint channel)
+{
+	pthread_mutex_lock(&_hostMutex);
+
+	_hostDmaSetterDone(channel, true);
+}
+
+void dma_channel_abort(uint channel)
+{
+	pthread_mutex_lock(&_hostMutex);
+
+	// Like the real thing, an abort doesn't raise the IRQ.
+	_hostDmaChannels[channel].busy = false;
+
+	pthread_mutex_unlock(&_hostMutex);
+}
+
+bool dma_channel_is_busy(uint channel)
+{
+	pthread_mutex_lock(&_hostMutex);
+	bool retVal = _hostDmaChannels[channel].busy;
+	pthread_mutex_unlock(&_hostMutex);
+
+	if(retVal) hostPoll();
+
+	return retVal;
+}
+
+void dma_channel_set_irq0_enabled(uint channel, bool enabled)
+{
+	_hostDmaChannels[channel].irq0Enabled = enabled;
+}
+
+bool dma_channel_get_irq0_status(uint channel)
+{
+	pthread_mutex_lock(&_hostMutex);
+	bool retVal = _hostDmaChannels[channel].irq0Status;
+	pthread_mutex_unlock(&_hostMutex);
+
+	return retVal;
+}
+
+void dma_channel_acknowledge_irq0(uint channel)
+{
+	pthread_mutex_lock(&_hostMutex);
+	_hostDmaChannels[channel].irq0Status = false;
+	pthread_mutex_unlock(&_hostMutex);
+}
+
+void dma_channel_set_irq1_enabled(uint channel, bool enabled)
+{
+	_hostDmaChannels[channel].irq1Enabled = enabled;
+}
+
+bool dma_channel_get_irq1_status(uint channel)
+{
+	pthread_mutex_lock(&_hostMutex);
+	bool retVal = _hostDmaChannels[channel].irq1Status;
+	pthread_mutex_unlock(&_hostMutex);
+
+	return retVal;
+}
+
+void dma_channel_acknowledge_irq1(uint channel)
+{
+	pthread_mutex_lock(&_hostMutex);
+	_hostDmaChannels[channel].irq1Status = false;
+	pthread_mutex_unlock(&_hostMutex);
+}
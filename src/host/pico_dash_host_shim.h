@@ -0,0 +1,141 @@
+#ifndef PICO_DASH_HOST_SHIM_H
+#define PICO_DASH_HOST_SHIM_H
+
+#include "pico.h"
+#include "pico/time.h"
+
+// Host (Linux) hardware shim control.
+// This is the "outside world" side of the shim: the virtual clock, the SPI master and the GPIO pins it drives.
+// Firmware code must never call any of this directly except through pico_dash_spi_hw.h.
+
+/**
+ * Advance the virtual clock.
+ * @param us Number of microseconds to advance by.
+ */
+void hostClockAdvance(uint64_t us);
+
+/**
+ * Wait (in real time) until core 1 has sampled the virtual clock since it was last advanced.
+ * This keeps the strobe loop in step with the simulation without forcing it into lock step.
+ * Returns immediately if core 1 isn't running. Gives up after a short real time timeout.
+ */
+void hostClockSync();
+
+/**
+ * Wait for core 1 to return from its entry function.
+ */
+void hostJoinCore1();
+
+/**
+ * Drive an input pin from outside the Pico. Delivers any enabled edge interrupt and signals an event to both cores.
+ */
+void hostGpioDrive(uint gpio, bool value);
+
+/**
+ * Shift bytes through spi0 as the master would. Each byte written lands in the slave rx FIFO (dropped on overrun) and
+ * each byte read comes from the slave tx FIFO (0 on underrun).
+ * @param tx Bytes to send. May be null to send zeros.
+ * @param rx Buffer to receive into. May be null to discard.
+ * @param len Number of bytes to shift.
+ */
+void hostSpiMasterTransfer(const uint8_t* tx, uint8_t* rx, int len);
+
+/**
+ * Run one full latch command cycle as the SPI master would: raise command active, wait for ready for command, write the
+ * command, wait for ready for command to drop, read the response and then drop command active.
+ * Core 0 must be servicing spiLatchProcess for this to complete.
+ * The response is read a byte at a time, each byte waiting for the firmware to have queued it, and a command longer
+ * than a frame is written a byte at a time, each waiting for room in the rx FIFO. ie The firmware is assumed to keep up
+ * with the master, which the shim can't otherwise model.
+ * @param command Command to send.
+ * @param commandSize Number of command bytes.
+ * @param response Buffer to read the response into.
+ * @param responseSize Number of response bytes to read.
+ * @returns True if the cycle completed, false if the Pico never responded.
+ */
+bool hostSpiMasterCommand(const uint8_t* command, int commandSize, uint8_t* response, int responseSize);
+
+/**
+ * Run a pipelined command cycle (SPI_PROTOCOL_PIPELINED) as the SPI master would. Each command is shifted in while the
+ * response to the one before it is shifted out, and a final NO_COMMAND shifts out the last response.
+ * The protocol version must already have been set with SET_PROTOCOL_VERSION.
+ * @param commands Command frames, back to back.
+ * @param commandCount Number of commands.
+ * @param responses Buffer to read the responses into, back to back.
+ * @param responseSizes Size of the response to each command. The master must know these up front.
+ * @returns True if the cycle completed, false if the Pico never responded.
+ */
+bool hostSpiMasterPipelinedCommands(const uint8_t* commands, int commandCount, uint8_t* responses,
+	const int* responseSizes);
+
+/**
+ * Run one length-prefixed command cycle (SPI_PROTOCOL_FRAMED) as the SPI master would. The command is sent with its
+ * length prefix, then the response's length prefix is read to know how much more to read.
+ * The protocol version must already have been set with SET_PROTOCOL_VERSION.
+ * @param command Command payload, without a length prefix.
+ * @param commandSize Number of command payload bytes.
+ * @param response Buffer to read the response payload into.
+ * @param maxResponseSize Size of the response buffer.
+ * @returns Size of the response payload, or -1 if the cycle didn't complete or the response was too big.
+ */
+int hostSpiMasterFramedCommand(const uint8_t* command, int commandSize, uint8_t* response, int maxResponseSize);
+
+/**
+ * Number of command active/ready for command handshakes performed by hostSpiMasterCommand,
+ * hostSpiMasterPipelinedCommands and hostSpiMasterFramedCommand since start.
+ */
+uint64_t hostSpiHandshakeCount();
+
+/**
+ * Number of bytes shifted by the master since start.
+ */
+uint64_t hostSpiByteCount();
+
+/**
+ * Set the level on an ADC input.
+ * @param input ADC input, 0 to 4.
+ * @param level Level in ADC counts, 0 to 4095.
+ * @param noise Peak uniform noise, in ADC counts, added to each conversion.
+ */
+void hostAdcSetInput(uint input, int level, int noise);
+
+/**
+ * Stamp a rising edge on a pulse capture input, as the capture state machine and DMA would.
+ * @param gpio Pin the edge arrived on.
+ * @param edgeTime Time of the edge.
+ * @returns True if the edge was captured, false if no capture is running on the pin.
+ */
+bool hostPulseCaptureEdge(uint gpio, absolute_time_t edgeTime);
+
+/**
+ * Erase the whole of the config flash, as a new chip, and forget the erase counts and any power loss.
+ */
+void hostConfigFlashWipe();
+
+/**
+ * Get the number of times a config flash sector has been erased since the config flash was last wiped.
+ */
+uint32_t hostConfigFlashErases(int sector);
+
+/**
+ * Lose power part way through writing the config flash. Every erase and program after the given number more bytes does
+ * nothing, until the config flash is wiped or this is called again.
+ * @param bytes Bytes left to erase or program. -1 to never lose power.
+ */
+void hostConfigFlashPowerLoss(int bytes);
+
+/**
+ * Flip bits of a config flash byte, as a flash cell going bad would.
+ * @param offset Offset of the byte from the start of the config sectors.
+ * @param bits Bits to flip.
+ */
+void hostConfigFlashCorrupt(uint32_t offset, uint8_t bits);
+
+/** Firmware side of the spi0 FIFO model. @see pico_dash_spi_hw.h */
+bool hostSpiRxReadable();
+bool hostSpiTxWritable();
+bool hostSpiTxEmpty();
+uint8_t hostSpiRead();
+void hostSpiWrite(uint8_t value);
+
+#endif
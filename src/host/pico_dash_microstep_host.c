@@ -0,0 +1,27 @@
+#include <stdio.h>
+
+#include "pico_dash_microstep.h"
+
+// Host stand in for the PIO/PWM microstepping. There is no PIO or PWM to drive, so no microstepper can be started and
+// gauges step their coils directly through the GPIO shim instead. The generated tables are still built into the host
+// so they can be checked.
+
+extern bool debugMsgActive;
+
+int startMicrostepper(uint coilGpio, uint enableGpio, int microsteps)
+{
+	if(debugMsgActive)
+	{
+		printf("No microstepper for GPIOs %u and %u at %i microsteps.\n", coilGpio, enableGpio, microsteps);
+	}
+
+	return -1;
+}
+
+void microstepperStep(int microstepper, int coilState, int direction, uint32_t intervalUs)
+{
+	(void)microstepper;
+	(void)coilState;
+	(void)direction;
+	(void)intervalUs;
+}
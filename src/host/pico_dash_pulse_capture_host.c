@@ -0,0 +1,73 @@
+#include "pico_dash_host_shim.h"
+#include "pico_dash_pulse_capture.h"
+#include "pico_dash_trace.h"
+
+// Host stand in for the PIO/DMA pulse capture. Edges are injected by the host with hostPulseCaptureEdge instead of being
+// timestamped by a state machine, but land in the same ring layout for the firmware to consume.
+
+struct HostPulseCapture
+{
+	bool claimed;
+	uint gpio;
+	uint32_t count;
+	uint32_t ring[PULSE_CAPTURE_RING_SIZE];
+};
+
+static struct HostPulseCapture _hostPulseCaptures[MAX_PULSE_CAPTURES];
+
+int startPulseCapture(uint gpio)
+{
+	for(int captureIndex = 0; captureIndex < MAX_PULSE_CAPTURES; captureIndex++)
+	{
+		struct HostPulseCapture* capture = _hostPulseCaptures + captureIndex;
+
+		if(!capture -> claimed)
+		{
+			capture -> gpio = gpio;
+			__atomic_store_n(&capture -> count, 0, __ATOMIC_RELAXED);
+			__atomic_store_n(&capture -> claimed, true, __ATOMIC_RELEASE);
+
+			return captureIndex;
+		}
+	}
+
+	TRACE(TRACE_PULSE_CAPTURE_NOT_STARTED, gpio, 0);
+
+	return -1;
+}
+
+void stopPulseCapture(int captureIndex)
+{
+	__atomic_store_n(&_hostPulseCaptures[captureIndex].claimed, false, __ATOMIC_RELEASE);
+}
+
+uint32_t getPulseCaptureCount(int captureIndex)
+{
+	return __atomic_load_n(&_hostPulseCaptures[captureIndex].count, __ATOMIC_ACQUIRE);
+}
+
+const volatile uint32_t* getPulseCaptureRing(int captureIndex)
+{
+	return _hostPulseCaptures[captureIndex].ring;
+}
+
+bool hostPulseCaptureEdge(uint gpio, absolute_time_t edgeTime)
+{
+	for(int captureIndex = 0; captureIndex < MAX_PULSE_CAPTURES; captureIndex++)
+	{
+		struct HostPulseCapture* capture = _hostPulseCaptures + captureIndex;
+
+		if(__atomic_load_n(&capture -> claimed, __ATOMIC_ACQUIRE) && capture -> gpio == gpio)
+		{
+			// Same as the state machine: the stamp is an inverted down count of microseconds.
+			capture -> ring[capture -> count % PULSE_CAPTURE_RING_SIZE] = ~(uint32_t)edgeTime;
+
+			// The stamp must be in the ring before the count says it's there, as with the DMA.
+			__atomic_store_n(&capture -> count, capture -> count + 1, __ATOMIC_RELEASE);
+
+			return true;
+		}
+	}
+
+	return false;
+}
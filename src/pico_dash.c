@@ -5,12 +5,52 @@
 #include "pico/time.h"
 #include "hardware/regs/intctrl.h"
 
+#include "pico_dash_gauge.h"
 #include "pico_dash_gpio.h"
 #include "pico_dash_latch.h"
 #include "pico_dash_spi_latch.h"
+#include "pico_dash_trace.h"
 
 bool debugMsgActive = true;
 
+/**
+ * Set to 1 to drive a tachometer gauge from ENGINE_RPM. Off unless asked for, as it claims GPIO 6 to 11, which pulse
+ * sensor inputs (PULSE_GPIO) must then keep clear of.
+ */
+#ifndef PICO_DASH_TACHO_GAUGE
+#define PICO_DASH_TACHO_GAUGE 0
+#endif
+
+#if PICO_DASH_TACHO_GAUGE
+
+/** First of 4 consecutive GPIO pins driving the tachometer's L293D 1A, 2A, 3A and 4A inputs, ie GPIO 6 to 9. */
+#define TACHO_GAUGE_COIL_FIRST_GPIO_PIN 6
+/**
+ * GPIO pin driving the tachometer's L293D 1,2EN input. Microstepping, the next pin (GPIO 11) drives 3,4EN, so both
+ * are claimed.
+ */
+#define TACHO_GAUGE_ENABLE_GPIO_PIN 10
+
+/** Tachometer. An X27.168 sweeps 315 degrees in 945 steps. */
+static const struct GaugeConfig tachoGauge =
+{
+	.coilGpios =
+	{
+		TACHO_GAUGE_COIL_FIRST_GPIO_PIN, TACHO_GAUGE_COIL_FIRST_GPIO_PIN + 1,
+		TACHO_GAUGE_COIL_FIRST_GPIO_PIN + 2, TACHO_GAUGE_COIL_FIRST_GPIO_PIN + 3
+	},
+	.enableGpio = TACHO_GAUGE_ENABLE_GPIO_PIN,
+	.microsteps = 16,
+	.index = ENGINE_RPM,
+	.minValue = 0,
+	.maxValue = 8000,
+	.sweepSteps = 945,
+	.maxStepRate = 1600,
+	.acceleration = 5000
+};
+
+#endif
+
 /**
  * Program for Pi Pico that interfaces to cars electrical signals and can either provide data to another display system
  * or drive physical gauges directly.
@@ -38,6 +78,12 @@ int main()
 	// Run the SPI comms on core 0.
 	spiLatchStartSubsystem();
 
+#if PICO_DASH_TACHO_GAUGE
+	// Drive the physical gauges from core 0. Their step interrupts are short enough not to hold up SPI comms.
+	addGauge(&tachoGauge);
+	startGauges();
+#endif
+
 	printf("Pico has initialised.\n");
 
 	// Main processing loop.
@@ -45,6 +91,9 @@ int main()
 	{
 		spiLatchProcess();
 
+		// Trace records are only printed while the SPI master has nothing for this core, a few at a time.
+		bool traceRecordsPending = !spiLatchProcReq() && traceDrain();
+
 		// Disable GPIO interrupts so that SPI master inactive can't be flipped to active before it can trigger WFE
 		// to be exited.
 
@@ -54,7 +103,7 @@ int main()
 		// IO_IRQ_BANK0 (GPIO)
 		irq_set_enabled(IO_IRQ_BANK0, false);
 
-		if(!spiLatchProcReq())
+		if(!spiLatchProcReq() && !traceRecordsPending)
 		{
 			// Wait for SEV event from GPIO interrupt pending.
 			// It doesn't matter if this returns immediately.
@@ -0,0 +1,210 @@
+#include "hardware/adc.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+
+#include "pico_dash_adc.h"
+
+/** ADC clock. Fixed at 48MHz by the SDK's clock setup. */
+#define ADC_CLOCK_HZ 48000000
+
+/** First GPIO with an ADC input. */
+#define ADC_FIRST_GPIO 26
+
+/** Input connected to the on chip temperature sensor. */
+#define ADC_TEMP_SENSOR_INPUT 4
+
+/** Number of samples each buffer can hold, enough for every input. */
+#define ADC_MAX_BUFFER_SAMPLES (MAX_ADC_INPUTS << ADC_DECIMATION_LOG2)
+
+/** Ping-pong sample buffers. Each is filled by its own DMA channel, which then chains to the other. */
+uint16_t _adcBuffers[2][ADC_MAX_BUFFER_SAMPLES];
+
+/** DMA channel for each buffer. -1 until capture is first started. */
+int _adcDmaChannels[2] = {-1, -1};
+
+/** Number of buffers completed since capture started. Buffer n is _adcBuffers[n & 1]. Written by the DMA IRQ. */
+volatile uint32_t _adcBuffersCompleted = 0;
+
+/** Number of completed buffers decimated, or skipped, since capture started. */
+uint32_t _adcBuffersProcessed = 0;
+
+/** Number of buffers skipped. */
+uint32_t _adcOverruns = 0;
+
+/** Inputs being captured. */
+uint32_t _adcInputMask = 0;
+
+/** Inputs being captured, in round robin order. */
+int _adcInputs[MAX_ADC_INPUTS];
+int _adcInputCount = 0;
+
+/** Latest decimated value of each input. */
+int _adcValues[MAX_ADC_INPUTS];
+
+/** DMA IRQ 1 handler, taken by core 1. Counts each completed buffer and readies its channel to be chained to again. */
+void __not_in_flash_func(_adcDmaIrqHandler)()
+{
+	for(int buffer = 0; buffer < 2; buffer++)
+	{
+		int channel = _adcDmaChannels[buffer];
+
+		if(dma_channel_get_irq1_status(channel))
+		{
+			dma_channel_acknowledge_irq1(channel);
+
+			// The transfer count reloads when the channel is chained to but the write address carries on from the end.
+			dma_channel_set_write_addr(channel, _adcBuffers[buffer], false);
+
+			_adcBuffersCompleted++;
+		}
+	}
+}
+
+/** Stop the ADC and both DMA channels, leaving nothing pending. */
+void _stopAdcCapture()
+{
+	adc_run(false);
+
+	// Abort both. Whichever one isn't running might otherwise be chained to by the one that is.
+	dma_channel_abort(_adcDmaChannels[0]);
+	dma_channel_abort(_adcDmaChannels[1]);
+
+	dma_channel_acknowledge_irq1(_adcDmaChannels[0]);
+	dma_channel_acknowledge_irq1(_adcDmaChannels[1]);
+
+	adc_fifo_drain();
+}
+
+/** Start capturing _adcInputs. */
+void _startAdcCapture()
+{
+	for(int index = 0; index < _adcInputCount; index++)
+	{
+		if(_adcInputs[index] == ADC_TEMP_SENSOR_INPUT)
+		{
+			adc_set_temp_sensor_enabled(true);
+		}
+		else
+		{
+			adc_gpio_init(ADC_FIRST_GPIO + _adcInputs[index]);
+		}
+	}
+
+	// Round robin carries on from the selected input to the next higher one in the mask, so sample n of each buffer is
+	// from _adcInputs[n % _adcInputCount].
+	adc_select_input(_adcInputs[0]);
+	adc_set_round_robin(_adcInputMask);
+
+	// DREQ on every sample, no error flag, full 12 bits.
+	adc_fifo_setup(true, true, 1, false, false);
+	adc_set_clkdiv((float)ADC_CLOCK_HZ / ADC_SAMPLE_RATE - 1);
+
+	uint bufferSamples = _adcInputCount << ADC_DECIMATION_LOG2;
+
+	for(int buffer = 0; buffer < 2; buffer++)
+	{
+		dma_channel_config dmaConfig = dma_channel_get_default_config(_adcDmaChannels[buffer]);
+		channel_config_set_transfer_data_size(&dmaConfig, DMA_SIZE_16);
+		channel_config_set_read_increment(&dmaConfig, false);
+		channel_config_set_write_increment(&dmaConfig, true);
+		channel_config_set_dreq(&dmaConfig, DREQ_ADC);
+		channel_config_set_chain_to(&dmaConfig, _adcDmaChannels[buffer ^ 1]);
+
+		dma_channel_configure(_adcDmaChannels[buffer], &dmaConfig, _adcBuffers[buffer], &adc_hw -> fifo, bufferSamples,
+			false);
+	}
+
+	_adcBuffersCompleted = 0;
+	_adcBuffersProcessed = 0;
+
+	dma_channel_start(_adcDmaChannels[0]);
+	adc_run(true);
+}
+
+void setAdcCaptureInputs(uint32_t inputMask)
+{
+	inputMask &= (1 << MAX_ADC_INPUTS) - 1;
+
+	if(inputMask != _adcInputMask)
+	{
+		if(_adcDmaChannels[0] < 0)
+		{
+			adc_init();
+
+			_adcDmaChannels[0] = dma_claim_unused_channel(true);
+			_adcDmaChannels[1] = dma_claim_unused_channel(true);
+
+			dma_channel_set_irq1_enabled(_adcDmaChannels[0], true);
+			dma_channel_set_irq1_enabled(_adcDmaChannels[1], true);
+
+			// Must be done on core 1 so the interrupt is taken by core 1.
+			irq_set_exclusive_handler(DMA_IRQ_1, _adcDmaIrqHandler);
+			irq_set_enabled(DMA_IRQ_1, true);
+		}
+		else if(_adcInputMask)
+		{
+			_stopAdcCapture();
+		}
+
+		_adcInputMask = inputMask;
+		_adcInputCount = 0;
+
+		for(int input = 0; input < MAX_ADC_INPUTS; input++)
+		{
+			if(inputMask & (1 << input))
+			{
+				_adcInputs[_adcInputCount++] = input;
+			}
+			else
+			{
+				_adcValues[input] = 0;
+			}
+		}
+
+		if(_adcInputCount > 0)
+		{
+			_startAdcCapture();
+		}
+	}
+}
+
+bool __not_in_flash_func(processAdcCapture)()
+{
+	bool retVal = false;
+
+	uint32_t completed = _adcBuffersCompleted;
+
+	if(completed - _adcBuffersProcessed > 1)
+	{
+		// Only the latest completed buffer is still intact. The one before it is being refilled.
+		_adcOverruns += completed - _adcBuffersProcessed - 1;
+		_adcBuffersProcessed = completed - 1;
+	}
+
+	if(completed != _adcBuffersProcessed)
+	{
+		uint32_t sums[MAX_ADC_INPUTS];
+
+		decimateInterleaved(_adcBuffers[_adcBuffersProcessed & 1], _adcInputCount, 1 << ADC_DECIMATION_LOG2, sums);
+
+		for(int index = 0; index < _adcInputCount; index++)
+		{
+			_adcValues[_adcInputs[index]] = decimatedValue(sums[index], ADC_DECIMATION_LOG2);
+		}
+
+		_adcBuffersProcessed++;
+		retVal = true;
+	}
+
+	return retVal;
+}
+
+int __not_in_flash_func(getAdcCaptureValue)(int input)
+{
+	return input >= 0 && input < MAX_ADC_INPUTS ? _adcValues[input] : 0;
+}
+
+uint32_t getAdcCaptureOverruns()
+{
+	return _adcOverruns;
+}
@@ -0,0 +1,46 @@
+#ifndef PICO_DASH_ADC_H
+#define PICO_DASH_ADC_H
+
+#include "pico.h"
+
+#include "pico_dash_decimate.h"
+
+// Free running ADC capture.
+// The ADC converts each captured input in turn (round robin) and DMA moves the samples into a pair of buffers, filling
+// one while core 1 decimates the other. The CPU does nothing per sample.
+// All functions must be called from core 1, which takes the DMA interrupt.
+
+/** Number of RP2040 ADC inputs. 0 to 3 are GPIO 26 to 29, 4 is the temperature sensor. */
+#define MAX_ADC_INPUTS 5
+
+/** Total ADC sample rate in samples per second, shared between the captured inputs. */
+#define ADC_SAMPLE_RATE 20000
+
+/** log2 of the number of samples of each input per buffer. Each decimated value is the average of this many samples. */
+#define ADC_DECIMATION_LOG2 6
+
+/**
+ * Start capturing the given inputs, or change which inputs are captured.
+ * @param inputMask Bit n set to capture input n. 0 to stop capturing.
+ */
+void setAdcCaptureInputs(uint32_t inputMask);
+
+/**
+ * Decimate any buffers completed since the last call.
+ * If core 1 has fallen a whole buffer behind the older buffer has been overwritten and is skipped.
+ * @returns True if there are new decimated values.
+ */
+bool processAdcCapture();
+
+/**
+ * Get the latest decimated value of an input.
+ * @returns Value of ADC_DECIMATED_BITS, or 0 if the input isn't being captured or nothing has been decimated yet.
+ */
+int getAdcCaptureValue(int input);
+
+/**
+ * Number of buffers skipped because core 1 didn't decimate them in time.
+ */
+uint32_t getAdcCaptureOverruns();
+
+#endif
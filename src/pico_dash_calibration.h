@@ -0,0 +1,92 @@
+#ifndef PICO_DASH_CALIBRATION_H
+#define PICO_DASH_CALIBRATION_H
+
+#include "pico.h"
+
+#include "pico_dash_decimate.h"
+
+// Piecewise linear calibration of decimated ADC values into latched data units.
+// Tables are generated at build time from the sensor curves in calibration/ (see tools/gen_calibration_tables.py) into
+// const arrays. Each pair of adjacent curve points is a segment with a precomputed fixed point slope. A uniform index
+// over the ADC input range points each lookup at, or a step or two before, its segment, so there is no search and no
+// division.
+
+/** Number of fraction bits in table outputs. */
+#define CALIBRATION_FRACTION_BITS 8
+
+/** A calibration table. */
+struct CalibrationTable
+{
+	/** Input is shifted down by this to get its index bucket. */
+	uint indexShift;
+
+	/** Number of fraction bits in slopes. */
+	uint slopeShift;
+
+	/** Number of segments. There is one more point than segments. */
+	int segmentCount;
+
+	/** First segment each index bucket's inputs can fall in. */
+	const uint8_t* index;
+
+	/** Decimated ADC value at each point, ascending. */
+	const int32_t* inputs;
+
+	/** Output at each point, in latched data units with CALIBRATION_FRACTION_BITS fraction bits. */
+	const int32_t* outputs;
+
+	/**
+	 * Change in output per ADC count across each segment, with slopeShift fraction bits. The generator guarantees that a
+	 * slope times any offset into its segment fits in 32 bits.
+	 */
+	const int32_t* slopes;
+};
+
+/** A sensor curve, as points. Only kept to check tables against. */
+struct CalibrationCurve
+{
+	/** Name of the curve. */
+	const char* name;
+
+	/** Number of points. */
+	int pointCount;
+
+	/** Decimated ADC value at each point, ascending. */
+	const int32_t* inputs;
+
+	/** Output at each point, in latched data units with CALIBRATION_FRACTION_BITS fraction bits. */
+	const int32_t* outputs;
+};
+
+/**
+ * Convert a decimated ADC value into latched data units. Inputs beyond the ends of the curve get the end values.
+ * @param table Table to use.
+ * @param input Decimated ADC value.
+ * @returns Output rounded to the nearest latched data unit.
+ */
+static inline int calibrate(const struct CalibrationTable* table, uint32_t input)
+{
+	int32_t output;
+
+	if((int32_t)input <= table -> inputs[0])
+	{
+		output = table -> outputs[0];
+	}
+	else if((int32_t)input >= table -> inputs[table -> segmentCount])
+	{
+		output = table -> outputs[table -> segmentCount];
+	}
+	else
+	{
+		int segment = table -> index[input >> table -> indexShift];
+
+		while((int32_t)input >= table -> inputs[segment + 1]) segment++;
+
+		output = table -> outputs[segment]
+			+ ((table -> slopes[segment] * ((int32_t)input - table -> inputs[segment])) >> table -> slopeShift);
+	}
+
+	return (output + (1 << (CALIBRATION_FRACTION_BITS - 1))) >> CALIBRATION_FRACTION_BITS;
+}
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef PICO_DASH_CHANNELS_H
+#define PICO_DASH_CHANNELS_H
+
+// Latched data channel registry.
+// Every latched data channel is declared once, here. The list is expanded wherever something is needed per channel: the
+// LatchedDataIndex enum, the name lookup, the dense metadata arrays indexed by latched data index and the default sensor
+// config. Adding a channel is a single line.
+
+/**
+ * The channels, in latched data index order.
+ * Each entry is CHANNEL(index, name, resolution, sensor type, strobe interval, pre-scale, post-scale):
+ *   index           LatchedDataIndex enum value.
+ *   name            MAX_LATCH_DATA_INDEX_NAME_SIZE character name the SPI master looks the channel up by. Must be
+ *                   unique.
+ *   resolution      Number of integer steps per graduation. @see getLatchedDataResolution
+ *   sensor type     Type (enum SensorType) the channel's sensor starts as.
+ *   strobe interval STROBE_INTERVAL the sensor starts with, in microseconds.
+ *   pre-scale       PULSE_PRE_SCALE or VOLTAGE_PRE_SCALE, by sensor type, the sensor starts with.
+ *   post-scale      PULSE_POST_SCALE or VOLTAGE_POST_SCALE, by sensor type, the sensor starts with. Not 0.
+ * The defaults are applied before the saved config is loaded, so a channel only needs to be made ACTIVE, and given its
+ * input, to start latching. Setting SENSOR_TYPE resets the scales to 1 as usual.
+ * @note New channels must go on the end so that existing indexes don't change.
+ */
+#define LATCHED_DATA_CHANNELS(CHANNEL) \
+	/** Engine RPM. Pulses a minute from the mean pulse period in microseconds. */ \
+	CHANNEL(ENGINE_RPM, "ERM", 1, PULSE_SENSOR, 1000, 60000000, 1) \
+	/** Speed km/h. */ \
+	CHANNEL(SPEED_KMH, "SKH", 1, PULSE_SENSOR, 1000, 3600000, 1) \
+	/** Engine temperature degrees celsius. In calibrated units, so unscaled. */ \
+	CHANNEL(ENGINE_TEMP_C, "ETC", 10, SCALED_VOLTAGE_SENSOR, 100000, 1, 1)
+
+#endif
@@ -0,0 +1,248 @@
+#include <string.h>
+
+#include "pico_dash_config.h"
+
+/** Zig-zag encoding maps small negative values, such as -1 for none, to small unsigned ones. */
+static inline uint32_t _zigZag(int32_t value)
+{
+	return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static inline int32_t _unZigZag(uint32_t value)
+{
+	return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+static inline void _putUint16(uint8_t* bytes, uint16_t value)
+{
+	bytes[0] = value & 0xFF;
+	bytes[1] = value >> 8;
+}
+
+static inline void _putUint32(uint8_t* bytes, uint32_t value)
+{
+	_putUint16(bytes, value & 0xFFFF);
+	_putUint16(bytes + 2, value >> 16);
+}
+
+static inline uint16_t _getUint16(const uint8_t* bytes)
+{
+	return bytes[0] | bytes[1] << 8;
+}
+
+static inline uint32_t _getUint32(const uint8_t* bytes)
+{
+	return _getUint16(bytes) | (uint32_t)_getUint16(bytes + 2) << 16;
+}
+
+uint32_t configCrc32(const uint8_t* data, int size)
+{
+	uint32_t crc = 0xFFFFFFFF;
+
+	// Only run on a save or a load, so a bit at a time is quick enough and saves a table.
+	for(int posn = 0; posn < size; posn++)
+	{
+		crc ^= data[posn];
+
+		for(int bit = 0; bit < 8; bit++)
+		{
+			crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+		}
+	}
+
+	return ~crc;
+}
+
+int sensorConfigSerialise(const struct SensorConfig* config, uint32_t sequence, uint8_t* slot)
+{
+	memset(slot, 0xFF, CONFIG_SLOT_SIZE);
+
+	int posn = CONFIG_HEADER_SIZE;
+
+	for(int index = 1; index < MAX_LATCHED_INDEXES; index++)
+	{
+		for(SensorData sensorVar = sensorConfigNextVar(0); sensorVar < MAX_SENSOR_DATA;
+			sensorVar = sensorConfigNextVar(sensorVar))
+		{
+			if(config -> setMask[index] & (1u << sensorVar))
+			{
+				slot[posn++] = index;
+				slot[posn++] = sensorVar;
+
+				uint32_t value = _zigZag(config -> values[index][sensorVar]);
+
+				while(value >= 0x80)
+				{
+					slot[posn++] = value | 0x80;
+					value >>= 7;
+				}
+
+				slot[posn++] = value;
+			}
+		}
+	}
+
+	_putUint32(slot, CONFIG_MAGIC);
+	_putUint16(slot + 4, CONFIG_VERSION);
+	_putUint16(slot + 6, posn - CONFIG_HEADER_SIZE);
+	_putUint32(slot + 8, sequence);
+
+	_putUint32(slot + posn, configCrc32(slot, posn));
+
+	return posn + CONFIG_CRC_SIZE;
+}
+
+/**
+ * Whether a slot holds a config of this version that is all there, ie its CRC is right.
+ * @param sequence Returns the sequence number of the slot. May be null.
+ */
+static bool _configSlotGood(const uint8_t* slot, uint32_t* sequence)
+{
+	int payloadSize = _getUint16(slot + 6);
+
+	bool retVal = _getUint32(slot) == CONFIG_MAGIC && _getUint16(slot + 4) == CONFIG_VERSION &&
+		payloadSize <= CONFIG_MAX_PAYLOAD_SIZE &&
+		_getUint32(slot + CONFIG_HEADER_SIZE + payloadSize) == configCrc32(slot, CONFIG_HEADER_SIZE + payloadSize);
+
+	if(retVal && sequence) *sequence = _getUint32(slot + 8);
+
+	return retVal;
+}
+
+bool sensorConfigDeserialise(const uint8_t* slot, struct SensorConfig* config, uint32_t* sequence)
+{
+	bool retVal = _configSlotGood(slot, sequence);
+
+	if(retVal)
+	{
+		memset(config, 0, sizeof(*config));
+
+		int posn = CONFIG_HEADER_SIZE;
+		int end = CONFIG_HEADER_SIZE + _getUint16(slot + 6);
+
+		while(retVal && posn < end)
+		{
+			uint32_t value = 0;
+			int shift = 0;
+
+			int index = slot[posn++];
+			int sensorVar = posn < end ? slot[posn++] : -1;
+
+			// The top bit of the last byte is clear. No more than 5 bytes for 32 bits.
+			do
+			{
+				retVal = posn < end && shift < 35;
+
+				if(retVal) value |= (uint32_t)(slot[posn] & 0x7F) << shift;
+
+				shift += 7;
+			}
+			while(retVal && slot[posn++] & 0x80);
+
+			if(retVal && index < MAX_LATCHED_INDEXES && sensorVar > 0 && sensorVar < MAX_SENSOR_DATA)
+			{
+				config -> setMask[index] |= 1u << sensorVar;
+				config -> values[index][sensorVar] = _unZigZag(value);
+			}
+		}
+	}
+
+	return retVal;
+}
+
+/** Whether a slot has been erased and not written since. */
+static bool _configSlotErased(int slotIndex)
+{
+	const uint8_t* slot = configFlashContents() + slotIndex * CONFIG_SLOT_SIZE;
+
+	bool retVal = true;
+
+	for(int posn = 0; retVal && posn < CONFIG_SLOT_SIZE; posn++)
+	{
+		retVal = slot[posn] == 0xFF;
+	}
+
+	return retVal;
+}
+
+/** Slot being saved. Only used by core 0. */
+static uint8_t _configSlot[CONFIG_SLOT_SIZE];
+
+/**
+ * Erase a block of slots, a sector at a time.
+ * @returns True if the whole block was erased.
+ */
+static bool _configEraseBlock(int block)
+{
+	bool retVal = true;
+
+	for(uint32_t offset = 0; retVal && offset < CONFIG_BLOCK_SIZE; offset += CONFIG_FLASH_SECTOR_SIZE)
+	{
+		retVal = configFlashErase(block * CONFIG_BLOCK_SIZE + offset);
+	}
+
+	return retVal;
+}
+
+/**
+ * Find the slot holding the newest good config.
+ * @param sequence Returns its sequence number. Untouched if there is none.
+ * @returns Slot index, or -1 if there is no good config.
+ */
+static int _configNewestSlot(uint32_t* sequence)
+{
+	int retVal = -1;
+
+	uint32_t slotSequence;
+
+	for(int slotIndex = 0; slotIndex < CONFIG_SLOTS; slotIndex++)
+	{
+		if(_configSlotGood(configFlashContents() + slotIndex * CONFIG_SLOT_SIZE, &slotSequence) &&
+			(retVal < 0 || slotSequence > *sequence))
+		{
+			retVal = slotIndex;
+			*sequence = slotSequence;
+		}
+	}
+
+	return retVal;
+}
+
+bool sensorConfigSave(const struct SensorConfig* config)
+{
+	uint32_t sequence = 0;
+
+	int newest = _configNewestSlot(&sequence);
+	int newestBlock = newest < 0 ? -1 : newest / CONFIG_SLOTS_PER_BLOCK;
+
+	// The slot after the newest, unless a save was lost part way through it. Moving on to a block means erasing it,
+	// which is never the newest's block because that is always at least a slot away.
+	int slotIndex = newest;
+	bool erase = false;
+
+	do
+	{
+		slotIndex = (slotIndex + 1) % CONFIG_SLOTS;
+		erase = slotIndex % CONFIG_SLOTS_PER_BLOCK == 0 && slotIndex / CONFIG_SLOTS_PER_BLOCK != newestBlock;
+	}
+	while(!erase && !_configSlotErased(slotIndex));
+
+	sensorConfigSerialise(config, sequence + 1, _configSlot);
+
+	bool retVal = (!erase || _configEraseBlock(slotIndex / CONFIG_SLOTS_PER_BLOCK)) &&
+		configFlashProgram(slotIndex * CONFIG_SLOT_SIZE, _configSlot, CONFIG_SLOT_SIZE);
+
+	// Read it back. A slot that didn't program properly is skipped by the next save.
+	retVal = retVal && memcmp(configFlashContents() + slotIndex * CONFIG_SLOT_SIZE, _configSlot, CONFIG_SLOT_SIZE) == 0;
+
+	return retVal;
+}
+
+bool sensorConfigLoad(struct SensorConfig* config)
+{
+	uint32_t sequence;
+
+	int slotIndex = _configNewestSlot(&sequence);
+
+	return slotIndex >= 0 && sensorConfigDeserialise(configFlashContents() + slotIndex * CONFIG_SLOT_SIZE, config, 0);
+}
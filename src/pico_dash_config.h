@@ -0,0 +1,216 @@
+#ifndef PICO_DASH_CONFIG_H
+#define PICO_DASH_CONFIG_H
+
+#include <assert.h>
+
+#include "pico.h"
+
+#include "pico_dash_latch.h"
+
+// Persistent sensor configuration.
+// The sensor config is kept in the last CONFIG_FLASH_SECTORS sectors of flash, which are split into CONFIG_FLASH_BLOCKS
+// blocks of slots. Each save goes in the next slot after the newest, so a block is only erased once every
+// CONFIG_SLOTS_PER_BLOCK saves, and a block is never erased while it holds the newest config. Losing power part way
+// through a save leaves the config from the save before.
+// Slots are sized from the channel registry to hold every variable of every sensor. A block is a sector, or a slot if
+// that is bigger. Adding channels can make the slots bigger, in which case a config saved by firmware with the old
+// slot size is not found.
+//
+// Slot layout. All integers are little endian.
+//
+//     4 bytes  CONFIG_MAGIC.
+//     2 bytes  Format version, CONFIG_VERSION.
+//     2 bytes  Payload length in bytes.
+//     4 bytes  Sequence number. One more than the save before.
+//     Payload  One entry for each sensor variable that has been set, in the order they are restored in:
+//                  1 byte   Latched data index.
+//                  1 byte   Sensor data id (enum SensorData).
+//                  1 to 5 bytes  Value, zig-zag encoded then 7 bits per byte, low bits first, top bit set on every
+//                           byte but the last.
+//     4 bytes  CRC-32 (as zlib's) of everything before it.
+//     The rest of the slot is left erased.
+//
+// Sensor data ids never change, so a config stays good across firmware versions. Entries for latched data indexes or
+// sensor data ids this firmware doesn't know are skipped.
+
+/** First word of every config slot. "PDCF" in flash. */
+#define CONFIG_MAGIC 0x46434450
+
+/** Version of the slot layout. Slots of any other version are ignored. */
+#define CONFIG_VERSION 1
+
+/** Size of a flash sector, the unit of erase, in bytes. */
+#define CONFIG_FLASH_SECTOR_SIZE 4096
+
+/** Size of the slot header and of the CRC after the payload, in bytes. */
+#define CONFIG_HEADER_SIZE 12
+#define CONFIG_CRC_SIZE 4
+
+/** Longest encoding of an entry, in bytes. */
+#define CONFIG_MAX_ENTRY_SIZE 7
+
+/** Longest serialised config, in bytes. Every variable of every sensor set, each at its longest. */
+#define CONFIG_MAX_SIZE (CONFIG_HEADER_SIZE + SENSOR_CONFIG_MAX_VARS * CONFIG_MAX_ENTRY_SIZE + CONFIG_CRC_SIZE)
+
+/**
+ * Size of a config slot in bytes. The smallest power of 2, of at least 512, that holds the longest config. So a whole
+ * number of flash pages, the unit of programming, and either a whole number of slots fit in a sector or the other way
+ * round.
+ */
+#define CONFIG_SLOT_SIZE (CONFIG_MAX_SIZE <= 512 ? 512 : LATCH_POW2_AT_LEAST(CONFIG_MAX_SIZE))
+
+/** Size of a block of slots, the unit the config is erased in, in bytes. */
+#define CONFIG_BLOCK_SIZE (CONFIG_SLOT_SIZE > CONFIG_FLASH_SECTOR_SIZE ? CONFIG_SLOT_SIZE : CONFIG_FLASH_SECTOR_SIZE)
+
+/** Number of blocks reserved for the config. At least 2, so that one can be erased. */
+#define CONFIG_FLASH_BLOCKS 2
+
+/** Number of flash sectors at the end of flash reserved for the config. */
+#define CONFIG_FLASH_SECTORS (CONFIG_FLASH_BLOCKS * CONFIG_BLOCK_SIZE / CONFIG_FLASH_SECTOR_SIZE)
+
+#define CONFIG_SLOTS_PER_BLOCK (CONFIG_BLOCK_SIZE / CONFIG_SLOT_SIZE)
+#define CONFIG_SLOTS (CONFIG_SLOTS_PER_BLOCK * CONFIG_FLASH_BLOCKS)
+
+/** Largest payload that fits in a slot, in bytes. */
+#define CONFIG_MAX_PAYLOAD_SIZE (CONFIG_SLOT_SIZE - CONFIG_HEADER_SIZE - CONFIG_CRC_SIZE)
+
+/** Every sensor variable. */
+#define SENSOR_CONFIG_ALL_MASK ((1u << MAX_SENSOR_DATA) - 2)
+
+/** Sensor variables that only pulse sensors have. */
+#define SENSOR_CONFIG_PULSE_MASK \
+	(1u << PULSE_ACCUMULATION_INTERVAL | 1u << PULSE_PRE_SCALE | 1u << PULSE_POST_SCALE | \
+	1u << PULSE_TEST_DURATION_START | 1u << PULSE_TEST_DURATION_END | 1u << PULSE_TEST_DURATION_STEP | \
+	1u << PULSE_TEST_STEP_TIME_INTERVAL | 1u << PULSE_GPIO | 1u << PULSE_PERIOD_THRESHOLD)
+
+/** Sensor variables that only scaled voltage sensors have. */
+#define SENSOR_CONFIG_VOLTAGE_MASK \
+	(1u << VOLTAGE_PRE_SCALE | 1u << VOLTAGE_POST_SCALE | 1u << VOLTAGE_CALIBRATION_TABLE)
+
+/**
+ * Sensor variables that SENSOR_TYPE resets. They are only restored after it, and setting it forgets them.
+ */
+#define SENSOR_CONFIG_TYPE_SPECIFIC_MASK (SENSOR_CONFIG_PULSE_MASK | SENSOR_CONFIG_VOLTAGE_MASK)
+
+/** The value of every sensor variable that has been set, as set with setSensorData. */
+struct SensorConfig
+{
+	/** Bit n set if sensor data id n has been set, by latched data index. */
+	uint32_t setMask[MAX_LATCHED_INDEXES];
+
+	/** Value of each sensor variable, by latched data index and sensor data id. Only those in setMask mean anything. */
+	int32_t values[MAX_LATCHED_INDEXES][MAX_SENSOR_DATA];
+};
+
+static_assert(MAX_SENSOR_DATA <= 32, "Sensor data ids must fit in a set mask");
+static_assert(CONFIG_MAX_SIZE <= CONFIG_SLOT_SIZE, "A full sensor config must fit in a config slot");
+
+/**
+ * Record a sensor variable being set. Setting SENSOR_TYPE forgets the type specific variables, as it resets them.
+ */
+static inline void sensorConfigSet(struct SensorConfig* config, LatchedDataIndex sensorIndex, SensorData sensorVar,
+	int varVal)
+{
+	if(sensorVar == SENSOR_TYPE) config -> setMask[sensorIndex] &= ~SENSOR_CONFIG_TYPE_SPECIFIC_MASK;
+
+	config -> setMask[sensorIndex] |= 1u << sensorVar;
+	config -> values[sensorIndex][sensorVar] = varVal;
+}
+
+/**
+ * Get the next sensor variable of a sensor to restore, in restore order: SENSOR_TYPE first, as it resets the type
+ * specific variables, then the rest by id and ACTIVE last, once the sensor is fully set up.
+ * @param sensorVar Variable restored last, or 0 to start.
+ * @returns Next variable in restore order, whether set or not. MAX_SENSOR_DATA after ACTIVE.
+ */
+static inline SensorData sensorConfigNextVar(SensorData sensorVar)
+{
+	SensorData retVal;
+
+	if(sensorVar == 0)
+	{
+		retVal = SENSOR_TYPE;
+	}
+	else if(sensorVar == ACTIVE)
+	{
+		retVal = MAX_SENSOR_DATA;
+	}
+	else
+	{
+		retVal = sensorVar == SENSOR_TYPE ? ACTIVE + 1 : sensorVar + 1;
+
+		if(retVal == SENSOR_TYPE) retVal++;
+		if(retVal == MAX_SENSOR_DATA) retVal = ACTIVE;
+	}
+
+	return retVal;
+}
+
+/**
+ * CRC-32, as zlib's crc32.
+ */
+uint32_t configCrc32(const uint8_t* data, int size);
+
+/**
+ * Serialise a sensor config into a slot.
+ * @param config Config to serialise.
+ * @param sequence Sequence number of the slot.
+ * @param slot Returns the slot, CONFIG_SLOT_SIZE bytes. Everything after the CRC is left erased.
+ * @returns Number of bytes used, up to and including the CRC.
+ */
+int sensorConfigSerialise(const struct SensorConfig* config, uint32_t sequence, uint8_t* slot);
+
+/**
+ * Deserialise a sensor config from a slot.
+ * @param slot Slot, CONFIG_SLOT_SIZE bytes.
+ * @param config Returns the config. Not to be used unless the slot is good.
+ * @param sequence Returns the sequence number of the slot. May be null.
+ * @returns True if the slot holds a good config of this version.
+ */
+bool sensorConfigDeserialise(const uint8_t* slot, struct SensorConfig* config, uint32_t* sequence);
+
+/**
+ * Save a sensor config to flash, in the slot after the newest.
+ * Core 0 only. Flash can't be read while it is being written, so core 1 is paused and interrupts on both cores are held
+ * off meanwhile: about 45 ms when a sector has to be erased, otherwise 2 ms or so.
+ * @returns True if the config was saved and reads back.
+ */
+bool sensorConfigSave(const struct SensorConfig* config);
+
+/**
+ * Load the newest good sensor config from flash.
+ * @param config Returns the config. Not to be used if there is none.
+ * @returns False if there is no good config in flash.
+ */
+bool sensorConfigLoad(struct SensorConfig* config);
+
+// Flash access. Implemented in pico_dash_config_flash.c, and by the host shim on the host. Offsets are from the start of
+// the config sectors.
+
+/**
+ * Get the contents of the config sectors, CONFIG_FLASH_SECTORS * CONFIG_FLASH_SECTOR_SIZE bytes.
+ */
+const uint8_t* configFlashContents();
+
+/**
+ * Erase a config sector, setting every byte to 0xFF.
+ * @param offset Offset of the sector.
+ * @returns True if the sector was erased.
+ */
+bool configFlashErase(uint32_t offset);
+
+/**
+ * Program erased config flash. Programming can only clear bits.
+ * @param offset Offset to program at. A whole number of flash pages.
+ * @param data Bytes to program.
+ * @param size Number of bytes. A whole number of flash pages.
+ * @returns True if the bytes were programmed.
+ */
+bool configFlashProgram(uint32_t offset, const uint8_t* data, uint32_t size);
+
+/**
+ * Let the calling core be paused while the other writes flash. Core 1 must call this before core 0 saves a config.
+ */
+void configFlashCoreInit();
+
+#endif
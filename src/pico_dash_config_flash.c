@@ -0,0 +1,70 @@
+#include <assert.h>
+
+#include "hardware/flash.h"
+#include "pico/flash.h"
+
+#include "pico_dash_config.h"
+
+// Config flash access through the SDK. Flash can't be read through XIP while it is being erased or programmed, so every
+// write runs through flash_safe_execute, which pauses core 1 in RAM and masks interrupts on both cores until it is done.
+
+static_assert(CONFIG_FLASH_SECTOR_SIZE == FLASH_SECTOR_SIZE, "Config sectors must be flash sectors");
+static_assert(CONFIG_SLOT_SIZE % FLASH_PAGE_SIZE == 0, "Config slots must be whole flash pages");
+
+/** Offset of the config sectors from the start of flash. The last sectors, well clear of the program. */
+#define CONFIG_FLASH_OFFSET (PICO_FLASH_SIZE_BYTES - CONFIG_FLASH_SECTORS * CONFIG_FLASH_SECTOR_SIZE)
+
+/** Longest to wait for core 1 to pause, in milliseconds. */
+#define CONFIG_FLASH_TIMEOUT_MS 100
+
+/** A flash write to run with core 1 paused. */
+struct ConfigFlashWrite
+{
+	/** Offset from the start of the config sectors. */
+	uint32_t offset;
+
+	/** Bytes to program. Null to erase a sector. */
+	const uint8_t* data;
+
+	/** Number of bytes to program. */
+	uint32_t size;
+};
+
+/** Carry out a flash write. Runs with core 1 paused and interrupts masked. */
+static void _configFlashWrite(void* param)
+{
+	const struct ConfigFlashWrite* write = param;
+
+	if(write -> data)
+	{
+		flash_range_program(CONFIG_FLASH_OFFSET + write -> offset, write -> data, write -> size);
+	}
+	else
+	{
+		flash_range_erase(CONFIG_FLASH_OFFSET + write -> offset, CONFIG_FLASH_SECTOR_SIZE);
+	}
+}
+
+const uint8_t* configFlashContents()
+{
+	return (const uint8_t*)(XIP_BASE + CONFIG_FLASH_OFFSET);
+}
+
+bool configFlashErase(uint32_t offset)
+{
+	struct ConfigFlashWrite write = {offset, 0, 0};
+
+	return flash_safe_execute(_configFlashWrite, &write, CONFIG_FLASH_TIMEOUT_MS) == PICO_OK;
+}
+
+bool configFlashProgram(uint32_t offset, const uint8_t* data, uint32_t size)
+{
+	struct ConfigFlashWrite write = {offset, data, size};
+
+	return flash_safe_execute(_configFlashWrite, &write, CONFIG_FLASH_TIMEOUT_MS) == PICO_OK;
+}
+
+void configFlashCoreInit()
+{
+	flash_safe_execute_core_init();
+}
@@ -0,0 +1,67 @@
+#include "pico_dash_decimate.h"
+
+/**
+ * Sum a fixed number of interleaved channels. With the channel count a compile time constant the inner loop unrolls and
+ * the sums stay in registers.
+ */
+#define DECIMATE_CHANNELS(count) \
+	{ \
+		uint32_t channelSums[count] = {0}; \
+		\
+		for(int sample = 0; sample < samplesPerChannel; sample++) \
+		{ \
+			for(int channel = 0; channel < count; channel++) \
+			{ \
+				channelSums[channel] += *samples++; \
+			} \
+		} \
+		\
+		for(int channel = 0; channel < count; channel++) \
+		{ \
+			sums[channel] = channelSums[channel]; \
+		} \
+	}
+
+void __not_in_flash_func(decimateInterleaved)(const uint16_t* samples, int channelCount, int samplesPerChannel,
+	uint32_t* sums)
+{
+	// The RP2040 ADC has at most 5 inputs to round robin over. The common counts get their own loop.
+	switch(channelCount)
+	{
+		case 1:
+
+			DECIMATE_CHANNELS(1);
+			break;
+
+		case 2:
+
+			DECIMATE_CHANNELS(2);
+			break;
+
+		case 3:
+
+			DECIMATE_CHANNELS(3);
+			break;
+
+		case 4:
+
+			DECIMATE_CHANNELS(4);
+			break;
+
+		default:
+
+			for(int channel = 0; channel < channelCount; channel++)
+			{
+				sums[channel] = 0;
+			}
+
+			for(int sample = 0; sample < samplesPerChannel; sample++)
+			{
+				for(int channel = 0; channel < channelCount; channel++)
+				{
+					sums[channel] += *samples++;
+				}
+			}
+			break;
+	}
+}
@@ -0,0 +1,37 @@
+#ifndef PICO_DASH_DECIMATE_H
+#define PICO_DASH_DECIMATE_H
+
+#include "pico.h"
+
+// Integer decimation of interleaved ADC samples.
+// Samples from a round robin capture are interleaved, one per channel in turn. Decimation sums each channel's samples
+// and the sums are shifted down to oversampled values. Averaging 4^n samples gains n bits of resolution (given enough
+// noise to dither), so the output carries more bits than the ADC.
+
+/** Bits in each ADC sample. */
+#define ADC_SAMPLE_BITS 12
+
+/** Bits in each decimated value. Full scale is (1 << ADC_DECIMATED_BITS) - 1. */
+#define ADC_DECIMATED_BITS 16
+
+/**
+ * Sum interleaved samples by channel.
+ * @param samples Samples. Sample n is from channel n % channelCount.
+ * @param channelCount Number of interleaved channels.
+ * @param samplesPerChannel Number of samples of each channel.
+ * @param sums Returns the sum of each channel's samples. Must have channelCount entries.
+ */
+void decimateInterleaved(const uint16_t* samples, int channelCount, int samplesPerChannel, uint32_t* sums);
+
+/**
+ * Convert the sum of a channel's samples into a value of ADC_DECIMATED_BITS.
+ * @param sum Sum of the samples.
+ * @param samplesPerChannelLog2 log2 of the number of samples summed. Must be at least
+ * ADC_DECIMATED_BITS - ADC_SAMPLE_BITS.
+ */
+static inline int decimatedValue(uint32_t sum, int samplesPerChannelLog2)
+{
+	return sum >> (samplesPerChannelLog2 - (ADC_DECIMATED_BITS - ADC_SAMPLE_BITS));
+}
+
+#endif
@@ -0,0 +1,114 @@
+#include "pico_dash_filter.h"
+
+bool configureFilter(struct Filter* filter, int type, int length)
+{
+	bool retVal = type >= FILTER_NONE && type < MAX_FILTER_TYPES && length >= 1 && length <= FILTER_MAX_LENGTH;
+
+	if(retVal)
+	{
+		filter -> type = type;
+		filter -> length = length;
+
+		resetFilter(filter);
+	}
+
+	return retVal;
+}
+
+/**
+ * Put a sample into the sorted window of a median filter, in place of the oldest sample if the window is full.
+ */
+static inline void _filterSortSample(struct Filter* filter, int32_t value)
+{
+	int32_t* sorted = filter -> sorted;
+
+	int posn;
+
+	if(filter -> count < filter -> length)
+	{
+		// Window still filling. The new sample goes on the end and is moved down into place.
+		posn = filter -> count;
+	}
+	else
+	{
+		// Any sample equal to the oldest will do to replace.
+		int32_t oldest = filter -> samples[filter -> next];
+
+		posn = 0;
+
+		while(sorted[posn] != oldest) posn++;
+
+		// Move up into place, if the new sample belongs above the old one.
+		while(posn + 1 < filter -> count && sorted[posn + 1] < value)
+		{
+			sorted[posn] = sorted[posn + 1];
+			posn++;
+		}
+	}
+
+	while(posn > 0 && sorted[posn - 1] > value)
+	{
+		sorted[posn] = sorted[posn - 1];
+		posn--;
+	}
+
+	sorted[posn] = value;
+}
+
+int __not_in_flash_func(filterUpdate)(struct Filter* filter, int value)
+{
+	int retVal = value;
+
+	switch(filter -> type)
+	{
+		case FILTER_EMA:
+
+			if(filter -> count == 0)
+			{
+				// First sample. The average starts from it rather than ramping up from 0.
+				filter -> accumulator = (int64_t)value << FILTER_EMA_FRACTION_BITS;
+				filter -> count = 1;
+			}
+			else
+			{
+				filter -> accumulator += (((int64_t)value << FILTER_EMA_FRACTION_BITS) - filter -> accumulator)
+					>> filter -> length;
+			}
+
+			// Rounded to nearest.
+			retVal = (filter -> accumulator + (1 << (FILTER_EMA_FRACTION_BITS - 1))) >> FILTER_EMA_FRACTION_BITS;
+			break;
+
+		case FILTER_MOVING_AVERAGE:
+
+			if(filter -> count == 0) filter -> accumulator = 0;
+
+			if(filter -> count < filter -> length) filter -> count++;
+			else filter -> accumulator -= filter -> samples[filter -> next];
+
+			filter -> accumulator += value;
+			filter -> samples[filter -> next] = value;
+			filter -> next = filter -> next + 1 < filter -> length ? filter -> next + 1 : 0;
+
+			retVal = filter -> accumulator / filter -> count;
+			break;
+
+		case FILTER_MEDIAN:
+
+			// Must be sorted before the sample it replaces is overwritten.
+			_filterSortSample(filter, value);
+
+			if(filter -> count < filter -> length) filter -> count++;
+
+			filter -> samples[filter -> next] = value;
+			filter -> next = filter -> next + 1 < filter -> length ? filter -> next + 1 : 0;
+
+			int middle = filter -> count / 2;
+
+			retVal = filter -> count & 1 ? filter -> sorted[middle]
+				: ((int64_t)filter -> sorted[middle - 1] + filter -> sorted[middle]) / 2;
+			break;
+	}
+
+	return retVal;
+}
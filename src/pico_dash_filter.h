@@ -0,0 +1,85 @@
+#ifndef PICO_DASH_FILTER_H
+#define PICO_DASH_FILTER_H
+
+#include "pico.h"
+
+// Integer smoothing of latched values.
+// Each sensor can put its values through a filter before they are latched, so that gauges and the master see steady
+// values without filtering again themselves. Every filter updates incrementally from its previous state: an exponential
+// moving average in fixed point, a moving average from a running sum over a ring of samples or a moving median from a
+// sorted copy of that ring. The median's window is small enough that keeping it sorted takes a handful of moves.
+
+/** Longest filter window, in samples. */
+#define FILTER_MAX_LENGTH 16
+
+/** Fraction bits of the exponential moving average. */
+#define FILTER_EMA_FRACTION_BITS 16
+
+/** Filter types. */
+enum FilterType
+{
+	/** Values are latched as they are. */
+	FILTER_NONE,
+
+	/** Exponential moving average. Each sample is weighted by 1 / 2^length, so length is log2 of the time constant. */
+	FILTER_EMA,
+
+	/** Mean of the last length samples. */
+	FILTER_MOVING_AVERAGE,
+
+	/** Median of the last length samples. Rejects spikes shorter than half the window. */
+	FILTER_MEDIAN,
+
+	/** Number of filter types. */
+	MAX_FILTER_TYPES
+};
+
+/** State of a filter. */
+struct Filter
+{
+	/** Type of filter (enum FilterType). */
+	uint8_t type;
+
+	/** Window length in samples, or log2 of the time constant for FILTER_EMA. 1 to FILTER_MAX_LENGTH. */
+	uint8_t length;
+
+	/** Number of samples in the window, up to length. */
+	uint8_t count;
+
+	/** Index into samples that the next sample goes in. Once the window is full, that of the oldest sample. */
+	uint8_t next;
+
+	/** Exponential moving average with FILTER_EMA_FRACTION_BITS, or the sum of the samples for a moving average. */
+	int64_t accumulator;
+
+	/** Samples in the window, in the order they arrived. */
+	int32_t samples[FILTER_MAX_LENGTH];
+
+	/** Samples in the window, in ascending order. Only kept for FILTER_MEDIAN. */
+	int32_t sorted[FILTER_MAX_LENGTH];
+};
+
+/**
+ * Set up a filter and empty it.
+ * @param type Filter type (enum FilterType).
+ * @param length Window length, or log2 of the time constant for FILTER_EMA.
+ * @returns False, leaving the filter as it was, if the type or length is out of bounds.
+ */
+bool configureFilter(struct Filter* filter, int type, int length);
+
+/**
+ * Empty a filter. The next sample starts it afresh.
+ */
+static inline void resetFilter(struct Filter* filter)
+{
+	filter -> count = 0;
+	filter -> next = 0;
+}
+
+/**
+ * Add a sample to a filter.
+ * @returns Filtered value. Until the window fills, the filter of the samples so far.
+ */
+int filterUpdate(struct Filter* filter, int value);
+
+#endif
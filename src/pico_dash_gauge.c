@@ -0,0 +1,301 @@
+#include <assert.h>
+
+#include "hardware/gpio.h"
+#include "hardware/timer.h"
+
+#include "pico_dash_gauge.h"
+#include "pico_dash_gauge_profile.h"
+#include "pico_dash_microstep.h"
+#include "pico_dash_sched.h"
+
+static_assert(MAX_GAUGES <= 32 && MAX_GAUGES <= MAX_SCHED_ITEMS, "Gauge numbers must fit the step interrupt's masks");
+
+/** Number of states in the coil sequence. */
+#define GAUGE_COIL_STATES MICROSTEP_STEPS_PER_CYCLE
+
+/**
+ * Coil sequence, as in X27_stepperTest. Bit n is the level of L293D input n + 1 (1A, 2A, 3A, 4A).
+ * Stepping forwards through it turns the needle away from the end stop.
+ */
+static const uint8_t _gaugeCoilStates[GAUGE_COIL_STATES] = {0x5, 0x1, 0x8, 0xA, 0x2, 0x4};
+
+/** A gauge. */
+struct Gauge
+{
+	struct GaugeConfig config;
+
+	/** Step intervals for the gauge's maximum step rate and acceleration. */
+	struct GaugeProfileTable table;
+
+	/** Needle motion. Only touched by the step interrupt once the gauges are started. */
+	struct GaugeProfile profile;
+
+	/** Microstepper driving the coils. -1 if they are stepped directly. */
+	int microstepper;
+
+	/** GPIO mask of the coil inputs. 0 if they are microstepped. */
+	uint32_t coilMask;
+
+	/** GPIO levels of the coil inputs at each coil state. */
+	uint32_t coilOutputs[GAUGE_COIL_STATES];
+
+	/** Current coil state. */
+	int coilState;
+
+	/** Whether homing has finished. Written by the step interrupt. */
+	volatile bool homed;
+
+	/** Copy of the needle position for other code to read. Written by the step interrupt. */
+	volatile int position;
+};
+
+struct Gauge _gauges[MAX_GAUGES];
+int _gaugeCount = 0;
+
+/** When each gauge's next step, or idle check, is due, by gauge number. Only touched by the step interrupt once started. */
+struct SchedQueue _gaugeSchedule;
+
+/** Hardware alarm set for the earliest step due. */
+int _gaugeAlarm = -1;
+
+/** Step interrupt timing. */
+struct GaugeTimingStats _gaugeTimingStats;
+
+int getGaugeTargetPosition(int gauge, int value)
+{
+	const struct GaugeConfig* config = &_gauges[gauge].config;
+
+	int64_t position = config -> maxValue != config -> minValue
+		? (int64_t)(value - config -> minValue) * config -> sweepSteps / (config -> maxValue - config -> minValue) : 0;
+
+	if(position < 0) position = 0;
+	if(position > config -> sweepSteps) position = config -> sweepSteps;
+
+	return position;
+}
+
+/**
+ * Take a gauge's step, or idle check, that is due.
+ * @param gaugeNum Gauge.
+ * @param deadline Time it was due.
+ * @param curTime Current time.
+ * @returns Time the next one is due.
+ */
+static absolute_time_t __not_in_flash_func(_stepGauge)(int gaugeNum, absolute_time_t deadline, absolute_time_t curTime)
+{
+	struct Gauge* gauge = &_gauges[gaugeNum];
+
+	if(gauge -> homed)
+	{
+		gauge -> profile.target = getGaugeTargetPosition(gaugeNum, getLatchedData(gauge -> config.index));
+	}
+
+	int direction = gaugeProfileStep(&gauge -> profile);
+
+	if(direction)
+	{
+		if(gauge -> microstepper >= 0)
+		{
+			// Spread across the time to the next step, which the profile has already moved on to.
+			microstepperStep(gauge -> microstepper, gauge -> coilState, direction, gaugeProfileInterval(&gauge -> profile));
+		}
+
+		gauge -> coilState += direction;
+
+		if(gauge -> coilState < 0) gauge -> coilState = GAUGE_COIL_STATES - 1;
+		else if(gauge -> coilState == GAUGE_COIL_STATES) gauge -> coilState = 0;
+
+		gauge -> position = gauge -> profile.position;
+
+		_gaugeTimingStats.steps++;
+
+		if(curTime > deadline && curTime - deadline > _gaugeTimingStats.maxLateness)
+		{
+			_gaugeTimingStats.maxLateness = curTime - deadline;
+		}
+
+		// Steps are timed from when they were due rather than when the interrupt got round to them, so interrupt latency
+		// doesn't add up into a slower needle.
+		deadline = delayed_by_us(deadline, gaugeProfileInterval(&gauge -> profile));
+	}
+	else
+	{
+		if(!gauge -> homed)
+		{
+			// Against the end stop. From here on the profile position is the needle position.
+			gauge -> profile.speedLimit = gauge -> table.maxSpeed;
+			gauge -> homed = true;
+		}
+
+		deadline = delayed_by_us(curTime, GAUGE_IDLE_POLL_INTERVAL);
+	}
+
+	return deadline;
+}
+
+/**
+ * Step interrupt. Takes every step due, or nearly due, across all the gauges, sets all their coils with a single GPIO
+ * write and sets the alarm for the next step due.
+ */
+void __not_in_flash_func(_gaugeAlarmCallback)(uint alarmNum)
+{
+	(void)alarmNum;
+
+	const struct SchedEntry* next;
+
+	_gaugeTimingStats.interrupts++;
+
+	do
+	{
+		absolute_time_t curTime = get_absolute_time();
+		absolute_time_t coalesceTime = delayed_by_us(curTime, GAUGE_STEP_COALESCE_INTERVAL);
+
+		uint32_t coilMask = 0;
+		uint32_t coilLevels = 0;
+
+		// Each gauge steps at most once per write. A gauge due again within the window waits for the next pass.
+		uint32_t gaugesStepped = 0;
+
+		while((next = schedQueuePeek(&_gaugeSchedule)) && next -> deadline <= coalesceTime &&
+			!(gaugesStepped & (1u << next -> id)))
+		{
+			int gaugeNum = next -> id;
+
+			schedQueueSet(&_gaugeSchedule, gaugeNum, _stepGauge(gaugeNum, next -> deadline, curTime));
+
+			coilMask |= _gauges[gaugeNum].coilMask;
+			coilLevels |= _gauges[gaugeNum].coilOutputs[_gauges[gaugeNum].coilState];
+			gaugesStepped |= 1u << gaugeNum;
+		}
+
+		if(coilMask) gpio_put_masked(coilMask, coilLevels);
+	}
+	// If the next step is already due it is taken now.
+	while(next && hardware_alarm_set_target(_gaugeAlarm, next -> deadline));
+}
+
+int addGauge(const struct GaugeConfig* config)
+{
+	int retVal = -1;
+
+	if(_gaugeCount < MAX_GAUGES)
+	{
+		struct Gauge* gauge = &_gauges[_gaugeCount];
+
+		gauge -> config = *config;
+
+		gaugeProfileInitTable(&gauge -> table, config -> maxStepRate, config -> acceleration);
+
+		gauge -> coilMask = 0;
+
+		for(int coil = 0; coil < GAUGE_COIL_GPIO_COUNT; coil++)
+		{
+			gauge -> coilMask |= 1u << config -> coilGpios[coil];
+		}
+
+		for(int state = 0; state < GAUGE_COIL_STATES; state++)
+		{
+			gauge -> coilOutputs[state] = 0;
+
+			for(int coil = 0; coil < GAUGE_COIL_GPIO_COUNT; coil++)
+			{
+				if(_gaugeCoilStates[state] & (1 << coil)) gauge -> coilOutputs[state] |= 1u << config -> coilGpios[coil];
+			}
+		}
+
+		retVal = _gaugeCount++;
+	}
+
+	return retVal;
+}
+
+void startGauges()
+{
+	schedQueueInit(&_gaugeSchedule);
+
+	_gaugeTimingStats.interrupts = 0;
+	_gaugeTimingStats.steps = 0;
+	_gaugeTimingStats.maxLateness = 0;
+
+	for(int index = 0; index < _gaugeCount; index++)
+	{
+		struct Gauge* gauge = &_gauges[index];
+
+		gauge -> coilState = 0;
+		gauge -> microstepper = -1;
+
+		// The state machine drives the coils as a block of consecutive pins.
+		bool coilsConsecutive = true;
+
+		for(int coil = 1; coil < GAUGE_COIL_GPIO_COUNT; coil++)
+		{
+			coilsConsecutive &= gauge -> config.coilGpios[coil] == gauge -> config.coilGpios[0] + coil;
+		}
+
+		if(gauge -> config.microsteps > 0 && gauge -> config.enableGpio >= 0 && coilsConsecutive)
+		{
+			gauge -> microstepper = startMicrostepper(gauge -> config.coilGpios[0], gauge -> config.enableGpio,
+				gauge -> config.microsteps);
+		}
+
+		if(gauge -> microstepper >= 0)
+		{
+			// The state machine has the coils now.
+			gauge -> coilMask = 0;
+		}
+		else
+		{
+			for(int coil = 0; coil < GAUGE_COIL_GPIO_COUNT; coil++)
+			{
+				gpio_init(gauge -> config.coilGpios[coil]);
+				gpio_set_dir(gauge -> config.coilGpios[coil], GPIO_OUT);
+			}
+
+			gpio_put_masked(gauge -> coilMask, gauge -> coilOutputs[0]);
+
+			// A gauge wired for microstepping has its enables on separate GPIOs.
+			int enableCount = gauge -> config.microsteps > 0 ? 2 : 1;
+
+			for(int enable = 0; gauge -> config.enableGpio >= 0 && enable < enableCount; enable++)
+			{
+				gpio_init(gauge -> config.enableGpio + enable);
+				gpio_set_dir(gauge -> config.enableGpio + enable, GPIO_OUT);
+				gpio_put(gauge -> config.enableGpio + enable, true);
+			}
+		}
+
+		// Wherever the needle is, a full sweep and a margin back towards the end stop is sure to reach it.
+		gaugeProfileInit(&gauge -> profile, &gauge -> table, gauge -> config.sweepSteps + GAUGE_HOMING_MARGIN_STEPS);
+		gauge -> profile.target = 0;
+		gauge -> profile.speedLimit = gaugeProfileSpeedIndex(&gauge -> table, GAUGE_HOMING_STEP_RATE);
+
+		gauge -> homed = false;
+		gauge -> position = gauge -> profile.position;
+
+		schedQueueSet(&_gaugeSchedule, index, delayed_by_us(get_absolute_time(), GAUGE_IDLE_POLL_INTERVAL));
+	}
+
+	if(_gaugeCount > 0)
+	{
+		_gaugeAlarm = hardware_alarm_claim_unused(true);
+
+		// Must be done on the core that is to take the step interrupts.
+		hardware_alarm_set_callback(_gaugeAlarm, _gaugeAlarmCallback);
+		hardware_alarm_set_target(_gaugeAlarm, schedQueuePeek(&_gaugeSchedule) -> deadline);
+	}
+}
+
+bool isGaugeHomed(int gauge)
+{
+	return gauge >= 0 && gauge < _gaugeCount && _gauges[gauge].homed;
+}
+
+int getGaugePosition(int gauge)
+{
+	return gauge >= 0 && gauge < _gaugeCount ? _gauges[gauge].position : 0;
+}
+
+void getGaugeTimingStats(struct GaugeTimingStats* stats)
+{
+	*stats = _gaugeTimingStats;
+}
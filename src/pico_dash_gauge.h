@@ -0,0 +1,132 @@
+#ifndef PICO_DASH_GAUGE_H
+#define PICO_DASH_GAUGE_H
+
+#include "pico.h"
+
+#include "pico_dash_latch.h"
+
+// Stepper motor gauges driven straight from latched data.
+// Each gauge is an X27 style stepper motor on an L293D, stepped through the same 6 state coil sequence as
+// X27_stepperTest. Each needle is stepped towards the position of its latched data value under a trapezoidal speed
+// profile (see pico_dash_gauge_profile.h), so needles move as fast as the motor allows without losing steps.
+// All the gauges share one hardware alarm. Their next step times are kept in a deadline ordered queue (see
+// pico_dash_sched.h), the alarm is set for the earliest and its interrupt takes every step due at that instant, setting
+// all their coils with one masked GPIO write. The core is only busy for the steps themselves, however many gauges there
+// are.
+// A gauge can be microstepped instead (see pico_dash_microstep.h), with sine/cosine coil currents set by PWM on the
+// L293D enables, so the needle glides rather than ticks at low speeds. Its steps are timed the same way but each is
+// handed to a PIO state machine, which spreads its microsteps across the interval to the next step.
+// On start each needle is homed by driving it further than its full sweep back against the motor's end stop at a
+// gentle step rate. The end stop is position 0.
+
+/**
+ * Maximum number of gauges. Must be no more than 32 and MAX_SCHED_ITEMS.
+ * Each gauge needs 4 coil GPIOs, so how many can actually be fitted depends on what else is using pins.
+ */
+#define MAX_GAUGES 8
+
+/**
+ * Steps due within this many microseconds of the earliest are taken in the same interrupt, by the same GPIO write.
+ * A fraction of the shortest step interval, so needles barely notice a step coming a little early.
+ */
+#define GAUGE_STEP_COALESCE_INTERVAL 10
+
+/** Steps driven beyond the full sweep when homing, to be sure of reaching the end stop from anywhere. */
+#define GAUGE_HOMING_MARGIN_STEPS 30
+
+/** Step rate when homing, in steps per second. Slow enough that the needle doesn't bounce off the end stop. */
+#define GAUGE_HOMING_STEP_RATE 400
+
+/** How often, in microseconds, a stopped gauge checks whether its latched data value has moved. */
+#define GAUGE_IDLE_POLL_INTERVAL 10000
+
+/** Number of coil inputs on the L293D. */
+#define GAUGE_COIL_GPIO_COUNT 4
+
+/** Step interrupt timing, since the gauges were started. */
+struct GaugeTimingStats
+{
+	/** Number of step interrupts. */
+	uint32_t interrupts;
+
+	/** Number of steps taken, across all gauges. */
+	uint32_t steps;
+
+	/** Latest any step has been taken after it was due, in microseconds. */
+	uint32_t maxLateness;
+};
+
+/** Description of a gauge. */
+struct GaugeConfig
+{
+	/**
+	 * GPIOs driving the L293D 1A, 2A, 3A and 4A inputs. 1A and 2A drive coil A, 3A and 4A coil B, wired so that stepping
+	 * backwards through the coil sequence turns the needle towards the end stop. Must be consecutive to microstep.
+	 */
+	uint coilGpios[GAUGE_COIL_GPIO_COUNT];
+
+	/**
+	 * GPIO driving the L293D 1,2EN and 3,4EN inputs. -1 if they are tied high.
+	 * To microstep it drives 1,2EN only and must be an even GPIO, with the next GPIO driving 3,4EN.
+	 */
+	int enableGpio;
+
+	/**
+	 * Microsteps per step, 8, 16 or 32. 0 to step the coils directly. Gauges that can't get a microstepper are stepped
+	 * directly too, with both enables held high.
+	 */
+	int microsteps;
+
+	/** Latched data the gauge shows. */
+	LatchedDataIndex index;
+
+	/** Latched data value at the end stop. */
+	int minValue;
+
+	/** Latched data value at full sweep. Values beyond either end pin the needle at that end. */
+	int maxValue;
+
+	/** Steps from the end stop to full sweep. */
+	int sweepSteps;
+
+	/** Maximum needle speed, in steps per second. */
+	int maxStepRate;
+
+	/** Needle acceleration and deceleration, in steps per second per second. */
+	int acceleration;
+};
+
+/**
+ * Add a gauge. Must be done before the gauges are started.
+ * @param config Description of the gauge. Copied.
+ * @returns Gauge number, or -1 if there are already MAX_GAUGES gauges.
+ */
+int addGauge(const struct GaugeConfig* config);
+
+/**
+ * Start homing then driving all added gauges. The step interrupts are taken by the calling core.
+ * @note Claims a hardware alarm.
+ */
+void startGauges();
+
+/**
+ * Whether a gauge has been homed and is following its latched data.
+ */
+bool isGaugeHomed(int gauge);
+
+/**
+ * Get the current needle position of a gauge, in steps from the end stop.
+ */
+int getGaugePosition(int gauge);
+
+/**
+ * Get the needle position, in steps from the end stop, that a gauge shows a latched data value at.
+ */
+int getGaugeTargetPosition(int gauge, int value);
+
+/**
+ * Get the step interrupt timing.
+ */
+void getGaugeTimingStats(struct GaugeTimingStats* stats);
+
+#endif
@@ -0,0 +1,127 @@
+#include "pico_dash_gauge_profile.h"
+
+/** Largest interval a table entry can hold. */
+#define GAUGE_PROFILE_MAX_INTERVAL 0xFFFF
+
+/** Integer square root, rounded down. */
+static uint32_t _isqrt64(uint64_t value)
+{
+	uint64_t root = 0;
+	uint64_t bit = (uint64_t)1 << 62;
+
+	while(bit > value) bit >>= 2;
+
+	while(bit)
+	{
+		if(value >= root + bit)
+		{
+			value -= root + bit;
+			root = (root >> 1) + bit;
+		}
+		else
+		{
+			root >>= 1;
+		}
+
+		bit >>= 2;
+	}
+
+	return root;
+}
+
+bool gaugeProfileInitTable(struct GaugeProfileTable* table, int maxStepRate, int acceleration)
+{
+	bool retVal = true;
+
+	if(maxStepRate < 1) maxStepRate = 1;
+	if(acceleration < 1) acceleration = 1;
+
+	// The stopping distance from the maximum step rate.
+	int64_t maxSpeed = (int64_t)maxStepRate * maxStepRate / (2 * (int64_t)acceleration);
+
+	if(maxSpeed < 1) maxSpeed = 1;
+
+	if(maxSpeed > GAUGE_PROFILE_MAX_SPEEDS)
+	{
+		maxSpeed = GAUGE_PROFILE_MAX_SPEEDS;
+		retVal = false;
+	}
+
+	table -> maxSpeed = maxSpeed;
+
+	// Time from rest to each step at constant acceleration, sqrt(2n / a) seconds, in 1/16ths of a microsecond.
+	uint64_t lastTime = 0;
+
+	for(int speed = 1; speed <= maxSpeed; speed++)
+	{
+		uint64_t time = _isqrt64(2 * (uint64_t)speed * 1000000000000ull * 256 / acceleration);
+		uint32_t interval = (time - lastTime + 8) >> 4;
+
+		if(interval > GAUGE_PROFILE_MAX_INTERVAL)
+		{
+			interval = GAUGE_PROFILE_MAX_INTERVAL;
+			retVal = false;
+		}
+
+		table -> intervals[speed - 1] = interval;
+		lastTime = time;
+	}
+
+	return retVal;
+}
+
+int gaugeProfileSpeedIndex(const struct GaugeProfileTable* table, int stepRate)
+{
+	int speed = 1;
+
+	while(speed < table -> maxSpeed && (uint64_t)table -> intervals[speed] * stepRate >= 1000000) speed++;
+
+	return speed;
+}
+
+void gaugeProfileInit(struct GaugeProfile* profile, const struct GaugeProfileTable* table, int position)
+{
+	profile -> table = table;
+	profile -> position = position;
+	profile -> target = position;
+	profile -> direction = 1;
+	profile -> speed = 0;
+	profile -> speedLimit = table -> maxSpeed;
+}
+
+int __not_in_flash_func(gaugeProfileStep)(struct GaugeProfile* profile)
+{
+	int retVal = 0;
+
+	int target = profile -> target;
+
+	bool moving = profile -> speed > 0;
+
+	// Starting from rest, towards wherever the target now is.
+	if(!moving && target != profile -> position)
+	{
+		profile -> direction = target > profile -> position ? 1 : -1;
+		moving = true;
+	}
+
+	if(moving)
+	{
+		profile -> position += profile -> direction;
+		retVal = profile -> direction;
+
+		// Steps left to go in the direction of travel. Negative if the target is now behind.
+		int remaining = (target - profile -> position) * profile -> direction;
+
+		// The speed index is the stopping distance, so holding it at the distance left stops exactly on the target.
+		if(remaining < profile -> speed || profile -> speed > profile -> speedLimit)
+		{
+			profile -> speed--;
+		}
+		else if(remaining > profile -> speed && profile -> speed < profile -> speedLimit)
+		{
+			profile -> speed++;
+		}
+	}
+
+	return retVal;
+}
@@ -0,0 +1,92 @@
+#ifndef PICO_DASH_GAUGE_PROFILE_H
+#define PICO_DASH_GAUGE_PROFILE_H
+
+#include "pico.h"
+
+// Trapezoidal stepper motion profiles.
+// Speeds are indexed by the number of steps it takes to stop from them. Under constant acceleration a the speed with a
+// stopping distance of n steps is sqrt(2an), so accelerating or decelerating by one speed index per step is exactly
+// constant acceleration, and whether to start decelerating is a comparison of the speed index with the distance left.
+// The interval to the next step at each speed index is precomputed as the time constant acceleration from rest takes
+// over that step of its run, so taking a step is a handful of integer operations with no division, small enough for a
+// step interrupt.
+// No hardware dependencies, so profiles can be checked on the host.
+
+/** Highest speed index a table can hold. */
+#define GAUGE_PROFILE_MAX_SPEEDS 512
+
+/** Step intervals for a maximum step rate and acceleration. */
+struct GaugeProfileTable
+{
+	/** Highest speed index, the one at the maximum step rate. */
+	int maxSpeed;
+
+	/** Microseconds to the next step at each speed index. Entry 0 is speed index 1. */
+	uint16_t intervals[GAUGE_PROFILE_MAX_SPEEDS];
+};
+
+/** A stepper moving under a profile. */
+struct GaugeProfile
+{
+	/** Step intervals. */
+	const struct GaugeProfileTable* table;
+
+	/** Current position, in steps. */
+	int position;
+
+	/** Position to move to. May be changed at any time, including while moving. */
+	int target;
+
+	/** Direction of travel, 1 or -1. Only meaningful while moving. */
+	int direction;
+
+	/** Speed index, which is the number of steps it takes to stop. 0 when stopped. */
+	int speed;
+
+	/** Highest speed index to accelerate to. At most table -> maxSpeed. */
+	int speedLimit;
+};
+
+/**
+ * Fill in a profile table.
+ * @param table Table to fill in.
+ * @param maxStepRate Maximum steps per second.
+ * @param acceleration Acceleration and deceleration, in steps per second per second.
+ * @returns True if the table could hold the profile. False if the highest speed index had to be capped, in which case
+ * the maximum step rate is lower than asked for, or the slowest intervals had to be capped, in which case starting and
+ * stopping are more abrupt than asked for.
+ */
+bool gaugeProfileInitTable(struct GaugeProfileTable* table, int maxStepRate, int acceleration);
+
+/**
+ * Get the highest speed index of a table whose step rate is no more than the given rate. Always at least 1.
+ */
+int gaugeProfileSpeedIndex(const struct GaugeProfileTable* table, int stepRate);
+
+/**
+ * Initialise a profile stopped at a position.
+ * @param profile Profile to initialise.
+ * @param table Step intervals. Must stay valid for the life of the profile.
+ * @param position Position, which is also the target.
+ */
+void gaugeProfileInit(struct GaugeProfile* profile, const struct GaugeProfileTable* table, int position);
+
+/**
+ * Take the next step towards the target, and pick the speed of the step after it.
+ * Must be called no sooner than gaugeProfileInterval after the step before it.
+ * If the target moves behind a moving stepper, or closer than it can stop in, the stepper decelerates at the profile
+ * acceleration and overshoots, then comes back from rest.
+ * @returns Direction of the step taken, 1 or -1, or 0 if stopped at the target and no step was taken.
+ */
+int gaugeProfileStep(struct GaugeProfile* profile);
+
+/**
+ * Get the number of microseconds to wait after a step before gaugeProfileStep is next due.
+ */
+static inline uint32_t gaugeProfileInterval(const struct GaugeProfile* profile)
+{
+	// Stopping isn't instant, so coming back from rest waits as long as the slowest step.
+	return profile -> table -> intervals[profile -> speed > 0 ? profile -> speed - 1 : 0];
+}
+
+#endif
@@ -0,0 +1,289 @@
+#include <string.h>
+
+#include "hardware/sync.h"
+
+#include "pico_dash_history.h"
+
+#if PICO_DASH_HISTORY
+
+/** A block of a history ring. */
+struct HistoryBlock
+{
+	/**
+	 * Number of blocks ever started in the ring, as of this one. Written last when the block is started, so until it
+	 * matches the rest of the block is left over from the block dropped for it, or has never been written.
+	 */
+	volatile uint32_t blocksStarted;
+
+	/** Sequence number, time and value of the first sample. */
+	uint32_t firstSequence;
+	absolute_time_t firstTime;
+	int32_t firstValue;
+
+	/** The samples after the first, delta encoded. */
+	uint8_t samples[HISTORY_BLOCK_SIZE];
+};
+
+/** History of a latched data index. */
+struct History
+{
+	struct HistoryBlock blocks[HISTORY_BLOCKS];
+
+	/**
+	 * Number of blocks ever started. The newest is block blocksStarted - 1. Moved on before a block is overwritten, so
+	 * a reader can tell whether a block it read was overwritten meanwhile.
+	 */
+	volatile uint32_t blocksStarted;
+
+	/** Number of samples ever recorded. Moved on once a sample has been written in full. */
+	volatile uint32_t recorded;
+
+	// Only used by core 1.
+
+	/** Bytes used in the newest block. */
+	int blockSize;
+
+	/** Time of the last sample and the time since the sample before it, in microseconds. */
+	absolute_time_t lastTime;
+	int32_t lastTimeDelta;
+
+	/** Value of the last sample. */
+	int32_t lastValue;
+};
+
+/** History by latched data index. In main SRAM: much too big for the scratch banks, and read by core 0. */
+static struct History _history[MAX_LATCHED_INDEXES - 1];
+
+/** Zig-zag encoding maps small negative deltas to small unsigned ones. */
+static inline uint32_t _zigZag(int32_t value)
+{
+	return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static inline int32_t _unZigZag(uint32_t value)
+{
+	return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+/**
+ * Write a varint, 7 bits per byte, low bits first, top bit set on every byte but the last.
+ * @returns Position after it.
+ */
+static inline int _putVarint(uint8_t* bytes, int posn, uint32_t value)
+{
+	while(value >= 0x80)
+	{
+		bytes[posn++] = value | 0x80;
+		value >>= 7;
+	}
+
+	bytes[posn++] = value;
+
+	return posn;
+}
+
+/**
+ * Read a varint. Never reads past the end of a block, which a block being overwritten could otherwise lead to.
+ * @returns Position after it.
+ */
+static inline int _getVarint(const uint8_t* bytes, int posn, uint32_t* value)
+{
+	int shift = 0;
+
+	*value = 0;
+
+	while(posn < HISTORY_BLOCK_SIZE && shift < 32)
+	{
+		*value |= (uint32_t)(bytes[posn] & 0x7F) << shift;
+		shift += 7;
+
+		if(!(bytes[posn++] & 0x80)) break;
+	}
+
+	return posn;
+}
+
+void __not_in_flash_func(historyRecord)(LatchedDataIndex index, absolute_time_t time, int32_t value)
+{
+	struct History* history = _history + index - 1;
+
+	uint32_t sequence = history -> recorded;
+
+	// Deltas of more than 35 minutes or so start a block, which has the time in full.
+	uint64_t timeDelta = time - history -> lastTime;
+
+	uint8_t sample[HISTORY_MAX_SAMPLE_SIZE];
+	int sampleSize = 0;
+
+	if(sequence > 0 && time >= history -> lastTime && timeDelta <= INT32_MAX)
+	{
+		// Strobes are at a steady rate, so the time delta is stored as its change from the last, which is close to 0.
+		sampleSize = _putVarint(sample, sampleSize, _zigZag((int32_t)timeDelta - history -> lastTimeDelta));
+		sampleSize = _putVarint(sample, sampleSize, _zigZag((int32_t)((uint32_t)value -
+			(uint32_t)history -> lastValue)));
+	}
+
+	if(sampleSize == 0 || history -> blockSize + sampleSize > HISTORY_BLOCK_SIZE)
+	{
+		// Start a block. Once the ring is full that drops the oldest, so core 0 must see it gone before any of it is
+		// overwritten.
+		uint32_t blockNumber = history -> blocksStarted;
+
+		history -> blocksStarted = blockNumber + 1;
+
+		__dmb();
+
+		struct HistoryBlock* block = history -> blocks + blockNumber % HISTORY_BLOCKS;
+
+		block -> firstSequence = sequence;
+		block -> firstTime = time;
+		block -> firstValue = value;
+
+		__dmb();
+
+		block -> blocksStarted = blockNumber + 1;
+
+		history -> blockSize = 0;
+		timeDelta = 0;
+	}
+	else
+	{
+		struct HistoryBlock* block = history -> blocks + (history -> blocksStarted - 1) % HISTORY_BLOCKS;
+
+		memcpy(block -> samples + history -> blockSize, sample, sampleSize);
+
+		history -> blockSize += sampleSize;
+	}
+
+	history -> lastTime = time;
+	history -> lastTimeDelta = (int32_t)timeDelta;
+	history -> lastValue = value;
+
+	// The sample must be written in full before core 0 sees it recorded.
+	__dmb();
+
+	history -> recorded = sequence + 1;
+}
+
+/**
+ * Whether a history block has been started and its header can be read.
+ */
+static inline bool _historyBlockStarted(const struct History* history, uint32_t blockNumber)
+{
+	return history -> blocks[blockNumber % HISTORY_BLOCKS].blocksStarted == blockNumber + 1;
+}
+
+int __not_in_flash_func(getHistory)(LatchedDataIndex index, uint32_t* sequence, struct HistorySample* samples,
+	int maxSamples, uint32_t* recorded)
+{
+	int retVal = 0;
+
+	*recorded = 0;
+
+	if(index > NO_LATCHED_INDEX && index < MAX_LATCHED_INDEXES)
+	{
+		const struct History* history = _history + index - 1;
+
+		uint32_t wanted = *sequence;
+		uint32_t blocksStarted;
+		uint32_t firstBlock;
+
+		// Core 1 can drop the oldest block while it is being copied, in which case the copy starts again from the new
+		// oldest. Unless samples are wanted from the oldest block, that only happens if core 0 is held up for longer
+		// than it takes to fill the whole ring.
+		do
+		{
+			retVal = 0;
+
+			blocksStarted = history -> blocksStarted;
+
+			__dmb();
+
+			*recorded = history -> recorded;
+
+			__dmb();
+
+			// Sequence numbers only ever go up, but wrap, so they are compared by difference.
+			if((int32_t)(*recorded - wanted) < 0) wanted = *recorded;
+
+			*sequence = wanted;
+
+			uint32_t oldestBlock = blocksStarted > HISTORY_BLOCKS ? blocksStarted - HISTORY_BLOCKS : 0;
+
+			// The block holding the first sample wanted is the newest started at or before it, or the oldest if it has
+			// been dropped. Blocks started after the samples were counted don't hold any of them.
+			firstBlock = blocksStarted;
+
+			while(firstBlock != oldestBlock && (firstBlock == blocksStarted ||
+				!_historyBlockStarted(history, firstBlock) ||
+				(int32_t)(wanted - history -> blocks[firstBlock % HISTORY_BLOCKS].firstSequence) < 0))
+			{
+				firstBlock--;
+			}
+
+			if(wanted != *recorded)
+			{
+				uint32_t blockNumber = firstBlock;
+				const struct HistoryBlock* block = history -> blocks + blockNumber % HISTORY_BLOCKS;
+
+				uint32_t sampleSequence = block -> firstSequence;
+				absolute_time_t time = block -> firstTime;
+				int32_t timeDelta = 0;
+				uint32_t value = block -> firstValue;
+				int posn = 0;
+
+				if((int32_t)(wanted - sampleSequence) < 0) *sequence = sampleSequence;
+
+				while(retVal < maxSamples && sampleSequence != *recorded)
+				{
+					if((int32_t)(sampleSequence - wanted) >= 0)
+					{
+						samples[retVal].time = time;
+						samples[retVal].value = value;
+
+						retVal++;
+					}
+
+					sampleSequence++;
+
+					const struct HistoryBlock* nextBlock = history -> blocks + (blockNumber + 1) % HISTORY_BLOCKS;
+
+					if(blockNumber + 1 != blocksStarted && _historyBlockStarted(history, blockNumber + 1) &&
+						nextBlock -> firstSequence == sampleSequence)
+					{
+						blockNumber++;
+						block = nextBlock;
+
+						time = block -> firstTime;
+						timeDelta = 0;
+						value = block -> firstValue;
+						posn = 0;
+					}
+					else
+					{
+						uint32_t delta;
+
+						posn = _getVarint(block -> samples, posn, &delta);
+						timeDelta += _unZigZag(delta);
+						time += timeDelta;
+
+						posn = _getVarint(block -> samples, posn, &delta);
+						value += _unZigZag(delta);
+					}
+				}
+			}
+
+			__dmb();
+		}
+		while(history -> blocksStarted - firstBlock > HISTORY_BLOCKS);
+	}
+
+	return retVal;
+}
+
+void resetHistory()
+{
+	memset(_history, 0, sizeof(_history));
+}
+
+#endif
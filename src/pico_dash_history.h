@@ -0,0 +1,95 @@
+#ifndef PICO_DASH_HISTORY_H
+#define PICO_DASH_HISTORY_H
+
+#include "pico.h"
+#include "pico/time.h"
+
+#include "pico_dash_latch.h"
+
+// Latched data history.
+// Every value core 1 latches is recorded, timestamped, in a ring per latched data index, so that the SPI master can log
+// at the full sensor rate while only reading now and then with GET_HISTORY, and doesn't lose anything across a restart
+// of its own.
+// Each ring is split into blocks. A block starts with one sample in full, then each sample after it is stored as the
+// time and value deltas from the one before, as zig-zag encoded varints. Sensors latch at a steady rate, so the time
+// delta is stored as its change from the last in microseconds, which is close to 0. A steady value latched at a steady
+// rate takes 2 bytes a sample, and a simulated drive takes 2 to 4. Once the ring is full the oldest block is dropped to
+// make room, so the history always starts at the beginning of a block.
+// Only core 1 records and only core 0 reads. A read that core 1 overtakes, by dropping a block the read was copying, is
+// thrown away and tried again from the new oldest sample.
+// Set PICO_DASH_HISTORY to 0 to compile all of it out. Recording is then an empty inline function and GET_HISTORY is a
+// bad command.
+
+#ifndef PICO_DASH_HISTORY
+#define PICO_DASH_HISTORY 1
+#endif
+
+/** Size of a history block, in bytes of delta encoded samples. */
+#define HISTORY_BLOCK_SIZE 256
+
+/**
+ * Number of history blocks per latched data index. 16 KB of samples each as default, 7 minutes or so of a value latched
+ * 10 times a second.
+ */
+#ifndef HISTORY_BLOCKS
+#define HISTORY_BLOCKS 64
+#endif
+
+/** Longest delta encoded sample, in bytes. A 5 byte varint each for the time and value deltas. */
+#define HISTORY_MAX_SAMPLE_SIZE 10
+
+/** A latched data sample. */
+struct HistorySample
+{
+	/** Time the value was latched. */
+	absolute_time_t time;
+
+	/** Latched value. */
+	int32_t value;
+};
+
+#if PICO_DASH_HISTORY
+
+/**
+ * Record a latched value. Core 1 only.
+ * @param index Latched data index the value was latched for.
+ * @param time Time it was latched.
+ * @param value Latched value.
+ */
+void historyRecord(LatchedDataIndex index, absolute_time_t time, int32_t value);
+
+/**
+ * Get samples from a latched data index's history. Core 0 only.
+ * @param index Latched data index.
+ * @param sequence Sequence number of the first sample wanted. Samples are numbered from 0, in the order they were
+ *                 recorded. Returns the sequence number of the first sample got, which is later than the one asked for
+ *                 if that has been dropped, or the sequence number the next sample will have if there are no samples.
+ * @param samples Returns the samples, in the order they were recorded.
+ * @param maxSamples Most samples to get.
+ * @param recorded Returns the number of samples ever recorded, ie the sequence number the next sample will have.
+ * @returns Number of samples got. 0 if the index is out of bounds.
+ */
+int getHistory(LatchedDataIndex index, uint32_t* sequence, struct HistorySample* samples, int maxSamples,
+	uint32_t* recorded);
+
+/**
+ * Clear every history. Only while core 1 isn't running.
+ */
+void resetHistory();
+
+#else
+
+static inline void historyRecord(LatchedDataIndex index, absolute_time_t time, int32_t value)
+{
+	(void)index;
+	(void)time;
+	(void)value;
+}
+
+static inline void resetHistory()
+{
+}
+
+#endif
+
+#endif
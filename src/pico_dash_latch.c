@@ -1,169 +1,1036 @@
+#include <assert.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdlib.h>
 
+#include "hardware/gpio.h"
+#include "hardware/structs/scb.h"
+#include "hardware/sync.h"
+#include "hardware/timer.h"
 #include "pico/multicore.h"
 #include "pico/time.h"
 
+#include "pico_dash_adc.h"
+#include "pico_dash_calibration_tables.h"
+#include "pico_dash_config.h"
+#include "pico_dash_filter.h"
+#include "pico_dash_history.h"
 #include "pico_dash_latch.h"
+#include "pico_dash_pulse_capture.h"
+#include "pico_dash_sched.h"
+#include "pico_dash_stats.h"
+#include "pico_dash_trace.h"
 
 extern bool debugMsgActive;
 
-/** Currently latched data. */
-int _latchedData[MAX_LATCHED_INDEXES];
+// Core 1's small per strobe values live in scratch X, the SRAM bank that also holds core 1's stack, so that strobes
+// never contend with core 0 for a bank. Core 0's SPI buffers are in scratch Y for the same reason. Scratch X is only
+// 4 KB, so anything sized per channel that is more than a word, like the sensors and their filters, is in main SRAM.
+
+/** Size of scratch X, in bytes. */
+#define SCRATCH_X_SIZE 4096
+
+/** Currently latched data. Only ever accessed by core 1. Other consumers get it from the published snapshots. */
+int __scratch_x("latch") _latchedData[MAX_LATCHED_INDEXES];
+
+/** Filter of each sensor's values. Only ever accessed by core 1, which brings it into line with the sensor's config. */
+struct Filter _latchedDataFilters[MAX_LATCHED_INDEXES];
+
+/** Whether any latched data has changed since the last snapshot was published. */
+bool _latchedDataChanged = false;
+
+/**
+ * Published snapshots of latched data. Double buffered so that a snapshot can be read while the next is being written.
+ * The current snapshot is _latchedDataSnapshots[_latchedDataSnapshotSeq & 1].
+ */
+struct LatchedDataSnapshot _latchedDataSnapshots[2];
+
+/**
+ * Snapshot sequence number. Incremented by core 1 each time a snapshot is published.
+ * Readers use it to detect that the buffer they were copying was re-written under them.
+ */
+volatile uint32_t _latchedDataSnapshotSeq = 0;
+
+/** Number of times each latched data index has been flagged as changed. Only written by core 1. */
+volatile uint32_t _latchedDataChangeSeq[MAX_LATCHED_INDEXES];
+
+/** _latchedDataChangeSeq of each latched data index when its change was last got. Only accessed by core 0. */
+uint32_t _latchedDataChangeAck[MAX_LATCHED_INDEXES];
+
+/** Value of each latched data index when it was last flagged as changed. Only accessed by core 1. */
+int __scratch_x("latch") _latchedDataChangeRef[MAX_LATCHED_INDEXES];
+
+static_assert(sizeof(_latchedData) + sizeof(_latchedDataChangeRef) + PICO_CORE1_STACK_SIZE <= SCRATCH_X_SIZE,
+	"Too many latched data channels for scratch X");
+
+/** Total number of changes flagged. Only written by core 1. */
+volatile uint32_t _latchedDataChangeCount = 0;
+
+/** GPIO raised when there are changes to get. -1 for none. */
+int _latchedDataReadyGpio = -1;
 
 /** Sensors. Indexes match latched data indexes. */
 struct Sensor _sensors[MAX_LATCHED_INDEXES];
 
+/** Active sensors, by next strobe time. Only ever accessed by core 1. */
+struct SchedQueue _sensorSchedule;
+
+/** Set when sensors have been activated, deactivated or re-timed and the schedule needs rebuilding. Core 1 only. */
+bool _sensorScheduleChanged = false;
+
+/** A change to a sensor's config, queued by core 0 for core 1 to apply. */
+struct SensorConfigRecord
+{
+	/** Latched data index of the sensor. */
+	uint8_t sensorIndex;
+
+	/** Sensor variable to set (SensorData). */
+	uint8_t sensorVar;
+
+	/** Value to set it to. */
+	int32_t varVal;
+};
+
+static_assert((SENSOR_CONFIG_QUEUE_SIZE & (SENSOR_CONFIG_QUEUE_SIZE - 1)) == 0,
+	"Sensor config queue size must be a power of 2");
+static_assert(SENSOR_CONFIG_QUEUE_SIZE >= SENSOR_CONFIG_MAX_VARS,
+	"A whole sensor config must fit in the sensor config queue to be loaded as one batch");
+
+/**
+ * Sensor config changes waiting to be applied, in the order they were set. A single producer, single consumer ring.
+ * Core 0 writes records ahead of _sensorConfigCommitted and core 1 only applies them once they are committed, so a batch
+ * of changes is applied in one go, between strobes, or not at all.
+ */
+struct SensorConfigRecord _sensorConfigQueue[SENSOR_CONFIG_QUEUE_SIZE];
+
+/** Number of records ever written into the queue, committed or not. Only accessed by core 0. */
+uint32_t _sensorConfigWritten = 0;
+
+/** Number of records ever committed. Only written by core 0. */
+volatile uint32_t _sensorConfigCommitted = 0;
+
+/** Number of records ever applied. Only written by the core applying them. */
+volatile uint32_t _sensorConfigApplied = 0;
+
+/** Whether a batch of sensor config changes has been begun and not yet committed. Only accessed by core 0. */
+bool _sensorConfigBatchOpen = false;
+
+/** Whether a change in the open batch could not be set, so the batch must not be applied. Only accessed by core 0. */
+bool _sensorConfigBatchFailed = false;
+
+/**
+ * Sensor config as committed so far, starting from the defaults. This is what is saved to flash. Only accessed by
+ * core 0.
+ */
+struct SensorConfig _sensorConfig;
+
+/** Sensor config loaded from flash. Only used by core 0. */
+struct SensorConfig _loadedSensorConfig;
+
+/**
+ * Whether core 1 is running and applies committed changes. Until then core 0 applies them itself as it commits them.
+ * Only ever changed while core 1 isn't running.
+ */
+bool _sensorConfigByCore1 = false;
+
+/** Hardware alarm that wakes core 1 when the next strobe is due. */
+int _sensorAlarm = -1;
+
+/** Resolution of each channel, by latched data index. */
+const int _latchedDataResolutions[MAX_LATCHED_INDEXES] =
+{
+#define LATCHED_DATA_RESOLUTION(index, name, resolution, sensorType, strobeInterval, preScale, postScale) \
+	[index] = resolution,
+	LATCHED_DATA_CHANNELS(LATCHED_DATA_RESOLUTION)
+#undef LATCHED_DATA_RESOLUTION
+};
+
+/** Type each channel's sensor starts as, by latched data index. */
+const SensorType _latchedDataSensorTypes[MAX_LATCHED_INDEXES] =
+{
+#define LATCHED_DATA_SENSOR_TYPE(index, name, resolution, sensorType, strobeInterval, preScale, postScale) \
+	[index] = sensorType,
+	LATCHED_DATA_CHANNELS(LATCHED_DATA_SENSOR_TYPE)
+#undef LATCHED_DATA_SENSOR_TYPE
+};
+
+/** Default config of a channel's sensor. @see LATCHED_DATA_CHANNELS */
+struct LatchedDataDefaults
+{
+	/** Strobe interval in microseconds. */
+	int strobeInterval;
+
+	/** Pre and post scales of a pulse or scaled voltage sensor. */
+	int preScale;
+	int postScale;
+};
+
+/** Default config of each channel's sensor, by latched data index. Only read by initLatcher. */
+const struct LatchedDataDefaults _latchedDataDefaults[MAX_LATCHED_INDEXES] =
+{
+	[NO_LATCHED_INDEX] = {0, 1, 1},
+#define LATCHED_DATA_DEFAULTS(index, name, resolution, sensorType, strobeInterval, preScale, postScale) \
+	[index] = {strobeInterval, preScale, postScale},
+	LATCHED_DATA_CHANNELS(LATCHED_DATA_DEFAULTS)
+#undef LATCHED_DATA_DEFAULTS
+};
+
+#define LATCHED_DATA_POST_SCALE_CHECK(index, name, resolution, sensorType, strobeInterval, preScale, postScale) \
+	static_assert(postScale != 0, "Channel " name " must not default to a post-scale of 0");
+LATCHED_DATA_CHANNELS(LATCHED_DATA_POST_SCALE_CHECK)
+#undef LATCHED_DATA_POST_SCALE_CHECK
+
+/**
+ * Name of each channel packed into a word (see _latchedDataNameKey), by latched data index. Packed at compile time so a
+ * name compare is a single word compare.
+ */
+#define LATCHED_DATA_NAME_KEY(name) \
+	((uint32_t)(uint8_t)(name)[0] | (uint32_t)(uint8_t)(name)[1] << 8 | (uint32_t)(uint8_t)(name)[2] << 16)
+
+const uint32_t _latchedDataNameKeys[MAX_LATCHED_INDEXES] =
+{
+#define LATCHED_DATA_NAME(index, name, resolution, sensorType, strobeInterval, preScale, postScale) \
+	[index] = LATCHED_DATA_NAME_KEY(name),
+	LATCHED_DATA_CHANNELS(LATCHED_DATA_NAME)
+#undef LATCHED_DATA_NAME
+};
+
+/**
+ * log2 of the number of name hash table slots. Sized from the channel registry, so that there are at least twice as many
+ * slots as channels.
+ */
+#define LATCHED_DATA_NAME_SLOTS_LOG2 \
+	(MAX_LATCHED_INDEXES * 2 <= 64 ? 6 : MAX_LATCHED_INDEXES * 2 <= 128 ? 7 : MAX_LATCHED_INDEXES * 2 <= 256 ? 8 : 9)
+#define LATCHED_DATA_NAME_SLOTS (1 << LATCHED_DATA_NAME_SLOTS_LOG2)
+
+static_assert(MAX_LATCHED_INDEXES * 2 <= LATCHED_DATA_NAME_SLOTS, "Too many latched data channels for the name hash");
+static_assert(MAX_LATCHED_INDEXES <= 256, "Latched data indexes must fit in a byte");
+
+/** Name hash table. Each slot holds a latched data index, 0 for empty. Open addressed with linear probing. */
+uint8_t _latchedDataNameSlots[LATCHED_DATA_NAME_SLOTS];
+
 /** Whether this is in test mode and is producing test data rather than reading actual live input. */
 bool _testMode = false;
 
-/** Flag to trigger sensor processing loop to exit. */
-bool _exitSensorProcLoop = false;
+/** Flag to trigger sensor processing loop to exit. */
+bool _exitSensorProcLoop = false;
+
+/**
+ * Pack a name into a word. Like strncmp, characters after a null don't count.
+ */
+uint32_t __not_in_flash_func(_latchedDataNameKey)(const char* name)
+{
+	uint32_t key = 0;
+
+	for(int index = 0; index < MAX_LATCH_DATA_INDEX_NAME_SIZE && name[index]; index++)
+	{
+		key |= (uint32_t)(uint8_t)name[index] << (index * 8);
+	}
+
+	return key;
+}
+
+/** Name hash table slot to start probing for a packed name at. Fibonacci hashing. */
+static inline uint _latchedDataNameHash(uint32_t key)
+{
+	return (key * 2654435769u) >> (32 - LATCHED_DATA_NAME_SLOTS_LOG2);
+}
+
+/** Fill the name hash table from the channel registry. */
+void _initLatchedDataNames()
+{
+	memset(_latchedDataNameSlots, 0, sizeof(_latchedDataNameSlots));
+
+	for(int index = 1; index < MAX_LATCHED_INDEXES; index++)
+	{
+		uint slot = _latchedDataNameHash(_latchedDataNameKeys[index]);
+
+		while(_latchedDataNameSlots[slot])
+		{
+			if(_latchedDataNameKeys[_latchedDataNameSlots[slot]] == _latchedDataNameKeys[index] && debugMsgActive)
+			{
+				printf("Latched data index %i has the same name as %i.\n", index, _latchedDataNameSlots[slot]);
+			}
+
+			slot = (slot + 1) % LATCHED_DATA_NAME_SLOTS;
+		}
+
+		_latchedDataNameSlots[slot] = index;
+	}
+}
+
+/**
+ * Get an Analog to Digital value from the given channel.
+ * @returns The latest decimated value, 0 if the channel isn't being captured.
+ */
+int __not_in_flash_func(_getAdcValue)(int channel)
+{
+	return getAdcCaptureValue(channel);
+}
+
+void _initVoltageSensor(int sensorIndex)
+{
+	_sensors[sensorIndex].voltagePreScale = 1;
+	_sensors[sensorIndex].voltagePostScale = 1;
+}
+
+void _initPulseSensor(int sensorIndex)
+{
+	_sensors[sensorIndex].pulseCount = 0;
+	_sensors[sensorIndex].pulsePreScale = 1;
+	_sensors[sensorIndex].pulsePostScale = 1;
+	_sensors[sensorIndex].pulsePeriodThreshold = 0;
+	_sensors[sensorIndex].pulsePeriodMode = false;
+	_sensors[sensorIndex].accumIntervalStartPulseTime = 0;
+	_sensors[sensorIndex].accumIntervalEndPulseTime = 0;
+	_sensors[sensorIndex].pulseTestCurDuration = _sensors[sensorIndex].pulseTestDurationStart;
+	_sensors[sensorIndex].pulseGpio = -1;
+	_sensors[sensorIndex].pulseCaptureIndex = -1;
+	_sensors[sensorIndex].pulseEdgesConsumed = 0;
+}
+
+/** Start timestamping the pulses of a pulse sensor, if it has an input and isn't already. */
+void _startPulseCapture(int sensorIndex)
+{
+	if(_sensors[sensorIndex].pulseGpio >= 0 && _sensors[sensorIndex].pulseCaptureIndex < 0)
+	{
+		int captureIndex = startPulseCapture(_sensors[sensorIndex].pulseGpio);
+
+		if(captureIndex >= 0)
+		{
+			// Only edges from now on count.
+			_sensors[sensorIndex].pulseEdgesConsumed = getPulseCaptureCount(captureIndex);
+			_sensors[sensorIndex].pulseCaptureIndex = captureIndex;
+		}
+	}
+}
+
+/** Stop timestamping the pulses of a pulse sensor. */
+void _stopPulseCapture(int sensorIndex)
+{
+	if(_sensors[sensorIndex].pulseCaptureIndex >= 0)
+	{
+		stopPulseCapture(_sensors[sensorIndex].pulseCaptureIndex);
+		_sensors[sensorIndex].pulseCaptureIndex = -1;
+	}
+}
+
+/**
+ * Accumulate the edges captured for a pulse sensor since it was last processed.
+ * Every edge is counted, even ones whose timestamps have since been overwritten in the ring, and the interval ends on
+ * the exact time of the latest edge. Only the newest timestamp (and the oldest, to start the very first interval) is
+ * needed, so this takes the same time however many edges arrived.
+ */
+void __not_in_flash_func(_accumulatePulseEdges)(int sensorIndex, absolute_time_t curTime)
+{
+	int captureIndex = _sensors[sensorIndex].pulseCaptureIndex;
+
+	uint32_t edgeCount = getPulseCaptureCount(captureIndex);
+	uint32_t newEdges = edgeCount - _sensors[sensorIndex].pulseEdgesConsumed;
+
+	if(newEdges > 0)
+	{
+		const volatile uint32_t* ring = getPulseCaptureRing(captureIndex);
+
+		// Stamps are the low 32 bits of the edge time. Extend them using the current time, allowing for an edge stamped
+		// just after the current time was read.
+		uint32_t curTime32 = (uint32_t)curTime;
+
+		if(_sensors[sensorIndex].accumIntervalStartPulseTime == 0)
+		{
+			uint32_t firstEdgeIndex;
+			uint32_t firstEdge;
+
+			// First edge since init starts the accumulation interval at pulse count 0. If its stamp has already been
+			// overwritten then start from the oldest stamp still in the ring instead. The oldest stamp's slot is the next
+			// the capture writes, so it is skipped, and a stamp overwritten while it was read is read again further on.
+			do
+			{
+				firstEdgeIndex = edgeCount - _sensors[sensorIndex].pulseEdgesConsumed >= PULSE_CAPTURE_RING_SIZE ?
+					edgeCount - (PULSE_CAPTURE_RING_SIZE - 1) : _sensors[sensorIndex].pulseEdgesConsumed;
+
+				firstEdge = pulseCaptureEdgeTime(ring[firstEdgeIndex % PULSE_CAPTURE_RING_SIZE]);
+
+				__dmb();
+
+				edgeCount = getPulseCaptureCount(captureIndex);
+			}
+			while(edgeCount - firstEdgeIndex > PULSE_CAPTURE_RING_SIZE);
+
+			_sensors[sensorIndex].accumIntervalStartPulseTime = curTime - (int32_t)(curTime32 - firstEdge);
+			_sensors[sensorIndex].accumIntervalEndPulseTime = _sensors[sensorIndex].accumIntervalStartPulseTime;
+
+			newEdges = edgeCount - firstEdgeIndex - 1;
+		}
+
+		if(newEdges > 0)
+		{
+			uint32_t lastEdge = pulseCaptureEdgeTime(ring[(edgeCount - 1) % PULSE_CAPTURE_RING_SIZE]);
+
+			_sensors[sensorIndex].pulseCount += newEdges;
+			_sensors[sensorIndex].accumIntervalEndPulseTime = curTime - (int32_t)(curTime32 - lastEdge);
+		}
+
+		_sensors[sensorIndex].pulseEdgesConsumed = edgeCount;
+		_sensors[sensorIndex].lastEdgeState = true;
+	}
+
+	// A capture stops once it has counted PULSE_CAPTURE_MAX_EDGES, so it is restarted long before then. Only edges that
+	// arrive while it restarts are missed, and the accumulation interval carries on from the edges already counted.
+	if(edgeCount >= PULSE_CAPTURE_RESTART_EDGES)
+	{
+		TRACE(TRACE_PULSE_CAPTURE_RESTARTED, sensorIndex, captureIndex);
+
+		_stopPulseCapture(sensorIndex);
+		_startPulseCapture(sensorIndex);
+	}
+}
+
+/**
+ * Give a sensor its channel's default scales, over the ones its type starts with, and record them in the committed
+ * config.
+ */
+void _initSensorDefaultScales(int sensorIndex)
+{
+	const struct LatchedDataDefaults* defaults = _latchedDataDefaults + sensorIndex;
+
+	switch(_sensors[sensorIndex].type)
+	{
+		case SCALED_VOLTAGE_SENSOR:
+
+			_sensors[sensorIndex].voltagePreScale = defaults -> preScale;
+			_sensors[sensorIndex].voltagePostScale = defaults -> postScale;
+
+			sensorConfigSet(&_sensorConfig, sensorIndex, VOLTAGE_PRE_SCALE, defaults -> preScale);
+			sensorConfigSet(&_sensorConfig, sensorIndex, VOLTAGE_POST_SCALE, defaults -> postScale);
+			break;
+
+		case PULSE_SENSOR:
+
+			_sensors[sensorIndex].pulsePreScale = defaults -> preScale;
+			_sensors[sensorIndex].pulsePostScale = defaults -> postScale;
+
+			sensorConfigSet(&_sensorConfig, sensorIndex, PULSE_PRE_SCALE, defaults -> preScale);
+			sensorConfigSet(&_sensorConfig, sensorIndex, PULSE_POST_SCALE, defaults -> postScale);
+			break;
+
+		default:
+
+			break;
+	}
+}
+
+/** Initialise the type specific data of a sensor. */
+void _initSensor(int sensorIndex)
+{
+	_sensors[sensorIndex].voltageCalibrationTable = NO_CALIBRATION;
+
+	switch(_sensors[sensorIndex].type)
+	{
+		case SCALED_VOLTAGE_SENSOR:
+
+			_initVoltageSensor(sensorIndex);
+			break;
+
+		case PULSE_SENSOR:
+
+			_initPulseSensor(sensorIndex);
+			break;
+
+		case ON_OFF_SENSOR:
+
+			// TODO ...
+			break;
+
+		default:
+
+			break;
+	}
+}
+
+/**
+ * Filter a sensor value, latch the result and record it in the history.
+ * @param sensorIndex Sensor the value is from.
+ * @param value Value in latched data units.
+ * @param curTime Time the value was captured.
+ */
+void __not_in_flash_func(_latchSensorValue)(int sensorIndex, int value, absolute_time_t curTime)
+{
+	struct Filter* filter = _latchedDataFilters + sensorIndex;
+
+	// The config may have been changed since the last value. The filter starts afresh with the new config.
+	if(filter -> type != _sensors[sensorIndex].filterType || filter -> length != _sensors[sensorIndex].filterLength)
+	{
+		configureFilter(filter, _sensors[sensorIndex].filterType, _sensors[sensorIndex].filterLength);
+	}
+
+	value = filterUpdate(filter, value);
+
+	if(value != _latchedData[sensorIndex])
+	{
+		_latchedData[sensorIndex] = value;
+		_latchedDataChanged = true;
+	}
+
+	historyRecord(sensorIndex, curTime, value);
+}
+
+/** Process a scaled voltage sensor. */
+void __not_in_flash_func(_procVoltageSensor)(int sensorIndex, absolute_time_t curTime)
+{
+	int value = _getAdcValue(_sensors[sensorIndex].adcChannel);
+
+	int calibrationTable = _sensors[sensorIndex].voltageCalibrationTable;
+
+	if(calibrationTable > NO_CALIBRATION && calibrationTable < MAX_CALIBRATION_TABLES)
+	{
+		value = calibrate(calibrationTables[calibrationTable], value);
+	}
+
+	// 64 bit so that a pre-scale can bring out the full resolution of the decimated value without overflow.
+	int64_t scaledValue = (int64_t)value * _sensors[sensorIndex].voltagePreScale;
+
+	int latchedValue = _sensors[sensorIndex].voltagePostScale ? scaledValue / _sensors[sensorIndex].voltagePostScale : 0;
+
+	_latchSensorValue(sensorIndex, latchedValue, curTime);
+}
+
+/**
+ * Resolve pulses into a pulse sensor output value.
+ * @param pulses Number of pulses.
+ * @param pulseInterval Time, in microseconds, from the rising edge before the first pulse to the last pulse's.
+ * @returns Pulses scaled by the sensor's pre-scale, divided by the interval, then divided by its post-scale. 0 if the
+ *          interval is empty.
+ */
+int __not_in_flash_func(_resolvePulses)(int sensorIndex, int pulses, int64_t pulseInterval)
+{
+	// Pre-scale reduces loss of precision. 64 bit so that the pre-scale can't overflow however many pulses there are.
+	int64_t value = (int64_t)pulses * _sensors[sensorIndex].pulsePreScale;
+
+	value = pulseInterval > 0 ? value / pulseInterval : 0;
+
+	// Bring sensor output back to intended units.
+	return value / _sensors[sensorIndex].pulsePostScale;
+}
+
+/** Process a pulse sensor. */
+void __not_in_flash_func(_procPulseSensor)(int sensorIndex)
+{
+	absolute_time_t curTime = get_absolute_time();
+
+	if(_testMode)
+	{
+		int pulseTestCurDur = _sensors[sensorIndex].pulseTestCurDuration;
+
+		if(_sensors[sensorIndex].accumIntervalStartPulseTime == 0)
+		{
+			// First processing after init. Just set accumulation start time. This is also treated as the first edge.
+			_sensors[sensorIndex].accumIntervalStartPulseTime = curTime;
+			_sensors[sensorIndex].accumIntervalEndPulseTime = curTime;
+		}
+		else if(pulseTestCurDur > 0)
+		{
+			// Maximum pulses that fit in time interval since last read.
+			int pulseCountDelta = absolute_time_diff_us(_sensors[sensorIndex].accumIntervalEndPulseTime, curTime)
+				/ _sensors[sensorIndex].pulseTestCurDuration;
+
+			_sensors[sensorIndex].pulseCount += pulseCountDelta;
+
+			// Update accumulation interval end time to be the rising edge of the last test pulse.
+			_sensors[sensorIndex].accumIntervalEndPulseTime = delayed_by_us(_sensors[sensorIndex].accumIntervalEndPulseTime,
+				pulseCountDelta * pulseTestCurDur);
+
+			_sensors[sensorIndex].lastEdgeState = true;
+		}
+	}
+	else if(_sensors[sensorIndex].pulseCaptureIndex >= 0)
+	{
+		_accumulatePulseEdges(sensorIndex, curTime);
+	}
+
+	absolute_time_t accumEndTime = delayed_by_us(_sensors[sensorIndex].accumIntervalStartPulseTime,
+		_sensors[sensorIndex].pulseAccumulationInterval);
+
+	int pulseCount = _sensors[sensorIndex].pulseCount;
+
+	int64_t pulseInterval = absolute_time_diff_us(_sensors[sensorIndex].accumIntervalStartPulseTime,
+		_sensors[sensorIndex].accumIntervalEndPulseTime);
+
+	// Pulses too far apart for the accumulation interval to count more than a few are resolved from their period as soon
+	// as they arrive. The interval runs from edge to edge so one pulse is enough.
+	bool periodMode = _sensors[sensorIndex].pulsePeriodThreshold > 0 && pulseCount > 0 &&
+		pulseInterval > (int64_t)_sensors[sensorIndex].pulsePeriodThreshold * pulseCount;
+
+	// In period mode an accumulation interval without pulses doesn't mean zero, the next pulse is just further off.
+	if(periodMode || (accumEndTime < curTime && (pulseCount > 0 || !_sensors[sensorIndex].pulsePeriodMode)))
+	{
+		// Accumulation interval has completed or a pulse period has been measured. Resolve pulses into a sensor output
+		// value, filter and latch.
+		_latchSensorValue(sensorIndex, _resolvePulses(sensorIndex, pulseCount, pulseInterval), curTime);
+
+		_sensors[sensorIndex].pulsePeriodMode = periodMode;
+
+		// Reset interval start time to the end time so that accumulation interval resets.
+		_sensors[sensorIndex].accumIntervalStartPulseTime = _sensors[sensorIndex].accumIntervalEndPulseTime;
+
+		// Start accumulating pulses again.
+		_sensors[sensorIndex].pulseCount = 0;
+	}
+	else if(_sensors[sensorIndex].pulsePeriodMode)
+	{
+		// Waiting on the next pulse. Once it is overdue the period is at least the time since the last one, so the value
+		// falls away towards 0 rather than holding until a pulse that may never come.
+		int maxValue = _resolvePulses(sensorIndex, 1, absolute_time_diff_us(
+			_sensors[sensorIndex].accumIntervalEndPulseTime, curTime));
+
+		if(maxValue < _latchedData[sensorIndex])
+		{
+			_latchedData[sensorIndex] = maxValue;
+			_latchedDataChanged = true;
+
+			historyRecord(sensorIndex, curTime, maxValue);
+
+			// Filtering on from the older values would hold the value up once pulses resume.
+			resetFilter(_latchedDataFilters + sensorIndex);
+		}
+	}
+}
+
+/**
+ * Publish the latched data as a new snapshot. Only ever called by core 1.
+ * @param captureTime Time the latched data was captured.
+ */
+void __not_in_flash_func(_publishLatchedData)(absolute_time_t captureTime)
+{
+	uint32_t nextSeq = _latchedDataSnapshotSeq + 1;
+
+	// Write the buffer that isn't current. Readers of the current buffer are undisturbed.
+	struct LatchedDataSnapshot* snapshot = _latchedDataSnapshots + (nextSeq & 1);
+
+	snapshot -> sequence = nextSeq;
+	snapshot -> captureTime = captureTime;
+
+	for(int index = 0; index < MAX_LATCHED_INDEXES; index++)
+	{
+		snapshot -> values[index] = _latchedData[index];
+	}
+
+	// The snapshot must be complete before it is made current.
+	__dmb();
+
+	_latchedDataSnapshotSeq = nextSeq;
+
+	_latchedDataChanged = false;
+
+	// Flag the values that have moved beyond their deadband. Flagging after the snapshot is current means core 0 never
+	// reports an older value for a change.
+	bool flagged = false;
+
+	for(int index = 1; index < MAX_LATCHED_INDEXES; index++)
+	{
+		int deadband = _sensors[index].changeDeadband;
+
+		if(deadband >= 0 && abs(_latchedData[index] - _latchedDataChangeRef[index]) > deadband)
+		{
+			_latchedDataChangeRef[index] = _latchedData[index];
+			_latchedDataChangeSeq[index]++;
+			flagged = true;
+		}
+	}
+
+	if(flagged)
+	{
+		_latchedDataChangeCount++;
+
+		// The flags must be visible before the master is told about them. @see getChangedLatchedData
+		__dmb();
+
+		if(_latchedDataReadyGpio >= 0) gpio_put(_latchedDataReadyGpio, true);
+	}
+}
+
+/**
+ * Rebuild the sensor schedule after sensors have been activated, deactivated or re-timed.
+ * Newly active sensors are due straight away. Already scheduled sensors are re-timed from their last strobe.
+ */
+void _rescheduleSensors(absolute_time_t curTime)
+{
+	uint32_t adcInputMask = 0;
+
+	for(int index = 0; index < MAX_LATCHED_INDEXES; index++)
+	{
+		if(_sensors[index].active && _sensors[index].type == SCALED_VOLTAGE_SENSOR && _sensors[index].adcChannel >= 0
+			&& _sensors[index].adcChannel < MAX_ADC_INPUTS)
+		{
+			adcInputMask |= 1 << _sensors[index].adcChannel;
+		}
+
+		if(!_sensors[index].active)
+		{
+			schedQueueRemove(&_sensorSchedule, index);
+		}
+		else if(schedQueueContains(&_sensorSchedule, index))
+		{
+			schedQueueSet(&_sensorSchedule, index, delayed_by_us(_sensors[index].lastStrobeTime,
+				_sensors[index].strobeInterval));
+		}
+		else
+		{
+			schedQueueSet(&_sensorSchedule, index, curTime);
+		}
+	}
+
+	// Only capture the inputs that are in use, so each gets the largest share of the ADC.
+	setAdcCaptureInputs(adcInputMask);
+}
+
+/**
+ * Strobe a sensor and schedule its next strobe.
+ * @param index Sensor to strobe.
+ * @param deadline Time the strobe was due.
+ * @param curTime Current time.
+ */
+void __not_in_flash_func(_strobeSensor)(int index, absolute_time_t deadline, absolute_time_t curTime)
+{
+	if(!_sensors[index].active)
+	{
+		// Deactivated since the schedule was last rebuilt.
+		schedQueueRemove(&_sensorSchedule, index);
+		return;
+	}
+
+	_sensors[index].lastStrobeTime = curTime;
+
+	statsRecordStrobeLateness(index, deadline, curTime);
+
+	switch(_sensors[index].type)
+	{
+		case SCALED_VOLTAGE_SENSOR:
+
+			_procVoltageSensor(index, curTime);
+			break;
+
+		case PULSE_SENSOR:
+
+			_procPulseSensor(index);
+			break;
+
+		case ON_OFF_SENSOR:
+
+			break;
+
+		default:
+
+			break;
+	}
+
+	// Strobes are kept on a fixed rate from the original deadline so that processing time doesn't accumulate as drift.
+	absolute_time_t nextStrobeTime = delayed_by_us(deadline, _sensors[index].strobeInterval);
+
+	if(nextStrobeTime <= curTime)
+	{
+		// Drop the strobes that have been missed rather than run them back to back to catch up.
+		_sensors[index].deadlineMisses++;
+
+		// Always at least a microsecond on, so even a zero strobe interval can't hold core 1 in this pass.
+		nextStrobeTime = delayed_by_us(curTime, _sensors[index].strobeInterval > 0 ? _sensors[index].strobeInterval : 1);
+	}
+
+	schedQueueSet(&_sensorSchedule, index, nextStrobeTime);
+}
+
+/**
+ * Set a sensor variable. Only ever called by the core applying sensor config, which is core 1 once it is running.
+ * The variable and value have already been checked.
+ */
+void _applySensorData(LatchedDataIndex sensorIndex, SensorData sensorVar, int varVal)
+{
+	switch(sensorVar)
+	{
+		case ACTIVE:
+
+			// Pulse capture must be running before the sensor is strobed, and only stopped after it isn't.
+			if(varVal > 0)
+			{
+				if(_sensors[sensorIndex].type == PULSE_SENSOR)
+				{
+					_startPulseCapture(sensorIndex);
+				}
+
+				_sensors[sensorIndex].active = true;
+			}
+			else
+			{
+				_sensors[sensorIndex].active = false;
+
+				if(_sensors[sensorIndex].type == PULSE_SENSOR)
+				{
+					_stopPulseCapture(sensorIndex);
+				}
+			}
+
+			_sensorScheduleChanged = true;
+			break;
+
+		case STROBE_INTERVAL:
+
+			_sensors[sensorIndex].strobeInterval = varVal;
+			_sensorScheduleChanged = true;
+			break;
+
+		case ADC_CHANNEL:
+
+			_sensors[sensorIndex].adcChannel = varVal;
+			_sensorScheduleChanged = true;
+			break;
+
+		case PULSE_ACCUMULATION_INTERVAL:
+
+			_sensors[sensorIndex].pulseAccumulationInterval = varVal;
+			break;
+
+		case PULSE_PRE_SCALE:
+
+			_sensors[sensorIndex].pulsePreScale = varVal;
+			break;
+
+		case PULSE_POST_SCALE:
+
+			_sensors[sensorIndex].pulsePostScale = varVal;
+			break;
+
+		case PULSE_TEST_DURATION_START:
+
+			_sensors[sensorIndex].pulseTestDurationStart = varVal;
+			_sensors[sensorIndex].pulseTestCurDuration = varVal;
+			break;
+
+		case PULSE_TEST_DURATION_END:
+
+			_sensors[sensorIndex].pulseTestDurationEnd = varVal;
+			break;
+
+		case PULSE_TEST_DURATION_STEP:
+
+			_sensors[sensorIndex].pulseTestDurationStep = varVal;
+			break;
+
+		case PULSE_TEST_STEP_TIME_INTERVAL:
+
+			_sensors[sensorIndex].pulseTestStepTimeInterval = varVal;
+			break;
+
+		case SENSOR_TYPE:
+
+			if(_sensors[sensorIndex].type == PULSE_SENSOR)
+			{
+				_stopPulseCapture(sensorIndex);
+			}
+
+			_sensors[sensorIndex].type = varVal;
+			_initSensor(sensorIndex);
+			_sensorScheduleChanged = true;
+			break;
+
+		case PULSE_GPIO:
+
+			// Takes effect the next time the sensor is made active.
+			_sensors[sensorIndex].pulseGpio = varVal;
+			break;
+
+		case PULSE_PERIOD_THRESHOLD:
+
+			_sensors[sensorIndex].pulsePeriodThreshold = varVal;
+			break;
+
+		case FILTER_TYPE:
+
+			_sensors[sensorIndex].filterType = varVal;
+			break;
+
+		case FILTER_LENGTH:
+
+			_sensors[sensorIndex].filterLength = varVal;
+			break;
+
+		case VOLTAGE_PRE_SCALE:
+
+			_sensors[sensorIndex].voltagePreScale = varVal;
+			break;
+
+		case VOLTAGE_POST_SCALE:
+
+			_sensors[sensorIndex].voltagePostScale = varVal;
+			break;
+
+		case CHANGE_DEADBAND:
 
-/** Get an Analog to Digital value from the given channel. */
-int _getAdcValue(int channel)
-{
-	// TODO ...
+			_sensors[sensorIndex].changeDeadband = varVal;
+			break;
 
-	// Just return 0 for now so that at least something is available before test mode is invoked.
-	return 0;
-}
+		case VOLTAGE_CALIBRATION_TABLE:
 
-void _initPulseSensor(int sensorIndex)
-{
-	_sensors[sensorIndex].pulseCount = 0;
-	_sensors[sensorIndex].pulsePreScale = 1;
-	_sensors[sensorIndex].pulsePostScale = 1;
-	_sensors[sensorIndex].accumIntervalStartPulseTime = 0;
-	_sensors[sensorIndex].accumIntervalEndPulseTime = 0;
-}
+			_sensors[sensorIndex].voltageCalibrationTable = varVal;
+			break;
 
-/** Process a pulse sensor. */
-void _procPulseSensor(int sensorIndex)
-{
-	absolute_time_t curTime = get_absolute_time();
+		default:
 
-	if(_sensors[sensorIndex].accumIntervalStartPulseTime == 0)
-	{
-		// First processing after init. Just set accumulation start time.
-		_sensors[sensorIndex].accumIntervalStartPulseTime = curTime;
+			// Checked before it was queued, so never applied.
+			TRACE(TRACE_SENSOR_VARIABLE_OUT_OF_BOUNDS, sensorVar, 0);
+			break;
 	}
-	else if(_testMode)
-	{
-		int pulseTestCurDur = _sensors[sensorIndex].pulseTestCurDuration;
+}
 
-		if(pulseTestCurDur > 0)
-		{
-			// Maximum pulses that fit in time interval since last read.
-			int pulseCountDelta = absolute_time_diff_us(curTime, _sensors[sensorIndex].accumIntervalEndPulseTime)
-				/ _sensors[sensorIndex].pulseTestCurDuration;
+/**
+ * Apply every committed sensor config change, in the order they were set. Only ever called by the core applying
+ * sensor config.
+ */
+void _applySensorConfig()
+{
+	uint32_t committed = _sensorConfigCommitted;
 
-			_sensors[sensorIndex].pulseCount += pulseCountDelta;
+	// Don't read the records before seeing the commit that covers them.
+	__dmb();
 
-			// Update accumulation interval end time to be the rising edge of the last test pulse.
-			_sensors[sensorIndex].accumIntervalEndPulseTime = delayed_by_us(_sensors[sensorIndex].accumIntervalEndPulseTime,
-				pulseCountDelta * pulseTestCurDur);
+	uint32_t applied = _sensorConfigApplied;
 
-			_sensors[sensorIndex].lastEdgeState = true;
-		}
-	}
-	else
+	while(applied != committed)
 	{
-		// TODO ... Get ADC data for channel and determine if pulse occurred.
-		// Don't forget to store edge state so multiple samples of the same edge don't trigger multiple pulses.
-	}
+		struct SensorConfigRecord* record = _sensorConfigQueue + (applied & (SENSOR_CONFIG_QUEUE_SIZE - 1));
 
-	absolute_time_t accumEndTime = delayed_by_us(_sensors[sensorIndex].accumIntervalStartPulseTime,
-		_sensors[sensorIndex].pulseAccumulationInterval);
-
-	if(accumEndTime < curTime)
-	{
-		// Accumulation interval has completed. Resolve pulses into a sensor output value.
+		_applySensorData(record -> sensorIndex, record -> sensorVar, record -> varVal);
 
-		// Pre-scale reduces loss of precision.
-		int latchedValue =  _sensors[sensorIndex].pulseCount * _sensors[sensorIndex].pulsePreScale;
+		applied++;
+	}
 
-		latchedValue /= absolute_time_diff_us(_sensors[sensorIndex].accumIntervalStartPulseTime,
-			_sensors[sensorIndex].accumIntervalEndPulseTime);
+	// The records must be finished with before core 0 can reuse their slots.
+	__dmb();
 
-		// Bring sensor output back to intended units and latch.
-		_latchedData[sensorIndex] = latchedValue / _sensors[sensorIndex].pulsePostScale;
+	_sensorConfigApplied = applied;
+}
 
-		// Reset interval start time to the end time so that accumulation interval resets.
-		_sensors[sensorIndex].accumIntervalStartPulseTime = _sensors[sensorIndex].accumIntervalEndPulseTime;
+/** Called when the sensor alarm fires. */
+void __not_in_flash_func(_sensorAlarmCallback)(uint alarmNum)
+{
+	(void)alarmNum;
 
-		// Start accumulating pulses again.
-		_sensors[sensorIndex].pulseCount = 0;
-	}
+	// Nothing to do. The interrupt is all that's needed to wake core 1 from WFE.
 }
 
-/** Main sensor processing loop. */
-void _sensorProcLoop()
+/** Main sensor processing loop. Sleeps until the next strobe is due. */
+void __not_in_flash_func(_sensorProcLoop)()
 {
 	while(!_exitSensorProcLoop)
 	{
-		for(int index = 0; index < MAX_LATCHED_INDEXES; index++)
+		// Config changes are only ever applied here, between strobes, so no strobe sees half of a batch.
+		if(_sensorConfigCommitted != _sensorConfigApplied) _applySensorConfig();
+
+		if(_sensorScheduleChanged)
 		{
-			if(_sensors[index].active)
-			{
-				absolute_time_t curPollTime = get_absolute_time();
+			_sensorScheduleChanged = false;
 
-				if(absolute_time_diff_us(_sensors[index].lastStrobeTime, curPollTime) > _sensors[index].strobeInterval)
-				{
-					_sensors[index].lastStrobeTime = curPollTime;
+			_rescheduleSensors(get_absolute_time());
+		}
 
-					switch(_sensors[index].type)
-					{
-						case SCALED_VOLTAGE_SENSOR:
+		// Decimate each ADC buffer as soon as it completes, before DMA comes back round to it. The DMA interrupt wakes
+		// core 1 for this.
+		processAdcCapture();
 
-							break;
+		absolute_time_t curTime = get_absolute_time();
 
-						case PULSE_SENSOR:
+		const struct SchedEntry* next;
 
-							_procPulseSensor(index);
-							break;
+		while((next = schedQueuePeek(&_sensorSchedule)) && next -> deadline <= curTime)
+		{
+			_strobeSensor(next -> id, next -> deadline, curTime);
+		}
 
-						case ON_OFF_SENSOR:
+		// Everything latched in the same pass is published together.
+		if(_latchedDataChanged) _publishLatchedData(get_absolute_time());
 
-							break;
-					}
-				}
-			}
+		next = schedQueuePeek(&_sensorSchedule);
+
+		// Sleep until the alarm for the next strobe fires, or core 0 commits sensor config. If the next strobe is already
+		// due the alarm isn't armed and the loop goes straight round again.
+		if(!next || !hardware_alarm_set_target(_sensorAlarm, next -> deadline))
+		{
+			__wfe();
 		}
 	}
+
+	hardware_alarm_cancel(_sensorAlarm);
+
+	setAdcCaptureInputs(0);
 }
 
 void initLatcher()
 {
+	_initLatchedDataNames();
+
+	memset(&_sensorConfig, 0, sizeof(_sensorConfig));
+
 	for(int index = 0; index < MAX_LATCHED_INDEXES; index++)
 	{
+		_sensors[index].type = _latchedDataSensorTypes[index];
 		_sensors[index].active = false;
+		_sensors[index].strobeInterval = _latchedDataDefaults[index].strobeInterval;
+		_sensors[index].adcChannel = 0;
 
 		_sensors[index].lastStrobeTime = 0;
+		_sensors[index].deadlineMisses = 0;
+		_sensors[index].changeDeadband = -1;
+		_sensors[index].filterType = FILTER_NONE;
+		_sensors[index].filterLength = 1;
+
+		// Every variable SENSOR_TYPE doesn't reset starts out set, so that loading a config always sets it.
+		sensorConfigSet(&_sensorConfig, index, SENSOR_TYPE, _sensors[index].type);
+		sensorConfigSet(&_sensorConfig, index, ACTIVE, 0);
+		sensorConfigSet(&_sensorConfig, index, STROBE_INTERVAL, _sensors[index].strobeInterval);
+		sensorConfigSet(&_sensorConfig, index, ADC_CHANNEL, 0);
+		sensorConfigSet(&_sensorConfig, index, CHANGE_DEADBAND, -1);
+		sensorConfigSet(&_sensorConfig, index, FILTER_TYPE, FILTER_NONE);
+		sensorConfigSet(&_sensorConfig, index, FILTER_LENGTH, 1);
+
+		_latchedDataChangeSeq[index] = 0;
+		_latchedDataChangeAck[index] = 0;
+		_latchedDataChangeRef[index] = 0;
+
+		_initSensor(index);
+		_initSensorDefaultScales(index);
+	}
 
-		switch(_sensors[index].type)
-		{
-			case SCALED_VOLTAGE_SENSOR:
-
-				// TODO ...
-				break;
-
-			case PULSE_SENSOR:
+	schedQueueInit(&_sensorSchedule);
+	_sensorScheduleChanged = false;
 
-				_initPulseSensor(index);
-				break;
+	resetHistory();
 
-			case ON_OFF_SENSOR:
+	_sensorConfigWritten = 0;
+	_sensorConfigCommitted = 0;
+	_sensorConfigApplied = 0;
+	_sensorConfigBatchOpen = false;
+	_sensorConfigBatchFailed = false;
+	_sensorConfigByCore1 = false;
 
-				// TODO ...
-				break;
-		}
-	}
+	// Restore the saved config, so the sensors are running as soon as core 1 starts without the master setting them up.
+	if(loadSensorConfig()) TRACE(TRACE_SENSOR_CONFIG_LOADED, 0, 0);
 }
 
 void _coreEntry()
 {
+	// The alarm interrupt must be taken by this core so that it wakes this core's WFE.
+	// SEVONPEND makes sure it does even if it arrives between arming the alarm and WFE.
+	scb_hw -> scr |= M0PLUS_SCR_SEVONPEND_BITS;
+
+	// Core 0 pauses this core while it saves the sensor config to flash.
+	configFlashCoreInit();
+
+	_sensorAlarm = hardware_alarm_claim_unused(true);
+	hardware_alarm_set_callback(_sensorAlarm, _sensorAlarmCallback);
+
 	_sensorProcLoop();
+
+	hardware_alarm_set_callback(_sensorAlarm, 0);
+	hardware_alarm_unclaim(_sensorAlarm);
 }
 
 void startLatcher()
@@ -174,74 +1041,297 @@ void startLatcher()
 		_latchedData[index] = 0;
 	}
 
+	_publishLatchedData(get_absolute_time());
+
+	// Anything set before now has already been applied.
+	_sensorConfigByCore1 = true;
+
 	multicore_launch_core1(_coreEntry);
 }
 
-int getLatchedDataIndex(const char* latchedDataIndexName)
+int __not_in_flash_func(getLatchedDataIndex)(const char* latchedDataIndexName)
 {
-	int retVal = -1;
+	uint32_t key = _latchedDataNameKey(latchedDataIndexName);
 
-	if(!strncmp("ERM", latchedDataIndexName, MAX_LATCH_DATA_INDEX_NAME_SIZE))
+	// Probe from the key's slot until the name or an empty slot is found. Less than half the slots are used so this is
+	// usually the first one.
+	for(uint slot = _latchedDataNameHash(key); _latchedDataNameSlots[slot]; slot = (slot + 1) % LATCHED_DATA_NAME_SLOTS)
 	{
-		retVal = ENGINE_RPM;
+		if(_latchedDataNameKeys[_latchedDataNameSlots[slot]] == key)
+		{
+			return _latchedDataNameSlots[slot];
+		}
 	}
-	else if(!strncmp("SKH", latchedDataIndexName, MAX_LATCH_DATA_INDEX_NAME_SIZE))
+
+	return -1;
+}
+
+int __not_in_flash_func(getLatchedDataResolution)(LatchedDataIndex index)
+{
+	return index < MAX_LATCHED_INDEXES ? _latchedDataResolutions[index] : 0;
+}
+
+int __not_in_flash_func(getLatchedData)(LatchedDataIndex index)
+{
+
+	// NOTE: Because latched values are a single word and the Cortex M0+ doesn't have a data cache and the AHB-lite crossbar
+	//       will stall any of the cores while the other is accessing a particular data location, it should be perfectly
+	//       safe _not_ to have synchronisation here. At worst the value comes from a snapshot newer than the one that was
+	//       current when the read started. Use getLatchedDataSnapshot when several values must be consistent.
+
+	if(index < MAX_LATCHED_INDEXES)
 	{
-		retVal = SPEED_KMH;
+		return _latchedDataSnapshots[_latchedDataSnapshotSeq & 1].values[index];
 	}
-	else if(!strncmp("ETC", latchedDataIndexName, MAX_LATCH_DATA_INDEX_NAME_SIZE))
+	else
 	{
-		retVal = ENGINE_TEMP_C;
+		TRACE(TRACE_LATCHED_DATA_INDEX_OUT_OF_BOUNDS, index, 0);
 	}
 
-	return retVal;
+	return 0;
+}
+
+void __not_in_flash_func(getLatchedDataSnapshot)(struct LatchedDataSnapshot* snapshot)
+{
+	uint32_t seq;
+
+	do
+	{
+		seq = _latchedDataSnapshotSeq;
+
+		__dmb();
+
+		*snapshot = _latchedDataSnapshots[seq & 1];
+
+		// The copy must be complete before the sequence is checked again.
+		__dmb();
+	}
+	// Core 1 only re-writes this buffer after publishing the other one, which moves the sequence on.
+	while(seq != _latchedDataSnapshotSeq);
+}
+
+void setLatchedDataReadyGpio(int gpio)
+{
+	_latchedDataReadyGpio = gpio;
+}
+
+int __not_in_flash_func(getChangedLatchedData)(uint8_t* indexes, int* values, int maxChanges)
+{
+	uint32_t changeCount = _latchedDataChangeCount;
+
+	// Read the flags before the snapshot. Core 1 only flags a change once the snapshot holding it is current, so the
+	// snapshot is never older than a flag that was seen.
+	uint32_t changeSeqs[MAX_LATCHED_INDEXES];
+
+	__dmb();
+
+	for(int index = 1; index < MAX_LATCHED_INDEXES; index++)
+	{
+		changeSeqs[index] = _latchedDataChangeSeq[index];
+	}
+
+	__dmb();
+
+	struct LatchedDataSnapshot snapshot;
+	getLatchedDataSnapshot(&snapshot);
+
+	int changes = 0;
+	bool moreChanges = false;
+
+	for(int index = 1; index < MAX_LATCHED_INDEXES; index++)
+	{
+		if(changeSeqs[index] != _latchedDataChangeAck[index])
+		{
+			if(changes < maxChanges)
+			{
+				indexes[changes] = index;
+				values[changes] = snapshot.values[index];
+				changes++;
+
+				_latchedDataChangeAck[index] = changeSeqs[index];
+			}
+			else
+			{
+				moreChanges = true;
+			}
+		}
+	}
+
+	if(_latchedDataReadyGpio >= 0)
+	{
+		gpio_put(_latchedDataReadyGpio, false);
+
+		// Core 1 raises the GPIO after counting a change. If it counted one that wasn't got here then either it raises the
+		// GPIO after it was lowered here, or the count has moved on and it's raised again here. At worst the master gets
+		// an empty response.
+		__dmb();
+
+		if(moreChanges || changeCount != _latchedDataChangeCount) gpio_put(_latchedDataReadyGpio, true);
+	}
+
+	return changes;
+}
+
+uint32_t getSensorDeadlineMisses(LatchedDataIndex index)
+{
+	return index < MAX_LATCHED_INDEXES ? _sensors[index].deadlineMisses : 0;
+}
+
+/** Commit every sensor config change written so far, for core 1 to apply at its next pass, or apply them now. */
+void __not_in_flash_func(_commitSensorConfig)()
+{
+	for(uint32_t committed = _sensorConfigCommitted; committed != _sensorConfigWritten; committed++)
+	{
+		struct SensorConfigRecord* record = _sensorConfigQueue + (committed & (SENSOR_CONFIG_QUEUE_SIZE - 1));
+
+		sensorConfigSet(&_sensorConfig, record -> sensorIndex, record -> sensorVar, record -> varVal);
+	}
+
+	// The records must be complete before core 1 can see them.
+	__dmb();
+
+	_sensorConfigCommitted = _sensorConfigWritten;
+
+	if(_sensorConfigByCore1)
+	{
+		// Wake core 1 to apply them.
+		__sev();
+	}
+	else
+	{
+		_applySensorConfig();
+	}
 }
 
-int getLatchedDataResolution(LatchedDataIndex index)
+/**
+ * Whether a value is in bounds for a sensor variable. Variables without bounds take any value.
+ */
+bool __not_in_flash_func(_sensorDataInBounds)(SensorData sensorVar, int varVal)
 {
-	int retVal = 0;
+	bool retVal = true;
 
-	switch (index)
+	switch(sensorVar)
 	{
-		case ENGINE_RPM:
+		case SENSOR_TYPE:
+
+			if(varVal < SCALED_VOLTAGE_SENSOR || varVal >= MAX_SENSOR_TYPES)
+			{
+				retVal = false;
+
+				TRACE(TRACE_SENSOR_DATA_OUT_OF_BOUNDS, sensorVar, varVal);
+			}
+			break;
+
+		case ADC_CHANNEL:
+
+			if(varVal < 0 || varVal >= MAX_ADC_INPUTS)
+			{
+				retVal = false;
+
+				TRACE(TRACE_SENSOR_DATA_OUT_OF_BOUNDS, sensorVar, varVal);
+			}
+			break;
+
+		case PULSE_GPIO:
+
+			// Goes straight to the pulse capture to set up the pin.
+			if(varVal < -1 || varVal >= NUM_BANK0_GPIOS)
+			{
+				retVal = false;
+
+				TRACE(TRACE_SENSOR_DATA_OUT_OF_BOUNDS, sensorVar, varVal);
+			}
+			break;
+
+		case PULSE_POST_SCALE:
+
+			// Every pulse sensor value is divided by it.
+			if(varVal == 0)
+			{
+				retVal = false;
+
+				TRACE(TRACE_SENSOR_DATA_OUT_OF_BOUNDS, sensorVar, varVal);
+			}
+			break;
+
+		case FILTER_TYPE:
+
+			if(varVal < FILTER_NONE || varVal >= MAX_FILTER_TYPES)
+			{
+				retVal = false;
+
+				TRACE(TRACE_FILTER_OUT_OF_BOUNDS, varVal, 0);
+			}
+			break;
 
-			retVal = 1;
+		case FILTER_LENGTH:
+
+			if(varVal < 1 || varVal > FILTER_MAX_LENGTH)
+			{
+				retVal = false;
+
+				TRACE(TRACE_FILTER_OUT_OF_BOUNDS, varVal, 0);
+			}
 			break;
 
-		case SPEED_KMH:
+		case VOLTAGE_CALIBRATION_TABLE:
 
-			retVal = 1;
+			if(varVal < 0 || varVal >= MAX_CALIBRATION_TABLES)
+			{
+				retVal = false;
+
+				TRACE(TRACE_CALIBRATION_TABLE_OUT_OF_BOUNDS, varVal, 0);
+			}
 			break;
 
-		case ENGINE_TEMP_C:
+		default:
 
-			retVal = 10;
 			break;
 	}
 
 	return retVal;
 }
 
-int getLatchedData(LatchedDataIndex index)
+/**
+ * Get the type a sensor will be once every change written so far is applied, committed or not. Core 0 only.
+ */
+SensorType __not_in_flash_func(_writtenSensorType)(LatchedDataIndex sensorIndex)
 {
+	// SENSOR_TYPE is always set in the committed config.
+	SensorType retVal = _sensorConfig.values[sensorIndex][SENSOR_TYPE];
 
-	// NOTE: Because latched values are a single word and the Cortex M0+ doesn't have a data cache and the AHB-lite crossbar
-	//       will stall any of the cores while the other is accessing a particular data location, it should be perfectly
-	//       safe _not_ to have synchronisation here.
-
-	if(index < MAX_LATCHED_INDEXES)
+	for(uint32_t committed = _sensorConfigCommitted; committed != _sensorConfigWritten; committed++)
 	{
-		return _latchedData[index];
+		struct SensorConfigRecord* record = _sensorConfigQueue + (committed & (SENSOR_CONFIG_QUEUE_SIZE - 1));
+
+		if(record -> sensorIndex == sensorIndex && record -> sensorVar == SENSOR_TYPE) retVal = record -> varVal;
 	}
-	else if(debugMsgActive)
+
+	return retVal;
+}
+
+/**
+ * Whether a sensor variable is used by a sensor as it will be once every change written so far is applied. Type
+ * specific variables share storage with the other types', so one set on the wrong type would corrupt the sensor.
+ */
+bool __not_in_flash_func(_sensorDataForType)(LatchedDataIndex sensorIndex, SensorData sensorVar)
+{
+	bool retVal = true;
+
+	if((1u << sensorVar) & SENSOR_CONFIG_TYPE_SPECIFIC_MASK)
 	{
-		printf("Latched data index %i out of bounds.\n", index);
+		SensorType type = _writtenSensorType(sensorIndex);
+
+		retVal = (1u << sensorVar) & (type == PULSE_SENSOR ? SENSOR_CONFIG_PULSE_MASK :
+			type == SCALED_VOLTAGE_SENSOR ? SENSOR_CONFIG_VOLTAGE_MASK : 0);
+
+		if(!retVal) TRACE(TRACE_SENSOR_VARIABLE_WRONG_TYPE, sensorVar, type);
 	}
 
-	return 0;
+	return retVal;
 }
 
-bool setSensorData(LatchedDataIndex sensorIndex, SensorData sensorVar, int varVal)
+bool __not_in_flash_func(setSensorData)(LatchedDataIndex sensorIndex, SensorData sensorVar, int varVal)
 {
 	bool retVal = false;
 
@@ -249,69 +1339,147 @@ bool setSensorData(LatchedDataIndex sensorIndex, SensorData sensorVar, int varVa
 	{
 		if(sensorVar < MAX_SENSOR_DATA)
 		{
-			switch(sensorVar)
+			if(_sensorDataInBounds(sensorVar, varVal) && _sensorDataForType(sensorIndex, sensorVar))
 			{
-				case ACTIVE:
+				if(_sensorConfigWritten - _sensorConfigApplied < SENSOR_CONFIG_QUEUE_SIZE)
+				{
+					struct SensorConfigRecord* record = _sensorConfigQueue
+						+ (_sensorConfigWritten & (SENSOR_CONFIG_QUEUE_SIZE - 1));
+
+					record -> sensorIndex = sensorIndex;
+					record -> sensorVar = sensorVar;
+					record -> varVal = varVal;
+
+					_sensorConfigWritten++;
+
+					// Outside a batch every change stands alone.
+					if(!_sensorConfigBatchOpen) _commitSensorConfig();
+
+					retVal = true;
+				}
+				else
+				{
+					TRACE(TRACE_SENSOR_CONFIG_QUEUE_FULL, sensorIndex, sensorVar);
+				}
+			}
+		}
+		else
+		{
+			TRACE(TRACE_SENSOR_VARIABLE_OUT_OF_BOUNDS, sensorVar, 0);
+		}
+	}
+	else
+	{
+		TRACE(TRACE_SENSOR_INDEX_OUT_OF_BOUNDS, sensorIndex, 0);
+	}
 
-					_sensors[sensorIndex].active = varVal > 0;
-					break;
+	if(!retVal && _sensorConfigBatchOpen) _sensorConfigBatchFailed = true;
 
-				case STROBE_INTERVAL:
+	return retVal;
+}
 
-					_sensors[sensorIndex].strobeInterval = varVal;
-					break;
+void __not_in_flash_func(beginSensorDataBatch)()
+{
+	if(!_sensorConfigBatchOpen)
+	{
+		_sensorConfigBatchOpen = true;
+		_sensorConfigBatchFailed = false;
+	}
+}
 
-				case ADC_CHANNEL:
+bool __not_in_flash_func(commitSensorDataBatch)()
+{
+	bool retVal = !_sensorConfigBatchFailed;
 
-					_sensors[sensorIndex].adcChannel = varVal;
-					break;
+	if(retVal)
+	{
+		_commitSensorConfig();
+	}
+	else
+	{
+		// Core 1 never looks beyond the committed records, so the batch can simply be written over.
+		_sensorConfigWritten = _sensorConfigCommitted;
+	}
 
-				case PULSE_ACCUMULATION_INTERVAL:
+	_sensorConfigBatchOpen = false;
+	_sensorConfigBatchFailed = false;
 
-					_sensors[sensorIndex].pulseAccumulationInterval = varVal;
-					break;
+	return retVal;
+}
 
-				case PULSE_PRE_SCALE:
+bool __not_in_flash_func(setSensorConfig)(LatchedDataIndex sensorIndex, uint32_t setMask, const int32_t* values)
+{
+	bool batchOpen = _sensorConfigBatchOpen;
 
-					_sensors[sensorIndex].pulsePreScale = varVal;
-					break;
+	bool retVal = sensorIndex < MAX_LATCHED_INDEXES;
 
-				case PULSE_POST_SCALE:
+	if(!retVal) TRACE(TRACE_SENSOR_INDEX_OUT_OF_BOUNDS, sensorIndex, 0);
 
-					_sensors[sensorIndex].pulsePostScale = varVal;
-					break;
+	if(retVal && setMask & ~SENSOR_CONFIG_ALL_MASK)
+	{
+		retVal = false;
 
-				case PULSE_TEST_DURATION_START:
+		TRACE(TRACE_SENSOR_CONFIG_MASK_OUT_OF_BOUNDS, setMask, 0);
+	}
 
-					_sensors[sensorIndex].pulseTestDurationStart = varVal;
-					break;
+	beginSensorDataBatch();
 
-				case PULSE_TEST_DURATION_END:
+	// In restore order, so the type is set before the values it resets and the sensor is only activated once set up.
+	for(SensorData sensorVar = sensorConfigNextVar(0); retVal && sensorVar < MAX_SENSOR_DATA;
+		sensorVar = sensorConfigNextVar(sensorVar))
+	{
+		if(setMask & (1u << sensorVar)) retVal = setSensorData(sensorIndex, sensorVar, values[sensorVar]);
+	}
 
-					_sensors[sensorIndex].pulseTestDurationEnd = varVal;
-					break;
+	// Inside a bigger batch the whole of it fails.
+	if(!retVal) _sensorConfigBatchFailed = true;
 
-				case PULSE_TEST_DURATION_STEP:
+	if(!batchOpen) retVal = commitSensorDataBatch();
 
-					_sensors[sensorIndex].pulseTestDurationStep = varVal;
-					break;
+	return retVal;
+}
 
-				case PULSE_TEST_STEP_TIME_INTERVAL:
+uint32_t __not_in_flash_func(getSensorConfig)(LatchedDataIndex sensorIndex, int32_t* values)
+{
+	uint32_t retVal = 0;
 
-					_sensors[sensorIndex].pulseTestStepTimeInterval = varVal;
-					break;
-			}
+	if(sensorIndex < MAX_LATCHED_INDEXES)
+	{
+		retVal = _sensorConfig.setMask[sensorIndex];
 
-			retVal = true;
-		}
-		else if(debugMsgActive)
+		for(int sensorVar = 0; sensorVar < MAX_SENSOR_DATA; sensorVar++)
 		{
-			printf("Sensor data variable index %i out of bounds.\n", sensorVar);
+			values[sensorVar] = retVal & (1u << sensorVar) ? _sensorConfig.values[sensorIndex][sensorVar] : 0;
 		}
 	}
-	else if(debugMsgActive)
+
+	return retVal;
+}
+
+bool saveSensorConfig()
+{
+	bool retVal = sensorConfigSave(&_sensorConfig);
+
+	if(!retVal) TRACE(TRACE_SENSOR_CONFIG_SAVE_FAILED, 0, 0);
+
+	return retVal;
+}
+
+bool loadSensorConfig()
+{
+	bool retVal = !_sensorConfigBatchOpen && sensorConfigLoad(&_loadedSensorConfig);
+
+	if(retVal)
 	{
-		printf("Sensor index %i out of bounds.\n", sensorIndex);
+		// One batch, so core 1 goes straight from the old config to the loaded one.
+		beginSensorDataBatch();
+
+		for(int index = 1; index < MAX_LATCHED_INDEXES; index++)
+		{
+			setSensorConfig(index, _loadedSensorConfig.setMask[index], _loadedSensorConfig.values[index]);
+		}
+
+		retVal = commitSensorDataBatch();
 	}
 
 	return retVal;
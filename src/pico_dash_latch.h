@@ -5,10 +5,29 @@
 
 #include "pico/time.h"
 
+#include "pico_dash_channels.h"
+
 // Anything to do with latching.
 
 #define MAX_LATCH_DATA_INDEX_NAME_SIZE 3
 
+/**
+ * Smallest power of 2, from 64 to 65536, that is at least n. For sizing buffers to the channel registry.
+ */
+#define LATCH_POW2_AT_LEAST(n) \
+	((n) <= 64 ? 64 : (n) <= 128 ? 128 : (n) <= 256 ? 256 : (n) <= 512 ? 512 : (n) <= 1024 ? 1024 : \
+	(n) <= 2048 ? 2048 : (n) <= 4096 ? 4096 : (n) <= 8192 ? 8192 : (n) <= 16384 ? 16384 : (n) <= 32768 ? 32768 : 65536)
+
+/** Most sensor variables there are to set, ie every variable of every sensor. The size of a whole sensor config. */
+#define SENSOR_CONFIG_MAX_VARS ((MAX_LATCHED_INDEXES - 1) * (MAX_SENSOR_DATA - 1))
+
+/**
+ * Most sensor config changes that can wait to be applied by core 1. Must be a power of 2. Core 1 applies them at its
+ * next pass, so the queue only fills if more than this are set in one batch or while core 1 is held up. Sized from the
+ * channel registry to hold a whole sensor config, so that loading one is a single batch.
+ */
+#define SENSOR_CONFIG_QUEUE_SIZE LATCH_POW2_AT_LEAST(SENSOR_CONFIG_MAX_VARS)
+
 /** Maximum number of Analog to Digital converter channels. */
 #define MAX_ADC_CHANNELS 16
 
@@ -24,7 +43,10 @@ typedef enum
 	PULSE_SENSOR,
 
 	/** Simple on/off state. */
-	ON_OFF_SENSOR
+	ON_OFF_SENSOR,
+
+	/** Must always be last to indicate the end of the enum. */
+	MAX_SENSOR_TYPES
 
 } SensorType;
 
@@ -45,6 +67,44 @@ typedef enum
 	PULSE_TEST_DURATION_END,
 	PULSE_TEST_DURATION_STEP,
 	PULSE_TEST_STEP_TIME_INTERVAL,
+	/**
+	 * Type of sensor (enum SensorType). Resets any type specific data so must be set before the type specific values.
+	 * @note Placed after the original values so that their ids don't change.
+	 */
+	SENSOR_TYPE,
+	/**
+	 * GPIO the pulses of a pulse sensor arrive on. Rising edges are timestamped in hardware while the sensor is active.
+	 * -1 (the default) for no input.
+	 */
+	PULSE_GPIO,
+	/** Multiplier applied to the decimated ADC value of a scaled voltage sensor. */
+	VOLTAGE_PRE_SCALE,
+	/** Divisor applied to the decimated ADC value of a scaled voltage sensor after the pre-scale. */
+	VOLTAGE_POST_SCALE,
+	/**
+	 * Calibration table (enum CalibrationTableId) converting the decimated ADC value of a scaled voltage sensor into
+	 * latched data units, before the pre and post scales are applied. NO_CALIBRATION (the default) for none.
+	 */
+	VOLTAGE_CALIBRATION_TABLE,
+	/**
+	 * Amount the latched value must move by, from the value it was last flagged as changed at, to be flagged as changed
+	 * again. Changed values are pushed to the master through the data ready GPIO and getChangedLatchedData.
+	 * -1 (the default) to never flag changes.
+	 */
+	CHANGE_DEADBAND,
+	/**
+	 * Mean pulse period, in microseconds, above which a pulse sensor resolves its value from the time between its
+	 * latest edges as soon as they arrive, instead of from the pulses counted over the accumulation interval. The scales
+	 * apply the same either way. 0 (the default) to always count over the accumulation interval.
+	 */
+	PULSE_PERIOD_THRESHOLD,
+	/** Filter (enum FilterType) that values are put through before they are latched. FILTER_NONE (the default) for none. */
+	FILTER_TYPE,
+	/**
+	 * Window length, in values, of the filter, or log2 of its time constant for FILTER_EMA. 1 (the default) to
+	 * FILTER_MAX_LENGTH.
+	 */
+	FILTER_LENGTH,
 	/** Must always be last to indicate the end of the enum. */
 	MAX_SENSOR_DATA
 
@@ -67,11 +127,46 @@ struct Sensor
 	/** Time of last strobe. */
 	absolute_time_t lastStrobeTime;
 
-	/** Analog to digital converter channel to use. */
+	/**
+	 * Number of strobe deadlines missed. A deadline is missed when the sensor is strobed so late that its next strobe is
+	 * already due, ie a strobe is lost.
+	 */
+	uint32_t deadlineMisses;
+
+	/** Analog to digital converter channel (RP2040 ADC input) to use. */
 	int adcChannel;
 
+	/** Change in latched value needed for the value to be flagged as changed. -1 to never flag changes. */
+	int changeDeadband;
+
+	/** Filter (enum FilterType) that values are put through before they are latched. */
+	int filterType;
+
+	/** Window length of the filter, or log2 of its time constant for FILTER_EMA. */
+	int filterLength;
+
+	/**
+	 * Calibration table applied to the decimated ADC value of a scaled voltage sensor before scaling. NO_CALIBRATION
+	 * for none. Kept out of the union so that it can't be left holding another type's data.
+	 */
+	int voltageCalibrationTable;
+
 	union
 	{
+		/** Scaled voltage sensor data. */
+		struct
+		{
+			/**
+			 * The decimated ADC value (ADC_DECIMATED_BITS, full scale at the ADC reference voltage), or its calibrated value if
+			 * there is a calibration table, is multiplied by this value then divided by voltagePostScale to get the sensor
+			 * output value.
+			 */
+			int voltagePreScale;
+
+			/** @see voltagePreScale */
+			int voltagePostScale;
+		};
+
 		/** Pulse sensor data. */
 		struct
 		{
@@ -97,12 +192,27 @@ struct Sensor
 			 */
 			int pulsePostScale;
 
+			/** Mean pulse period, in microseconds, above which the value is resolved on every pulse. 0 for never. */
+			int pulsePeriodThreshold;
+
+			/** Whether the latched value was last resolved from the pulse period rather than the accumulation interval. */
+			bool pulsePeriodMode;
+
 			/** Start time of accumulating interval. ie First rising edge, pulse count 0. */
 			absolute_time_t accumIntervalStartPulseTime;
 
 			/** Time of last pulse rising edge. */
 			absolute_time_t accumIntervalEndPulseTime;
 
+			/** GPIO the pulses arrive on. -1 for none. */
+			int pulseGpio;
+
+			/** Pulse capture timestamping the rising edges on pulseGpio. -1 when not capturing. */
+			int pulseCaptureIndex;
+
+			/** Number of captured edges that have been accumulated. Compared to the capture count to find new edges. */
+			uint32_t pulseEdgesConsumed;
+
 			/** Duration of test pulse, in microseconds, at test start value. */
 			int pulseTestDurationStart;
 
@@ -127,26 +237,42 @@ struct Sensor
 /**
  * Indexes used to store and retrieve latched data.
  * Also applies to sensor descriptors.
+ * Declared by the channel registry. @see LATCHED_DATA_CHANNELS
  * @note Index 0 is never used because SPI comms needs to avoid zeros if possible.
  */
 typedef enum
 {
-	/** Engine RPM. */
-	ENGINE_RPM = 1,
+	/** Never used. */
+	NO_LATCHED_INDEX,
 
-	/** Speed km/h. */
-	SPEED_KMH,
-
-	/** Engine temperature degrees celsius. */
-	ENGINE_TEMP_C,
+#define LATCHED_DATA_INDEX(index, name, resolution, sensorType, strobeInterval, preScale, postScale) \
+	index,
+	LATCHED_DATA_CHANNELS(LATCHED_DATA_INDEX)
+#undef LATCHED_DATA_INDEX
 
 	/** Marker to indicate the size of the latched data indexes. Must _always_ be last in enum. */
 	MAX_LATCHED_INDEXES
 
 } LatchedDataIndex;
 
+/**
+ * A consistent copy of all latched data, as latched by a single sensor processing pass.
+ */
+struct LatchedDataSnapshot
+{
+	/** Snapshot sequence number. Increases by one with each published snapshot. */
+	uint32_t sequence;
+
+	/** Time the latched data was captured. */
+	absolute_time_t captureTime;
+
+	/** Latched data, by latched data index. */
+	int values[MAX_LATCHED_INDEXES];
+};
+
 /**
  * Initialise the latcher. Must be done before it is started.
+ * Restores the sensor config last saved with saveSensorConfig, if there is one.
  */
 void initLatcher();
 
@@ -158,6 +284,7 @@ void startLatcher();
 
 /**
  * Get the latched data index given a name.
+ * Constant time. Only the first MAX_LATCH_DATA_INDEX_NAME_SIZE characters are compared.
  * @returns Positive index if found, -1 otherwise.
  */
 int getLatchedDataIndex(const char* latchedDataIndexName);
@@ -174,15 +301,106 @@ int getLatchedDataResolution(LatchedDataIndex index);
  */
 int getLatchedData(LatchedDataIndex index);
 
+/**
+ * Get a consistent copy of all the currently latched data.
+ * Lock free. Core 1 is never held up by a reader and a reader only has to retry if core 1 publishes twice while it is
+ * copying.
+ */
+void getLatchedDataSnapshot(struct LatchedDataSnapshot* snapshot);
+
+/**
+ * Set the GPIO that core 1 raises when latched data is flagged as changed. It is lowered by getChangedLatchedData once
+ * there is nothing left to get.
+ * @param gpio GPIO, already set up as an output. -1 for none.
+ */
+void setLatchedDataReadyGpio(int gpio);
+
+/**
+ * Get the latched data flagged as changed since it was last got, and clear the flags.
+ * A latched data index is flagged as changed when its value moves beyond the sensor's CHANGE_DEADBAND.
+ * The values all come from one snapshot, no older than the change that flagged them.
+ * Core 0 only.
+ * @param indexes Returns the changed latched data indexes, in ascending order.
+ * @param values Returns the current values of the changed indexes.
+ * @param maxChanges Most changes to return. Any others stay flagged, and the data ready GPIO stays raised, for next time.
+ * @returns Number of changes returned.
+ */
+int getChangedLatchedData(uint8_t* indexes, int* values, int maxChanges);
+
+/**
+ * Get the number of strobe deadlines a sensor has missed since the latcher was initialised.
+ */
+uint32_t getSensorDeadlineMisses(LatchedDataIndex index);
+
 /**
  * Set the data for a paricular sensor.
+ * Type specific variables (PULSE_* and VOLTAGE_*) can only be set on a sensor of their type, as it will be once the
+ * changes set before this one are applied.
+ * The change is checked straight away but only applied by core 1 between strobes, at its next pass, so a strobe never
+ * sees a sensor part way through being changed. Changes are applied in the order they were set. Inside a batch
+ * (see beginSensorDataBatch) the change waits for the batch to be committed.
+ * Core 0 only.
  * @param sensorIndex Sensor to set data for.
  * @param sensorVar Sensor variable to set data for.
  * @param varVal Variable value to set.
- * @returns True for success, false for could not be set.
+ * @returns True for success, false for could not be set, ie out of bounds or too many changes waiting to be applied.
  */
 bool setSensorData(LatchedDataIndex sensorIndex, SensorData sensorVar, int varVal);
 
+/**
+ * Begin a batch of sensor data. Nothing set from now on is applied until commitSensorDataBatch, then it is all applied
+ * together, between the same two strobes. Use it for changes that only make sense together, such as a pulse sensor's
+ * pre-scale, post-scale and accumulation interval. Does nothing if a batch is already begun.
+ * Core 0 only.
+ */
+void beginSensorDataBatch();
+
+/**
+ * Commit the batch of sensor data begun with beginSensorDataBatch, for core 1 to apply.
+ * Core 0 only.
+ * @returns True for success. False if anything in the batch could not be set, in which case none of it is applied.
+ */
+bool commitSensorDataBatch();
+
+/**
+ * Set any number of a sensor's variables at once, as a batch of setSensorData. They are set in the order a saved config
+ * is restored in: SENSOR_TYPE first, as it resets the type specific variables, and ACTIVE last. Inside a batch they join
+ * it, and a failure fails the batch.
+ * Core 0 only.
+ * @param sensorIndex Sensor to set data for.
+ * @param setMask Bit n set to set sensor data id n. Bit 0 and bits for ids that don't exist must be clear.
+ * @param values Value of each sensor variable, by sensor data id. Only those in setMask are used.
+ * @returns True for success. False if anything could not be set, in which case none of it is applied.
+ */
+bool setSensorConfig(LatchedDataIndex sensorIndex, uint32_t setMask, const int32_t* values);
+
+/**
+ * Get a sensor's variables as committed, ie as they will be once core 1 has applied everything set so far outside of
+ * an open batch. Variables never set since the sensor type was last set have their type's defaults but read as unset.
+ * Core 0 only.
+ * @param sensorIndex Sensor to get data for.
+ * @param values Returns the value of each sensor variable, MAX_SENSOR_DATA of them by sensor data id. 0 for unset.
+ * @returns Bit n set if sensor data id n has been set. 0 if the sensor index is out of bounds.
+ */
+uint32_t getSensorConfig(LatchedDataIndex sensorIndex, int32_t* values);
+
+/**
+ * Save the sensor config, everything set with setSensorData and committed, to flash. It is restored when the latcher
+ * is initialised.
+ * Core 0 only. Pauses core 1, and holds off interrupts, for as long as it takes to write flash. @see sensorConfigSave
+ * @returns True for success.
+ */
+bool saveSensorConfig();
+
+/**
+ * Load the sensor config last saved with saveSensorConfig and apply it as one batch. Variables the saved config
+ * doesn't have, ie type specific variables that were never set, go back to their defaults.
+ * Core 0 only. Not while a batch is begun.
+ * @returns True for success. False if there is no saved config or it could not be applied, in which case nothing
+ *          changes.
+ */
+bool loadSensorConfig();
+
 /**
  * Set whether latcher is in test mode.
  */
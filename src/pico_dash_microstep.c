@@ -0,0 +1,157 @@
+#include "hardware/clocks.h"
+#include "hardware/dma.h"
+#include "hardware/gpio.h"
+#include "hardware/pio.h"
+#include "hardware/pwm.h"
+
+#include "pico_dash_microstep.h"
+#include "pico_dash_microstep.pio.h"
+#include "pico_dash_microstep_tables.h"
+#include "pico_dash_trace.h"
+
+/** DMA transfer count for forwarding PWM levels. The largest possible so the channel effectively never completes. */
+#define MICROSTEP_PWM_DMA_TRANSFER_COUNT 0xffffffff
+
+/** PIO used for all microsteppers. One state machine per microstepper. */
+#define MICROSTEP_PIO pio1
+
+/** A single microstepper. */
+struct Microstepper
+{
+	/** Whether this microstepper is in use. */
+	bool claimed;
+
+	/** Tables for the microstepper's microsteps per step. */
+	const struct MicrostepTable* table;
+
+	/** DMA channel moving a step's table entries into the state machine. */
+	int stepDmaChannel;
+
+	/** DMA channel moving PWM levels from the state machine into the PWM slice. */
+	int pwmDmaChannel;
+};
+
+struct Microstepper _microsteppers[MAX_MICROSTEPPERS];
+
+/** Offset the microstep program was loaded at. -1 if not yet loaded. */
+int _microstepProgramOffset = -1;
+
+/** Get the generated tables for a number of microsteps per step. NULL if there are none. */
+static const struct MicrostepTable* _findMicrostepTable(int microsteps)
+{
+	const struct MicrostepTable* retVal = NULL;
+
+	for(int index = 0; index < MICROSTEP_TABLE_COUNT; index++)
+	{
+		if(microstepTables[index].microsteps == microsteps)
+		{
+			retVal = &microstepTables[index];
+		}
+	}
+
+	return retVal;
+}
+
+int startMicrostepper(uint coilGpio, uint enableGpio, int microsteps)
+{
+	int microstepperNum = 0;
+
+	while(microstepperNum < MAX_MICROSTEPPERS && _microsteppers[microstepperNum].claimed)
+	{
+		microstepperNum++;
+	}
+
+	const struct MicrostepTable* table = _findMicrostepTable(microsteps);
+
+	// Both enables must be on the same PWM slice so one compare register write sets both coil levels.
+	if(microstepperNum == MAX_MICROSTEPPERS || !table || pwm_gpio_to_channel(enableGpio) != PWM_CHAN_A ||
+		enableGpio + 1 >= NUM_BANK0_GPIOS)
+	{
+		TRACE(TRACE_MICROSTEPPER_NOT_STARTED, coilGpio, microsteps);
+
+		return -1;
+	}
+
+	if(_microstepProgramOffset < 0)
+	{
+		_microstepProgramOffset = pio_add_program(MICROSTEP_PIO, &microstep_program);
+	}
+
+	struct Microstepper* microstepper = _microsteppers + microstepperNum;
+
+	microstepper -> claimed = true;
+	microstepper -> table = table;
+
+	uint slice = pwm_gpio_to_slice_num(enableGpio);
+
+	pwm_config pwmConfig = pwm_get_default_config();
+	pwm_config_set_wrap(&pwmConfig, MICROSTEP_PWM_TOP);
+	pwm_config_set_clkdiv(&pwmConfig, (float)clock_get_hz(clk_sys) / ((MICROSTEP_PWM_TOP + 1) * MICROSTEP_PWM_HZ));
+	pwm_init(slice, &pwmConfig, false);
+	pwm_set_both_levels(slice, 0, 0);
+
+	gpio_set_function(enableGpio, GPIO_FUNC_PWM);
+	gpio_set_function(enableGpio + 1, GPIO_FUNC_PWM);
+
+	// State machine index matches microstepper number.
+	uint sm = microstepperNum;
+
+	pio_sm_claim(MICROSTEP_PIO, sm);
+	microstep_program_init(MICROSTEP_PIO, sm, _microstepProgramOffset, coilGpio);
+
+	microstepper -> pwmDmaChannel = dma_claim_unused_channel(true);
+
+	dma_channel_config dmaConfig = dma_channel_get_default_config(microstepper -> pwmDmaChannel);
+	channel_config_set_transfer_data_size(&dmaConfig, DMA_SIZE_32);
+	channel_config_set_read_increment(&dmaConfig, false);
+	channel_config_set_write_increment(&dmaConfig, false);
+	channel_config_set_dreq(&dmaConfig, pio_get_dreq(MICROSTEP_PIO, sm, false));
+
+	dma_channel_configure(microstepper -> pwmDmaChannel, &dmaConfig, &pwm_hw -> slice[slice].cc,
+		&MICROSTEP_PIO -> rxf[sm], MICROSTEP_PWM_DMA_TRANSFER_COUNT, true);
+
+	microstepper -> stepDmaChannel = dma_claim_unused_channel(true);
+
+	dmaConfig = dma_channel_get_default_config(microstepper -> stepDmaChannel);
+	channel_config_set_transfer_data_size(&dmaConfig, DMA_SIZE_32);
+	channel_config_set_read_increment(&dmaConfig, true);
+	channel_config_set_write_increment(&dmaConfig, false);
+	channel_config_set_dreq(&dmaConfig, pio_get_dreq(MICROSTEP_PIO, sm, true));
+
+	dma_channel_configure(microstepper -> stepDmaChannel, &dmaConfig, &MICROSTEP_PIO -> txf[sm], table -> forward, 0,
+		false);
+
+	pio_sm_set_enabled(MICROSTEP_PIO, sm, true);
+	pwm_set_enabled(slice, true);
+
+	// Straight to coil state 0.
+	pio_sm_put_blocking(MICROSTEP_PIO, sm, 1);
+	pio_sm_put_blocking(MICROSTEP_PIO, sm, table -> forward[0]);
+
+	return microstepperNum;
+}
+
+void __not_in_flash_func(microstepperStep)(int microstepperNum, int coilState, int direction, uint32_t intervalUs)
+{
+	struct Microstepper* microstepper = _microsteppers + microstepperNum;
+	const struct MicrostepTable* table = microstepper -> table;
+
+	uint sm = microstepperNum;
+
+	// Rounded down so the step's microsteps are all taken before the next step is due.
+	uint32_t cycles = (uint64_t)intervalUs * (MICROSTEP_PIO_HZ / 1000000) / table -> microsteps;
+	uint32_t delay = cycles > MICROSTEP_PIO_OVERHEAD_CYCLES ? cycles - MICROSTEP_PIO_OVERHEAD_CYCLES : 0;
+
+	// The first entry of each table run is the coil state the step starts from, which the coils are already at.
+	const uint32_t* entries = direction > 0
+		? table -> forward + coilState * table -> microsteps + 1
+		: table -> reverse + (MICROSTEP_STEPS_PER_CYCLE - coilState) % MICROSTEP_STEPS_PER_CYCLE * table -> microsteps + 1;
+
+	// The previous step's DMA finishes with its last few microsteps still in the FIFO, and the periods are rounded down,
+	// so neither of these waits unless a step comes several microsteps early.
+	dma_channel_wait_for_finish_blocking(microstepper -> stepDmaChannel);
+
+	pio_sm_put_blocking(MICROSTEP_PIO, sm, delay << 1 | 1);
+
+	dma_channel_transfer_from_buffer_now(microstepper -> stepDmaChannel, entries, table -> microsteps);
+}
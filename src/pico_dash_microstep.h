@@ -0,0 +1,66 @@
+#ifndef PICO_DASH_MICROSTEP_H
+#define PICO_DASH_MICROSTEP_H
+
+#include "pico.h"
+
+// Sine/cosine microstepping for X27 style stepper motors on an L293D.
+// Each microstepper runs a PIO state machine that sets the L293D inputs, which give the sign of each coil current, and
+// paces the microsteps of a step evenly across the step interval. The magnitude of each coil current is PWM on that
+// coil's L293D enable. The state machine pushes the enable levels of each microstep as it takes it and DMA forwards them
+// straight into the PWM slice's compare register.
+// The microstep tables are generated at build time by tools/gen_microstep_tables.py. For each step the CPU only queues a
+// period word into the state machine's FIFO and starts a DMA of that step's run of table entries in behind it.
+
+/** Maximum number of microsteppers. One per PIO state machine on pio1. */
+#define MAX_MICROSTEPPERS 4
+
+/** Steps in one electrical cycle of the motor. Must match tools/gen_microstep_tables.py. */
+#define MICROSTEP_STEPS_PER_CYCLE 6
+
+/** PWM wrap value for the L293D enables. Must match tools/gen_microstep_tables.py. */
+#define MICROSTEP_PWM_TOP 2047
+
+/** Bit position of the PWM compare levels in a table entry. Must match tools/gen_microstep_tables.py. */
+#define MICROSTEP_WORD_LEVELS_SHIFT 5
+
+/** Approximate PWM frequency on the L293D enables, in Hz. Above hearing so the motors don't whine. */
+#define MICROSTEP_PWM_HZ 20000
+
+/** Microstep tables for one number of microsteps per step. */
+struct MicrostepTable
+{
+	/** Microsteps per step. */
+	int microsteps;
+
+	/**
+	 * State machine words for each microstep of an electrical cycle, plus one, going forwards. Entry n * microsteps is
+	 * coil state n of the 6 state coil sequence.
+	 */
+	const uint32_t* forward;
+
+	/** As forward but going backwards. Entry n is microstep -n of the forward table. */
+	const uint32_t* reverse;
+};
+
+/**
+ * Start a microstepper, with the coils at coil state 0.
+ * @param coilGpio First of 4 consecutive GPIOs driving the L293D 1A, 2A, 3A and 4A inputs.
+ * @param enableGpio GPIO driving the L293D 1,2EN input. Must be on PWM channel A, an even GPIO. The next GPIO drives the
+ * 3,4EN input.
+ * @param microsteps Microsteps per step. Must be one of the generated tables' (8, 16 or 32).
+ * @returns Microstepper number, or -1 if there are no microsteppers free or the GPIOs or microsteps can't be used.
+ * @note Claims a pio1 state machine and 2 DMA channels.
+ */
+int startMicrostepper(uint coilGpio, uint enableGpio, int microsteps);
+
+/**
+ * Take a step, spreading its microsteps evenly across the step interval. The step's microsteps follow on from those of
+ * the previous step if they haven't all been taken yet.
+ * @param microstepper Microstepper.
+ * @param coilState Coil state the step starts from, 0 to MICROSTEP_STEPS_PER_CYCLE - 1.
+ * @param direction 1 to step forwards through the coil sequence, -1 backwards.
+ * @param intervalUs Time to spread the step across, in microseconds.
+ */
+void microstepperStep(int microstepper, int coilState, int direction, uint32_t intervalUs);
+
+#endif
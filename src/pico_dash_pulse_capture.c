@@ -0,0 +1,126 @@
+#include "hardware/dma.h"
+#include "hardware/pio.h"
+#include "hardware/timer.h"
+
+#include "pico_dash_pulse_capture.h"
+#include "pico_dash_pulse_capture.pio.h"
+#include "pico_dash_trace.h"
+
+/** DMA transfer count for a capture. The largest possible, so the channel only completes after days of edges. */
+#define PULSE_CAPTURE_DMA_TRANSFER_COUNT PULSE_CAPTURE_MAX_EDGES
+
+/** PIO used for all captures. One state machine per capture. */
+#define PULSE_CAPTURE_PIO pio0
+
+/** A single pulse capture. */
+struct PulseCapture
+{
+	/** Whether this capture is in use. */
+	bool claimed;
+
+	/** DMA channel moving stamps from the state machine into the ring. */
+	int dmaChannel;
+
+	/** Edge timestamps. Aligned to its size so DMA write address wrapping can be used to make it a ring. */
+	uint32_t ring[PULSE_CAPTURE_RING_SIZE] __attribute__((aligned(PULSE_CAPTURE_RING_SIZE * sizeof(uint32_t))));
+};
+
+struct PulseCapture _pulseCaptures[MAX_PULSE_CAPTURES];
+
+/** Offset the capture program was loaded at. -1 if not yet loaded. */
+int _pulseCaptureProgramOffset = -1;
+
+/** log2 of the ring size in bytes, for DMA write address wrapping. */
+static uint _pulseCaptureRingSizeBits()
+{
+	uint bits = 0;
+
+	while((1u << bits) < PULSE_CAPTURE_RING_SIZE * sizeof(uint32_t))
+	{
+		bits++;
+	}
+
+	return bits;
+}
+
+int startPulseCapture(uint gpio)
+{
+	int captureIndex = 0;
+
+	while(captureIndex < MAX_PULSE_CAPTURES && _pulseCaptures[captureIndex].claimed)
+	{
+		captureIndex++;
+	}
+
+	if(captureIndex == MAX_PULSE_CAPTURES)
+	{
+		TRACE(TRACE_PULSE_CAPTURE_NOT_STARTED, gpio, 0);
+
+		return -1;
+	}
+
+	if(_pulseCaptureProgramOffset < 0)
+	{
+		_pulseCaptureProgramOffset = pio_add_program(PULSE_CAPTURE_PIO, &pulse_capture_program);
+	}
+
+	struct PulseCapture* capture = _pulseCaptures + captureIndex;
+
+	capture -> claimed = true;
+
+	// State machine index matches capture index.
+	uint sm = captureIndex;
+
+	pio_sm_claim(PULSE_CAPTURE_PIO, sm);
+	pulse_capture_program_init(PULSE_CAPTURE_PIO, sm, _pulseCaptureProgramOffset, gpio);
+
+	capture -> dmaChannel = dma_claim_unused_channel(true);
+
+	dma_channel_config dmaConfig = dma_channel_get_default_config(capture -> dmaChannel);
+	channel_config_set_transfer_data_size(&dmaConfig, DMA_SIZE_32);
+	channel_config_set_read_increment(&dmaConfig, false);
+	channel_config_set_write_increment(&dmaConfig, true);
+	channel_config_set_ring(&dmaConfig, true, _pulseCaptureRingSizeBits());
+	channel_config_set_dreq(&dmaConfig, pio_get_dreq(PULSE_CAPTURE_PIO, sm, false));
+
+	dma_channel_configure(capture -> dmaChannel, &dmaConfig, capture -> ring, &PULSE_CAPTURE_PIO -> rxf[sm],
+		PULSE_CAPTURE_DMA_TRANSFER_COUNT, true);
+
+	// Load X with the inverted timer so the stamps are in step with absolute time.
+	pio_sm_put(PULSE_CAPTURE_PIO, sm, ~time_us_32());
+	pio_sm_exec(PULSE_CAPTURE_PIO, sm, pio_encode_pull(false, false));
+	pio_sm_exec(PULSE_CAPTURE_PIO, sm, pio_encode_mov(pio_x, pio_osr));
+
+	pio_sm_set_enabled(PULSE_CAPTURE_PIO, sm, true);
+
+	return captureIndex;
+}
+
+void stopPulseCapture(int captureIndex)
+{
+	struct PulseCapture* capture = _pulseCaptures + captureIndex;
+
+	if(capture -> claimed)
+	{
+		uint sm = captureIndex;
+
+		pio_sm_set_enabled(PULSE_CAPTURE_PIO, sm, false);
+		pio_sm_unclaim(PULSE_CAPTURE_PIO, sm);
+
+		dma_channel_abort(capture -> dmaChannel);
+		dma_channel_unclaim(capture -> dmaChannel);
+
+		capture -> claimed = false;
+	}
+}
+
+uint32_t __not_in_flash_func(getPulseCaptureCount)(int captureIndex)
+{
+	// The transfer count goes down by one as each stamp is written into the ring.
+	return PULSE_CAPTURE_DMA_TRANSFER_COUNT - dma_channel_hw_addr(_pulseCaptures[captureIndex].dmaChannel) -> transfer_count;
+}
+
+const volatile uint32_t* __not_in_flash_func(getPulseCaptureRing)(int captureIndex)
+{
+	return _pulseCaptures[captureIndex].ring;
+}
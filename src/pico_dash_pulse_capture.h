@@ -0,0 +1,66 @@
+#ifndef PICO_DASH_PULSE_CAPTURE_H
+#define PICO_DASH_PULSE_CAPTURE_H
+
+#include "pico.h"
+
+// Hardware timestamping of pulse input rising edges.
+// Each capture runs a PIO state machine that stamps every rising edge on its pin with a microsecond count that runs in
+// step with the system timer. DMA moves the stamps out of the PIO FIFO into a ring buffer per capture, so no edge is
+// missed however late core 1 gets to processing the sensor.
+
+/** Maximum number of simultaneous pulse captures. One per PIO state machine on pio0. */
+#define MAX_PULSE_CAPTURES 4
+
+/** Number of edge timestamps held by each capture ring. Must be a power of 2 so DMA can wrap the ring. */
+#define PULSE_CAPTURE_RING_SIZE 32
+
+/**
+ * Most edges a capture can count. The capture's DMA transfer count can't be re-armed while it is running, so once this
+ * many edges have been captured it stops, and no more stamps are written.
+ */
+#define PULSE_CAPTURE_MAX_EDGES 0xffffffffu
+
+/**
+ * Edges after which a capture should be restarted to stay well clear of PULSE_CAPTURE_MAX_EDGES. A day or so of a
+ * 20 kHz input.
+ */
+#define PULSE_CAPTURE_RESTART_EDGES 0x80000000u
+
+/**
+ * Start capturing rising edges on a GPIO.
+ * @param gpio Pin the pulses arrive on.
+ * @returns Capture index for the other pulse capture functions, or -1 if all captures are in use.
+ */
+int startPulseCapture(uint gpio);
+
+/**
+ * Stop a capture started by startPulseCapture and free it for re-use.
+ */
+void stopPulseCapture(int captureIndex);
+
+/**
+ * Get the total number of rising edges captured since the capture was started.
+ * The timestamp of edge n is at index n % PULSE_CAPTURE_RING_SIZE of the capture ring until PULSE_CAPTURE_RING_SIZE
+ * further edges have been captured. The oldest stamp's slot is the next written, so check the count again after reading
+ * it to be sure it wasn't overwritten meanwhile.
+ * Starts at 0 and stops at PULSE_CAPTURE_MAX_EDGES, along with the capture, so restart the capture once the count
+ * reaches PULSE_CAPTURE_RESTART_EDGES.
+ */
+uint32_t getPulseCaptureCount(int captureIndex);
+
+/**
+ * Get the ring buffer of edge timestamps for a capture.
+ * Each entry is as written by the capture hardware. Use pulseCaptureEdgeTime to convert it to a time.
+ */
+const volatile uint32_t* getPulseCaptureRing(int captureIndex);
+
+/**
+ * Convert a raw ring entry into the low 32 bits of the absolute time, in microseconds, of the edge.
+ * The PIO program can only count down so the count is stored inverted.
+ */
+static inline uint32_t pulseCaptureEdgeTime(uint32_t ringEntry)
+{
+	return ~ringEntry;
+}
+
+#endif
@@ -0,0 +1,121 @@
+#include "pico.h"
+
+#include "pico_dash_sched.h"
+
+/** Put an entry at a heap position and record where it is. */
+static void __not_in_flash_func(_schedPlace)(struct SchedQueue* queue, int posn, struct SchedEntry entry)
+{
+	queue -> entries[posn] = entry;
+	queue -> position[entry.id] = posn;
+}
+
+/** Move the entry at a heap position towards the root until its parent is no later. */
+static void __not_in_flash_func(_schedSiftUp)(struct SchedQueue* queue, int posn)
+{
+	struct SchedEntry entry = queue -> entries[posn];
+
+	while(posn > 0)
+	{
+		int parent = (posn - 1) / 2;
+
+		if(queue -> entries[parent].deadline <= entry.deadline) break;
+
+		_schedPlace(queue, posn, queue -> entries[parent]);
+		posn = parent;
+	}
+
+	_schedPlace(queue, posn, entry);
+}
+
+/** Move the entry at a heap position towards the leaves until neither child is earlier. */
+static void __not_in_flash_func(_schedSiftDown)(struct SchedQueue* queue, int posn)
+{
+	struct SchedEntry entry = queue -> entries[posn];
+
+	while(true)
+	{
+		int child = posn * 2 + 1;
+
+		if(child >= queue -> count) break;
+
+		if(child + 1 < queue -> count && queue -> entries[child + 1].deadline < queue -> entries[child].deadline)
+		{
+			child++;
+		}
+
+		if(entry.deadline <= queue -> entries[child].deadline) break;
+
+		_schedPlace(queue, posn, queue -> entries[child]);
+		posn = child;
+	}
+
+	_schedPlace(queue, posn, entry);
+}
+
+void schedQueueInit(struct SchedQueue* queue)
+{
+	queue -> count = 0;
+
+	for(int id = 0; id < MAX_SCHED_ITEMS; id++)
+	{
+		queue -> position[id] = -1;
+	}
+}
+
+void __not_in_flash_func(schedQueueSet)(struct SchedQueue* queue, int id, absolute_time_t deadline)
+{
+	int posn = queue -> position[id];
+
+	if(posn < 0)
+	{
+		posn = queue -> count++;
+
+		struct SchedEntry entry = {deadline, id};
+		_schedPlace(queue, posn, entry);
+
+		_schedSiftUp(queue, posn);
+	}
+	else
+	{
+		absolute_time_t oldDeadline = queue -> entries[posn].deadline;
+
+		queue -> entries[posn].deadline = deadline;
+
+		if(deadline < oldDeadline)
+		{
+			_schedSiftUp(queue, posn);
+		}
+		else
+		{
+			_schedSiftDown(queue, posn);
+		}
+	}
+}
+
+void schedQueueRemove(struct SchedQueue* queue, int id)
+{
+	int posn = queue -> position[id];
+
+	if(posn >= 0)
+	{
+		queue -> position[id] = -1;
+		queue -> count--;
+
+		if(posn < queue -> count)
+		{
+			// Fill the hole with the last entry, which may belong either side of where it lands.
+			absolute_time_t removedDeadline = queue -> entries[posn].deadline;
+
+			_schedPlace(queue, posn, queue -> entries[queue -> count]);
+
+			if(queue -> entries[posn].deadline < removedDeadline)
+			{
+				_schedSiftUp(queue, posn);
+			}
+			else
+			{
+				_schedSiftDown(queue, posn);
+			}
+		}
+	}
+}
@@ -0,0 +1,71 @@
+#ifndef PICO_DASH_SCHED_H
+#define PICO_DASH_SCHED_H
+
+#include "pico/time.h"
+
+// Deadline ordered scheduling queue.
+// A binary min-heap of items keyed by the time they are next due. Finding the earliest deadline is constant time and
+// adding, moving or removing an item is O(log n), so it scales to many more items than a poll of every one of them.
+// Not thread safe. Each queue belongs to a single core.
+
+/** Maximum number of items in a queue. Item ids must be less than this. */
+#define MAX_SCHED_ITEMS 64
+
+/** An item in a queue. */
+struct SchedEntry
+{
+	/** Time the item is next due. */
+	absolute_time_t deadline;
+
+	/** Caller's id for the item. */
+	int id;
+};
+
+struct SchedQueue
+{
+	/** Heap of entries. The earliest deadline is always entry 0. */
+	struct SchedEntry entries[MAX_SCHED_ITEMS];
+
+	/** Number of entries in the heap. */
+	int count;
+
+	/** Position in entries of each item id, -1 if not queued. */
+	int position[MAX_SCHED_ITEMS];
+};
+
+/**
+ * Initialise a queue to empty.
+ */
+void schedQueueInit(struct SchedQueue* queue);
+
+/**
+ * Add an item to the queue, or move it if it is already queued.
+ * @param queue Queue to add to.
+ * @param id Item id.
+ * @param deadline Time the item is next due.
+ */
+void schedQueueSet(struct SchedQueue* queue, int id, absolute_time_t deadline);
+
+/**
+ * Remove an item from the queue. Does nothing if it isn't queued.
+ */
+void schedQueueRemove(struct SchedQueue* queue, int id);
+
+/**
+ * Whether an item is queued.
+ */
+static inline bool schedQueueContains(const struct SchedQueue* queue, int id)
+{
+	return queue -> position[id] >= 0;
+}
+
+/**
+ * Get the item with the earliest deadline.
+ * @returns The entry, or null if the queue is empty. Only valid until the queue is next changed.
+ */
+static inline const struct SchedEntry* schedQueuePeek(const struct SchedQueue* queue)
+{
+	return queue -> count > 0 ? queue -> entries : 0;
+}
+
+#endif
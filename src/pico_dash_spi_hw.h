@@ -0,0 +1,54 @@
+#ifndef PICO_DASH_SPI_HW_H
+#define PICO_DASH_SPI_HW_H
+
+#include "hardware/spi.h"
+
+// Raw access to the spi0 FIFOs.
+// On target these are single register accesses. The host build routes them to the Linux shim's FIFO model, because a
+// plain struct field can't model a FIFO that pops on read.
+
+#ifdef PICO_DASH_HOST
+
+#include "pico_dash_host_shim.h"
+
+#define spiRxReadable hostSpiRxReadable
+#define spiTxWritable hostSpiTxWritable
+#define spiTxEmpty hostSpiTxEmpty
+#define spiReadByte hostSpiRead
+#define spiWriteByte hostSpiWrite
+
+#else
+
+/** Whether the rx FIFO has data in it. */
+static inline bool spiRxReadable()
+{
+	return spi0_hw -> sr & SPI_SSPSR_RNE_BITS;
+}
+
+/** Whether the tx FIFO has space in it. */
+static inline bool spiTxWritable()
+{
+	return spi0_hw -> sr & SPI_SSPSR_TNF_BITS;
+}
+
+/** Whether the tx FIFO is empty. */
+static inline bool spiTxEmpty()
+{
+	return spi0_hw -> sr & SPI_SSPSR_TFE_BITS;
+}
+
+/** Pop a byte from the rx FIFO. */
+static inline uint8_t spiReadByte()
+{
+	return spi0_hw -> dr;
+}
+
+/** Push a byte into the tx FIFO. */
+static inline void spiWriteByte(uint8_t value)
+{
+	spi0_hw -> dr = value;
+}
+
+#endif
+
+#endif
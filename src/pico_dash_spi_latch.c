@@ -1,28 +1,62 @@
-#include <stdio.h>
+#include <assert.h>
 
+#include "hardware/dma.h"
 #include "hardware/sync.h"
 #include "pico/time.h"
 
+#include "pico_dash_config.h"
 #include "pico_dash_gpio.h"
+#include "pico_dash_spi_hw.h"
 #include "pico_dash_spi_latch.h"
 #include "pico_dash_latch.h"
+#include "pico_dash_trace.h"
 
-extern bool debugMsgActive;
+static_assert(SPI_MAX_FRAME_PAYLOAD_SIZE >= SPI_MAX_RESPONSE_SIZE, "Every response must fit in a length-prefixed frame");
+static_assert(SPI_MAX_FRAME_PAYLOAD_SIZE >= SPI_MAX_COMMAND_SIZE, "Every command must fit in a length-prefixed frame");
+static_assert(SPI_MAX_RESPONSE_SIZE >= SPI_SENSOR_CONFIG_SIZE(MAX_SENSOR_DATA - 1),
+	"A GET_SENSOR_CONFIG of every sensor variable must fit in a response");
+static_assert(SPI_MAX_RESPONSE_SIZE >= SPI_GET_CHANGED_RESPONSE_SIZE(MAX_LATCHED_INDEXES) &&
+	SPI_MAX_RESPONSE_SIZE >= SPI_GET_STATS_HISTOGRAM_RESPONSE_SIZE &&
+	SPI_MAX_RESPONSE_SIZE >= SPI_GET_STATS_COUNTERS_RESPONSE_SIZE, "Every response must fit in SPI_MAX_RESPONSE_SIZE");
 
-/** Input buffer to read into. */
-uint8_t inputBuffer[SPI_COMMAND_RESPONSE_FRAME_SIZE];
+/**
+ * Input buffer to read into. The command frame is always at the start, after the length prefix if there is one. Big
+ * enough for the longest length-prefixed frame or pipelined transfer, the rest of which is padding.
+ * Both buffers are in scratch Y with core 0's stack, so neither the CPU nor the frame DMA contends with core 1 for them.
+ */
+uint8_t __scratch_y("spi_latch") inputBuffer[SPI_MAX_TRANSFER_SIZE];
 
 /** Current position to read into. */
 int inputBufferPosn = 0;
 
-/** Output buffer to write out. */
-uint8_t outputBuffer[SPI_COMMAND_RESPONSE_FRAME_SIZE];
+/** Output buffer to write out. Holds a whole, possibly multi-frame or length-prefixed, response. */
+uint8_t __scratch_y("spi_latch") outputBuffer[SPI_MAX_TRANSFER_SIZE];
 
-/** Position to read next output value from. Will be less than write position if data needs to be written. */
+/** Position to read next output value from. */
 int outputBufferReadPosn = 0;
 
-/** Position to write next output value from. */
-int outputBufferWritePosn = 0;
+/** Number of bytes of response in the output buffer. Always a whole number of frames. */
+int outputBufferLength = SPI_COMMAND_RESPONSE_FRAME_SIZE;
+
+#if PICO_DASH_HISTORY
+
+/** Samples got for a GET_HISTORY response. Too big for core 0's stack in scratch Y. */
+struct HistorySample spiHistorySamples[SPI_HISTORY_MAX_SAMPLES];
+
+#endif
+
+#if SPI_LATCH_DMA
+
+/** DMA channel that moves a command frame from the SPI rx FIFO into the input buffer. */
+int spiRxDmaChannel;
+
+/** DMA channel that moves a response frame from the output buffer into the SPI tx FIFO. */
+int spiTxDmaChannel;
+
+/** Set by the DMA IRQ once a full command frame has landed in the input buffer. */
+volatile bool spiRxFrameComplete = false;
+
+#endif
 
 /**
  * Whether the SPI master is currently actively procesing a latch command.
@@ -34,6 +68,18 @@ bool spiLatchCommandActive = false;
 /** Flag to indicate the latch command cycle is complete. */
 bool spiLatchCommandCycleComplete = false;
 
+/** Protocol version (enum SpiProtocolVersion) used for command cycles. */
+int spiProtocolVersion = SPI_PROTOCOL_HALF_DUPLEX;
+
+/** Largest length-prefixed frame payload agreed with the master. */
+int spiFramePayloadSize = SPI_COMMAND_RESPONSE_FRAME_SIZE;
+
+/** Time the master last raised command active. */
+absolute_time_t spiLatchCommandActiveTime = 0;
+
+/** Time the command being processed was received. */
+absolute_time_t spiCommandReceivedTime = 0;
+
 /**
  * Set whether this Pico is ready for a latch command.
  */
@@ -43,213 +89,954 @@ void __not_in_flash_func(setReadyForCommand)(bool ready)
 }
 
 /**
- * Read commands from SPI and write responses.
- * @note Only one command/response "frame" is processed at a time.
+ * Write a 32 bit integer into a response. Little endian byte order.
+ * @returns Position after the integer.
  */
-void __not_in_flash_func(processSpiCommandResponse)()
+static inline int putResponseUint32(uint8_t* outputFrame, int outputFramePosn, uint32_t value)
 {
-	// Note: Latch commmand going inactive triggers abort of command processing.
+	outputFrame[outputFramePosn++] = value & 0xFF;
+	outputFrame[outputFramePosn++] = (value >> 8) & 0xFF;
+	outputFrame[outputFramePosn++] = (value >> 16) & 0xFF;
+	outputFrame[outputFramePosn++] = (value >> 24) & 0xFF;
 
-	// Clear the rx fifo. Assume RFC (ready for command) is inactive and that causes the master to stall sending a
-	// command.
-	while(spi0_hw -> sr & SPI_SSPSR_RNE_BITS)
+	return outputFramePosn;
+}
+
+/**
+ * Read a 32 bit integer from a command. Little endian byte order.
+ */
+static inline uint32_t getCommandUint32(const uint8_t* inputFrame, int inputFramePosn)
+{
+	return inputFrame[inputFramePosn] | inputFrame[inputFramePosn + 1] << 8 | inputFrame[inputFramePosn + 2] << 16 |
+		(uint32_t)inputFrame[inputFramePosn + 3] << 24;
+}
+
+/**
+ * Count the sensor data ids in a sensor config mask. Bits for ids that don't exist aren't counted.
+ */
+static inline int sensorConfigMaskVars(uint32_t sensorConfigMask)
+{
+	int retVal = 0;
+
+	for(sensorConfigMask &= SENSOR_CONFIG_ALL_MASK; sensorConfigMask; sensorConfigMask &= sensorConfigMask - 1) retVal++;
+
+	return retVal;
+}
+
+int __not_in_flash_func(spiCommandSize)(const uint8_t* inputFrame)
+{
+	int retVal = SPI_COMMAND_RESPONSE_FRAME_SIZE;
+
+	if(inputFrame[0] == SET_SENSOR_CONFIG)
 	{
-		// Get rx fifo data from dr register.
-		uint32_t dr = spi0_hw -> dr;
+		retVal = SPI_SENSOR_CONFIG_SIZE(sensorConfigMaskVars(getCommandUint32(inputFrame, 2)));
 	}
 
-	// Indicate ready for command.
-	setReadyForCommand(true);
+	return retVal;
+}
 
-	//if(debugMsgActive) printf("Ready for command.\n");
+/**
+ * Decode a command and build the response for it.
+ * @param inputFrame Command. Always at least a frame, zero padded.
+ * @param commandSize Number of bytes of command received. Commands that need more are bad.
+ * @param outputFrame Response to populate.
+ * @param maxResponseSize Largest response the master can take. Commands whose response could be bigger are bad.
+ * @param lengthPrefixed True if the response goes in a length-prefixed frame, so doesn't need padding to the size the
+ *                       master expects.
+ * @returns Length of the response in bytes.
+ */
+int __not_in_flash_func(processSpiCommand)(const uint8_t* inputFrame, int commandSize, uint8_t* outputFrame,
+	int maxResponseSize, bool lengthPrefixed)
+{
+	// Clear the output frame.
+	int outputFramePosn = SPI_COMMAND_RESPONSE_FRAME_SIZE;
+	while(--outputFramePosn > 0)
+	{
+		outputFrame[outputFramePosn] = 0;
+	}
 
-	// Read a command frame from the SPI rx fifo. Assume rx data is padded with 0's while master is waiting for a reply
-	// to the command.
-	inputBufferPosn = 0;
+	// As default, put the command back into the first position in the return frame.
+	outputFrame[outputFramePosn++] = inputFrame[0];
 
-	// Used for timeout of read command.
-	absolute_time_t timeoutTime = make_timeout_time_ms(1);
+	int latchedDataIndex;
+
+	uint32_t sensorConfigMask;
+	int32_t sensorConfigVals[MAX_SENSOR_DATA];
+
+	statsCount(STATS_COMMANDS);
+
+	TRACE(TRACE_SPI_COMMAND, inputFrame[0], 0);
+
+	// Processs the command.
+	switch(inputFrame[0])
+	{
+		case GET_LATCHED_DATA_INDEX:
+
+			// Two bytes have to be output.
+
+			// Return latched data index. Only the first MAX_LATCH_DATA_INDEX_NAME_SIZE characters are compared so the
+			// name doesn't need to be null terminated.
+			outputFrame[outputFramePosn++] = getLatchedDataIndex((const char*)(inputFrame + 1));
+
+			break;
+
+		case GET_LATCHED_DATA_RESOLUTION:
+
+			// Three bytes have to be output.
+
+			latchedDataIndex = inputFrame[1];
+			int latchedDataResolution = getLatchedDataResolution(latchedDataIndex);
+
+			// Latched data. Little endian byte order.
+			outputFrame[outputFramePosn++] = latchedDataResolution & 0xFF;
+			outputFrame[outputFramePosn++] = (latchedDataResolution >> 8) & 0xFF;
+
+			break;
+
+		case GET_LATCHED_DATA:
+
+			// Five bytes have to be output.
+
+			latchedDataIndex = inputFrame[1];
+			int latchedDataVal = getLatchedData(latchedDataIndex);
+
+			// Latched data. Little endian byte order.
+			outputFrame[outputFramePosn++] = latchedDataVal & 0xFF;
+			outputFrame[outputFramePosn++] = (latchedDataVal >> 8) & 0xFF;
+			outputFrame[outputFramePosn++] = (latchedDataVal >> 16) & 0xFF;
+			outputFrame[outputFramePosn++] = (latchedDataVal >> 24) & 0xFF;
+
+			break;
+
+		case SET_SENSOR_DATA:
+
+			latchedDataIndex = inputFrame[1];
+			int sensorIndex = inputFrame[2];
+
+			int sensorDataVal = inputFrame[3];
+			int scratch = inputFrame[4];
+			sensorDataVal += scratch << 8;
+			scratch = inputFrame[5];
+			sensorDataVal += scratch << 16;
+			scratch = inputFrame[6];
+			sensorDataVal += scratch << 24;
+
+			// Just reply with the inverted success value so that 0 indicates no error.
+			outputFrame[outputFramePosn++] = !setSensorData(latchedDataIndex, sensorIndex, sensorDataVal);
+
+			break;
+
+		case BEGIN_SENSOR_DATA_BATCH:
+
+			beginSensorDataBatch();
+
+			break;
+
+		case COMMIT_SENSOR_DATA_BATCH:
+
+			// Inverted success value so that 0 indicates no error.
+			outputFrame[outputFramePosn++] = !commitSensorDataBatch();
+
+			break;
+
+		case SAVE_CONFIG:
+
+			outputFrame[outputFramePosn++] = !saveSensorConfig();
+
+			break;
+
+		case LOAD_CONFIG:
+
+			outputFrame[outputFramePosn++] = !loadSensorConfig();
+
+			break;
+
+		case SET_SENSOR_CONFIG:
+
+			sensorConfigMask = getCommandUint32(inputFrame, 2);
+
+			// The values are read by the bits of the mask, so they must all be for ids that exist.
+			if(sensorConfigMask & ~SENSOR_CONFIG_ALL_MASK)
+			{
+				TRACE(TRACE_SENSOR_CONFIG_MASK_OUT_OF_BOUNDS, sensorConfigMask, 0);
+
+				outputFramePosn = -1;
+				break;
+			}
+
+			// Pipelined, the rest of the command may not have fitted in the transfer. Length-prefixed, the payload may
+			// be shorter than the mask says. Either way the missing values would read as 0.
+			if(commandSize < 6 + 4 * sensorConfigMaskVars(sensorConfigMask))
+			{
+				TRACE(TRACE_SPI_COMMAND_INCOMPLETE, commandSize, 6 + 4 * sensorConfigMaskVars(sensorConfigMask));
+
+				outputFramePosn = -1;
+				break;
+			}
+
+			// Values of the ids in the mask follow it, in ascending id order.
+			int inputFramePosn = 6;
+
+			for(int sensorVar = 0; sensorVar < MAX_SENSOR_DATA; sensorVar++)
+			{
+				if(sensorConfigMask & (1u << sensorVar))
+				{
+					sensorConfigVals[sensorVar] = getCommandUint32(inputFrame, inputFramePosn);
+					inputFramePosn += 4;
+				}
+			}
+
+			// Inverted success value so that 0 indicates no error.
+			outputFrame[outputFramePosn++] = !setSensorConfig(inputFrame[1], sensorConfigMask, sensorConfigVals);
+
+			break;
+
+		case GET_SENSOR_CONFIG:
+
+			latchedDataIndex = inputFrame[1];
+			sensorConfigMask = getCommandUint32(inputFrame, 2);
+
+			if(latchedDataIndex >= MAX_LATCHED_INDEXES)
+			{
+				TRACE(TRACE_SENSOR_INDEX_OUT_OF_BOUNDS, latchedDataIndex, 0);
+
+				outputFramePosn = -1;
+				break;
+			}
+
+			if(sensorConfigMask & ~SENSOR_CONFIG_ALL_MASK ||
+				6 + 4 * sensorConfigMaskVars(sensorConfigMask) > maxResponseSize)
+			{
+				TRACE(TRACE_SENSOR_CONFIG_MASK_OUT_OF_BOUNDS, sensorConfigMask, 0);
+
+				outputFramePosn = -1;
+				break;
+			}
+
+			uint32_t sensorConfigSetMask = getSensorConfig(latchedDataIndex, sensorConfigVals);
+
+			outputFrame[outputFramePosn++] = latchedDataIndex;
+
+			outputFramePosn = putResponseUint32(outputFrame, outputFramePosn, sensorConfigSetMask & sensorConfigMask);
+
+			for(int sensorVar = 0; sensorVar < MAX_SENSOR_DATA; sensorVar++)
+			{
+				if(sensorConfigMask & (1u << sensorVar))
+				{
+					outputFramePosn = putResponseUint32(outputFrame, outputFramePosn, sensorConfigVals[sensorVar]);
+				}
+			}
+
+			// Zero pad the last frame.
+			while(!lengthPrefixed && outputFramePosn % SPI_COMMAND_RESPONSE_FRAME_SIZE) outputFrame[outputFramePosn++] = 0;
+
+			break;
+
+		case GET_LATCHED_DATA_MULTI:
+		{
+			// Check every requested index exists before writing anything so the master gets either all or nothing.
+			int requestedIndexes = 0;
+
+			for(latchedDataIndex = 0; latchedDataIndex < SPI_LATCHED_DATA_MULTI_MAX_INDEXES; latchedDataIndex++)
+			{
+				if(inputFrame[1 + latchedDataIndex / 8] & (1 << (latchedDataIndex % 8)))
+				{
+					if(latchedDataIndex == 0 || latchedDataIndex >= MAX_LATCHED_INDEXES)
+					{
+						TRACE(TRACE_LATCHED_DATA_INDEX_OUT_OF_BOUNDS, latchedDataIndex, 0);
+
+						outputFramePosn = -1;
+						break;
+					}
+
+					requestedIndexes++;
+				}
+			}
+
+			if(outputFramePosn < 0) break;
+
+			if(1 + 4 * requestedIndexes > maxResponseSize)
+			{
+				TRACE(TRACE_SPI_RESPONSE_TOO_BIG, requestedIndexes, 0);
+
+				outputFramePosn = -1;
+				break;
+			}
+
+			// All values come from the one sensor processing pass.
+			struct LatchedDataSnapshot snapshot;
+			getLatchedDataSnapshot(&snapshot);
+
+			// Four bytes per requested index, in ascending index order.
+			for(latchedDataIndex = 1; latchedDataIndex < MAX_LATCHED_INDEXES; latchedDataIndex++)
+			{
+				if(inputFrame[1 + latchedDataIndex / 8] & (1 << (latchedDataIndex % 8)))
+				{
+					int latchedDataVal = snapshot.values[latchedDataIndex];
+
+					// Latched data. Little endian byte order.
+					outputFrame[outputFramePosn++] = latchedDataVal & 0xFF;
+					outputFrame[outputFramePosn++] = (latchedDataVal >> 8) & 0xFF;
+					outputFrame[outputFramePosn++] = (latchedDataVal >> 16) & 0xFF;
+					outputFrame[outputFramePosn++] = (latchedDataVal >> 24) & 0xFF;
+				}
+			}
+
+			// Zero pad the last frame.
+			while(!lengthPrefixed && outputFramePosn % SPI_COMMAND_RESPONSE_FRAME_SIZE) outputFrame[outputFramePosn++] = 0;
+
+			break;
+		}
+
+		case GET_CHANGED:
+		{
+			int maxChanges = inputFrame[1];
+
+			if(maxChanges < 1 || maxChanges >= MAX_LATCHED_INDEXES || 2 + 5 * maxChanges > maxResponseSize)
+			{
+				TRACE(TRACE_SPI_MAX_CHANGES_OUT_OF_BOUNDS, maxChanges, 0);
+
+				outputFramePosn = -1;
+				break;
+			}
+
+			uint8_t changedIndexes[MAX_LATCHED_INDEXES];
+			int changedValues[MAX_LATCHED_INDEXES];
+
+			int changes = getChangedLatchedData(changedIndexes, changedValues, maxChanges);
+
+			outputFrame[outputFramePosn++] = changes;
+
+			for(int change = 0; change < changes; change++)
+			{
+				outputFrame[outputFramePosn++] = changedIndexes[change];
+
+				// Latched data. Little endian byte order.
+				outputFrame[outputFramePosn++] = changedValues[change] & 0xFF;
+				outputFrame[outputFramePosn++] = (changedValues[change] >> 8) & 0xFF;
+				outputFrame[outputFramePosn++] = (changedValues[change] >> 16) & 0xFF;
+				outputFrame[outputFramePosn++] = (changedValues[change] >> 24) & 0xFF;
+			}
+
+			// Zero pad to the size the master expects.
+			while(!lengthPrefixed && outputFramePosn < SPI_GET_CHANGED_RESPONSE_SIZE(maxChanges))
+			{
+				outputFrame[outputFramePosn++] = 0;
+			}
+
+			break;
+		}
+
+		case SET_PROTOCOL_VERSION:
+		{
+			int protocolVersion = inputFrame[1] < SPI_PROTOCOL_MAX_VERSION ? inputFrame[1] : SPI_PROTOCOL_MAX_VERSION;
+			int framePayloadSize = inputFrame[2] | inputFrame[3] << 8;
+
+			if(protocolVersion == 0 ||
+				(protocolVersion == SPI_PROTOCOL_FRAMED && framePayloadSize < SPI_COMMAND_RESPONSE_FRAME_SIZE))
+			{
+				outputFramePosn = -1;
+				break;
+			}
+
+			// The current command cycle carries on with the protocol it started with.
+			spiProtocolVersion = protocolVersion;
+			spiFramePayloadSize = framePayloadSize < SPI_MAX_FRAME_PAYLOAD_SIZE ? framePayloadSize
+				: SPI_MAX_FRAME_PAYLOAD_SIZE;
+
+			outputFrame[outputFramePosn++] = spiProtocolVersion;
+
+			if(spiProtocolVersion == SPI_PROTOCOL_FRAMED)
+			{
+				outputFrame[outputFramePosn++] = spiFramePayloadSize & 0xFF;
+				outputFrame[outputFramePosn++] = (spiFramePayloadSize >> 8) & 0xFF;
+			}
+
+			break;
+		}
+
+		case GET_CAPABILITIES:
+
+			outputFrame[outputFramePosn++] = SPI_PROTOCOL_MAX_VERSION;
+			outputFrame[outputFramePosn++] = SPI_MAX_FRAME_PAYLOAD_SIZE & 0xFF;
+			outputFrame[outputFramePosn++] = (SPI_MAX_FRAME_PAYLOAD_SIZE >> 8) & 0xFF;
+
+			break;
+
+#if PICO_DASH_STATS
+
+		case GET_STATS:
+		{
+			int statsSelect = inputFrame[1];
+			latchedDataIndex = inputFrame[2];
+
+			outputFrame[outputFramePosn++] = statsSelect;
+
+			if(statsSelect == SPI_GET_STATS_COUNTERS)
+			{
+				if(latchedDataIndex != 0 || SPI_GET_STATS_COUNTERS_RESPONSE_SIZE > maxResponseSize)
+				{
+					outputFramePosn = -1;
+					break;
+				}
+
+				for(int counter = 0; counter < MAX_STATS_COUNTERS; counter++)
+				{
+					outputFramePosn = putResponseUint32(outputFrame, outputFramePosn, getStatsCounter(counter));
+				}
+			}
+			else
+			{
+				struct StatsHistogram histogram;
+
+				if((statsSelect != STATS_STROBE_LATENESS && latchedDataIndex != 0) ||
+					!getStatsHistogram(statsSelect, latchedDataIndex, &histogram) ||
+					SPI_GET_STATS_HISTOGRAM_RESPONSE_SIZE > maxResponseSize)
+				{
+					TRACE(TRACE_STATS_OUT_OF_BOUNDS, statsSelect, latchedDataIndex);
+
+					outputFramePosn = -1;
+					break;
+				}
+
+				outputFrame[outputFramePosn++] = latchedDataIndex;
+
+				outputFramePosn = putResponseUint32(outputFrame, outputFramePosn, histogram.count);
+				outputFramePosn = putResponseUint32(outputFrame, outputFramePosn, histogram.max);
+				outputFramePosn = putResponseUint32(outputFrame, outputFramePosn, histogram.sum);
+				outputFramePosn = putResponseUint32(outputFrame, outputFramePosn, histogram.sum >> 32);
+
+				for(int bucket = 0; bucket < STATS_HISTOGRAM_BUCKETS; bucket++)
+				{
+					outputFramePosn = putResponseUint32(outputFrame, outputFramePosn, histogram.buckets[bucket]);
+				}
+			}
+
+			// Reset after building the response so nothing recorded in between is lost.
+			if(inputFrame[3] & SPI_GET_STATS_RESET) resetStats();
+
+			// Zero pad the last frame.
+			while(!lengthPrefixed && outputFramePosn % SPI_COMMAND_RESPONSE_FRAME_SIZE) outputFrame[outputFramePosn++] = 0;
+
+			break;
+		}
+
+#endif
+
+#if PICO_DASH_HISTORY
+
+		case GET_HISTORY:
+
+			latchedDataIndex = inputFrame[1];
+
+			int maxSamples = inputFrame[6];
+
+			if(latchedDataIndex <= NO_LATCHED_INDEX || latchedDataIndex >= MAX_LATCHED_INDEXES)
+			{
+				TRACE(TRACE_LATCHED_DATA_INDEX_OUT_OF_BOUNDS, latchedDataIndex, 0);
+
+				outputFramePosn = -1;
+				break;
+			}
+
+			if(maxSamples < 1 || maxSamples > SPI_HISTORY_MAX_SAMPLES || 11 + 8 * maxSamples > maxResponseSize)
+			{
+				TRACE(TRACE_SPI_HISTORY_SAMPLES_OUT_OF_BOUNDS, maxSamples, 0);
+
+				outputFramePosn = -1;
+				break;
+			}
+
+			uint32_t historySequence = getCommandUint32(inputFrame, 2);
+			uint32_t historyRecorded;
+
+			int historySamples = getHistory(latchedDataIndex, &historySequence, spiHistorySamples, maxSamples,
+				&historyRecorded);
+
+			outputFrame[outputFramePosn++] = latchedDataIndex;
+			outputFrame[outputFramePosn++] = historySamples;
+
+			outputFramePosn = putResponseUint32(outputFrame, outputFramePosn, historySequence);
+			outputFramePosn = putResponseUint32(outputFrame, outputFramePosn, historyRecorded);
+
+			for(int sample = 0; sample < historySamples; sample++)
+			{
+				outputFramePosn = putResponseUint32(outputFrame, outputFramePosn, spiHistorySamples[sample].time);
+				outputFramePosn = putResponseUint32(outputFrame, outputFramePosn, spiHistorySamples[sample].value);
+			}
+
+			// Zero pad to the size asked for, whatever the number of samples got.
+			while(!lengthPrefixed && outputFramePosn < SPI_GET_HISTORY_RESPONSE_SIZE(maxSamples))
+			{
+				outputFrame[outputFramePosn++] = 0;
+			}
+
+			break;
+
+#endif
+
+		default:
+
+			TRACE(TRACE_SPI_UNKNOWN_COMMAND, inputFrame[0], 0);
+
+			outputFramePosn = -1;
+	}
+
+	if(outputFramePosn < 0)
+	{
+		// Bad command.
+
+		statsCount(STATS_BAD_COMMANDS);
+
+		outputFramePosn = 0;
+		while(outputFramePosn < SPI_COMMAND_RESPONSE_FRAME_SIZE) outputFrame[outputFramePosn++] = 0xFF;
+	}
+
+	// Single frame responses are always a full frame, unless the frame says how long they are.
+	return outputFramePosn > SPI_COMMAND_RESPONSE_FRAME_SIZE || lengthPrefixed ? outputFramePosn
+		: SPI_COMMAND_RESPONSE_FRAME_SIZE;
+}
+
+int __not_in_flash_func(processSpiCommandFrame)(const uint8_t* inputFrame, uint8_t* outputFrame)
+{
+	return processSpiCommand(inputFrame, spiCommandSize(inputFrame), outputFrame, SPI_MAX_RESPONSE_SIZE, false);
+}
+
+#if SPI_LATCH_DMA
+
+void __not_in_flash_func(spiDmaIrqHandler)()
+{
+	if(dma_channel_get_irq0_status(spiRxDmaChannel))
+	{
+		dma_channel_acknowledge_irq0(spiRxDmaChannel);
+
+		spiRxFrameComplete = true;
+
+		// Make sure a WFE that raced with this interrupt still wakes.
+		__sev();
+	}
+}
+
+/**
+ * Stop any frame transfers that are still in progress, ie because the master aborted the command cycle.
+ */
+void __not_in_flash_func(abortFrameDma)()
+{
+	if(dma_channel_is_busy(spiRxDmaChannel)) dma_channel_abort(spiRxDmaChannel);
+	if(dma_channel_is_busy(spiTxDmaChannel)) dma_channel_abort(spiTxDmaChannel);
+
+	// An abort can leave the completion flagged.
+	dma_channel_acknowledge_irq0(spiRxDmaChannel);
+}
+
+#endif
+
+/**
+ * Receive a command frame into the input buffer.
+ * With DMA the frame lands in the input buffer without the CPU and the core sleeps until the DMA IRQ wakes it.
+ * @note Reception must already have been started with startReceiveCommandFrame, before ready for command was raised.
+ * @param length Number of bytes the input buffer should hold once the frame is received.
+ * @returns True if a full frame was received. False on timeout or the master aborting the command cycle.
+ */
+bool __not_in_flash_func(receiveCommandFrame)(int length)
+{
+	// Used for timeout of read command. Long length-prefixed frames get longer, though at SPI_BAUD they need much less.
+	absolute_time_t timeoutTime = make_timeout_time_ms(1 + length / 128);
 
 	bool timeout = false;
 
-	while(spiLatchCommandActive && inputBufferPosn < SPI_COMMAND_RESPONSE_FRAME_SIZE && !timeout)
+#if SPI_LATCH_DMA
+
+	while(spiLatchCommandActive && !spiRxFrameComplete && !timeout)
+	{
+		// Sleep until the frame DMA completes, the command active GPIO changes or the timeout expires.
+		timeout = best_effort_wfe_or_timeout(timeoutTime);
+	}
+
+	// The frame may have completed right on the timeout.
+	timeout = timeout && !spiRxFrameComplete;
+
+	if(spiRxFrameComplete) inputBufferPosn = length;
+
+	if(timeout) TRACE(TRACE_SPI_RECEIVE_TIMEOUT, inputBufferPosn, length);
+
+#else
+
+	while(spiLatchCommandActive && inputBufferPosn < length && !timeout)
 	{
 		// Note: This loop could potentially deadlock with the master if it thinks it has sent the frame but the Pico
 		//       hasn't received all the data.
 
-		if(spi0_hw -> sr & SPI_SSPSR_RNE_BITS)
+		if(spiRxReadable())
 		{
 			// Get rx fifo data from dr register.
-			inputBuffer[inputBufferPosn++] = spi0_hw -> dr;
+			inputBuffer[inputBufferPosn++] = spiReadByte();
 		}
 		else
 		{
 			// Check for timeout.
-			absolute_time_t curTime = get_absolute_time();
-			timeout = curTime > timeoutTime;
-
-			if(debugMsgActive && timeout)
-			{
-				printf("Timeout during latch command read. Timeout time: %lu  Current time: %lu\n", timeoutTime, curTime);
-			}
+			timeout = get_absolute_time() > timeoutTime;
 		}
 	}
 
-	//if(debugMsgActive && !timeout) printf("Latch command finished read.\n");
+	if(timeout) TRACE(TRACE_SPI_RECEIVE_TIMEOUT, inputBufferPosn, length);
+
+#endif
+
+	if(timeout) statsCount(STATS_RECEIVE_TIMEOUTS);
+
+	return !timeout && inputBufferPosn == length;
+}
+
+/**
+ * Start reception of a command frame into the input buffer, carrying on from whatever it already holds.
+ * @param length Number of bytes the input buffer should hold once the frame is received.
+ */
+void __not_in_flash_func(startReceiveCommandFrame)(int length)
+{
+#if SPI_LATCH_DMA
+
+	spiRxFrameComplete = false;
+
+	dma_channel_set_write_addr(spiRxDmaChannel, inputBuffer + inputBufferPosn, false);
+	dma_channel_set_trans_count(spiRxDmaChannel, length - inputBufferPosn, true);
+
+#else
+
+	(void)length;
+
+#endif
+}
+
+/**
+ * Send the response frame in the output buffer and indicate to the master that it can be read.
+ */
+void __not_in_flash_func(sendResponseFrame)()
+{
+	if(!spiTxEmpty())
+	{
+		statsCount(STATS_TX_FIFO_NOT_EMPTY);
+
+		TRACE(TRACE_SPI_TX_FIFO_NOT_EMPTY, 0, 0);
+	}
 
 	// Always reset output buffer read position.
 	outputBufferReadPosn = 0;
 
-	bool commandReplyReady = false;
+#if SPI_LATCH_DMA
+
+	// The DMA keeps the tx FIFO topped up as the master reads, however many frames the response is. There is no need to
+	// wait for it to finish. A master abort is cleaned up at the start of the next command.
+	dma_channel_set_read_addr(spiTxDmaChannel, outputBuffer, false);
+	dma_channel_set_trans_count(spiTxDmaChannel, outputBufferLength, true);
 
-	if(!timeout && inputBufferPosn == SPI_COMMAND_RESPONSE_FRAME_SIZE)
+	// This should indicate to the master that it can start to read the command response.
+	setReadyForCommand(false);
+
+	statsRecordSince(STATS_COMMAND_SERVICE_TIME, spiCommandReceivedTime);
+
+	TRACE(TRACE_SPI_RESPONSE_READY, outputBufferLength, 0);
+
+#else
+
+	// Write as much as possible from output buffer to SPI tx fifo.
+	while(outputBufferReadPosn < outputBufferLength && spiLatchCommandActive && spiTxWritable())
 	{
-		// Command frame was read.
+		spiWriteByte(outputBuffer[outputBufferReadPosn++]);
+	}
+
+	// This should indicate to the master that it can start to read the command response.
+	setReadyForCommand(false);
+
+	statsRecordSince(STATS_COMMAND_SERVICE_TIME, spiCommandReceivedTime);
+
+	TRACE(TRACE_SPI_RESPONSE_READY, outputBufferLength, 0);
+
+	absolute_time_t timeoutTime = make_timeout_time_ms(1);
+
+	bool timeout = false;
 
-		// Clear the output buffer.
-		outputBufferWritePosn = SPI_COMMAND_RESPONSE_FRAME_SIZE;
-		while(--outputBufferWritePosn > 0)
+	// Write any remaining data from output buffer to SPI tx fifo.
+	while(outputBufferReadPosn < outputBufferLength && spiLatchCommandActive && !timeout)
+	{
+		if(spiTxWritable())
 		{
-			outputBuffer[outputBufferWritePosn] = 0;
+			spiWriteByte(outputBuffer[outputBufferReadPosn++]);
+
+			// Timed from the last byte so that a long response isn't cut off.
+			timeoutTime = make_timeout_time_ms(1);
 		}
+		else
+		{
+			// Check for timeout.
+			timeout = get_absolute_time() > timeoutTime;
+		}
+	}
 
-		// As default, put the command back into the first position in the return buffer.
-		outputBuffer[outputBufferWritePosn++] = inputBuffer[0];
+	if(timeout) statsCount(STATS_SEND_TIMEOUTS);
 
-		int latchedDataIndex;
+	if(timeout) TRACE(TRACE_SPI_SEND_TIMEOUT, outputBufferReadPosn, outputBufferLength);
 
-		// Processs the command.
-		switch(inputBuffer[0])
-		{
-			case GET_LATCHED_DATA_INDEX:
+#endif
+}
 
-				// Get latch data index command is complete.
-				if(debugMsgActive) printf("Proc cmd GET_LATCHED_DATA_INDEX\n");
+/**
+ * Read commands from SPI and write responses.
+ * @note Only one command/response "frame" is processed at a time.
+ */
+void __not_in_flash_func(processSpiCommandResponse)()
+{
+	// Note: Latch commmand going inactive triggers abort of command processing.
 
-				// Two bytes have to be output.
+#if SPI_LATCH_DMA
+	// Anything left over from an aborted command cycle.
+	abortFrameDma();
+#endif
 
-				// Null terminate the input string.
-				inputBuffer[4] = 0;
+	// Clear the rx fifo. Assume RFC (ready for command) is inactive and that causes the master to stall sending a
+	// command.
+	while(spiRxReadable())
+	{
+		// Get rx fifo data from dr register.
+		spiReadByte();
+	}
 
-				// Return latched data index.
-				outputBuffer[outputBufferWritePosn++] = getLatchedDataIndex(inputBuffer + 1);
+	// Read a command frame from the SPI rx fifo. Assume rx data is padded with 0's while master is waiting for a reply
+	// to the command.
+	inputBufferPosn = 0;
 
-				break;
+	startReceiveCommandFrame(SPI_COMMAND_RESPONSE_FRAME_SIZE);
 
-			case GET_LATCHED_DATA_RESOLUTION:
+	// Indicate ready for command.
+	setReadyForCommand(true);
 
-				if(debugMsgActive) printf("Proc cmd GET_LATCHED_DATA_RESOLUTION\n");
+	statsRecordSince(STATS_READY_LATENCY, spiLatchCommandActiveTime);
 
-				// Three bytes have to be output.
+	TRACE(TRACE_SPI_READY_FOR_COMMAND, 0, 0);
 
-				latchedDataIndex = inputBuffer[1];
-				int latchedDataResolution = getLatchedDataResolution(latchedDataIndex);
+	bool received = receiveCommandFrame(SPI_COMMAND_RESPONSE_FRAME_SIZE);
 
-				// Latched data. Little endian byte order.
-				outputBuffer[outputBufferWritePosn++] = latchedDataResolution & 0xFF;
-				outputBuffer[outputBufferWritePosn++] = (latchedDataResolution >> 8) & 0xFF;
+	// The rest of a multi-frame command follows straight on from its first frame.
+	int commandSize = received ? spiCommandSize(inputBuffer) : 0;
 
-				break;
+	if(commandSize > SPI_COMMAND_RESPONSE_FRAME_SIZE)
+	{
+		startReceiveCommandFrame(commandSize);
 
-			case GET_LATCHED_DATA:
+		received = receiveCommandFrame(commandSize);
+	}
 
-				if(debugMsgActive) printf("Proc cmd GET_LATCHED_DATA\n");
+	if(received)
+	{
+		spiCommandReceivedTime = statsTimeNow();
 
-				// Five bytes have to be output.
+		// Command frame was read.
+		outputBufferLength = processSpiCommandFrame(inputBuffer, outputBuffer);
 
-				latchedDataIndex = inputBuffer[1];
-				int latchedDataVal = getLatchedData(latchedDataIndex);
+		sendResponseFrame();
+	}
+	else
+	{
+		// Command aborted. Wait for next command cycle.
+		setReadyForCommand(false);
+	}
+}
 
-				// Latched data. Little endian byte order.
-				outputBuffer[outputBufferWritePosn++] = latchedDataVal & 0xFF;
-				outputBuffer[outputBufferWritePosn++] = (latchedDataVal >> 8) & 0xFF;
-				outputBuffer[outputBufferWritePosn++] = (latchedDataVal >> 16) & 0xFF;
-				outputBuffer[outputBufferWritePosn++] = (latchedDataVal >> 24) & 0xFF;
+/**
+ * Read a length-prefixed command frame from SPI and write a length-prefixed response.
+ * The length prefix is received first and the rest of the transfer sized from it.
+ * @see SPI_PROTOCOL_FRAMED
+ */
+void __not_in_flash_func(processSpiFramedCommandResponse)()
+{
+#if SPI_LATCH_DMA
+	// Anything left over from an aborted command cycle.
+	abortFrameDma();
+#endif
 
-				break;
+	while(spiRxReadable())
+	{
+		spiReadByte();
+	}
 
-			case SET_SENSOR_DATA:
+	inputBufferPosn = 0;
 
-				if(debugMsgActive) printf("Proc cmd SET_SENSOR_DATA\n");
+	startReceiveCommandFrame(SPI_FRAME_HEADER_SIZE);
 
-				latchedDataIndex = inputBuffer[1];
-				int sensorIndex = inputBuffer[2];
+	setReadyForCommand(true);
 
-				int sensorDataVal = inputBuffer[3];
-				int scratch = inputBuffer[4];
-				sensorDataVal += scratch << 8;
-				scratch = inputBuffer[5];
-				sensorDataVal += scratch << 16;
-				scratch = inputBuffer[6];
-				sensorDataVal += scratch << 24;
+	statsRecordSince(STATS_READY_LATENCY, spiLatchCommandActiveTime);
 
-				// Just reply with the inverted success value so that 0 indicates no error.
-				outputBuffer[outputBufferWritePosn++] = !setSensorData(latchedDataIndex, sensorIndex, sensorDataVal);
+	bool received = receiveCommandFrame(SPI_FRAME_HEADER_SIZE);
 
-				break;
+	int payloadSize = inputBuffer[0] | inputBuffer[1] << 8;
 
-			default:
+	if(received)
+	{
+		if(payloadSize < 1 || payloadSize > spiFramePayloadSize)
+		{
+			TRACE(TRACE_SPI_FRAME_SIZE_OUT_OF_BOUNDS, payloadSize, 0);
 
-				// Bad command.
+			statsCount(STATS_BAD_COMMANDS);
 
-				outputBufferWritePosn = 0;
-				while(outputBufferWritePosn++ < SPI_COMMAND_RESPONSE_FRAME_SIZE) outputBuffer[outputBufferWritePosn] = 0xFF;
+			received = false;
+		}
+		else
+		{
+			// With DMA the rx FIFO holds the start of the payload until the channel is re-armed.
+			startReceiveCommandFrame(SPI_FRAME_HEADER_SIZE + payloadSize);
 
-				if(debugMsgActive) printf("Unknown SPI command 0x%X\n", inputBuffer[0]);
+			received = receiveCommandFrame(SPI_FRAME_HEADER_SIZE + payloadSize);
 		}
+	}
+
+	if(received)
+	{
+		spiCommandReceivedTime = statsTimeNow();
+
+		uint8_t* command = inputBuffer + SPI_FRAME_HEADER_SIZE;
+
+		// Short commands read as if zero padded to a whole frame. Longer commands must be sent in full.
+		for(int index = payloadSize; index < SPI_COMMAND_RESPONSE_FRAME_SIZE; index++) command[index] = 0;
+
+		int responseSize = processSpiCommand(command, payloadSize, outputBuffer + SPI_FRAME_HEADER_SIZE,
+			spiFramePayloadSize, true);
+
+		// Length prefix. Little endian byte order.
+		outputBuffer[0] = responseSize & 0xFF;
+		outputBuffer[1] = (responseSize >> 8) & 0xFF;
 
-		commandReplyReady = true;
+		outputBufferLength = SPI_FRAME_HEADER_SIZE + responseSize;
+
+		sendResponseFrame();
 	}
 	else
 	{
 		// Command aborted. Wait for next command cycle.
 		setReadyForCommand(false);
 	}
+}
 
-	if(commandReplyReady)
+/**
+ * Shift in a command frame while shifting out the response to the previous command, as a pipelined transfer.
+ * The transfer is as long as the response in the output buffer. Waits as long as it takes for the master to start the
+ * transfer but, once it has started, the master must finish it.
+ * @param readyForCommand Level to set ready for command to once this Pico is ready for the transfer.
+ * @param firstTransfer True for the first transfer of the command cycle, which carries no response.
+ * @returns True if the whole transfer was shifted. False if the master aborted the command cycle or stalled.
+ */
+bool __not_in_flash_func(transferPipelinedFrame)(bool readyForCommand, bool firstTransfer)
+{
+	inputBufferPosn = 0;
+	outputBufferReadPosn = 0;
+
+#if SPI_LATCH_DMA
+
+	spiRxFrameComplete = false;
+
+	dma_channel_set_write_addr(spiRxDmaChannel, inputBuffer, false);
+	dma_channel_set_trans_count(spiRxDmaChannel, outputBufferLength, true);
+
+	dma_channel_set_read_addr(spiTxDmaChannel, outputBuffer, false);
+	dma_channel_set_trans_count(spiTxDmaChannel, outputBufferLength, true);
+
+	setReadyForCommand(readyForCommand);
+
+	if(firstTransfer) statsRecordSince(STATS_READY_LATENCY, spiLatchCommandActiveTime);
+	else statsRecordSince(STATS_COMMAND_SERVICE_TIME, spiCommandReceivedTime);
+
+	// Sleep until the transfer completes or the command active GPIO changes.
+	while(spiLatchCommandActive && !spiRxFrameComplete) __wfe();
+
+	if(spiRxFrameComplete) inputBufferPosn = outputBufferLength;
+
+#else
+
+	while(outputBufferReadPosn < outputBufferLength && spiTxWritable())
 	{
-		if(debugMsgActive && !(spi0_hw -> sr & SPI_SSPSR_TFE_BITS))
-		{
-			printf("Warning: Latch command transmit FIFO was not empty.\n");
-		}
+		spiWriteByte(outputBuffer[outputBufferReadPosn++]);
+	}
 
-		//if(debugMsgActive) printf("Writing command reply.\n");
+	setReadyForCommand(readyForCommand);
 
-		// Write as much as possible from output buffer to SPI tx fifo.
-		while(outputBufferReadPosn < SPI_COMMAND_RESPONSE_FRAME_SIZE && spiLatchCommandActive &&
-			spi0_hw -> sr & SPI_SSPSR_TNF_BITS)
-		{
-			spi0_hw -> dr = outputBuffer[outputBufferReadPosn++];
-		}
+	if(firstTransfer) statsRecordSince(STATS_READY_LATENCY, spiLatchCommandActiveTime);
+	else statsRecordSince(STATS_COMMAND_SERVICE_TIME, spiCommandReceivedTime);
 
-		// This should indicate to the master that it can start to read the command response.
-		setReadyForCommand(false);
+	absolute_time_t timeoutTime = 0;
 
-		//if(debugMsgActive) printf("Master can read command response.\n");
+	bool timeout = false;
 
-		timeoutTime = make_timeout_time_ms(1);
+	while(spiLatchCommandActive && inputBufferPosn < outputBufferLength && !timeout)
+	{
+		if(spiRxReadable())
+		{
+			inputBuffer[inputBufferPosn++] = spiReadByte();
 
-		// Write any remaining data from output buffer to SPI tx fifo.
-		while(outputBufferReadPosn < SPI_COMMAND_RESPONSE_FRAME_SIZE && spiLatchCommandActive && !timeout)
+			// Timed from the last byte so that a long transfer isn't cut off.
+			timeoutTime = make_timeout_time_ms(1);
+		}
+		else if(outputBufferReadPosn < outputBufferLength && spiTxWritable())
 		{
-			if(spi0_hw -> sr & SPI_SSPSR_TNF_BITS)
-			{
-				spi0_hw -> dr = outputBuffer[outputBufferReadPosn++];
-			}
-			else
-			{
-				// Check for timeout.
-				timeout = get_absolute_time() > timeoutTime;
-			}
+			spiWriteByte(outputBuffer[outputBufferReadPosn++]);
+		}
+		else if(inputBufferPosn > 0)
+		{
+			timeout = get_absolute_time() > timeoutTime;
 		}
+	}
+
+	if(timeout) statsCount(STATS_RECEIVE_TIMEOUTS);
+
+	if(timeout) TRACE(TRACE_SPI_PIPELINED_TIMEOUT, inputBufferPosn, outputBufferLength);
+
+#endif
+
+	return inputBufferPosn == outputBufferLength;
+}
+
+/**
+ * Run a pipelined command cycle, processing commands until the master drops command active.
+ * @see SPI_PROTOCOL_PIPELINED
+ */
+void __not_in_flash_func(processSpiPipelinedCycle)()
+{
+#if SPI_LATCH_DMA
+	// Anything left over from an aborted command cycle.
+	abortFrameDma();
+#endif
+
+	while(spiRxReadable())
+	{
+		spiReadByte();
+	}
 
-		if(debugMsgActive && timeout) printf("Timeout during latch command reply.\n");
-		//if(debugMsgActive && !timeout) printf("Latch command finished read.\n");
+	// The first transfer has no response to carry.
+	outputBufferLength = SPI_COMMAND_RESPONSE_FRAME_SIZE;
+
+	for(int index = 0; index < outputBufferLength; index++) outputBuffer[index] = 0;
+
+	bool readyForCommand = true;
+	bool firstTransfer = true;
+
+	// NO_COMMAND ends the pipeline. Nothing more is queued so the tx FIFO is left empty for the next command cycle.
+	while(transferPipelinedFrame(readyForCommand, firstTransfer) && inputBuffer[0] != NO_COMMAND)
+	{
+		spiCommandReceivedTime = statsTimeNow();
+
+		outputBufferLength = processSpiCommand(inputBuffer, inputBufferPosn, outputBuffer, SPI_MAX_RESPONSE_SIZE, false);
+
+		readyForCommand = !readyForCommand;
+		firstTransfer = false;
 	}
+
+	setReadyForCommand(false);
 }
 
 void __not_in_flash_func(spiGpioIrqCallback)(uint gpio, uint32_t event_mask)
 {
+	// Only registered for SPI_LATCH_COMMAND_ACTIVE_GPIO_PIN.
+	(void)gpio;
+
 	// This should just trigger the processing, not actually do it during the interupt.
 	// Note: Edge interrupts are used because level interrupts will continuously fire.
 
@@ -257,15 +1044,17 @@ void __not_in_flash_func(spiGpioIrqCallback)(uint gpio, uint32_t event_mask)
 	{
 		spiLatchCommandActive = gpio_get(SPI_LATCH_COMMAND_ACTIVE_GPIO_PIN);
 
+		if(spiLatchCommandActive) spiLatchCommandActiveTime = statsTimeNow();
+
 		gpio_put(SPI_LATCH_COMMAND_ACTIVE_LED_GPIO_PIN, spiLatchCommandActive);
 
 		if(spiLatchCommandActive)
 		{
-			if(debugMsgActive) printf("SPI master is active.\n");
+			TRACE(TRACE_SPI_MASTER_ACTIVE, 0, 0);
 		}
 		else
 		{
-			if(debugMsgActive) printf("SPI master is inactive.\n");
+			TRACE(TRACE_SPI_MASTER_INACTIVE, 0, 0);
 		}
 	}
 
@@ -306,21 +1095,73 @@ void spiLatchStartSubsystem()
 	gpio_set_dir(SPI_LATCH_READY_FOR_COMMAND_GPIO_PIN, GPIO_OUT);
 	gpio_put(SPI_LATCH_READY_FOR_COMMAND_GPIO_PIN, false);
 
+	// Setup GPIO pin to tell the SPI master there is changed latched data. Raised by core 1 from now on.
+	gpio_init(SPI_LATCH_DATA_READY_GPIO_PIN);
+	gpio_set_dir(SPI_LATCH_DATA_READY_GPIO_PIN, GPIO_OUT);
+	gpio_put(SPI_LATCH_DATA_READY_GPIO_PIN, false);
+	setLatchedDataReadyGpio(SPI_LATCH_DATA_READY_GPIO_PIN);
+
 	// Setup the gpio callback. This doesn't set the irq event though.
 	setGpioIrqCallBack(SPI_LATCH_COMMAND_ACTIVE_GPIO_PIN, spiGpioIrqCallback);
 
 	// Enable the IRQ for the gpio pin.
 	gpio_set_irq_enabled(SPI_LATCH_COMMAND_ACTIVE_GPIO_PIN, GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL, true);
+
+#if SPI_LATCH_DMA
+
+	// Setup DMA to move frames between the SPI FIFOs and the frame buffers. Transfers are paced by the SPI DREQs and
+	// configured once here, only the buffer address and transfer count are re-armed for each frame.
+
+	spiRxDmaChannel = dma_claim_unused_channel(true);
+	spiTxDmaChannel = dma_claim_unused_channel(true);
+
+	dma_channel_config dmaConfig = dma_channel_get_default_config(spiRxDmaChannel);
+	channel_config_set_transfer_data_size(&dmaConfig, DMA_SIZE_8);
+	channel_config_set_read_increment(&dmaConfig, false);
+	channel_config_set_write_increment(&dmaConfig, true);
+	channel_config_set_dreq(&dmaConfig, spi_get_dreq(spi0, false));
+
+	dma_channel_configure(spiRxDmaChannel, &dmaConfig, inputBuffer, &spi_get_hw(spi0) -> dr,
+		SPI_COMMAND_RESPONSE_FRAME_SIZE, false);
+
+	dmaConfig = dma_channel_get_default_config(spiTxDmaChannel);
+	channel_config_set_transfer_data_size(&dmaConfig, DMA_SIZE_8);
+	channel_config_set_read_increment(&dmaConfig, true);
+	channel_config_set_write_increment(&dmaConfig, false);
+	channel_config_set_dreq(&dmaConfig, spi_get_dreq(spi0, true));
+
+	dma_channel_configure(spiTxDmaChannel, &dmaConfig, &spi_get_hw(spi0) -> dr, outputBuffer,
+		SPI_COMMAND_RESPONSE_FRAME_SIZE, false);
+
+	// Only completion of a received frame needs to wake the core.
+	dma_channel_set_irq0_enabled(spiRxDmaChannel, true);
+	irq_set_exclusive_handler(DMA_IRQ_0, spiDmaIrqHandler);
+	irq_set_enabled(DMA_IRQ_0, true);
+
+#endif
 }
 
-void spiLatchProcess()
+void __not_in_flash_func(spiLatchProcess)()
 {
 	if(spiLatchCommandActive)
 	{
 		spiLatchCommandCycleComplete = false;
 
+		statsCount(STATS_COMMAND_CYCLES);
+
 		// Process a single command cycle
-		processSpiCommandResponse();
+		if(spiProtocolVersion == SPI_PROTOCOL_PIPELINED)
+		{
+			processSpiPipelinedCycle();
+		}
+		else if(spiProtocolVersion == SPI_PROTOCOL_FRAMED)
+		{
+			processSpiFramedCommandResponse();
+		}
+		else
+		{
+			processSpiCommandResponse();
+		}
 
 		// Wait for command cycle to complete. This has to be triggered by the falling edge of the command active GPIO
 		// because otherwise the command processing routine may re-enter before the master has a chance to finish reading
@@ -339,7 +1180,7 @@ void spiLatchProcess()
 	}
 }
 
-bool spiLatchProcReq()
+bool __not_in_flash_func(spiLatchProcReq)()
 {
 	return spiLatchCommandActive;
 }
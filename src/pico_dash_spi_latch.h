@@ -4,6 +4,10 @@
 #include "hardware/gpio.h"
 #include "hardware/spi.h"
 
+#include "pico_dash_history.h"
+#include "pico_dash_latch.h"
+#include "pico_dash_stats.h"
+
 // SPI communication.
 // spi0 Is used exclusively.
 
@@ -28,9 +32,74 @@
  */
 #define SPI_LATCH_READY_FOR_COMMAND_GPIO_PIN 21
 
+/**
+ * The GPIO pin to use to indicate to the SPI master that latched data has changed and can be got with GET_CHANGED.
+ * Raised by core 1 when a sensor's value moves beyond its CHANGE_DEADBAND and lowered once GET_CHANGED has got every
+ * change, so the master only needs to issue commands when there is something new.
+ * @note This is _not_ part of the SPI subsystem.
+ */
+#define SPI_LATCH_DATA_READY_GPIO_PIN 22
+
 /** The command/response frame size, in bytes. */
 #define SPI_COMMAND_RESPONSE_FRAME_SIZE 8
 
+/** Size of a response of the given number of bytes, rounded up to whole frames. */
+#define SPI_WHOLE_FRAMES_SIZE(bytes) \
+	(((bytes) + SPI_COMMAND_RESPONSE_FRAME_SIZE - 1) / SPI_COMMAND_RESPONSE_FRAME_SIZE * SPI_COMMAND_RESPONSE_FRAME_SIZE)
+
+/** Number of latched data indexes that fit in the GET_LATCHED_DATA_MULTI index mask. */
+#define SPI_LATCHED_DATA_MULTI_MAX_INDEXES ((SPI_COMMAND_RESPONSE_FRAME_SIZE - 1) * 8)
+
+/** Size of a GET_CHANGED response with room for the given number of changes. */
+#define SPI_GET_CHANGED_RESPONSE_SIZE(maxChanges) SPI_WHOLE_FRAMES_SIZE(2 + 5 * (maxChanges))
+
+/** GET_STATS selector for the event counters rather than a histogram. */
+#define SPI_GET_STATS_COUNTERS 0xFF
+
+/** GET_STATS flag to reset every stat once the response has been built. */
+#define SPI_GET_STATS_RESET 0x01
+
+/** Size of a GET_STATS response for the event counters. */
+#define SPI_GET_STATS_COUNTERS_RESPONSE_SIZE SPI_WHOLE_FRAMES_SIZE(2 + 4 * MAX_STATS_COUNTERS)
+
+/** Size of a GET_STATS response for a histogram. */
+#define SPI_GET_STATS_HISTOGRAM_RESPONSE_SIZE SPI_WHOLE_FRAMES_SIZE(3 + 16 + 4 * STATS_HISTOGRAM_BUCKETS)
+
+/**
+ * Size of a SET_SENSOR_CONFIG command, or of a GET_SENSOR_CONFIG response, carrying the given number of sensor
+ * variables.
+ */
+#define SPI_SENSOR_CONFIG_SIZE(sensorVars) SPI_WHOLE_FRAMES_SIZE(6 + 4 * (sensorVars))
+
+/** Size of a GET_HISTORY response with room for the given number of samples. */
+#define SPI_GET_HISTORY_RESPONSE_SIZE(maxSamples) SPI_WHOLE_FRAMES_SIZE(11 + 8 * (maxSamples))
+
+/** Most samples a GET_HISTORY can ask for. As many as fit in the largest length-prefixed frame payload. */
+#define SPI_HISTORY_MAX_SAMPLES 62
+
+/** Longest command, in bytes. A SET_SENSOR_CONFIG of every sensor variable. Every other command is a single frame. */
+#define SPI_MAX_COMMAND_SIZE SPI_SENSOR_CONFIG_SIZE(MAX_SENSOR_DATA - 1)
+
+/** Largest response, in bytes. A GET_HISTORY of the most samples, which is bigger than any other response. */
+#define SPI_MAX_RESPONSE_SIZE SPI_GET_HISTORY_RESPONSE_SIZE(SPI_HISTORY_MAX_SAMPLES)
+
+/** Size of the length prefix of a length-prefixed frame, in bytes. @see SPI_PROTOCOL_FRAMED */
+#define SPI_FRAME_HEADER_SIZE 2
+
+/** Largest length-prefixed frame payload this Pico supports, in bytes. Must be at least SPI_MAX_RESPONSE_SIZE. */
+#define SPI_MAX_FRAME_PAYLOAD_SIZE 512
+
+/** Longest transfer in any protocol version, in bytes. */
+#define SPI_MAX_TRANSFER_SIZE (SPI_FRAME_HEADER_SIZE + SPI_MAX_FRAME_PAYLOAD_SIZE)
+
+/**
+ * Set to 1 to have DMA move command/response frames between the SPI FIFOs and the frame buffers. Core 0 then sleeps
+ * while a command frame is being received instead of polling the rx FIFO, and only wakes to decode a finished frame.
+ */
+#ifndef SPI_LATCH_DMA
+#define SPI_LATCH_DMA 0
+#endif
+
 /**
  * SPI baud rate. My understanding is that, as a slave, this specifies the maximum baud rate that master can use,
  * with the minimum being the system clock rate divided by (254 x 256).
@@ -57,6 +126,16 @@
  */
 enum SpiCommand
 {
+	/**
+	 * No command. Pipelined masters use it to shift out the response to their last command, which also ends the
+	 * pipeline. Only a command in SPI_PROTOCOL_PIPELINED, where it has no response. In every other protocol it is a bad
+	 * command, like any other low value, so that a zero frame is never taken as a command.
+	 *
+	 *     Incoming data payload:
+	 *                            1 byte command.
+	 */
+	NO_COMMAND = 0x00,
+
 	/**
 	 * Get index to use to retrieve latched data.
 	 *
@@ -113,9 +192,317 @@ enum SpiCommand
 	 *                            1 byte that is the command supplied from the incoming data payload.
 	 *                            1 byte indicating an error code. 0 indicates no error.
 	 */
-	SET_SENSOR_DATA = 0xF4
+	SET_SENSOR_DATA = 0xF4,
+
+	/**
+	 * Get latched data for many indexes in a single command cycle.
+	 * The response is as many frames as it takes to hold it and the master reads all of them, back to back, in the
+	 * one command cycle. The number of frames follows from the number of indexes requested so the master always knows
+	 * how many to read.
+	 *
+	 *     Incoming data payload:
+	 *                            1 byte command.
+	 *                            7 bytes of latched data index mask. Bit n of byte 1 + n / 8 (ie bit n % 8) set
+	 *                            requests latched data index n. Bit 0 and bits for indexes that don't exist must be
+	 *                            clear, otherwise the command is bad.
+	 *
+	 *     Outgoing data payload:
+	 *                            1 byte that is the command supplied from the incoming data payload.
+	 *                            32 bit integer (4 bytes) for each requested index, in ascending index order.
+	 *                            Byte order, little endian (ie lowest order byte first).
+	 *                            Zero padding to the end of the last frame.
+	 *                            ie (1 + 4 x number of indexes + 7) / 8 frames.
+	 */
+	GET_LATCHED_DATA_MULTI = 0xF5,
+
+	/**
+	 * Get the latched data that has changed since it was last got. Only sensors with a CHANGE_DEADBAND set are ever
+	 * reported. The master would normally only issue this when SPI_LATCH_DATA_READY_GPIO_PIN is raised.
+	 * The response is as many frames as it takes to hold the most changes the master asked for, whatever the actual
+	 * number of changes, so the master always knows how many to read. Changes that don't fit are left for the next
+	 * GET_CHANGED and the data ready GPIO stays raised.
+	 *
+	 *     Incoming data payload:
+	 *                            1 byte command.
+	 *                            1 byte that contains the most changes to return. 1 to the number of latched data
+	 *                            indexes, otherwise the command is bad.
+	 *
+	 *     Outgoing data payload:
+	 *                            1 byte that is the command supplied from the incoming data payload.
+	 *                            1 byte that contains the number of changes.
+	 *                            For each change, in ascending index order:
+	 *                                1 byte that contains the latched data index.
+	 *                                32 bit integer (4 bytes). Byte order, little endian (ie lowest order byte first).
+	 *                            Zero padding to the end of the last frame.
+	 *                            ie (2 + 5 x most changes + 7) / 8 frames.
+	 */
+	GET_CHANGED = 0xF6,
+
+	/**
+	 * Set the protocol version (enum SpiProtocolVersion) used from the next command cycle on. Masters that never send
+	 * this get SPI_PROTOCOL_HALF_DUPLEX.
+	 *
+	 *     Incoming data payload:
+	 *                            1 byte command.
+	 *                            1 byte that contains the highest protocol version the master supports. 0 is bad.
+	 *                            16 bit integer (2 bytes) that is the largest length-prefixed frame payload the master
+	 *                            supports. Only used for SPI_PROTOCOL_FRAMED, where less than
+	 *                            SPI_COMMAND_RESPONSE_FRAME_SIZE is bad. Byte order, little endian.
+	 *
+	 *     Outgoing data payload:
+	 *                            1 byte that is the command supplied from the incoming data payload.
+	 *                            1 byte that contains the protocol version that will be used. The lower of the master's
+	 *                            and SPI_PROTOCOL_MAX_VERSION.
+	 *                            For SPI_PROTOCOL_FRAMED, 16 bit integer (2 bytes) that is the largest frame payload
+	 *                            that will be used. The lower of the master's and SPI_MAX_FRAME_PAYLOAD_SIZE.
+	 *                            Byte order, little endian.
+	 */
+	SET_PROTOCOL_VERSION = 0xF7,
+
+	/**
+	 * Get what this Pico's SPI protocol supports, so the master can choose what to ask for with SET_PROTOCOL_VERSION.
+	 *
+	 *     Incoming data payload:
+	 *                            1 byte command.
+	 *
+	 *     Outgoing data payload:
+	 *                            1 byte that is the command supplied from the incoming data payload.
+	 *                            1 byte that contains the highest protocol version supported (SPI_PROTOCOL_MAX_VERSION).
+	 *                            16 bit integer (2 bytes) that is the largest length-prefixed frame payload supported
+	 *                            (SPI_MAX_FRAME_PAYLOAD_SIZE). Byte order, little endian.
+	 */
+	GET_CAPABILITIES = 0xF8,
+
+	/**
+	 * Get latency and jitter stats (see pico_dash_stats.h), either the event counters or one timing histogram. All
+	 * times are in microseconds. The response size depends only on what is asked for, so the master always knows how
+	 * many frames to read. A bad command if the stats were compiled out.
+	 *
+	 *     Incoming data payload:
+	 *                            1 byte command.
+	 *                            1 byte that is SPI_GET_STATS_COUNTERS or the histogram id (enum StatsHistogramId).
+	 *                            1 byte that contains the latched data index, for STATS_STROBE_LATENESS. Must be 0
+	 *                            otherwise.
+	 *                            1 byte of flags. SPI_GET_STATS_RESET resets every stat after they have been read.
+	 *
+	 *     Outgoing data payload for SPI_GET_STATS_COUNTERS:
+	 *                            1 byte that is the command supplied from the incoming data payload.
+	 *                            1 byte that is SPI_GET_STATS_COUNTERS.
+	 *                            32 bit integer (4 bytes) for each counter, in counter id (enum StatsCounterId) order.
+	 *                            Zero padding to the end of the last frame.
+	 *                            ie SPI_GET_STATS_COUNTERS_RESPONSE_SIZE bytes.
+	 *
+	 *     Outgoing data payload for a histogram:
+	 *                            1 byte that is the command supplied from the incoming data payload.
+	 *                            1 byte that is the histogram id.
+	 *                            1 byte that is the latched data index.
+	 *                            32 bit integer (4 bytes) that is the number of times recorded.
+	 *                            32 bit integer (4 bytes) that is the longest time recorded.
+	 *                            64 bit integer (8 bytes) that is the sum of the times recorded.
+	 *                            32 bit integer (4 bytes) for each of the STATS_HISTOGRAM_BUCKETS buckets.
+	 *                            Zero padding to the end of the last frame.
+	 *                            ie SPI_GET_STATS_HISTOGRAM_RESPONSE_SIZE bytes.
+	 *
+	 *     All integers are little endian byte order (ie lowest order byte first).
+	 */
+	GET_STATS = 0xF9,
+
+	/**
+	 * Begin a batch of sensor data. Nothing set with SET_SENSOR_DATA from now on takes effect until
+	 * COMMIT_SENSOR_DATA_BATCH, then it all takes effect together, between the same two strobes.
+	 *
+	 *     Incoming data payload:
+	 *                            1 byte command.
+	 *
+	 *     Outgoing data payload:
+	 *                            1 byte that is the command supplied from the incoming data payload.
+	 */
+	BEGIN_SENSOR_DATA_BATCH = 0xFA,
+
+	/**
+	 * Commit the batch of sensor data begun with BEGIN_SENSOR_DATA_BATCH. If any SET_SENSOR_DATA in the batch failed
+	 * then none of the batch takes effect.
+	 *
+	 *     Incoming data payload:
+	 *                            1 byte command.
+	 *
+	 *     Outgoing data payload:
+	 *                            1 byte that is the command supplied from the incoming data payload.
+	 *                            1 byte indicating an error code. 0 indicates no error.
+	 */
+	COMMIT_SENSOR_DATA_BATCH = 0xFB,
+
+	/**
+	 * Save the sensor config, everything set with SET_SENSOR_DATA and committed, to flash. It is restored every time
+	 * this Pico starts, so the master only needs to set the sensors up once. Writing flash pauses the sensors, and holds
+	 * up the response, for up to 50 ms or so.
+	 *
+	 *     Incoming data payload:
+	 *                            1 byte command.
+	 *
+	 *     Outgoing data payload:
+	 *                            1 byte that is the command supplied from the incoming data payload.
+	 *                            1 byte indicating an error code. 0 indicates no error.
+	 */
+	SAVE_CONFIG = 0xFC,
+
+	/**
+	 * Go back to the sensor config last saved with SAVE_CONFIG. It takes effect all together, as a batch. Fails,
+	 * changing nothing, if there is no saved config or a batch has been begun.
+	 *
+	 *     Incoming data payload:
+	 *                            1 byte command.
+	 *
+	 *     Outgoing data payload:
+	 *                            1 byte that is the command supplied from the incoming data payload.
+	 *                            1 byte indicating an error code. 0 indicates no error.
+	 */
+	LOAD_CONFIG = 0xFD,
+
+	/**
+	 * Set any number of a sensor's variables, up to the whole of its config, in one command. Takes effect all together,
+	 * as a batch, or not at all, so a sensor is never left part set up. The variables are set in restore order:
+	 * SENSOR_TYPE first, as it resets the type specific variables, and ACTIVE last. Inside a batch begun with
+	 * BEGIN_SENSOR_DATA_BATCH it joins the batch, and failing fails the batch.
+	 * The command is as many frames as it takes to hold it and the master writes all of them, back to back, in the one
+	 * command cycle. The number of frames follows from the mask. Pipelined, the whole command must fit in the transfer
+	 * it is shifted in with, so it is best sent half duplex or framed. Framed, the payload must hold every value in the
+	 * mask. Only the padding may be left off.
+	 * Every value is checked before any is set. Type specific variables must match the sensor's type, as set by this
+	 * command or before it.
+	 *
+	 *     Incoming data payload:
+	 *                            1 byte command.
+	 *                            1 byte that contains the latched data index that the sensor populates.
+	 *                            32 bit integer (4 bytes) mask of the sensor data ids (enum SensorData) to set. Bit n
+	 *                            set sets id n. Bit 0 and bits for ids that don't exist must be clear, otherwise the
+	 *                            command is bad.
+	 *                            32 bit integer (4 bytes) value for each id in the mask, in ascending id order.
+	 *                            Zero padding to the end of the last frame.
+	 *                            ie SPI_SENSOR_CONFIG_SIZE(number of ids) bytes.
+	 *
+	 *     Outgoing data payload:
+	 *                            1 byte that is the command supplied from the incoming data payload.
+	 *                            1 byte indicating an error code. 0 indicates no error.
+	 *
+	 *     All integers are little endian byte order (ie lowest order byte first).
+	 */
+	SET_SENSOR_CONFIG = 0xFE,
+
+	/**
+	 * Get any number of a sensor's variables, as committed. Variables never set since the sensor type was last set read
+	 * as 0 and are left out of the returned mask. Where every variable asked for has been set, the response is the
+	 * SET_SENSOR_CONFIG command for them but for its first byte.
+	 * The response size depends only on the mask asked for, so the master always knows how many frames to read.
+	 *
+	 *     Incoming data payload:
+	 *                            1 byte command.
+	 *                            1 byte that contains the latched data index that the sensor populates.
+	 *                            32 bit integer (4 bytes) mask of the sensor data ids (enum SensorData) to get. Bit n
+	 *                            set gets id n. Bit 0 and bits for ids that don't exist must be clear, otherwise the
+	 *                            command is bad.
+	 *
+	 *     Outgoing data payload:
+	 *                            1 byte that is the command supplied from the incoming data payload.
+	 *                            1 byte that contains the latched data index.
+	 *                            32 bit integer (4 bytes) mask of the ids asked for that have been set.
+	 *                            32 bit integer (4 bytes) value for each id asked for, in ascending id order.
+	 *                            Zero padding to the end of the last frame.
+	 *                            ie SPI_SENSOR_CONFIG_SIZE(number of ids asked for) bytes.
+	 *
+	 *     All integers are little endian byte order (ie lowest order byte first).
+	 */
+	GET_SENSOR_CONFIG = 0xF0,
+
+	/**
+	 * Get samples from a latched data index's history (see pico_dash_history.h): every value latched for it, in the
+	 * order they were latched, with the time each was latched. Samples are numbered in that order from 0, so the master
+	 * can ask for those since the last it got, however long ago that was, so long as they haven't been dropped to make
+	 * room. Otherwise the first sample got is later than the one asked for. No samples are got if there are none from
+	 * the one asked for on.
+	 * The response size depends only on the most samples asked for, so the master always knows how many frames to read.
+	 * The most samples take 64 frames, so are best got framed. A bad command if the history was compiled out.
+	 *
+	 *     Incoming data payload:
+	 *                            1 byte command.
+	 *                            1 byte that contains the latched data index.
+	 *                            32 bit integer (4 bytes) sequence number of the first sample wanted.
+	 *                            1 byte that is the most samples to get, from 1 to SPI_HISTORY_MAX_SAMPLES.
+	 *
+	 *     Outgoing data payload:
+	 *                            1 byte that is the command supplied from the incoming data payload.
+	 *                            1 byte that contains the latched data index.
+	 *                            1 byte that is the number of samples got.
+	 *                            32 bit integer (4 bytes) sequence number of the first sample got, or that the next
+	 *                            sample latched will have if none were got.
+	 *                            32 bit integer (4 bytes) number of samples ever latched, ie the sequence number the
+	 *                            next sample latched will have.
+	 *                            For each sample got:
+	 *                                32 bit integer (4 bytes) time it was latched, the low 32 bits of the microsecond
+	 *                                timer.
+	 *                                32 bit integer (4 bytes) value latched.
+	 *                            Zero padding to the end of the last frame.
+	 *                            ie SPI_GET_HISTORY_RESPONSE_SIZE(most samples) bytes.
+	 *
+	 *     All integers are little endian byte order (ie lowest order byte first).
+	 */
+	GET_HISTORY = 0xEF
 };
 
+/**
+ * Versions of the command cycle protocol.
+ */
+enum SpiProtocolVersion
+{
+	/**
+	 * One command per command cycle. The master raises command active, waits for ready for command, writes the command
+	 * frame, waits for ready for command to drop, reads the response and then drops command active.
+	 */
+	SPI_PROTOCOL_HALF_DUPLEX = 1,
+
+	/**
+	 * Any number of commands per command cycle, each response shifted out while the next command is shifted in.
+	 * The master raises command active and waits for ready for command. Ready for command then toggles each time this
+	 * Pico is ready for the next transfer. Each transfer shifts in a command frame and, at the same time, shifts out the
+	 * response to the previous command. A transfer is as long as that response, with the command frame first and zero
+	 * padding after it. The first transfer of a cycle is a frame long and carries no response. The master shifts out
+	 * the response to its last command with a NO_COMMAND. That ends the pipeline. Nothing more is shifted out and ready
+	 * for command stays low until the next command cycle, so the master just drops command active.
+	 * Half the bus time of SPI_PROTOCOL_HALF_DUPLEX per command, and only one command active handshake per cycle.
+	 */
+	SPI_PROTOCOL_PIPELINED = 2,
+
+	/**
+	 * One command per command cycle, as SPI_PROTOCOL_HALF_DUPLEX, but with length-prefixed frames of up to the agreed
+	 * frame payload size instead of fixed size frames. Each frame is a 16 bit integer (2 bytes, little endian) payload
+	 * length followed by the payload. A command payload is the command byte and its arguments, as they would be in a
+	 * fixed size frame, without the padding. Trailing zero arguments of single frame commands may be left off. A
+	 * response payload is exactly as long as the response, also without padding. The master reads the length prefix of
+	 * the response first to know how much more to read.
+	 * A whole bulk read is one handshake and close to wire speed.
+	 */
+	SPI_PROTOCOL_FRAMED = 3,
+
+	/** Highest version supported. */
+	SPI_PROTOCOL_MAX_VERSION = SPI_PROTOCOL_FRAMED
+};
+
+/**
+ * Get the size of a command from its first frame.
+ * @param inputFrame First frame of the command.
+ * @returns Size of the whole command in bytes. Always a whole number of frames, and no more than SPI_MAX_COMMAND_SIZE.
+ */
+int spiCommandSize(const uint8_t* inputFrame);
+
+/**
+ * Decode a command frame and build the response for it.
+ * This is the whole of command processing with none of the SPI transfer, so it can be run and timed anywhere.
+ * @param inputFrame Command of spiCommandSize bytes. A single frame for all but SET_SENSOR_CONFIG.
+ * @param outputFrame Response of up to SPI_MAX_RESPONSE_SIZE bytes to populate.
+ * @returns Length of the response in bytes. Always a whole number of frames.
+ */
+int processSpiCommandFrame(const uint8_t* inputFrame, uint8_t* outputFrame);
+
 /**
  * Start the SPI latched data communication subsystem.
  * This will "bind" to the calling core and should only ever be run by one core.
@@ -0,0 +1,92 @@
+#include "hardware/sync.h"
+
+#include "pico_dash_stats.h"
+
+#if PICO_DASH_STATS
+
+struct StatsHistogram _statsHistograms[STATS_STROBE_LATENESS];
+
+uint32_t _statsCounters[MAX_STATS_COUNTERS];
+
+/** Strobe lateness by latched data index. Only written by core 1. */
+struct StatsHistogram _statsStrobeLateness[MAX_LATCHED_INDEXES];
+
+/** Incremented by core 0 to ask core 1 to reset the strobe lateness. */
+volatile uint32_t _statsResetSeq = 0;
+
+/** _statsResetSeq as of core 1's last reset of the strobe lateness. Only written by core 1. */
+volatile uint32_t _statsResetAck = 0;
+
+void __not_in_flash_func(statsRecordStrobeLateness)(LatchedDataIndex index, absolute_time_t deadline,
+	absolute_time_t curTime)
+{
+	uint32_t resetSeq = _statsResetSeq;
+
+	if(resetSeq != _statsResetAck)
+	{
+		for(int sensorIndex = 0; sensorIndex < MAX_LATCHED_INDEXES; sensorIndex++)
+		{
+			_statsStrobeLateness[sensorIndex] = (struct StatsHistogram){0};
+		}
+
+		// The histograms must be clear before core 0 reads them as reset.
+		__dmb();
+
+		_statsResetAck = resetSeq;
+	}
+
+	uint64_t latenessUs = curTime > deadline ? curTime - deadline : 0;
+
+	statsHistogramAdd(&_statsStrobeLateness[index], latenessUs < UINT32_MAX ? latenessUs : UINT32_MAX);
+}
+
+bool __not_in_flash_func(getStatsHistogram)(enum StatsHistogramId histogram, LatchedDataIndex index, struct StatsHistogram* copy)
+{
+	bool retVal = true;
+
+	*copy = (struct StatsHistogram){0};
+
+	if(histogram < STATS_STROBE_LATENESS)
+	{
+		*copy = _statsHistograms[histogram];
+	}
+	else if(histogram == STATS_STROBE_LATENESS && index > NO_LATCHED_INDEX && index < MAX_LATCHED_INDEXES)
+	{
+		// Until core 1 gets round to a reset it asked for, core 0 sees the strobe lateness as already reset. Each field
+		// is copied whole but core 1 may be part way through a record, so the copy can be a strobe out between fields.
+		if(_statsResetAck == _statsResetSeq)
+		{
+			__dmb();
+
+			*copy = _statsStrobeLateness[index];
+		}
+	}
+	else
+	{
+		retVal = false;
+	}
+
+	return retVal;
+}
+
+uint32_t __not_in_flash_func(getStatsCounter)(enum StatsCounterId counter)
+{
+	return counter < MAX_STATS_COUNTERS ? _statsCounters[counter] : 0;
+}
+
+void __not_in_flash_func(resetStats)()
+{
+	for(int histogram = 0; histogram < STATS_STROBE_LATENESS; histogram++)
+	{
+		_statsHistograms[histogram] = (struct StatsHistogram){0};
+	}
+
+	for(int counter = 0; counter < MAX_STATS_COUNTERS; counter++)
+	{
+		_statsCounters[counter] = 0;
+	}
+
+	_statsResetSeq++;
+}
+
+#endif
@@ -0,0 +1,190 @@
+#ifndef PICO_DASH_STATS_H
+#define PICO_DASH_STATS_H
+
+#include "pico.h"
+#include "pico/time.h"
+
+#include "pico_dash_latch.h"
+
+// Latency and jitter stats.
+// Event counters and log2 histograms of timings, all in microseconds off the 64 bit timer. Recording is an increment or
+// two and a count leading zeros, cheap enough for the SPI service loop and the strobe loop. The SPI master reads them
+// with GET_STATS.
+// The SPI stats belong to core 0 and the strobe lateness to core 1, so neither core ever writes the other's. Resetting
+// the strobe lateness from core 0 is a request that core 1 carries out at its next strobe.
+// Set PICO_DASH_STATS to 0 to compile all of it out. Recording is then an empty inline function and GET_STATS is a bad
+// command.
+
+#ifndef PICO_DASH_STATS
+#define PICO_DASH_STATS 1
+#endif
+
+/**
+ * Number of histogram buckets. Bucket 0 counts times of 0, bucket n times from 2^(n-1) to 2^n - 1 microseconds and the
+ * last bucket everything from 2^(STATS_HISTOGRAM_BUCKETS - 2) microseconds up.
+ */
+#define STATS_HISTOGRAM_BUCKETS 16
+
+/** Timing histograms. Those before STATS_STROBE_LATENESS are core 0 timings. */
+enum StatsHistogramId
+{
+	/** Time from a command being received to its response being ready for the master to read. */
+	STATS_COMMAND_SERVICE_TIME,
+
+	/** Time from the master raising command active to this Pico raising ready for command. */
+	STATS_READY_LATENCY,
+
+	/** How late a sensor strobe ran after it was due. One histogram per latched data index. */
+	STATS_STROBE_LATENESS,
+
+	/** Number of histogram ids. */
+	MAX_STATS_HISTOGRAMS
+};
+
+/** Event counters. */
+enum StatsCounterId
+{
+	/** Command cycles started by the master. */
+	STATS_COMMAND_CYCLES,
+
+	/** Commands decoded, good or bad. */
+	STATS_COMMANDS,
+
+	/** Commands answered with a bad command response, including length-prefixed frames that were too long. */
+	STATS_BAD_COMMANDS,
+
+	/** Command cycles abandoned because the master stopped sending part way through a command or transfer. */
+	STATS_RECEIVE_TIMEOUTS,
+
+	/** Responses abandoned because the master stopped reading part way through. */
+	STATS_SEND_TIMEOUTS,
+
+	/** Responses started with bytes of an earlier response still in the SPI tx FIFO. */
+	STATS_TX_FIFO_NOT_EMPTY,
+
+	/** Number of counters. */
+	MAX_STATS_COUNTERS
+};
+
+/** A log2 histogram of times. */
+struct StatsHistogram
+{
+	/** Number of times recorded. */
+	uint32_t count;
+
+	/** Longest time recorded, in microseconds. */
+	uint32_t max;
+
+	/** Sum of the times recorded, in microseconds. */
+	uint64_t sum;
+
+	/** Number of times in each bucket. */
+	uint32_t buckets[STATS_HISTOGRAM_BUCKETS];
+};
+
+/** Get the histogram bucket a time falls in. */
+static inline int statsHistogramBucket(uint32_t timeUs)
+{
+	int bucket = timeUs ? 32 - __builtin_clz(timeUs) : 0;
+
+	return bucket < STATS_HISTOGRAM_BUCKETS ? bucket : STATS_HISTOGRAM_BUCKETS - 1;
+}
+
+/** Add a time to a histogram. */
+static inline void statsHistogramAdd(struct StatsHistogram* histogram, uint32_t timeUs)
+{
+	histogram -> count++;
+	histogram -> sum += timeUs;
+	histogram -> buckets[statsHistogramBucket(timeUs)]++;
+
+	if(timeUs > histogram -> max) histogram -> max = timeUs;
+}
+
+#if PICO_DASH_STATS
+
+/** Current time, to start a core 0 timing from. */
+static inline absolute_time_t statsTimeNow()
+{
+	return get_absolute_time();
+}
+
+/** Histograms of the core 0 timings, by histogram id. Only written by core 0. */
+extern struct StatsHistogram _statsHistograms[STATS_STROBE_LATENESS];
+
+/** Event counters, by counter id. Only written by core 0. */
+extern uint32_t _statsCounters[MAX_STATS_COUNTERS];
+
+/**
+ * Record a core 0 timing.
+ * @param histogram STATS_COMMAND_SERVICE_TIME or STATS_READY_LATENCY.
+ * @param since Time the timing started. It ends now.
+ */
+static inline void statsRecordSince(enum StatsHistogramId histogram, absolute_time_t since)
+{
+	int64_t timeUs = absolute_time_diff_us(since, get_absolute_time());
+
+	statsHistogramAdd(&_statsHistograms[histogram], timeUs < 0 ? 0 : timeUs > UINT32_MAX ? UINT32_MAX : timeUs);
+}
+
+/** Count an event. Core 0 only. */
+static inline void statsCount(enum StatsCounterId counter)
+{
+	_statsCounters[counter]++;
+}
+
+/**
+ * Record how late a sensor strobe ran. Core 1 only.
+ * @param index Latched data index of the sensor.
+ * @param deadline Time the strobe was due.
+ * @param curTime Time it ran.
+ */
+void statsRecordStrobeLateness(LatchedDataIndex index, absolute_time_t deadline, absolute_time_t curTime);
+
+/**
+ * Get a copy of a histogram.
+ * @param histogram Histogram id.
+ * @param index Latched data index, for STATS_STROBE_LATENESS. Ignored otherwise.
+ * @param copy Returns the histogram. Empty if the id or index is out of bounds.
+ * @returns True if the histogram exists.
+ */
+bool getStatsHistogram(enum StatsHistogramId histogram, LatchedDataIndex index, struct StatsHistogram* copy);
+
+/**
+ * Get an event counter.
+ */
+uint32_t getStatsCounter(enum StatsCounterId counter);
+
+/**
+ * Reset every histogram and counter. Core 0 only.
+ */
+void resetStats();
+
+#else
+
+/** No timings, so there is no need to read the timer. */
+static inline absolute_time_t statsTimeNow()
+{
+	return 0;
+}
+
+static inline void statsRecordSince(enum StatsHistogramId histogram, absolute_time_t since)
+{
+	(void)histogram;
+	(void)since;
+}
+
+static inline void statsCount(enum StatsCounterId counter)
+{
+	(void)counter;
+}
+
+static inline void statsRecordStrobeLateness(LatchedDataIndex index, absolute_time_t deadline, absolute_time_t curTime)
+{
+	(void)index;
+	(void)deadline;
+	(void)curTime;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,145 @@
+#include <assert.h>
+#include <stdio.h>
+
+#include "hardware/sync.h"
+#include "hardware/timer.h"
+
+#include "pico_dash_trace.h"
+
+extern bool debugMsgActive;
+
+/** Number of trace rings. One per core. */
+#define TRACE_RINGS 2
+
+/** Most records taken from each ring per drain, to keep the main loop responsive to the SPI master. */
+#define TRACE_DRAIN_BATCH 4
+
+static_assert((TRACE_RING_SIZE & (TRACE_RING_SIZE - 1)) == 0, "Trace ring size must be a power of 2");
+
+/** A core's trace ring. */
+struct TraceRing
+{
+	struct TraceRecord records[TRACE_RING_SIZE];
+
+	/** Number of records ever written. Only written by the ring's core. */
+	volatile uint32_t head;
+
+	/** Number of records ever drained. Only written by core 0. */
+	volatile uint32_t tail;
+
+	/** Number of records dropped because the ring was full. Only written by the ring's core. */
+	volatile uint32_t dropped;
+};
+
+#if PICO_DASH_TRACE_LEVEL > TRACE_LEVEL_NONE
+
+#define TRACE_EVENT_FORMAT(id, level, format) format,
+
+/** printf format of each trace event, by trace event id. */
+static const char* const _traceFormats[MAX_TRACE_EVENTS] =
+{
+	TRACE_EVENTS(TRACE_EVENT_FORMAT)
+};
+
+#undef TRACE_EVENT_FORMAT
+
+struct TraceRing _traceRings[TRACE_RINGS];
+
+/** Drop count of each ring as of the last drop reported. Only used by core 0. */
+uint32_t _traceDroppedReported[TRACE_RINGS];
+
+void __not_in_flash_func(traceRecord)(enum TraceEventId event, int32_t arg0, int32_t arg1)
+{
+	// Read the time first. It's the only part that could take a while and doesn't need interrupts masked.
+	uint32_t time = time_us_32();
+
+	struct TraceRing* ring = _traceRings + get_core_num();
+
+	// Only this core writes its ring, so masking its interrupts is all it takes to keep producers apart.
+	uint32_t interrupts = save_and_disable_interrupts();
+
+	uint32_t head = ring -> head;
+
+	if(head - ring -> tail < TRACE_RING_SIZE)
+	{
+		struct TraceRecord* record = ring -> records + (head & (TRACE_RING_SIZE - 1));
+
+		record -> time = time;
+		record -> event = event;
+		record -> args[0] = arg0;
+		record -> args[1] = arg1;
+
+		// The record must be complete before core 0 can see it.
+		__dmb();
+
+		ring -> head = head + 1;
+	}
+	else
+	{
+		ring -> dropped++;
+	}
+
+	restore_interrupts(interrupts);
+}
+
+bool traceDrain()
+{
+	bool retVal = false;
+
+	for(uint core = 0; core < TRACE_RINGS; core++)
+	{
+		struct TraceRing* ring = _traceRings + core;
+
+		uint32_t tail = ring -> tail;
+
+		for(int count = 0; count < TRACE_DRAIN_BATCH && tail != ring -> head; count++)
+		{
+			// Don't read the record before seeing the head that covers it.
+			__dmb();
+
+			struct TraceRecord record = ring -> records[tail & (TRACE_RING_SIZE - 1)];
+
+			// The copy must be taken before the producer can reuse the slot.
+			__dmb();
+
+			ring -> tail = ++tail;
+
+			if(debugMsgActive && record.event < MAX_TRACE_EVENTS)
+			{
+				printf("%10lu core %u: ", (unsigned long)record.time, core);
+				printf(_traceFormats[record.event], record.args[0], record.args[1]);
+				printf("\n");
+			}
+		}
+
+		uint32_t dropped = ring -> dropped;
+
+		if(dropped != _traceDroppedReported[core])
+		{
+			if(debugMsgActive) printf("%lu trace records dropped on core %u.\n",
+				(unsigned long)(dropped - _traceDroppedReported[core]), core);
+
+			_traceDroppedReported[core] = dropped;
+		}
+
+		retVal = retVal || tail != ring -> head;
+	}
+
+	return retVal;
+}
+
+#else
+
+void traceRecord(enum TraceEventId event, int32_t arg0, int32_t arg1)
+{
+	(void)event;
+	(void)arg0;
+	(void)arg1;
+}
+
+bool traceDrain()
+{
+	return false;
+}
+
+#endif
@@ -0,0 +1,125 @@
+#ifndef PICO_DASH_TRACE_H
+#define PICO_DASH_TRACE_H
+
+#include "pico.h"
+
+// Binary trace log.
+// printf to USB stdio can take milliseconds, long enough for the SPI master to time out a command, so interrupt handlers
+// and the SPI service loop log through this instead. Logging an event writes a 16 byte record (timestamp, event id and
+// two arguments) into a ring belonging to the calling core. Only that core writes the ring, with interrupts masked for
+// the few cycles it takes, so no lock is shared between the cores. A full ring drops the record and counts the drop.
+// Core 0 drains both rings from its main loop whenever the SPI master has nothing for it, and only there are records
+// formatted and printed. Records logged by core 1 wait for core 0's next pass of its main loop.
+// Events below PICO_DASH_TRACE_LEVEL compile out entirely, arguments and all.
+
+/** Trace levels. */
+#define TRACE_LEVEL_NONE 0
+#define TRACE_LEVEL_ERROR 1
+#define TRACE_LEVEL_WARN 2
+#define TRACE_LEVEL_INFO 3
+#define TRACE_LEVEL_DEBUG 4
+
+/** Most detailed level of event to log. Anything more detailed compiles out. */
+#ifndef PICO_DASH_TRACE_LEVEL
+#define PICO_DASH_TRACE_LEVEL TRACE_LEVEL_INFO
+#endif
+
+/** Number of records in each core's ring. Must be a power of 2. */
+#define TRACE_RING_SIZE 64
+
+/**
+ * All trace events.
+ * Each entry is EVENT(id, level, format). The format is a printf format for the event's two int arguments, without a
+ * trailing newline. Arguments it doesn't use are ignored.
+ */
+#define TRACE_EVENTS(EVENT) \
+	EVENT(TRACE_SPI_MASTER_ACTIVE, TRACE_LEVEL_DEBUG, "SPI master is active.") \
+	EVENT(TRACE_SPI_MASTER_INACTIVE, TRACE_LEVEL_DEBUG, "SPI master is inactive.") \
+	EVENT(TRACE_SPI_READY_FOR_COMMAND, TRACE_LEVEL_DEBUG, "Ready for command.") \
+	EVENT(TRACE_SPI_COMMAND, TRACE_LEVEL_DEBUG, "Proc cmd 0x%X") \
+	EVENT(TRACE_SPI_RESPONSE_READY, TRACE_LEVEL_DEBUG, "Master can read %i byte command response.") \
+	EVENT(TRACE_SPI_UNKNOWN_COMMAND, TRACE_LEVEL_WARN, "Unknown SPI command 0x%X") \
+	EVENT(TRACE_SPI_RECEIVE_TIMEOUT, TRACE_LEVEL_WARN, "Timeout during latch command read. %i of %i bytes received.") \
+	EVENT(TRACE_SPI_SEND_TIMEOUT, TRACE_LEVEL_WARN, "Timeout during latch command reply. %i of %i bytes sent.") \
+	EVENT(TRACE_SPI_PIPELINED_TIMEOUT, TRACE_LEVEL_WARN, "Timeout during pipelined transfer. %i of %i bytes received.") \
+	EVENT(TRACE_SPI_TX_FIFO_NOT_EMPTY, TRACE_LEVEL_WARN, "Latch command transmit FIFO was not empty.") \
+	EVENT(TRACE_SPI_FRAME_SIZE_OUT_OF_BOUNDS, TRACE_LEVEL_INFO, "Frame payload size %i out of bounds.") \
+	EVENT(TRACE_SPI_COMMAND_INCOMPLETE, TRACE_LEVEL_INFO, "Only %i of %i command bytes received.") \
+	EVENT(TRACE_SPI_RESPONSE_TOO_BIG, TRACE_LEVEL_INFO, "Response to %i indexes too big.") \
+	EVENT(TRACE_SPI_MAX_CHANGES_OUT_OF_BOUNDS, TRACE_LEVEL_INFO, "Most changes %i out of bounds.") \
+	EVENT(TRACE_SPI_HISTORY_SAMPLES_OUT_OF_BOUNDS, TRACE_LEVEL_INFO, "Most history samples %i out of bounds.") \
+	EVENT(TRACE_STATS_OUT_OF_BOUNDS, TRACE_LEVEL_INFO, "Stats histogram %i, index %i out of bounds.") \
+	EVENT(TRACE_LATCHED_DATA_INDEX_OUT_OF_BOUNDS, TRACE_LEVEL_INFO, "Latched data index %i out of bounds.") \
+	EVENT(TRACE_SENSOR_INDEX_OUT_OF_BOUNDS, TRACE_LEVEL_INFO, "Sensor index %i out of bounds.") \
+	EVENT(TRACE_SENSOR_VARIABLE_OUT_OF_BOUNDS, TRACE_LEVEL_INFO, "Sensor data variable index %i out of bounds.") \
+	EVENT(TRACE_SENSOR_DATA_OUT_OF_BOUNDS, TRACE_LEVEL_INFO, "Sensor data variable %i value %i out of bounds.") \
+	EVENT(TRACE_SENSOR_VARIABLE_WRONG_TYPE, TRACE_LEVEL_INFO, "Sensor data variable %i not used by sensor type %i.") \
+	EVENT(TRACE_SENSOR_CONFIG_MASK_OUT_OF_BOUNDS, TRACE_LEVEL_INFO, "Sensor config mask 0x%X out of bounds.") \
+	EVENT(TRACE_CALIBRATION_TABLE_OUT_OF_BOUNDS, TRACE_LEVEL_INFO, "Calibration table %i out of bounds.") \
+	EVENT(TRACE_FILTER_OUT_OF_BOUNDS, TRACE_LEVEL_INFO, "Filter type or length %i out of bounds.") \
+	EVENT(TRACE_SENSOR_CONFIG_QUEUE_FULL, TRACE_LEVEL_WARN, "Sensor config queue full. Sensor %i data %i not set.") \
+	EVENT(TRACE_SENSOR_CONFIG_LOADED, TRACE_LEVEL_INFO, "Sensor config loaded from flash.") \
+	EVENT(TRACE_SENSOR_CONFIG_SAVE_FAILED, TRACE_LEVEL_ERROR, "Sensor config could not be saved to flash.") \
+	EVENT(TRACE_MICROSTEPPER_NOT_STARTED, TRACE_LEVEL_ERROR, "No microstepper for coil GPIO %i at %i microsteps.") \
+	EVENT(TRACE_PULSE_CAPTURE_NOT_STARTED, TRACE_LEVEL_ERROR, "No free pulse capture for GPIO %i.") \
+	EVENT(TRACE_PULSE_CAPTURE_RESTARTED, TRACE_LEVEL_INFO, "Sensor %i pulse capture %i restarted before its count ran out.")
+
+#define TRACE_EVENT_ENUM(id, level, format) id,
+#define TRACE_EVENT_LEVEL(id, level, format) id##_LEVEL = level,
+
+/** Trace event ids. */
+enum TraceEventId
+{
+	TRACE_EVENTS(TRACE_EVENT_ENUM)
+
+	/** Number of trace events. */
+	MAX_TRACE_EVENTS
+};
+
+/** Level of each trace event, as <id>_LEVEL. */
+enum TraceEventLevel
+{
+	TRACE_EVENTS(TRACE_EVENT_LEVEL)
+};
+
+#undef TRACE_EVENT_ENUM
+#undef TRACE_EVENT_LEVEL
+
+/** A logged trace event. */
+struct TraceRecord
+{
+	/** Time the event was logged, in microseconds. The low 32 bits of the timer. */
+	uint32_t time;
+
+	/** Trace event id. */
+	uint32_t event;
+
+	/** Event arguments. */
+	int32_t args[2];
+};
+
+/**
+ * Log a trace event, unless its level is compiled out.
+ * @param event Trace event id.
+ * @param arg0 First argument.
+ * @param arg1 Second argument.
+ */
+#define TRACE(event, arg0, arg1) \
+	do \
+	{ \
+		if(event##_LEVEL <= PICO_DASH_TRACE_LEVEL) traceRecord(event, arg0, arg1); \
+	} while(0)
+
+/**
+ * Log a trace event into the calling core's ring. Safe from interrupt handlers. Use TRACE, which compiles out events
+ * below PICO_DASH_TRACE_LEVEL.
+ */
+void traceRecord(enum TraceEventId event, int32_t arg0, int32_t arg1);
+
+/**
+ * Take a few records from each core's ring and, if debug messages are on, print them. Core 0 only.
+ * @returns True if records are left to drain.
+ */
+bool traceDrain();
+
+#endif
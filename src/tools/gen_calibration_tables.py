@@ -0,0 +1,278 @@
+#!/usr/bin/env python3
+"""
+Generate pico_dash_calibration_tables.c/.h from sensor curve CSV files.
+
+Each CSV describes one sensor curve. Comment lines starting with # may hold "key: value" settings:
+
+    name           Table name, upper case with underscores. Required.
+    output_scale   Multiplier taking the output column to latched data units. Default 1.
+    index_log2     log2 of the number of uniform index buckets across the ADC input range. Default 6.
+    pullup_ohm     Pull-up resistance, to the ADC reference, for curves given by sensor resistance.
+
+The first other line is a header naming the two columns. The first column is either "adc", the decimated ADC value, or
+"resistance_ohm", the sensor resistance to ground read through the pull-up. The second column is the sensor output.
+
+Each pair of adjacent points becomes a table segment with a precomputed fixed point slope, so the table reproduces the
+curve exactly, kinks and all. A uniform index over the ADC input range gives the first segment that each bucket of input
+values can fall in, so a lookup is a shift, a step or two forward and a multiply. No search and no division.
+
+Usage: gen_calibration_tables.py <output dir> <curve.csv>...
+"""
+
+import csv
+import os
+import sys
+
+# Must match pico_dash_decimate.h and pico_dash_calibration.h.
+ADC_DECIMATED_BITS = 16
+ADC_SAMPLE_BITS = 12
+CALIBRATION_FRACTION_BITS = 8
+
+# Most fraction bits a slope can have.
+MAX_SLOPE_SHIFT = 24
+
+# Most segments a table can have. Index buckets hold segment numbers in a byte.
+MAX_SEGMENTS = 255
+
+ADC_FULL_SCALE = ((1 << ADC_SAMPLE_BITS) - 1) << (ADC_DECIMATED_BITS - ADC_SAMPLE_BITS)
+
+
+def fail(path, message):
+    sys.exit("%s: %s" % (path, message))
+
+
+def read_curve(path):
+    settings = {}
+    rows = []
+
+    with open(path, newline="") as csv_file:
+        lines = []
+
+        for line in csv_file:
+            stripped = line.strip()
+
+            if stripped.startswith("#"):
+                key, sep, value = stripped[1:].partition(":")
+
+                if sep:
+                    settings[key.strip()] = value.strip()
+            elif stripped:
+                lines.append(stripped)
+
+        rows = list(csv.reader(lines))
+
+    if "name" not in settings:
+        fail(path, "no name setting")
+
+    if len(rows) < 3:
+        fail(path, "need a header and at least two points")
+
+    input_kind = rows[0][0].strip()
+    output_scale = float(settings.get("output_scale", "1"))
+    points = []
+
+    for row in rows[1:]:
+        value = float(row[0])
+
+        if input_kind == "adc":
+            adc = value
+        elif input_kind == "resistance_ohm":
+            if "pullup_ohm" not in settings:
+                fail(path, "resistance curves need a pullup_ohm setting")
+
+            pullup = float(settings["pullup_ohm"])
+            adc = ADC_FULL_SCALE * value / (value + pullup)
+        else:
+            fail(path, "unknown input column %s" % input_kind)
+
+        points.append((round(adc), round(float(row[1]) * output_scale * (1 << CALIBRATION_FRACTION_BITS))))
+
+    points.sort()
+
+    for index in range(1, len(points)):
+        if points[index][0] == points[index - 1][0]:
+            fail(path, "two points at ADC value %i" % points[index][0])
+
+    return {
+        "name": settings["name"],
+        "index_log2": int(settings.get("index_log2", "6")),
+        "points": points,
+        "source": os.path.basename(path),
+    }
+
+
+def interpolate(points, adc):
+    """Piecewise linear interpolation of the curve, clamped to its end points."""
+    if adc <= points[0][0]:
+        return points[0][1]
+
+    for index in range(1, len(points)):
+        if adc <= points[index][0]:
+            (x0, y0), (x1, y1) = points[index - 1], points[index]
+            return y0 + (y1 - y0) * (adc - x0) / (x1 - x0)
+
+    return points[-1][1]
+
+
+def camel(name):
+    parts = name.lower().split("_")
+    return parts[0] + "".join(part.capitalize() for part in parts[1:])
+
+
+def build_table(path, curve):
+    points = curve["points"]
+    inputs = [point[0] for point in points]
+    outputs = [point[1] for point in points]
+
+    if len(points) - 1 > MAX_SEGMENTS:
+        fail(path, "more than %i segments" % MAX_SEGMENTS)
+
+    # The lookup multiplies a segment's slope by the input's offset into the segment in 32 bit arithmetic. Give the slopes
+    # as many fraction bits as that allows for the largest change in output across any segment.
+    max_change = max(abs(outputs[index + 1] - outputs[index]) for index in range(len(points) - 1))
+    slope_shift = MAX_SLOPE_SHIFT
+
+    while slope_shift > 0 and max_change << slope_shift >= 1 << 30:
+        slope_shift -= 1
+
+    slopes = [round((outputs[index + 1] - outputs[index]) * (1 << slope_shift) / (inputs[index + 1] - inputs[index]))
+        for index in range(len(points) - 1)]
+
+    # First segment that each bucket of inputs can fall in.
+    index_shift = ADC_DECIMATED_BITS - curve["index_log2"]
+    index = []
+    segment = 0
+
+    for bucket in range(1 << curve["index_log2"]):
+        while segment < len(points) - 2 and inputs[segment + 1] <= bucket << index_shift:
+            segment += 1
+
+        index.append(segment)
+
+    return {
+        "index_shift": index_shift,
+        "slope_shift": slope_shift,
+        "index": index,
+        "inputs": inputs,
+        "outputs": outputs,
+        "slopes": slopes,
+    }
+
+
+def format_array(values, indent="\t"):
+    lines = []
+
+    for start in range(0, len(values), 8):
+        lines.append(indent + ", ".join(str(value) for value in values[start:start + 8]))
+
+    return ",\n".join(lines)
+
+
+def main():
+    if len(sys.argv) < 3:
+        sys.exit(__doc__)
+
+    out_dir = sys.argv[1]
+    curves = [read_curve(path) for path in sys.argv[2:]]
+    curves.sort(key=lambda curve: curve["name"])
+
+    header = [
+        "#ifndef PICO_DASH_CALIBRATION_TABLES_H",
+        "#define PICO_DASH_CALIBRATION_TABLES_H",
+        "",
+        "// Generated by tools/gen_calibration_tables.py from the sensor curves in calibration/. Do not edit.",
+        "",
+        "#include \"pico_dash_calibration.h\"",
+        "",
+        "/** Calibration tables. Set as the VOLTAGE_CALIBRATION_TABLE of a scaled voltage sensor. */",
+        "typedef enum",
+        "{",
+        "\t/** No calibration. The decimated ADC value is used as is. */",
+        "\tNO_CALIBRATION,",
+        "",
+    ]
+
+    source = [
+        "// Generated by tools/gen_calibration_tables.py from the sensor curves in calibration/. Do not edit.",
+        "",
+        "#include \"pico_dash_calibration_tables.h\"",
+        "",
+    ]
+
+    for curve in curves:
+        path = curve["source"]
+        table = build_table(path, curve)
+        var = camel(curve["name"])
+
+        header += [
+            "\t/** From %s. */" % path,
+            "\t%s_CALIBRATION," % curve["name"],
+            "",
+        ]
+
+        arrays = (
+            ("uint8_t", "Index", table["index"]),
+            ("int32_t", "Inputs", table["inputs"]),
+            ("int32_t", "Outputs", table["outputs"]),
+            ("int32_t", "Slopes", table["slopes"]),
+        )
+
+        source += ["// %s" % path, ""]
+
+        for c_type, suffix, values in arrays:
+            source += [
+                "static const %s _%s%s[%i] =" % (c_type, var, suffix, len(values)),
+                "{",
+                format_array(values),
+                "};",
+                "",
+            ]
+
+        source += [
+            "static const struct CalibrationTable _%sTable =" % var,
+            "{",
+            "\t%i, %i, %i, _%sIndex, _%sInputs, _%sOutputs, _%sSlopes" % (table["index_shift"], table["slope_shift"],
+                len(table["slopes"]), var, var, var, var),
+            "};",
+            "",
+        ]
+
+    header += [
+        "\t/** Must always be last to indicate the end of the enum. */",
+        "\tMAX_CALIBRATION_TABLES",
+        "",
+        "} CalibrationTableId;",
+        "",
+        "/** Tables by id. Entry 0 (NO_CALIBRATION) is null. */",
+        "extern const struct CalibrationTable* const calibrationTables[MAX_CALIBRATION_TABLES];",
+        "",
+        "/** The sensor curves the tables were generated from, by id, for checking the tables against. */",
+        "extern const struct CalibrationCurve calibrationCurves[MAX_CALIBRATION_TABLES];",
+        "",
+        "#endif",
+    ]
+
+    source += [
+        "const struct CalibrationTable* const calibrationTables[MAX_CALIBRATION_TABLES] =",
+        "{",
+        "\t0,",
+    ] + ["\t&_%sTable," % camel(curve["name"]) for curve in curves] + [
+        "};",
+        "",
+        "const struct CalibrationCurve calibrationCurves[MAX_CALIBRATION_TABLES] =",
+        "{",
+        "\t{0, 0, 0, 0},",
+    ] + ["\t{\"%s\", %i, _%sInputs, _%sOutputs}," % (curve["name"], len(curve["points"]), camel(curve["name"]),
+        camel(curve["name"])) for curve in curves] + [
+        "};",
+    ]
+
+    os.makedirs(out_dir, exist_ok=True)
+
+    for name, lines in (("pico_dash_calibration_tables.h", header), ("pico_dash_calibration_tables.c", source)):
+        with open(os.path.join(out_dir, name), "w") as out_file:
+            out_file.write("\n".join(lines) + "\n")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,123 @@
+#!/usr/bin/env python3
+"""
+Generate pico_dash_microstep_tables.c/.h, the sine/cosine microstep tables for X27 style stepper motors.
+
+The 6 state coil sequence of X27_stepperTest steps the field through an electrical cycle 60 degrees at a time. Going by
+the states where a coil is off, coil A carries cos(angle - 30) and coil B cos(angle + 30). Microstepping drives those
+currents at every 1/M of a step, the magnitudes as PWM on the L293D enables and the signs on the L293D inputs.
+
+Each table entry is a word for the microstep state machine (see pico_dash_microstep.pio): bit 0 clear, bits 1-4 the
+L293D 1A-4A inputs, and from bit 5 up the PWM slice compare levels, coil A's enable in the low half and coil B's in the
+high half. A coil with a level of 0 has both its inputs low, as in the 6 state sequence.
+
+There are two tables per microstep count, each covering a whole electrical cycle plus one entry so that a step never
+wraps. Entry n of the forward table is microstep n of the cycle. Entry n of the reverse table is microstep -n.
+
+Usage: gen_microstep_tables.py <output dir>
+"""
+
+import math
+import os
+import sys
+
+# Must match pico_dash_microstep.h.
+MICROSTEP_STEPS_PER_CYCLE = 6
+MICROSTEP_PWM_TOP = 2047
+MICROSTEP_WORD_LEVELS_SHIFT = 5
+MICROSTEP_COUNTS = (8, 16, 32)
+
+
+def coil_levels(current):
+    """Enable level and the pair of input levels for a coil current from -1 to 1."""
+    level = round(abs(current) * MICROSTEP_PWM_TOP)
+
+    if level == 0:
+        return 0, 0, 0
+
+    return level, int(current > 0), int(current < 0)
+
+
+def entry(microstep, microsteps):
+    angle = 2 * math.pi * microstep / (microsteps * MICROSTEP_STEPS_PER_CYCLE)
+
+    level_a, a1, a2 = coil_levels(math.cos(angle - math.pi / 6))
+    level_b, b1, b2 = coil_levels(math.cos(angle + math.pi / 6))
+
+    inputs = a1 | a2 << 1 | b1 << 2 | b2 << 3
+
+    return (level_b << 16 | level_a) << MICROSTEP_WORD_LEVELS_SHIFT | inputs << 1
+
+
+def format_array(values, indent="\t"):
+    lines = []
+
+    for start in range(0, len(values), 6):
+        lines.append(indent + ", ".join("0x%08x" % value for value in values[start:start + 6]))
+
+    return ",\n".join(lines)
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.exit(__doc__)
+
+    out_dir = sys.argv[1]
+
+    header = [
+        "#ifndef PICO_DASH_MICROSTEP_TABLES_H",
+        "#define PICO_DASH_MICROSTEP_TABLES_H",
+        "",
+        "// Generated by tools/gen_microstep_tables.py. Do not edit.",
+        "",
+        "#include \"pico_dash_microstep.h\"",
+        "",
+        "/** Number of microstep tables. */",
+        "#define MICROSTEP_TABLE_COUNT %i" % len(MICROSTEP_COUNTS),
+        "",
+        "/** Microstep tables, by ascending microsteps per step. */",
+        "extern const struct MicrostepTable microstepTables[MICROSTEP_TABLE_COUNT];",
+        "",
+        "#endif",
+    ]
+
+    source = [
+        "// Generated by tools/gen_microstep_tables.py. Do not edit.",
+        "",
+        "#include \"pico_dash_microstep_tables.h\"",
+        "",
+    ]
+
+    for microsteps in MICROSTEP_COUNTS:
+        cycle = microsteps * MICROSTEP_STEPS_PER_CYCLE
+
+        forward = [entry(microstep, microsteps) for microstep in range(cycle + 1)]
+
+        # Exactly the forward entries, so stepping back always lands on the same levels as stepping forward.
+        reverse = [forward[(cycle - microstep) % cycle] for microstep in range(cycle + 1)]
+
+        for name, values in (("Forward", forward), ("Reverse", reverse)):
+            source += [
+                "static const uint32_t _microstep%i%s[%i] =" % (microsteps, name, len(values)),
+                "{",
+                format_array(values),
+                "};",
+                "",
+            ]
+
+    source += [
+        "const struct MicrostepTable microstepTables[MICROSTEP_TABLE_COUNT] =",
+        "{",
+    ] + ["\t{%i, _microstep%iForward, _microstep%iReverse}," % (microsteps, microsteps, microsteps)
+        for microsteps in MICROSTEP_COUNTS] + [
+        "};",
+    ]
+
+    os.makedirs(out_dir, exist_ok=True)
+
+    for name, lines in (("pico_dash_microstep_tables.h", header), ("pico_dash_microstep_tables.c", source)):
+        with open(os.path.join(out_dir, name), "w") as out_file:
+            out_file.write("\n".join(lines) + "\n")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,153 @@
+#!/usr/bin/env python3
+"""
+Report which RP2040 memory each function and variable of a firmware ELF landed in.
+
+Flash is read through the XIP cache, so code there stalls on a miss. Main SRAM is 4 banks striped word by word, shared
+by both cores and DMA. Scratch X and Y are 4 KB banks of their own, each holding one core's stack: core 1's in X and
+core 0's in Y.
+
+The report gives the bytes used in each region, then lists every function and variable outside flash, by region and
+address. Hot path functions named on the command line are listed with the region they landed in. Any of them left in
+flash fail the report. Any that aren't in the ELF at all were either inlined into their callers or not built.
+
+Usage: placement_report.py <elf> <report> [hot function ...]
+"""
+
+import struct
+import sys
+
+# RP2040 address map. Name, start, end.
+REGIONS = (
+    ("Flash (XIP)", 0x10000000, 0x11000000),
+    ("SRAM (striped banks 0-3)", 0x20000000, 0x20040000),
+    ("Scratch X (core 1)", 0x20040000, 0x20041000),
+    ("Scratch Y (core 0)", 0x20041000, 0x20042000),
+)
+
+OTHER_REGION = "Other"
+
+SHT_SYMTAB = 2
+STT_OBJECT = 1
+STT_FUNC = 2
+
+
+def read_symbols(path):
+    """Sized functions and variables in an ELF's symbol table, as (name, address, size, is function) tuples."""
+    with open(path, "rb") as elf_file:
+        data = elf_file.read()
+
+    if data[:4] != b"\x7fELF" or data[5] != 1:
+        sys.exit("%s is not a little endian ELF file." % path)
+
+    is_64 = data[4] == 2
+
+    if is_64:
+        header_format, section_format, symbol_format = "<16sHHIQQQIHHHHHH", "<IIQQQQIIQQ", "<IBBHQQ"
+    else:
+        header_format, section_format, symbol_format = "<16sHHIIIIIHHHHHH", "<IIIIIIIIII", "<IIIBBH"
+
+    header = struct.unpack_from(header_format, data)
+    section_offset, section_size, section_count = header[6], header[11], header[12]
+
+    sections = [struct.unpack_from(section_format, data, section_offset + index * section_size)
+        for index in range(section_count)]
+
+    symbols = []
+
+    for section in sections:
+        if section[1] != SHT_SYMTAB:
+            continue
+
+        offset, size, link, entry_size = section[4], section[5], section[6], section[9]
+        strings_offset = sections[link][4]
+
+        for symbol_offset in range(offset, offset + size, entry_size):
+            if is_64:
+                name_offset, info, _, _, address, symbol_size = struct.unpack_from(symbol_format, data, symbol_offset)
+            else:
+                name_offset, address, symbol_size, info, _, _ = struct.unpack_from(symbol_format, data, symbol_offset)
+
+            symbol_type = info & 0xf
+
+            if symbol_type not in (STT_OBJECT, STT_FUNC) or symbol_size == 0:
+                continue
+
+            name_end = data.index(b"\0", strings_offset + name_offset)
+            name = data[strings_offset + name_offset:name_end].decode()
+
+            # Thumb function addresses have bit 0 set.
+            if symbol_type == STT_FUNC:
+                address &= ~1
+
+            symbols.append((name, address, symbol_size, symbol_type == STT_FUNC))
+
+    return symbols
+
+
+def region_of(address):
+    for name, start, end in REGIONS:
+        if start <= address < end:
+            return name
+
+    return OTHER_REGION
+
+
+def main():
+    if len(sys.argv) < 3:
+        sys.exit(__doc__)
+
+    elf_path, report_path, hot_functions = sys.argv[1], sys.argv[2], sys.argv[3:]
+
+    symbols = read_symbols(elf_path)
+
+    region_names = [name for name, _, _ in REGIONS] + [OTHER_REGION]
+    by_region = {name: [] for name in region_names}
+
+    for symbol in symbols:
+        by_region[region_of(symbol[1])].append(symbol)
+
+    lines = ["Memory placement of %s" % elf_path, ""]
+
+    for region in region_names:
+        code = sum(size for _, _, size, is_function in by_region[region] if is_function)
+        variables = sum(size for _, _, size, is_function in by_region[region] if not is_function)
+
+        lines.append("%-26s %8i bytes of code %8i bytes of variables" % (region, code, variables))
+
+    in_flash = []
+
+    if hot_functions:
+        lines += ["", "Hot path functions:"]
+
+        located = {}
+
+        for name, address, _, is_function in symbols:
+            if is_function:
+                located.setdefault(name, region_of(address))
+
+        for name in hot_functions:
+            region = located.get(name, "Inlined or not built")
+
+            if region == REGIONS[0][0]:
+                in_flash.append(name)
+
+            lines.append("    %-40s %s" % (name, region))
+
+    for region in region_names[1:]:
+        if not by_region[region]:
+            continue
+
+        lines += ["", "%s:" % region]
+
+        for name, address, size, is_function in sorted(by_region[region], key=lambda symbol: symbol[1]):
+            lines.append("    0x%08x %6i %-4s %s" % (address, size, "code" if is_function else "data", name))
+
+    with open(report_path, "w") as report_file:
+        report_file.write("\n".join(lines) + "\n")
+
+    if in_flash:
+        sys.exit("Hot path functions in flash: %s. See %s." % (", ".join(in_flash), report_path))
+
+
+if __name__ == "__main__":
+    main()